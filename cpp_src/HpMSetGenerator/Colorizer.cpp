@@ -0,0 +1,176 @@
+#include "pch.h"
+
+#include "framework.h"
+#include <immintrin.h>
+#include "MSetGenerator.h"
+#include "Colorizer.h"
+
+#pragma region Constructor
+
+Colorizer::Colorizer(COLORBANDTABLEREQ table, const int* bandIndexes, const double* bandValues, const int* opacities)
+{
+    _bandCount = table.BandCount;
+    _highCutoff = table.HighCutoff;
+    _useEscapeVelocities = table.UseEscapeVelocities != 0;
+
+    _bandIndexes = bandIndexes;
+    _bandValues = bandValues;
+    _opacities = opacities;
+}
+
+#pragma endregion
+
+#pragma region Public Methods
+
+int Colorizer::Colorize(const uint16_t* counts, const uint16_t* escapeVelocities, int valueCount, uint32_t* pixels)
+{
+    if (!_useEscapeVelocities)
+    {
+        escapeVelocities = nullptr;
+    }
+
+    int errors = 0;
+    int fullVectorsEnd = valueCount - valueCount % LANES;
+
+    for (int start = 0; start < fullVectorsEnd; start += LANES)
+    {
+        errors += ColorizeVector(counts + start, escapeVelocities == nullptr ? nullptr : escapeVelocities + start, pixels + start, ALL_LANES);
+    }
+
+    int remaining = valueCount - fullVectorsEnd;
+
+    if (remaining > 0)
+    {
+        // The last vector is padded with zero counts, only the remaining pixels are written.
+        uint16_t countLanes[LANES] = { 0 };
+        uint16_t escapeVelocityLanes[LANES] = { 0 };
+        uint32_t pixelLanes[LANES];
+
+        for (int lanePtr = 0; lanePtr < remaining; lanePtr++)
+        {
+            countLanes[lanePtr] = counts[fullVectorsEnd + lanePtr];
+
+            if (escapeVelocities != nullptr)
+            {
+                escapeVelocityLanes[lanePtr] = escapeVelocities[fullVectorsEnd + lanePtr];
+            }
+        }
+
+        int lanesUsed = (1 << remaining) - 1;
+        errors += ColorizeVector(countLanes, escapeVelocities == nullptr ? nullptr : escapeVelocityLanes, pixelLanes, lanesUsed);
+
+        for (int lanePtr = 0; lanePtr < remaining; lanePtr++)
+        {
+            pixels[fullVectorsEnd + lanePtr] = pixelLanes[lanePtr];
+        }
+    }
+
+    return errors;
+}
+
+#pragma endregion
+
+#pragma region Private Methods
+
+// Errors are only counted for the lanes whose bit is set in lanesUsed.
+int Colorizer::ColorizeVector(const uint16_t* counts, const uint16_t* escapeVelocities, uint32_t* pixels, int lanesUsed)
+{
+    __m256i countsVec = _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i const*)counts));
+
+    // Counts at or above the HighCutoff use the last band, the lookup table ends at the HighCutoff.
+    __m256i clampedCounts = _mm256_min_epi32(countsVec, _mm256_set1_epi32(_highCutoff));
+    __m256i bandIndexes = _mm256_i32gather_epi32(_bandIndexes, clampedCounts, 4);
+
+    __m256d countValues[2];
+    countValues[0] = _mm256_cvtepi32_pd(_mm256_castsi256_si128(countsVec));
+    countValues[1] = _mm256_cvtepi32_pd(_mm256_extracti128_si256(countsVec, 1));
+
+    if (escapeVelocities != nullptr)
+    {
+        __m256i escapeVelocitiesVec = _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i const*)escapeVelocities));
+        __m256d valueFactor = _mm256_set1_pd(10000.0);
+
+        countValues[0] = _mm256_add_pd(countValues[0], _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(escapeVelocitiesVec)), valueFactor));
+        countValues[1] = _mm256_add_pd(countValues[1], _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(escapeVelocitiesVec, 1)), valueFactor));
+    }
+
+    int errors = 0;
+    __m128i reds[2];
+    __m128i greens[2];
+    __m128i blues[2];
+
+    for (int half = 0; half < 2; half++)
+    {
+        __m128i halfBandIndexes = half == 0 ? _mm256_castsi256_si128(bandIndexes) : _mm256_extracti128_si256(bandIndexes, 1);
+        __m256d stepFactors = GetStepFactors(halfBandIndexes, countValues[half]);
+        int halfLanesUsed = (lanesUsed >> (half * 4)) & 0xF;
+
+        reds[half] = GetComponents(halfBandIndexes, stepFactors, BAND_START_RED, BAND_DIFF_RED, halfLanesUsed, errors);
+        greens[half] = GetComponents(halfBandIndexes, stepFactors, BAND_START_GREEN, BAND_DIFF_GREEN, halfLanesUsed, errors);
+        blues[half] = GetComponents(halfBandIndexes, stepFactors, BAND_START_BLUE, BAND_DIFF_BLUE, halfLanesUsed, errors);
+    }
+
+    __m256i red = _mm256_set_m128i(reds[1], reds[0]);
+    __m256i green = _mm256_set_m128i(greens[1], greens[0]);
+    __m256i blue = _mm256_set_m128i(blues[1], blues[0]);
+    __m256i alpha = _mm256_i32gather_epi32(_opacities, bandIndexes, 4);
+
+    // Blue, Green, Red, Alpha in memory order.
+    __m256i pixelsVec = _mm256_or_si256(
+        _mm256_or_si256(blue, _mm256_slli_epi32(green, 8)),
+        _mm256_or_si256(_mm256_slli_epi32(red, 16), _mm256_slli_epi32(alpha, 24)));
+
+    _mm256_storeu_si256((__m256i*)pixels, pixelsVec);
+
+    return errors;
+}
+
+// The step factor is the distance into the band divided by the band's width, or zero if the value is not past the band's StartingCutoff.
+__m256d Colorizer::GetStepFactors(__m128i bandIndexes, __m256d values)
+{
+    __m256d startingCutoffs = _mm256_i32gather_pd(GetValues(BAND_STARTING_CUTOFF), bandIndexes, 8);
+    __m256d bucketWidths = _mm256_i32gather_pd(GetValues(BAND_BUCKET_WIDTH), bandIndexes, 8);
+
+    __m256d bucketDistances = _mm256_sub_pd(values, startingCutoffs);
+    __m256d stepFactors = _mm256_div_pd(bucketDistances, bucketWidths);
+
+    __m256d isPastStart = _mm256_cmp_pd(bucketDistances, _mm256_setzero_pd(), _CMP_GT_OQ);
+
+    return _mm256_and_pd(stepFactors, isPastStart);
+}
+
+// The multiply and add are kept separate, to match the rounding of BlendVals.BlendAndPlace.
+__m128i Colorizer::GetComponents(__m128i bandIndexes, __m256d stepFactors, int startValue, int diffValue, int lanesUsed, int& errors)
+{
+    __m256d starts = _mm256_i32gather_pd(GetValues(startValue), bandIndexes, 8);
+    __m256d diffs = _mm256_i32gather_pd(GetValues(diffValue), bandIndexes, 8);
+
+    __m256d components = _mm256_add_pd(_mm256_mul_pd(stepFactors, diffs), starts);
+    components = _mm256_round_pd(components, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+
+    __m256d isInRange = _mm256_and_pd(
+        _mm256_cmp_pd(components, _mm256_setzero_pd(), _CMP_GE_OQ),
+        _mm256_cmp_pd(components, _mm256_set1_pd(255.0), _CMP_LE_OQ));
+
+    int inRangeMask = _mm256_movemask_pd(isInRange);
+
+    if (inRangeMask != 0xF)
+    {
+        // A NaN fails both comparisons here but not in BlendAndPlace, where it is not replaced.
+        __m256d isOutOfRange = _mm256_or_pd(
+            _mm256_cmp_pd(components, _mm256_setzero_pd(), _CMP_LT_OQ),
+            _mm256_cmp_pd(components, _mm256_set1_pd(255.0), _CMP_GT_OQ));
+
+        int outOfRangeMask = _mm256_movemask_pd(isOutOfRange);
+
+        errors += _mm_popcnt_u32(outOfRangeMask & lanesUsed);
+        components = _mm256_blendv_pd(components, _mm256_set1_pd(50.0), isOutOfRange);
+
+        // The NaN lanes are converted to zero.
+        components = _mm256_and_pd(components, _mm256_cmp_pd(components, components, _CMP_ORD_Q));
+    }
+
+    return _mm256_cvtpd_epi32(components);
+}
+
+#pragma endregion
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "pch.h"
+#include <immintrin.h>
+#include <cstdint>
+
+typedef struct _COLORBANDTABLEREQ
+{
+	int BandCount;
+	int HighCutoff;
+	int UseEscapeVelocities;
+
+} COLORBANDTABLEREQ;
+
+// Converts counts and escape velocities to BGRA pixels, 8 samples at a time, using the lookup tables built by ColorMap.GetColorBandTable.
+// Gives the same result as ColorMap.PlaceColor: the band's start color plus the step factor times the difference to its end color,
+// rounded to the nearest even value, with 50 used for any component that is out of range.
+class Colorizer
+{
+	int _bandCount;
+	int _highCutoff;
+	bool _useEscapeVelocities;
+
+	// The band index for each count from 0 to the HighCutoff.
+	const int* _bandIndexes;
+
+	// The values for each band, stored value by value, in the order of the BAND_ constants.
+	const double* _bandValues;
+	const int* _opacities;
+
+	static const int LANES = 8;
+	static const int ALL_LANES = 0xFF;
+
+	static const int BAND_STARTING_CUTOFF = 0;
+	static const int BAND_BUCKET_WIDTH = 1;
+	static const int BAND_START_RED = 2;
+	static const int BAND_START_GREEN = 3;
+	static const int BAND_START_BLUE = 4;
+	static const int BAND_DIFF_RED = 5;
+	static const int BAND_DIFF_GREEN = 6;
+	static const int BAND_DIFF_BLUE = 7;
+
+public:
+
+	Colorizer(COLORBANDTABLEREQ table, const int* bandIndexes, const double* bandValues, const int* opacities);
+
+	// If escapeVelocities is null, or the table does not use escape velocities, the escape velocities are taken to be zero.
+	// Returns the number of components that were out of range.
+	int Colorize(const uint16_t* counts, const uint16_t* escapeVelocities, int valueCount, uint32_t* pixels);
+
+private:
+
+	int ColorizeVector(const uint16_t* counts, const uint16_t* escapeVelocities, uint32_t* pixels, int lanesUsed);
+
+	__m128i GetComponents(__m128i bandIndexes, __m256d stepFactors, int startValue, int diffValue, int lanesUsed, int& errors);
+	__m256d GetStepFactors(__m128i bandIndexes, __m256d values);
+
+	inline const double* GetValues(int valueIndex)
+	{
+		return _bandValues + (size_t)valueIndex * _bandCount;
+	}
+};
@@ -7,10 +7,11 @@
 #include "Iterator.h"
 
 #include <array>
+#include <cmath>
 
 #pragma region Constructor / Destructor
 
-Iterator::Iterator(Fp31VecMath* const vMath, int targetIterations, int thresholdForComparison)
+Iterator::Iterator(Fp31VecMath* const vMath, int targetIterations, int thresholdForComparison, int iterationsPerStep, bool skipInteriorSamples)
 {
     _vMath = vMath;
 
@@ -26,6 +27,24 @@ Iterator::Iterator(Fp31VecMath* const vMath, int targetIterations, int threshold
     _tempVec = _vMath->CreateLimbSet();
 
     _justOne = _mm256_set1_epi32(1);
+
+    // The count recorded for a sample that reaches the target without escaping.
+    _targetReachedCountVector = _mm256_set1_epi32(targetIterations + 1);
+
+    _overflowFlags = _mm256_set1_epi32(0);
+
+    _iterationsPerStep = iterationsPerStep;
+    _targetIterations = targetIterations;
+    _skipInteriorSamples = skipInteriorSamples;
+
+    _savedZrs = _vMath->CreateLimbSet();
+    _savedZis = _vMath->CreateLimbSet();
+
+    ResetEscapedZValues(true);
+
+    // The threshold is compared with the most significant limb of |z|^2, one is added since the comparison is 'greater than'.
+    double threshold = (thresholdForComparison + 1.0) * _vMath->GetMslScale();
+    _inverseLog2Threshold = 1.0 / std::log2(threshold);
 }
 
 Iterator::~Iterator()
@@ -35,17 +54,59 @@ Iterator::~Iterator()
     delete _sumOfSqrs;
     delete _zRZiSqrs;
     delete _tempVec;
+    delete _savedZrs;
+    delete _savedZis;
 }
 
 #pragma endregion
 
 bool Iterator::GenerateMapCol(__m256i* const cr, __m256i* const ciVec, __m256i& resultCounts)
 {
+    return GenerateMapColInternal(cr, ciVec, resultCounts, false, false);
+}
+
+bool Iterator::GenerateMapCol(__m256i* const cr, __m256i* const ciVec, __m256i& resultCounts, __m128i& resultEscapeVelocities)
+{
+    return GenerateMapCol(cr, ciVec, resultCounts, &resultEscapeVelocities, nullptr);
+}
+
+// Either result may be null, in which case that value is not calculated.
+bool Iterator::GenerateMapCol(__m256i* const cr, __m256i* const ciVec, __m256i& resultCounts, __m128i* resultEscapeVelocities, __m256* resultDistanceEstimates)
+{
+    bool trackDerivatives = resultDistanceEstimates != nullptr;
+    bool allEscaped = GenerateMapColInternal(cr, ciVec, resultCounts, true, trackDerivatives);
+
+    if (resultEscapeVelocities != nullptr)
+    {
+        *resultEscapeVelocities = GetEscapeVelocities(cr, ciVec, resultCounts);
+    }
+
+    if (resultDistanceEstimates != nullptr)
+    {
+        *resultDistanceEstimates = GetDistanceEstimates(resultCounts);
+    }
+
+    return allEscaped;
+}
+
+bool Iterator::GenerateMapColInternal(__m256i* const cr, __m256i* const ciVec, __m256i& resultCounts, bool saveEscapedZValues, bool trackDerivatives)
+{
+    if (saveEscapedZValues)
+    {
+        ResetEscapedZValues(trackDerivatives);
+    }
+
     __m256i haveEscapedFlags = _mm256_set1_epi32(0);
 
-    __m256i doneFlags = _mm256_set1_epi32(0);
+    // Samples within the main cardioid or the period-2 bulb never escape, these are done before the first iteration.
+    __m256i doneFlags = _skipInteriorSamples ? GetInteriorFlags(cr, ciVec) : _mm256_set1_epi32(0);
+    resultCounts = _mm256_and_si256(doneFlags, _targetReachedCountVector);
+
+    if (_mm256_movemask_epi8(doneFlags) == -1)
+    {
+        return false;
+    }
 
-    resultCounts = _mm256_set1_epi32(0);
     __m256i counts = _mm256_set1_epi32(0);
 
     __m256i* zr = _vMath->CreateLimbSet();
@@ -56,13 +117,54 @@ bool Iterator::GenerateMapCol(__m256i* const cr, __m256i* const ciVec, __m256i&
 
     __m256i escapedFlagsVec = _mm256_set1_epi32(0);
 
+    _vMath->ClearOverflowFlags();
+
     IterateFirstRound(cr, ciVec, zr, zi, escapedFlagsVec);
+    AccumulateOverflowFlags(doneFlags);
+    __m256i prevHaveEscapedFlags = haveEscapedFlags;
     int compositeIsDone = UpdateCounts(escapedFlagsVec, counts, resultCounts, doneFlags, haveEscapedFlags);
 
+    if (saveEscapedZValues)
+    {
+        SaveEscapedZValues(zr, zi, _mm256_andnot_si256(prevHaveEscapedFlags, haveEscapedFlags), trackDerivatives);
+    }
+
+    // The number of iterations remaining that must be checked one at a time.
+    int singleStepsRemaining = 0;
+
     while (compositeIsDone != -1)
     {
+        if (_iterationsPerStep > 1 && singleStepsRemaining == 0)
+        {
+            if (IterateBatch(cr, ciVec, zr, zi, counts, doneFlags, trackDerivatives))
+            {
+                continue;
+            }
+
+            // A sample escaped, overflowed or reached the target during the batch, the batch has been
+            // rolled back and is now repeated, checking each iteration, to get the exact counts.
+            singleStepsRemaining = _iterationsPerStep;
+        }
+
+        if (singleStepsRemaining > 0)
+        {
+            singleStepsRemaining--;
+        }
+
+        if (trackDerivatives)
+        {
+            UpdateDerivatives(zr, zi);
+        }
+
         Iterate(cr, ciVec, zr, zi, escapedFlagsVec);
+        AccumulateOverflowFlags(doneFlags);
+        prevHaveEscapedFlags = haveEscapedFlags;
         compositeIsDone = UpdateCounts(escapedFlagsVec, counts, resultCounts, doneFlags, haveEscapedFlags);
+
+        if (saveEscapedZValues)
+        {
+            SaveEscapedZValues(zr, zi, _mm256_andnot_si256(prevHaveEscapedFlags, haveEscapedFlags), trackDerivatives);
+        }
     }
 
     int allEscaped = _mm256_movemask_epi8(haveEscapedFlags);
@@ -70,6 +172,46 @@ bool Iterator::GenerateMapCol(__m256i* const cr, __m256i* const ciVec, __m256i&
     return allEscaped == -1 ? true : false;
 }
 
+__m256i Iterator::GetInteriorFlags(__m256i* const cr, __m256i* const ci)
+{
+    // Points this close to the boundary are iterated, this covers the error of the conversion to double.
+    const __m256d margin = _mm256_set1_pd(1e-12);
+
+    const __m256d quarter = _mm256_set1_pd(0.25);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d sixteenth = _mm256_set1_pd(0.0625);
+
+    __m256d xs[2];
+    __m256d ys[2];
+    _vMath->ConvertToDoubles(cr, xs[0], xs[1]);
+    _vMath->ConvertToDoubles(ci, ys[0], ys[1]);
+
+    __m128i flags[2];
+
+    for (int i = 0; i < 2; i++)
+    {
+        __m256d ySqr = _mm256_mul_pd(ys[i], ys[i]);
+
+        // Main cardioid: q * (q + (x - 1/4)) < y^2 / 4, where q = (x - 1/4)^2 + y^2
+        __m256d xLessQuarter = _mm256_sub_pd(xs[i], quarter);
+        __m256d q = _mm256_add_pd(_mm256_mul_pd(xLessQuarter, xLessQuarter), ySqr);
+        __m256d lhs = _mm256_mul_pd(q, _mm256_add_pd(q, xLessQuarter));
+        __m256d rhs = _mm256_sub_pd(_mm256_mul_pd(ySqr, quarter), margin);
+        __m256d inCardioid = _mm256_cmp_pd(lhs, rhs, _CMP_LT_OQ);
+
+        // Period-2 bulb: (x + 1)^2 + y^2 < 1/16
+        __m256d xPlusOne = _mm256_add_pd(xs[i], one);
+        __m256d bulbDist = _mm256_add_pd(_mm256_mul_pd(xPlusOne, xPlusOne), ySqr);
+        __m256d inBulb = _mm256_cmp_pd(bulbDist, _mm256_sub_pd(sixteenth, margin), _CMP_LT_OQ);
+
+        // Narrow the four 64-bit flags to 32-bits.
+        __m256i wideFlags = _mm256_castpd_si256(_mm256_or_pd(inCardioid, inBulb));
+        flags[i] = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(wideFlags, _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7)));
+    }
+
+    return _mm256_set_m128i(flags[1], flags[0]);
+}
+
 void Iterator::IterateFirstRound(__m256i* const cr, __m256i* const ci, __m256i* const zr, __m256i* const zi, __m256i& escapedFlagsVec)
 {
     for (int limbPtr = 0; limbPtr < _vMath->LimbCount; limbPtr++) {
@@ -85,6 +227,14 @@ void Iterator::IterateFirstRound(__m256i* const cr, __m256i* const ci, __m256i*
 }
 
 void Iterator::Iterate(__m256i* const cr, __m256i* const ci, __m256i* const zr, __m256i* const zi, __m256i& escapedFlagsVec)
+{
+    IterateWithoutCheck(cr, ci, zr, zi);
+
+    _vMath->Add(_zrSqrs, _ziSqrs, _sumOfSqrs);
+    _vMath->IsGreaterOrEqThan(_sumOfSqrs, _thresholdVector, escapedFlagsVec);
+}
+
+void Iterator::IterateWithoutCheck(__m256i* const cr, __m256i* const ci, __m256i* const zr, __m256i* const zi)
 {
 
     // square(z.r + z.i)
@@ -106,12 +256,96 @@ void Iterator::Iterate(__m256i* const cr, __m256i* const ci, __m256i* const zr,
 
     _vMath->Square(zr, _zrSqrs);
     _vMath->Square(zi, _ziSqrs);
-    _vMath->Add(_zrSqrs, _ziSqrs, _sumOfSqrs);
+}
+
+#pragma region Batched Iteration
+
+bool Iterator::IterateBatch(__m256i* const cr, __m256i* const ci, __m256i* const zr, __m256i* const zi, __m256i& counts, __m256i doneFlags, bool trackDerivatives)
+{
+    // Performs _iterationsPerStep iterations, only checking for escape after the last one.
+    // Once a sample escapes |z| grows with each iteration, so a sample that escaped during the batch is still
+    // beyond the threshold at the end, unless its value has overflowed -- which is also detected.
+    // Returns false if the batch was rolled back because a sample that was not already done escaped,
+    // overflowed or would reach the target iterations.
+
+    // All lanes are iterated the same number of times.
+    int iterationCount = _mm256_extract_epi32(counts, 0);
+
+    if (iterationCount + _iterationsPerStep > _targetIterations)
+    {
+        return false;
+    }
+
+    for (int limbPtr = 0; limbPtr < _vMath->LimbCount; limbPtr++)
+    {
+        _savedZrs[limbPtr] = zr[limbPtr];
+        _savedZis[limbPtr] = zi[limbPtr];
+    }
+
+    if (trackDerivatives)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            _savedDzrs[i] = _dzrs[i];
+            _savedDzis[i] = _dzis[i];
+        }
+    }
+
+    for (int step = 0; step < _iterationsPerStep; step++)
+    {
+        if (trackDerivatives)
+        {
+            UpdateDerivatives(zr, zi);
+        }
+
+        IterateWithoutCheck(cr, ci, zr, zi);
+    }
 
+    __m256i escapedFlagsVec;
+    _vMath->Add(_zrSqrs, _ziSqrs, _sumOfSqrs);
     _vMath->IsGreaterOrEqThan(_sumOfSqrs, _thresholdVector, escapedFlagsVec);
 
+    __m256i overflowFlags = _vMath->GetOverflowFlags();
+    _vMath->ClearOverflowFlags();
+
+    __m256i eventFlags = _mm256_andnot_si256(doneFlags, _mm256_or_si256(escapedFlagsVec, overflowFlags));
+
+    if (_mm256_testz_si256(eventFlags, eventFlags))
+    {
+        counts = _mm256_add_epi32(counts, _mm256_set1_epi32(_iterationsPerStep));
+        return true;
+    }
+
+    RollBackBatch(zr, zi, trackDerivatives);
+
+    return false;
+}
+
+void Iterator::RollBackBatch(__m256i* const zr, __m256i* const zi, bool trackDerivatives)
+{
+    for (int limbPtr = 0; limbPtr < _vMath->LimbCount; limbPtr++)
+    {
+        zr[limbPtr] = _savedZrs[limbPtr];
+        zi[limbPtr] = _savedZis[limbPtr];
+    }
+
+    if (trackDerivatives)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            _dzrs[i] = _savedDzrs[i];
+            _dzis[i] = _savedDzis[i];
+        }
+    }
+
+    // The next iteration uses the squares of the restored values, these were computed without overflow before the batch.
+    _vMath->Square(zr, _zrSqrs);
+    _vMath->Square(zi, _ziSqrs);
+    _vMath->ClearOverflowFlags();
 }
 
+#pragma endregion
+
 int Iterator::UpdateCounts(__m256i escapedFlagsVec, __m256i& counts, __m256i& resultCounts, __m256i& doneFlags, __m256i& hasEscapedFlags)
 {
     counts = _mm256_add_epi32(counts, _justOne);
@@ -124,8 +358,8 @@ int Iterator::UpdateCounts(__m256i escapedFlagsVec, __m256i& counts, __m256i& re
 
     const __m256i prevDoneFlags = doneFlags;
 
-    // If escaped or reached the target iterations, we're done 
-    doneFlags = _mm256_or_si256(hasEscapedFlags, targetReachedCompVec);
+    // If escaped or reached the target iterations, we're done. Lanes that were done before the first iteration remain done.
+    doneFlags = _mm256_or_si256(prevDoneFlags, _mm256_or_si256(hasEscapedFlags, targetReachedCompVec));
 
     int compositeIsDone = _mm256_movemask_epi8(doneFlags);
     int prevCompositeIsDone = _mm256_movemask_epi8(prevDoneFlags);
@@ -142,6 +376,246 @@ int Iterator::UpdateCounts(__m256i escapedFlagsVec, __m256i& counts, __m256i& re
 }
 
 
+void Iterator::AccumulateOverflowFlags(__m256i doneFlags)
+{
+    // Lanes that are already done keep being iterated until the entire vector is done, their values are
+    // expected to grow without bound, so only overflows from lanes still in play are recorded.
+
+    __m256i overflowFlags = _vMath->GetOverflowFlags();
+    _overflowFlags = _mm256_or_si256(_overflowFlags, _mm256_andnot_si256(doneFlags, overflowFlags));
+
+    _vMath->ClearOverflowFlags();
+}
+
+#pragma region Escape Velocities
+
+void Iterator::ResetEscapedZValues(bool trackDerivatives)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        _escapedZrs[i] = _mm256_setzero_pd();
+        _escapedZis[i] = _mm256_setzero_pd();
+    }
+
+    if (trackDerivatives)
+    {
+        // z = c after the first iteration, so dz/dc = 1
+        for (int i = 0; i < 2; i++)
+        {
+            _dzrs[i] = _mm256_set1_pd(1.0);
+            _dzis[i] = _mm256_setzero_pd();
+            _escapedDzrs[i] = _mm256_setzero_pd();
+            _escapedDzis[i] = _mm256_setzero_pd();
+        }
+    }
+}
+
+void Iterator::SaveEscapedZValues(__m256i* const zr, __m256i* const zi, __m256i justEscapedFlags, bool trackDerivatives)
+{
+    if (_mm256_testz_si256(justEscapedFlags, justEscapedFlags))
+    {
+        return;
+    }
+
+    __m256d zrs[2];
+    __m256d zis[2];
+    _vMath->ConvertToDoubles(zr, zrs[0], zrs[1]);
+    _vMath->ConvertToDoubles(zi, zis[0], zis[1]);
+
+    // Widen the 32-bit flags to 64-bits, lanes 0-3 and then lanes 4-7.
+    __m256d masks[2];
+    masks[0] = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(justEscapedFlags)));
+    masks[1] = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_extracti128_si256(justEscapedFlags, 1)));
+
+    for (int i = 0; i < 2; i++)
+    {
+        _escapedZrs[i] = _mm256_blendv_pd(_escapedZrs[i], zrs[i], masks[i]);
+        _escapedZis[i] = _mm256_blendv_pd(_escapedZis[i], zis[i], masks[i]);
+
+        if (trackDerivatives)
+        {
+            _escapedDzrs[i] = _mm256_blendv_pd(_escapedDzrs[i], _dzrs[i], masks[i]);
+            _escapedDzis[i] = _mm256_blendv_pd(_escapedDzis[i], _dzis[i], masks[i]);
+        }
+    }
+}
+
+__m128i Iterator::GetEscapeVelocities(__m256i* const cr, __m256i* const ci, __m256i counts)
+{
+    // A few more iterations are performed, using doubles, starting with the z value at which each sample escaped.
+    // This reduces the error of the approximation: EV = k + 1 - log2(log(|z(n + k)|) / log(R)), where k is the number of extra iterations.
+    // The fixed-point format does not have the range required to hold these values.
+
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d extraIterationsPlusOne = _mm256_set1_pd(EV_EXTRA_ITERATIONS + 1.0);
+    const __m256d inverseLog2Threshold = _mm256_set1_pd(_inverseLog2Threshold);
+    const __m256d scale = _mm256_set1_pd(ESCAPE_VELOCITY_SCALE);
+
+    __m256d crs[2];
+    __m256d cis[2];
+    _vMath->ConvertToDoubles(cr, crs[0], crs[1]);
+    _vMath->ConvertToDoubles(ci, cis[0], cis[1]);
+
+    __m128i evs[2];
+
+    for (int i = 0; i < 2; i++)
+    {
+        __m256d zr = _escapedZrs[i];
+        __m256d zi = _escapedZis[i];
+
+        for (int k = 0; k < EV_EXTRA_ITERATIONS; k++)
+        {
+            __m256d zrSqr = _mm256_mul_pd(zr, zr);
+            __m256d ziSqr = _mm256_mul_pd(zi, zi);
+
+            zi = _mm256_add_pd(_mm256_mul_pd(two, _mm256_mul_pd(zr, zi)), cis[i]);
+            zr = _mm256_add_pd(_mm256_sub_pd(zrSqr, ziSqr), crs[i]);
+        }
+
+        __m256d sumOfSqrs = _mm256_add_pd(_mm256_mul_pd(zr, zr), _mm256_mul_pd(zi, zi));
+
+        // log(|z|^2) / log(threshold) == log(|z|) / log(R)
+        __m256d ratio = _mm256_mul_pd(Log2(sumOfSqrs), inverseLog2Threshold);
+        __m256d ev = _mm256_sub_pd(extraIterationsPlusOne, Log2(ratio));
+
+        // Clamp to 0..1, _mm256_max_pd returns the second operand if the first is NaN.
+        ev = _mm256_min_pd(_mm256_max_pd(ev, zero), one);
+
+        ev = _mm256_round_pd(_mm256_mul_pd(ev, scale), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        evs[i] = _mm256_cvtpd_epi32(ev);
+    }
+
+    // Only samples that escaped before reaching the target have an escape velocity.
+    __m256i result = _mm256_set_m128i(evs[1], evs[0]);
+    result = _mm256_andnot_si256(_mm256_cmpgt_epi32(counts, _targetIterationsVector), result);
+
+    // Narrow to 16-bits, the pack operates on each 128-bit lane, the permute moves the results into the lower 128 bits.
+    result = _mm256_packus_epi32(result, result);
+    result = _mm256_permute4x64_epi64(result, 0b1000);
+
+    return _mm256_castsi256_si128(result);
+}
+
+__m256d Iterator::Log2(__m256d source)
+{
+    // source = m * 2^e, with 1 <= m < 2, the source must be positive.
+    // log2(source) = e + ln(m) / ln(2), where ln(m) = 2 * atanh(t) and t = (m - 1) / (m + 1)
+
+    const __m256d magic = _mm256_set1_pd(4503599627370496.0);                 // 2^52
+    const __m256d magicPlusBias = _mm256_set1_pd(4503599627370496.0 + 1023.0);
+    const __m256i mantissaMask = _mm256_set1_epi64x(0x000FFFFFFFFFFFFF);
+    const __m256i exponentOfOne = _mm256_set1_epi64x(0x3FF0000000000000);
+    const __m256d sqrtTwo = _mm256_set1_pd(1.4142135623730951);
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d inverseLn2 = _mm256_set1_pd(1.4426950408889634);
+
+    __m256i bits = _mm256_castpd_si256(source);
+
+    // The biased exponent is placed in the mantissa of 2^52 and the bias removed by subtraction.
+    __m256i exponentBits = _mm256_srli_epi64(bits, 52);
+    __m256d e = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(exponentBits, _mm256_castpd_si256(magic))), magicPlusBias);
+
+    __m256d m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, mantissaMask), exponentOfOne));
+
+    // Use sqrt(2)/2 <= m < sqrt(2) to keep t small.
+    __m256d isLarge = _mm256_cmp_pd(m, sqrtTwo, _CMP_GT_OQ);
+    m = _mm256_blendv_pd(m, _mm256_mul_pd(m, half), isLarge);
+    e = _mm256_add_pd(e, _mm256_and_pd(isLarge, one));
+
+    __m256d t = _mm256_div_pd(_mm256_sub_pd(m, one), _mm256_add_pd(m, one));
+    __m256d tSqr = _mm256_mul_pd(t, t);
+
+    // 2 * (t + t^3/3 + t^5/5 + t^7/7 + t^9/9), |t| < 0.172
+    __m256d poly = _mm256_set1_pd(2.0 / 9.0);
+    poly = _mm256_add_pd(_mm256_mul_pd(poly, tSqr), _mm256_set1_pd(2.0 / 7.0));
+    poly = _mm256_add_pd(_mm256_mul_pd(poly, tSqr), _mm256_set1_pd(2.0 / 5.0));
+    poly = _mm256_add_pd(_mm256_mul_pd(poly, tSqr), _mm256_set1_pd(2.0 / 3.0));
+    poly = _mm256_add_pd(_mm256_mul_pd(poly, tSqr), _mm256_set1_pd(2.0));
+
+    __m256d lnM = _mm256_mul_pd(poly, t);
+
+    return _mm256_add_pd(e, _mm256_mul_pd(lnM, inverseLn2));
+}
+
+#pragma endregion
+
+#pragma region Distance Estimation
+
+void Iterator::UpdateDerivatives(__m256i* const zr, __m256i* const zi)
+{
+    // dz(n+1) = 2 * z(n) * dz(n) + 1
+    // The derivative quickly exceeds the range of the fixed-point format, a double's precision is sufficient.
+
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d two = _mm256_set1_pd(2.0);
+
+    __m256d zrs[2];
+    __m256d zis[2];
+    _vMath->ConvertToDoubles(zr, zrs[0], zrs[1]);
+    _vMath->ConvertToDoubles(zi, zis[0], zis[1]);
+
+    for (int i = 0; i < 2; i++)
+    {
+        __m256d productR = _mm256_sub_pd(_mm256_mul_pd(zrs[i], _dzrs[i]), _mm256_mul_pd(zis[i], _dzis[i]));
+        __m256d productI = _mm256_add_pd(_mm256_mul_pd(zrs[i], _dzis[i]), _mm256_mul_pd(zis[i], _dzrs[i]));
+
+        _dzrs[i] = _mm256_add_pd(_mm256_mul_pd(two, productR), one);
+        _dzis[i] = _mm256_mul_pd(two, productI);
+    }
+}
+
+__m256 Iterator::GetDistanceEstimates(__m256i counts)
+{
+    // The distance from c to the boundary of the set is between b/4 and b, where b = 2 * |z| * ln|z| / |dz/dc|
+    // 2 * ln|z| = ln(|z|^2) = log2(|z|^2) * ln(2)
+
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d ln2 = _mm256_set1_pd(0.6931471805599453);
+
+    __m128 des[2];
+
+    for (int i = 0; i < 2; i++)
+    {
+        __m256d zr = _escapedZrs[i];
+        __m256d zi = _escapedZis[i];
+        __m256d dzr = _escapedDzrs[i];
+        __m256d dzi = _escapedDzis[i];
+
+        __m256d zSumOfSqrs = _mm256_add_pd(_mm256_mul_pd(zr, zr), _mm256_mul_pd(zi, zi));
+        __m256d dzSumOfSqrs = _mm256_add_pd(_mm256_mul_pd(dzr, dzr), _mm256_mul_pd(dzi, dzi));
+
+        __m256d twoLnMagZ = _mm256_mul_pd(Log2(zSumOfSqrs), ln2);
+        __m256d de = _mm256_div_pd(_mm256_mul_pd(_mm256_sqrt_pd(zSumOfSqrs), twoLnMagZ), _mm256_sqrt_pd(dzSumOfSqrs));
+
+        // A derivative that has overflowed produces zero or NaN, both are reported as zero, _mm256_max_pd returns the second operand if the first is NaN.
+        de = _mm256_max_pd(de, zero);
+
+        des[i] = _mm256_cvtpd_ps(de);
+    }
+
+    // Samples that did not escape are given a distance of zero.
+    __m256 result = _mm256_set_m128(des[1], des[0]);
+    __m256i targetReachedFlags = _mm256_cmpgt_epi32(counts, _targetIterationsVector);
+    result = _mm256_andnot_ps(_mm256_castsi256_ps(targetReachedFlags), result);
+
+    return result;
+}
+
+#pragma endregion
+
+bool Iterator::HasOverflowed()
+{
+    return _mm256_testz_si256(_overflowFlags, _overflowFlags) == 0;
+}
+
+void Iterator::ClearOverflowFlags()
+{
+    _overflowFlags = _mm256_set1_epi32(0);
+}
+
 /*
 
 // Select between two sources, byte by byte. Used in various functions and operators
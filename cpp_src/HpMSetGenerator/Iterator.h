@@ -19,21 +19,78 @@ class Iterator
 	__m256i* _tempVec;
 
 	__m256i _justOne;
+	__m256i _targetReachedCountVector;
+
+	__m256i _overflowFlags;
+
+	// If greater than 1, this many iterations are performed between escape checks.
+	int _iterationsPerStep;
+	int _targetIterations;
+
+	// If true, samples within the main cardioid or the period-2 bulb are not iterated.
+	bool _skipInteriorSamples;
+
+	// The values of z and dz/dc at the start of the current batch of iterations.
+	__m256i* _savedZrs;
+	__m256i* _savedZis;
+	__m256d _savedDzrs[2];
+	__m256d _savedDzis[2];
+
+	// The value of each sample's z at the iteration it escaped, lanes 0-3 and 4-7.
+	__m256d _escapedZrs[2];
+	__m256d _escapedZis[2];
+
+	// The derivative, dz/dc, of each sample's z and its value at the iteration the sample escaped.
+	__m256d _dzrs[2];
+	__m256d _dzis[2];
+	__m256d _escapedDzrs[2];
+	__m256d _escapedDzis[2];
+
+	double _inverseLog2Threshold;
+
+	// The number of iterations performed after a sample escapes, before its escape velocity is calculated.
+	static const int EV_EXTRA_ITERATIONS = 3;
+
+	// Escape velocities are stored as the fraction multiplied by this value.
+	static constexpr double ESCAPE_VELOCITY_SCALE = 10000.0;
 
 public:
 
-	Iterator(Fp31VecMath* const vMath, int targetIterations, int thresholdForComparison);
+	Iterator(Fp31VecMath* const vMath, int targetIterations, int thresholdForComparison, int iterationsPerStep = 1, bool skipInteriorSamples = true);
 	~Iterator();
 
 	bool GenerateMapCol(__m256i* const cr, __m256i* const ciVec, __m256i& resultCounts);
+	bool GenerateMapCol(__m256i* const cr, __m256i* const ciVec, __m256i& resultCounts, __m128i& resultEscapeVelocities);
+	bool GenerateMapCol(__m256i* const cr, __m256i* const ciVec, __m256i& resultCounts, __m128i* resultEscapeVelocities, __m256* resultDistanceEstimates);
+
+	bool HasOverflowed();
+	void ClearOverflowFlags();
 
 private:
 
+	bool GenerateMapColInternal(__m256i* const cr, __m256i* const ciVec, __m256i& resultCounts, bool saveEscapedZValues, bool trackDerivatives);
+
+	__m256i GetInteriorFlags(__m256i* const cr, __m256i* const ci);
+
 	void IterateFirstRound(__m256i* const cr, __m256i* const ci, __m256i* const zr, __m256i* const zi, __m256i& escapedFlagsVec);
 
 	void Iterate(__m256i* const cr, __m256i* const ci, __m256i* const zr, __m256i* const zi, __m256i& escapedFlagsVec);
+	void IterateWithoutCheck(__m256i* const cr, __m256i* const ci, __m256i* const zr, __m256i* const zi);
+
+	bool IterateBatch(__m256i* const cr, __m256i* const ci, __m256i* const zr, __m256i* const zi, __m256i& counts, __m256i doneFlags, bool trackDerivatives);
+	void RollBackBatch(__m256i* const zr, __m256i* const zi, bool trackDerivatives);
 
 	int UpdateCounts(__m256i escapedFlagsVec, __m256i& counts, __m256i& resultCounts, __m256i& doneFlags, __m256i& haveEscapedFlags);
 
+	void AccumulateOverflowFlags(__m256i doneFlags);
+
+	void ResetEscapedZValues(bool trackDerivatives);
+	void SaveEscapedZValues(__m256i* const zr, __m256i* const zi, __m256i justEscapedFlags, bool trackDerivatives);
+	__m128i GetEscapeVelocities(__m256i* const cr, __m256i* const ci, __m256i counts);
+
+	void UpdateDerivatives(__m256i* const zr, __m256i* const zi);
+	__m256 GetDistanceEstimates(__m256i counts);
+	__m256d Log2(__m256d source);
+
 };
 
@@ -6,6 +6,10 @@
 #include "MSetGenerator.h"
 #include "Fp31VecMath.h"
 #include "Iterator.h"
+#include "SamplePointGenerator.h"
+#include "ProgressiveBlockGenerator.h"
+#include "SubsampleGenerator.h"
+#include "Colorizer.h"
 
 #include <iostream>
 
@@ -37,8 +41,38 @@ typedef struct _MSETREQ
     int ThresholdForComparison;
     int iterationsPerStep;
 
+    // If not zero, samples within the main cardioid or the period-2 bulb are given the target count without being iterated.
+    int skipInteriorSamples;
+
 } MSETREQ;
 
+typedef struct _SAMPLEPOINTREQ
+{
+    // Each value is N * 2^exponent, where N = value[0] * 2^63 + value[1].
+    int64_t positionX[2];
+    int64_t positionY[2];
+    int64_t samplePointDelta[2];
+
+    int positionExponent;
+    int samplePointDeltaExponent;
+
+    // BlockSize
+    int BlockSizeWidth;
+    int BlockSizeHeight;
+
+    // ApFixedPointFormat
+    int BitsBeforeBinaryPoint;
+    int LimbCount;
+    int TargetExponent;
+
+} SAMPLEPOINTREQ;
+
+const int EFFECTIVE_BITS_PER_LIMB = 31;
+
+// Bit flags returned by GenerateMapSectionRow
+const int ROW_RESULT_ALL_ESCAPED = 1;
+const int ROW_RESULT_OVERFLOW = 2;
+
 #pragma warning( push )
 #pragma warning( disable : 4316 )
 __m256i* CreateLimbSet(int limbCount) {
@@ -48,7 +82,8 @@ __m256i* CreateLimbSet(int limbCount) {
 
 extern "C"
 {
-    __declspec(dllexport) int GenerateMapSectionRow(MSETREQ mapSectionRequest, __m256i* crsForARow, __m256i* ciVec, __m256i* countsForARow)
+    // If escapeVelocitiesForARow or distanceEstimatesForARow is null, those values are not calculated.
+    int GenerateMapSectionRowInternal(MSETREQ mapSectionRequest, __m256i* crsForARow, __m256i* ciVec, __m256i* countsForARow, uint16_t* escapeVelocitiesForARow, float* distanceEstimatesForARow)
     {
         int limbCount = mapSectionRequest.LimbCount;
         int bitsBeforeBp = mapSectionRequest.BitsBeforeBinaryPoint;
@@ -59,8 +94,11 @@ extern "C"
 
         _RPTA("Generating a MapSectionRow with LimbCount: %d and Target Iterations: %d\n", limbCount, targetIterations);
 
+        // If greater than 1, escape is checked once per this many iterations.
+        int iterationsPerStep = mapSectionRequest.iterationsPerStep;
+
         Fp31VecMath vMath = Fp31VecMath(limbCount, bitsBeforeBp, targetExponent);
-        Iterator iterator = Iterator(&vMath, targetIterations, thresholdForComparison);
+        Iterator iterator = Iterator(&vMath, targetIterations, thresholdForComparison, iterationsPerStep, mapSectionRequest.skipInteriorSamples != 0);
 
         __m256i* ci = CreateLimbSet(limbCount);
         for (int limbPtr = 0; limbPtr < limbCount; limbPtr++)
@@ -74,6 +112,7 @@ extern "C"
         __m256i* cr = CreateLimbSet(limbCount);
 
         bool allRowSamplesHaveEscaped = true;
+        bool inputsAreValid = vMath.CheckReservedBitIsClear(ci);
         int vectorsPerRow = mapSectionRequest.VectorsPerRow;
 
         for (int idx = 0; idx < vectorsPerRow; idx++)
@@ -86,12 +125,41 @@ extern "C"
                 cr[limbPtr] = crLimb;
             }
 
+            if (!vMath.CheckReservedBitIsClear(cr))
+            {
+                inputsAreValid = false;
+            }
+
             //__m256i countsVec = countsForARow[idx];
 
             //ymm = _mm256_loadu_si256((__m256i const*)p);
             __m256i countsVec = _mm256_loadu_si256((__m256i const*) (&countsForARow[idx]));
 
-            bool allSamplesHaveEscaped = iterator.GenerateMapCol(cr, ci, countsVec);
+            bool allSamplesHaveEscaped;
+
+            if (escapeVelocitiesForARow == nullptr && distanceEstimatesForARow == nullptr)
+            {
+                allSamplesHaveEscaped = iterator.GenerateMapCol(cr, ci, countsVec);
+            }
+            else
+            {
+                __m128i escapeVelocitiesVec;
+                __m256 distanceEstimatesVec;
+
+                allSamplesHaveEscaped = iterator.GenerateMapCol(cr, ci, countsVec,
+                    escapeVelocitiesForARow == nullptr ? nullptr : &escapeVelocitiesVec,
+                    distanceEstimatesForARow == nullptr ? nullptr : &distanceEstimatesVec);
+
+                if (escapeVelocitiesForARow != nullptr)
+                {
+                    _mm_storeu_si128((__m128i*)(&escapeVelocitiesForARow[idx * 8]), escapeVelocitiesVec);
+                }
+
+                if (distanceEstimatesForARow != nullptr)
+                {
+                    _mm256_storeu_ps(&distanceEstimatesForARow[idx * 8], distanceEstimatesVec);
+                }
+            }
 
             //countsForARow[idx] = countsVec;
             _mm256_storeu_si256((__m256i*)(&countsForARow[idx]), countsVec);
@@ -105,7 +173,228 @@ extern "C"
         delete[] ci;
         delete[] cr;
 
-        return allRowSamplesHaveEscaped ? 1 : 0;
+        // If the BitsBeforeBinaryPoint is too small for this region, one or more sample points have produced
+        // a value that does not fit -- the counts for this row cannot be trusted, the caller should use a wider format.
+        bool overflowed = iterator.HasOverflowed() || !inputsAreValid;
+
+        if (overflowed)
+        {
+            _RPTA("Overflow detected for row: %d using BitsBeforeBinaryPoint: %d.\n", mapSectionRequest.RowNumber, bitsBeforeBp);
+        }
+
+        int result = allRowSamplesHaveEscaped ? ROW_RESULT_ALL_ESCAPED : 0;
+
+        if (overflowed)
+        {
+            result |= ROW_RESULT_OVERFLOW;
+        }
+
+        return result;
+    }
+
+    __declspec(dllexport) int GenerateMapSectionRow(MSETREQ mapSectionRequest, __m256i* crsForARow, __m256i* ciVec, __m256i* countsForARow)
+    {
+        return GenerateMapSectionRowInternal(mapSectionRequest, crsForARow, ciVec, countsForARow, nullptr, nullptr);
+    }
+
+    // Same as GenerateMapSectionRow, but also writes the escape velocity of each sample, one uint16_t per sample.
+    __declspec(dllexport) int GenerateMapSectionRowWithEscapeVelocities(MSETREQ mapSectionRequest, __m256i* crsForARow, __m256i* ciVec, __m256i* countsForARow, uint16_t* escapeVelocitiesForARow)
+    {
+        return GenerateMapSectionRowInternal(mapSectionRequest, crsForARow, ciVec, countsForARow, escapeVelocitiesForARow, nullptr);
+    }
+
+    // Same as GenerateMapSectionRow, but also writes an estimate of the distance from each sample to the boundary of the set, one float per sample.
+    // The distance is given in the same units as the sample points, it is zero for samples that did not escape.
+    __declspec(dllexport) int GenerateMapSectionRowWithDistanceEstimates(MSETREQ mapSectionRequest, __m256i* crsForARow, __m256i* ciVec, __m256i* countsForARow, float* distanceEstimatesForARow)
+    {
+        return GenerateMapSectionRowInternal(mapSectionRequest, crsForARow, ciVec, countsForARow, nullptr, distanceEstimatesForARow);
+    }
+
+    // Builds the sample points for an entire block from the block's position and the sample point delta.
+    // crsForBlock receives BlockSizeWidth / 8 vectors of LimbCount limbs, using the same layout as crsForARow.
+    // cisForBlock receives BlockSizeHeight limb sets of LimbCount limbs, each limb broadcast to all lanes, the ciVec for row n starts at n * LimbCount.
+    // The multiples of the delta are cached by the delta's value and LimbCount.
+    // Returns 0 if successful, otherwise one or more of the SAMPLE_POINTS_RESULT flags.
+    __declspec(dllexport) int GenerateSamplePoints(SAMPLEPOINTREQ samplePointRequest, __m256i* crsForBlock, __m256i* cisForBlock)
+    {
+        int limbCount = samplePointRequest.LimbCount;
+        int bitsBeforeBp = samplePointRequest.BitsBeforeBinaryPoint;
+        int targetExponent = samplePointRequest.TargetExponent;
+
+        Fp31VecMath vMath = Fp31VecMath(limbCount, bitsBeforeBp, targetExponent);
+        SamplePointGenerator samplePointGenerator = SamplePointGenerator(&vMath, targetExponent);
+
+        int result = samplePointGenerator.GenerateSamplePoints(samplePointRequest.positionX, samplePointRequest.positionY, samplePointRequest.positionExponent,
+            samplePointRequest.samplePointDelta, samplePointRequest.samplePointDeltaExponent,
+            samplePointRequest.BlockSizeWidth, samplePointRequest.BlockSizeHeight, crsForBlock, cisForBlock);
+
+        if (result != 0)
+        {
+            _RPTA("GenerateSamplePoints failed with result: %d using LimbCount: %d.\n", result, limbCount);
+        }
+
+        return result;
+    }
+
+    // Generates an entire block in three passes, every 4th sample of every 4th row, every 2nd, then all samples, see ProgressiveBlockGenerator.
+    // The sample points are given using the layout produced by GenerateSamplePoints. Counts and escape velocities are written as one uint16_t per sample,
+    // row by row. If escapeVelocitiesForBlock is null, escape velocities are not calculated. passCompleted may be null.
+    // samplesIterated receives the number of samples that were iterated, the remainder were guessed from their neighbors.
+    // Returns zero or more of the PROGRESSIVE_RESULT flags.
+    __declspec(dllexport) int GenerateBlockProgressive(MSETREQ mapSectionRequest, __m256i* crsForBlock, __m256i* cisForBlock, uint16_t* countsForBlock, uint16_t* escapeVelocitiesForBlock,
+        PassCompletedCallback passCompleted, int* samplesIterated)
+    {
+        int limbCount = mapSectionRequest.LimbCount;
+        int bitsBeforeBp = mapSectionRequest.BitsBeforeBinaryPoint;
+        int targetExponent = mapSectionRequest.TargetExponent;
+
+        Fp31VecMath vMath = Fp31VecMath(limbCount, bitsBeforeBp, targetExponent);
+        Iterator iterator = Iterator(&vMath, mapSectionRequest.TargetIterations, mapSectionRequest.ThresholdForComparison, mapSectionRequest.iterationsPerStep,
+            mapSectionRequest.skipInteriorSamples != 0);
+
+        ProgressiveBlockGenerator blockGenerator = ProgressiveBlockGenerator(&vMath, &iterator, mapSectionRequest.TargetIterations, mapSectionRequest.BlockSizeWidth, mapSectionRequest.BlockSizeHeight,
+            crsForBlock, cisForBlock, countsForBlock, escapeVelocitiesForBlock);
+
+        int result = blockGenerator.Generate(passCompleted);
+
+        if (samplesIterated != nullptr)
+        {
+            *samplesIterated = blockGenerator.GetSamplesIterated();
+        }
+
+        if ((result & PROGRESSIVE_RESULT_OVERFLOW) != 0)
+        {
+            _RPTA("Overflow detected for a progressive block using BitsBeforeBinaryPoint: %d.\n", bitsBeforeBp);
+        }
+
+        return result;
+    }
+
+    // Generates a subsampleFactor x subsampleFactor grid of subsamples centered on each of the given samples of a block, see SubsampleGenerator.
+    // The samplePointRequest gives the position of the block's first subsample and the spacing of the subsamples, its BlockSize is that of the block.
+    // samplePositions holds an x, y pair for each sample, counts and escapeVelocities receive subsampleFactor^2 values for each sample.
+    // If escapeVelocities is null, escape velocities are not calculated.
+    // Returns 0 if successful, otherwise one or more of the SAMPLE_POINTS_RESULT flags or SUBSAMPLES_RESULT_OVERFLOW.
+    __declspec(dllexport) int GenerateSubsamples(SAMPLEPOINTREQ samplePointRequest, MSETREQ mapSectionRequest, int subsampleFactor, int* samplePositions, int sampleCount,
+        uint16_t* counts, uint16_t* escapeVelocities)
+    {
+        int limbCount = samplePointRequest.LimbCount;
+        int bitsBeforeBp = samplePointRequest.BitsBeforeBinaryPoint;
+        int targetExponent = samplePointRequest.TargetExponent;
+
+        Fp31VecMath vMath = Fp31VecMath(limbCount, bitsBeforeBp, targetExponent);
+        SamplePointGenerator samplePointGenerator = SamplePointGenerator(&vMath, targetExponent);
+        Iterator iterator = Iterator(&vMath, mapSectionRequest.TargetIterations, mapSectionRequest.ThresholdForComparison, mapSectionRequest.iterationsPerStep,
+            mapSectionRequest.skipInteriorSamples != 0);
+
+        SubsampleGenerator subsampleGenerator = SubsampleGenerator(&vMath, &iterator, subsampleFactor);
+
+        int result = subsampleGenerator.BuildLattice(&samplePointGenerator, samplePointRequest.positionX, samplePointRequest.positionY, samplePointRequest.positionExponent,
+            samplePointRequest.samplePointDelta, samplePointRequest.samplePointDeltaExponent, samplePointRequest.BlockSizeWidth, samplePointRequest.BlockSizeHeight);
+
+        if (result != 0)
+        {
+            _RPTA("GenerateSubsamples could not build the lattice, result: %d using LimbCount: %d.\n", result, limbCount);
+            return result;
+        }
+
+        subsampleGenerator.Generate(samplePositions, sampleCount, counts, escapeVelocities);
+
+        if (iterator.HasOverflowed())
+        {
+            _RPTA("Overflow detected while generating subsamples using BitsBeforeBinaryPoint: %d.\n", bitsBeforeBp);
+            result |= SUBSAMPLES_RESULT_OVERFLOW;
+        }
+
+        return result;
+    }
+
+    // Converts the counts and escape velocities of valueCount samples to BGRA pixels using the tables built by ColorMap.GetColorBandTable.
+    // Returns the number of color components that were out of range and replaced.
+    __declspec(dllexport) int ColorizeSamples(COLORBANDTABLEREQ colorBandTable, int* bandIndexes, double* bandValues, int* opacities,
+        uint16_t* counts, uint16_t* escapeVelocities, int valueCount, uint32_t* pixels)
+    {
+        Colorizer colorizer = Colorizer(colorBandTable, bandIndexes, bandValues, opacities);
+        int errors = colorizer.Colorize(counts, escapeVelocities, valueCount, pixels);
+
+        if (errors > 0)
+        {
+            _RPTA("ColorizeSamples replaced %d color components that were out of range.\n", errors);
+        }
+
+        return errors;
+    }
+
+    // Generates every vectorStride'th vector of a row twice, once at the request's LimbCount and once using one less limb.
+    // The sample points must be supplied using the request's (higher) LimbCount, the lower precision values are
+    // obtained by dropping the least significant limb.
+    // Returns the number of samples whose counts differ, or -1 if either precision overflowed.
+    __declspec(dllexport) int ProbeMapSectionRowPrecision(MSETREQ mapSectionRequest, __m256i* crsForARow, __m256i* ciVec, int vectorStride)
+    {
+        int limbCount = mapSectionRequest.LimbCount;
+        int bitsBeforeBp = mapSectionRequest.BitsBeforeBinaryPoint;
+        int targetExponent = mapSectionRequest.TargetExponent;
+
+        int targetIterations = mapSectionRequest.TargetIterations;
+        int thresholdForComparison = mapSectionRequest.ThresholdForComparison;
+
+        if (limbCount < 2 || vectorStride < 1)
+        {
+            return -1;
+        }
+
+        _RPTA("Probing a MapSectionRow with LimbCount: %d and %d.\n", limbCount, limbCount - 1);
+
+        // The most significant limb holds the same bits in both formats, so the ThresholdForComparison applies to both.
+        Fp31VecMath vMath = Fp31VecMath(limbCount, bitsBeforeBp, targetExponent);
+        Iterator iterator = Iterator(&vMath, targetIterations, thresholdForComparison);
+
+        Fp31VecMath vMathLower = Fp31VecMath(limbCount - 1, bitsBeforeBp, targetExponent + EFFECTIVE_BITS_PER_LIMB);
+        Iterator iteratorLower = Iterator(&vMathLower, targetIterations, thresholdForComparison);
+
+        __m256i* ci = CreateLimbSet(limbCount);
+        for (int limbPtr = 0; limbPtr < limbCount; limbPtr++)
+        {
+            ci[limbPtr] = _mm256_loadu_si256((__m256i const*) (&ciVec[limbPtr]));
+        }
+
+        __m256i* cr = CreateLimbSet(limbCount);
+
+        int numberOfMismatches = 0;
+        int vectorsPerRow = mapSectionRequest.VectorsPerRow;
+
+        for (int idx = 0; idx < vectorsPerRow; idx += vectorStride)
+        {
+            int vPtr = idx * limbCount;
+
+            for (int limbPtr = 0; limbPtr < limbCount; limbPtr++)
+            {
+                cr[limbPtr] = _mm256_loadu_si256((__m256i const*) (&crsForARow[vPtr + limbPtr]));
+            }
+
+            __m256i counts;
+            iterator.GenerateMapCol(cr, ci, counts);
+
+            // Limbs are stored least significant first.
+            __m256i countsLower;
+            iteratorLower.GenerateMapCol(cr + 1, ci + 1, countsLower);
+
+            __m256i sameFlags = _mm256_cmpeq_epi32(counts, countsLower);
+            int sameMask = _mm256_movemask_ps(_mm256_castsi256_ps(sameFlags));
+
+            numberOfMismatches += _mm_popcnt_u32(~sameMask & 0xFF);
+        }
+
+        delete[] ci;
+        delete[] cr;
+
+        if (iterator.HasOverflowed() || iteratorLower.HasOverflowed())
+        {
+            _RPTA("Overflow detected while probing row: %d.\n", mapSectionRequest.RowNumber);
+            return -1;
+        }
+
+        return numberOfMismatches;
     }
 
     __declspec(dllexport) int BaseSimdTest()
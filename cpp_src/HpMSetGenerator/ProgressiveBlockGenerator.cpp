@@ -0,0 +1,345 @@
+#include "pch.h"
+
+#include "framework.h"
+#include <immintrin.h>
+#include "MSetGenerator.h"
+#include "Fp31VecMath.h"
+#include "Iterator.h"
+#include "ProgressiveBlockGenerator.h"
+
+#pragma region Constructor
+
+ProgressiveBlockGenerator::ProgressiveBlockGenerator(Fp31VecMath* const vMath, Iterator* const iterator, int targetIterations, int blockWidth, int blockHeight,
+    __m256i* crsForBlock, __m256i* cisForBlock, uint16_t* counts, uint16_t* escapeVelocities)
+    : _states((size_t)blockWidth * blockHeight, SAMPLE_UNKNOWN)
+{
+    _vMath = vMath;
+    _iterator = iterator;
+    _targetIterations = targetIterations;
+
+    _limbCount = vMath->LimbCount;
+    _blockWidth = blockWidth;
+    _blockHeight = blockHeight;
+
+    _crsForBlock = crsForBlock;
+    _cisForBlock = cisForBlock;
+
+    _counts = counts;
+    _escapeVelocities = escapeVelocities;
+
+    _samplesIterated = 0;
+    _allSamplesHaveEscaped = true;
+}
+
+#pragma endregion
+
+#pragma region Public Methods
+
+int ProgressiveBlockGenerator::Generate(PassCompletedCallback passCompleted)
+{
+    int result = 0;
+    int passNumber = 0;
+
+    for (int stepSize = INITIAL_STEP_SIZE; stepSize >= 1; stepSize /= 2)
+    {
+        GeneratePass(stepSize);
+
+        if (stepSize < INITIAL_STEP_SIZE)
+        {
+            VerifyGuesses(stepSize);
+        }
+
+        if (stepSize > 1)
+        {
+            FillPreview(stepSize);
+        }
+
+        if (passCompleted != nullptr && passCompleted(passNumber, stepSize) != 0 && stepSize > 1)
+        {
+            result |= PROGRESSIVE_RESULT_CANCELLED;
+            break;
+        }
+
+        passNumber++;
+    }
+
+    if (_allSamplesHaveEscaped && (result & PROGRESSIVE_RESULT_CANCELLED) == 0)
+    {
+        result |= PROGRESSIVE_RESULT_ALL_ESCAPED;
+    }
+
+    if (_iterator->HasOverflowed())
+    {
+        result |= PROGRESSIVE_RESULT_OVERFLOW;
+    }
+
+    return result;
+}
+
+int ProgressiveBlockGenerator::GetSamplesIterated()
+{
+    return _samplesIterated;
+}
+
+#pragma endregion
+
+#pragma region Private Methods
+
+void ProgressiveBlockGenerator::GeneratePass(int stepSize)
+{
+    std::vector<int> xValues;
+
+    for (int y = 0; y < _blockHeight; y += stepSize)
+    {
+        xValues.clear();
+
+        for (int x = 0; x < _blockWidth; x += stepSize)
+        {
+            int sampleIndex = y * _blockWidth + x;
+
+            if (_states[sampleIndex] != SAMPLE_UNKNOWN)
+            {
+                // Calculated or guessed by an earlier pass.
+                continue;
+            }
+
+            uint16_t count;
+            uint16_t escapeVelocity;
+
+            if (stepSize < INITIAL_STEP_SIZE && TryGuess(x, y, stepSize, count, escapeVelocity))
+            {
+                _counts[sampleIndex] = count;
+
+                if (_escapeVelocities != nullptr)
+                {
+                    _escapeVelocities[sampleIndex] = escapeVelocity;
+                }
+
+                _states[sampleIndex] = SAMPLE_GUESSED;
+            }
+            else
+            {
+                xValues.push_back(x);
+            }
+        }
+
+        IterateSamples(y, xValues);
+    }
+}
+
+// Calculates each guessed sample on the lattice that disagrees with a calculated neighbor. Since a calculated
+// value can differ from the guess, the samples around it are checked again, until no more guesses are rejected.
+// Returns the number of guesses that were rejected.
+int ProgressiveBlockGenerator::VerifyGuesses(int stepSize)
+{
+    std::vector<int> xValues;
+    int guessesRejected = 0;
+    int rejectedThisRound;
+
+    do
+    {
+        rejectedThisRound = 0;
+
+        for (int y = 0; y < _blockHeight; y += stepSize)
+        {
+            xValues.clear();
+
+            for (int x = 0; x < _blockWidth; x += stepSize)
+            {
+                if (_states[y * _blockWidth + x] == SAMPLE_GUESSED && DisagreesWithNeighbors(x, y, stepSize))
+                {
+                    xValues.push_back(x);
+                }
+            }
+
+            rejectedThisRound += (int)xValues.size();
+            IterateSamples(y, xValues);
+        }
+
+        guessesRejected += rejectedThisRound;
+
+    } while (rejectedThisRound > 0);
+
+    return guessesRejected;
+}
+
+// Gives each sample that is not on the lattice the value of the sample at the top, left corner of its cell.
+void ProgressiveBlockGenerator::FillPreview(int stepSize)
+{
+    for (int y = 0; y < _blockHeight; y++)
+    {
+        int rowStart = y * _blockWidth;
+        int sourceRowStart = (y - y % stepSize) * _blockWidth;
+
+        for (int x = 0; x < _blockWidth; x++)
+        {
+            if (_states[rowStart + x] != SAMPLE_UNKNOWN)
+            {
+                continue;
+            }
+
+            int sourceIndex = sourceRowStart + x - x % stepSize;
+
+            _counts[rowStart + x] = _counts[sourceIndex];
+
+            if (_escapeVelocities != nullptr)
+            {
+                _escapeVelocities[rowStart + x] = _escapeVelocities[sourceIndex];
+            }
+        }
+    }
+}
+
+// The neighbors are the samples on the previous, coarser lattice that surround the sample:
+// two for a sample on the edge of a cell and four for a sample at the center of a cell.
+bool ProgressiveBlockGenerator::TryGuess(int x, int y, int stepSize, uint16_t& count, uint16_t& escapeVelocity)
+{
+    int coarseStepSize = stepSize * 2;
+
+    int x0 = x % coarseStepSize == 0 ? x : x - stepSize;
+    int x1 = x % coarseStepSize == 0 ? x : x + stepSize;
+    int y0 = y % coarseStepSize == 0 ? y : y - stepSize;
+    int y1 = y % coarseStepSize == 0 ? y : y + stepSize;
+
+    if (x1 >= _blockWidth || y1 >= _blockHeight)
+    {
+        // Samples along the right and bottom edges may not have a neighbor on each side.
+        return false;
+    }
+
+    int neighborIndexes[4] = { y0 * _blockWidth + x0, y0 * _blockWidth + x1, y1 * _blockWidth + x0, y1 * _blockWidth + x1 };
+
+    count = _counts[neighborIndexes[0]];
+    escapeVelocity = 0;
+
+    if (_escapeVelocities != nullptr && count <= _targetIterations)
+    {
+        // The escape velocity varies from sample to sample even where the counts agree, only samples that reach the target are guessed.
+        return false;
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        int neighborIndex = neighborIndexes[i];
+
+        if (_states[neighborIndex] == SAMPLE_UNKNOWN || _counts[neighborIndex] != count)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ProgressiveBlockGenerator::DisagreesWithNeighbors(int x, int y, int stepSize)
+{
+    uint16_t count = _counts[y * _blockWidth + x];
+
+    for (int ny = y - stepSize; ny <= y + stepSize; ny += stepSize)
+    {
+        if (ny < 0 || ny >= _blockHeight)
+        {
+            continue;
+        }
+
+        for (int nx = x - stepSize; nx <= x + stepSize; nx += stepSize)
+        {
+            if (nx < 0 || nx >= _blockWidth)
+            {
+                continue;
+            }
+
+            int neighborIndex = ny * _blockWidth + nx;
+
+            if (_states[neighborIndex] == SAMPLE_CALCULATED && _counts[neighborIndex] != count)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// Iterates the samples of row y at the given x positions, 8 at a time. The last vector is padded by repeating the last sample.
+void ProgressiveBlockGenerator::IterateSamples(int y, std::vector<int>& xValues)
+{
+    int sampleCount = (int)xValues.size();
+
+    if (sampleCount == 0)
+    {
+        return;
+    }
+
+    __m256i* cr = _vMath->CreateLimbSet();
+    __m256i* ci = _vMath->CreateLimbSet();
+
+    for (int limbPtr = 0; limbPtr < _limbCount; limbPtr++)
+    {
+        ci[limbPtr] = _mm256_loadu_si256((__m256i const*) (&_cisForBlock[y * _limbCount + limbPtr]));
+    }
+
+    alignas(32) uint32_t crLanes[LANES];
+    alignas(32) uint32_t countLanes[LANES];
+    alignas(16) uint16_t escapeVelocityLanes[LANES];
+
+    for (int start = 0; start < sampleCount; start += LANES)
+    {
+        // Gather the x values of the samples from the block's sample points.
+        for (int limbPtr = 0; limbPtr < _limbCount; limbPtr++)
+        {
+            for (int lanePtr = 0; lanePtr < LANES; lanePtr++)
+            {
+                int x = xValues[start + lanePtr < sampleCount ? start + lanePtr : sampleCount - 1];
+                uint32_t* sourceLanes = (uint32_t*)(&_crsForBlock[(x / LANES) * _limbCount + limbPtr]);
+                crLanes[lanePtr] = sourceLanes[x % LANES];
+            }
+
+            cr[limbPtr] = _mm256_load_si256((__m256i const*)crLanes);
+        }
+
+        __m256i countsVec;
+        bool allSamplesHaveEscaped;
+
+        if (_escapeVelocities == nullptr)
+        {
+            allSamplesHaveEscaped = _iterator->GenerateMapCol(cr, ci, countsVec);
+        }
+        else
+        {
+            __m128i escapeVelocitiesVec;
+            allSamplesHaveEscaped = _iterator->GenerateMapCol(cr, ci, countsVec, escapeVelocitiesVec);
+            _mm_store_si128((__m128i*)escapeVelocityLanes, escapeVelocitiesVec);
+        }
+
+        if (!allSamplesHaveEscaped)
+        {
+            _allSamplesHaveEscaped = false;
+        }
+
+        _mm256_store_si256((__m256i*)countLanes, countsVec);
+
+        int lanesUsed = sampleCount - start < LANES ? sampleCount - start : LANES;
+
+        for (int lanePtr = 0; lanePtr < lanesUsed; lanePtr++)
+        {
+            int sampleIndex = y * _blockWidth + xValues[start + lanePtr];
+
+            _counts[sampleIndex] = (uint16_t)countLanes[lanePtr];
+
+            if (_escapeVelocities != nullptr)
+            {
+                _escapeVelocities[sampleIndex] = escapeVelocityLanes[lanePtr];
+            }
+
+            _states[sampleIndex] = SAMPLE_CALCULATED;
+        }
+
+        _samplesIterated += lanesUsed;
+    }
+
+    delete[] cr;
+    delete[] ci;
+}
+
+#pragma endregion
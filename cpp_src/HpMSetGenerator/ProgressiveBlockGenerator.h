@@ -0,0 +1,73 @@
+#pragma once
+
+#include "pch.h"
+#include <immintrin.h>
+#include <cstdint>
+#include <vector>
+
+// Bit flags returned by Generate, the first two have the same meaning as the GenerateMapSectionRow flags.
+const int PROGRESSIVE_RESULT_ALL_ESCAPED = 1;
+const int PROGRESSIVE_RESULT_OVERFLOW = 2;
+const int PROGRESSIVE_RESULT_CANCELLED = 4;
+
+// Called once each pass has completed, the counts and escape velocities for the block are complete at that point,
+// samples that have not yet been calculated hold the value of the nearest sample on the pass's lattice.
+// Return a non-zero value to stop before the next pass.
+typedef int (*PassCompletedCallback)(int passNumber, int stepSize);
+
+// Generates a block using successive refinement: every 4th sample of every 4th row, then every 2nd, then all samples.
+// A sample added by the 2nd or 3rd pass whose neighbors on the previous lattice all have the same count is given that count
+// without being iterated. When escape velocities are calculated, only samples whose neighbors reached the target are guessed.
+// Once a pass is complete, each guess is verified against the calculated samples around it, a guess that disagrees with
+// any of them is replaced by calculating the sample.
+class ProgressiveBlockGenerator
+{
+	Fp31VecMath* _vMath;
+	Iterator* _iterator;
+	int _targetIterations;
+
+	int _limbCount;
+	int _blockWidth;
+	int _blockHeight;
+
+	__m256i* _crsForBlock;
+	__m256i* _cisForBlock;
+
+	uint16_t* _counts;
+	uint16_t* _escapeVelocities;
+
+	// The state of each sample, one of the SAMPLE_ constants.
+	std::vector<uint8_t> _states;
+
+	int _samplesIterated;
+	bool _allSamplesHaveEscaped;
+
+	static const int LANES = 8;
+	static const int INITIAL_STEP_SIZE = 4;
+
+	static const uint8_t SAMPLE_UNKNOWN = 0;
+	static const uint8_t SAMPLE_CALCULATED = 1;
+	static const uint8_t SAMPLE_GUESSED = 2;
+
+public:
+
+	// If escapeVelocities is null, escape velocities are not calculated.
+	ProgressiveBlockGenerator(Fp31VecMath* const vMath, Iterator* const iterator, int targetIterations, int blockWidth, int blockHeight,
+		__m256i* crsForBlock, __m256i* cisForBlock, uint16_t* counts, uint16_t* escapeVelocities);
+
+	int Generate(PassCompletedCallback passCompleted);
+
+	// The number of samples that were iterated, the remainder were guessed.
+	int GetSamplesIterated();
+
+private:
+
+	void GeneratePass(int stepSize);
+	int VerifyGuesses(int stepSize);
+	void FillPreview(int stepSize);
+
+	bool TryGuess(int x, int y, int stepSize, uint16_t& count, uint16_t& escapeVelocity);
+	bool DisagreesWithNeighbors(int x, int y, int stepSize);
+
+	void IterateSamples(int y, std::vector<int>& xValues);
+};
@@ -0,0 +1,317 @@
+#include "pch.h"
+
+#include "framework.h"
+#include <immintrin.h>
+#include "MSetGenerator.h"
+#include "Fp31VecMath.h"
+#include "SamplePointGenerator.h"
+
+#pragma region SamplePointOffsets
+
+#pragma warning( push )
+#pragma warning( disable : 4316 )
+SamplePointOffsets::SamplePointOffsets(int limbCount, int vectorCount)
+{
+    LimbCount = limbCount;
+    VectorCount = vectorCount;
+    Values = new __m256i[(size_t)limbCount * vectorCount];
+}
+#pragma warning( pop )
+
+SamplePointOffsets::~SamplePointOffsets()
+{
+    delete[] Values;
+}
+
+#pragma endregion
+
+#pragma region Constructor
+
+std::map<std::pair<std::vector<uint32_t>, int>, std::shared_ptr<SamplePointOffsets>> SamplePointGenerator::_offsetsCache;
+std::mutex SamplePointGenerator::_offsetsCacheMutex;
+
+SamplePointGenerator::SamplePointGenerator(Fp31VecMath* const vMath, int targetExponent)
+{
+    _vMath = vMath;
+    _limbCount = vMath->LimbCount;
+    _targetExponent = targetExponent;
+}
+
+#pragma endregion
+
+#pragma region Public Methods
+
+int SamplePointGenerator::GenerateSamplePoints(const int64_t positionX[2], const int64_t positionY[2], int positionExponent, const int64_t samplePointDelta[2], int samplePointDeltaExponent,
+    int blockSizeWidth, int blockSizeHeight, __m256i* crsForBlock, __m256i* cisForBlock)
+{
+    std::vector<uint32_t> startX(_limbCount);
+    std::vector<uint32_t> startY(_limbCount);
+    std::vector<uint32_t> delta(_limbCount);
+
+    int result = ConvertToFp31(positionX, positionExponent, startX.data());
+    result |= ConvertToFp31(positionY, positionExponent, startY.data());
+    result |= ConvertToFp31(samplePointDelta, samplePointDeltaExponent, delta.data());
+
+    if (result != 0)
+    {
+        return result;
+    }
+
+    // A single set of offsets is used for both directions.
+    int extent = blockSizeWidth > blockSizeHeight ? blockSizeWidth : blockSizeHeight;
+    int vectorCount = (extent + LANES - 1) / LANES;
+
+    bool overflowed;
+    std::shared_ptr<SamplePointOffsets> offsets = GetOffsets(delta.data(), vectorCount, overflowed);
+
+    if (overflowed)
+    {
+        return SAMPLE_POINTS_RESULT_OVERFLOW;
+    }
+
+    // X values: each vector holds 8 consecutive samples.
+    if (!AddOffsets(startX.data(), offsets.get(), blockSizeWidth / LANES, crsForBlock))
+    {
+        return SAMPLE_POINTS_RESULT_OVERFLOW;
+    }
+
+    // Y values: computed 8 rows at a time, then each row's value is broadcast to all lanes.
+    int rowVectorCount = (blockSizeHeight + LANES - 1) / LANES;
+    __m256i* yVecs = new __m256i[(size_t)rowVectorCount * _limbCount];
+
+    if (!AddOffsets(startY.data(), offsets.get(), rowVectorCount, yVecs))
+    {
+        delete[] yVecs;
+        return SAMPLE_POINTS_RESULT_OVERFLOW;
+    }
+
+    alignas(32) uint32_t lanes[LANES];
+
+    for (int vecPtr = 0; vecPtr < rowVectorCount; vecPtr++)
+    {
+        for (int limbPtr = 0; limbPtr < _limbCount; limbPtr++)
+        {
+            _mm256_store_si256((__m256i*)lanes, yVecs[vecPtr * _limbCount + limbPtr]);
+
+            for (int lanePtr = 0; lanePtr < LANES; lanePtr++)
+            {
+                int rowNumber = vecPtr * LANES + lanePtr;
+
+                if (rowNumber < blockSizeHeight)
+                {
+                    _mm256_storeu_si256(&cisForBlock[rowNumber * _limbCount + limbPtr], _mm256_set1_epi32(lanes[lanePtr]));
+                }
+            }
+        }
+    }
+
+    delete[] yVecs;
+
+    return 0;
+}
+
+// Converts value[0] * 2^63 + value[1], times 2^exponent to a Fp31 value, using two's complement for negative values.
+int SamplePointGenerator::ConvertToFp31(const int64_t value[2], int exponent, uint32_t* limbs)
+{
+    int shiftAmount = exponent - _targetExponent;
+
+    if (shiftAmount < 0)
+    {
+        // The value has more fractional bits than the format, as for FP31ValHelper.CreateFP31Val, this is not supported.
+        return SAMPLE_POINTS_RESULT_UNSUPPORTED_EXPONENT;
+    }
+
+    // Form the 128-bit, two's complement value of N.
+    uint64_t hiShifted = (uint64_t)value[0] << 63;
+    uint64_t lo = hiShifted + (uint64_t)value[1];
+    int64_t hi = (value[0] >> 1) + (value[1] < 0 ? -1 : 0) + (lo < hiShifted ? 1 : 0);
+
+    // Bit n of the result is bit n - shiftAmount of N.
+    for (int limbPtr = 0; limbPtr < _limbCount; limbPtr++)
+    {
+        uint32_t limb = 0;
+
+        for (int bitPtr = 0; bitPtr < EFFECTIVE_BITS_PER_LIMB; bitPtr++)
+        {
+            limb |= GetBit(lo, hi, limbPtr * EFFECTIVE_BITS_PER_LIMB + bitPtr - shiftAmount) << bitPtr;
+        }
+
+        limbs[limbPtr] = limb;
+    }
+
+    // The bits of N at and above the result's sign bit must all match the sign.
+    int signBitPos = _limbCount * EFFECTIVE_BITS_PER_LIMB - 1 - shiftAmount;
+    uint32_t sign = hi < 0 ? 1 : 0;
+
+    if (signBitPos < 0)
+    {
+        return (hi == 0 && lo == 0) ? 0 : SAMPLE_POINTS_RESULT_OVERFLOW;
+    }
+
+    for (int bitPos = signBitPos; bitPos < 128; bitPos++)
+    {
+        if (GetBit(lo, hi, bitPos) != sign)
+        {
+            return SAMPLE_POINTS_RESULT_OVERFLOW;
+        }
+    }
+
+    return 0;
+}
+
+void SamplePointGenerator::ClearOffsetsCache()
+{
+    std::lock_guard<std::mutex> lock(_offsetsCacheMutex);
+    _offsetsCache.clear();
+}
+
+#pragma endregion
+
+#pragma region Private Methods
+
+std::shared_ptr<SamplePointOffsets> SamplePointGenerator::GetOffsets(uint32_t* deltaLimbs, int vectorCount, bool& overflowed)
+{
+    std::pair<std::vector<uint32_t>, int> key(std::vector<uint32_t>(deltaLimbs, deltaLimbs + _limbCount), vectorCount);
+
+    {
+        std::lock_guard<std::mutex> lock(_offsetsCacheMutex);
+
+        auto it = _offsetsCache.find(key);
+        if (it != _offsetsCache.end())
+        {
+            overflowed = false;
+            return it->second;
+        }
+    }
+
+    // Build outside the lock, if two threads build the same offsets, the last one wins.
+    std::shared_ptr<SamplePointOffsets> result = BuildOffsets(deltaLimbs, vectorCount, overflowed);
+
+    if (!overflowed)
+    {
+        std::lock_guard<std::mutex> lock(_offsetsCacheMutex);
+
+        if (_offsetsCache.size() >= MAX_CACHED_OFFSETS)
+        {
+            // Offsets in use by other threads are kept alive by their shared_ptr.
+            _offsetsCache.clear();
+        }
+
+        _offsetsCache[key] = result;
+    }
+
+    return result;
+}
+
+std::shared_ptr<SamplePointOffsets> SamplePointGenerator::BuildOffsets(uint32_t* deltaLimbs, int vectorCount, bool& overflowed)
+{
+    std::shared_ptr<SamplePointOffsets> result = std::make_shared<SamplePointOffsets>(_limbCount, vectorCount);
+
+    // The first vector holds 0, 1, 2, ... 7 times delta.
+    std::vector<uint32_t> multiple(_limbCount, 0);
+    std::vector<uint32_t> laneValues((size_t)_limbCount * LANES);
+
+    bool scalarOverflowed = false;
+
+    for (int lanePtr = 0; lanePtr < LANES; lanePtr++)
+    {
+        for (int limbPtr = 0; limbPtr < _limbCount; limbPtr++)
+        {
+            laneValues[(size_t)limbPtr * LANES + lanePtr] = multiple[limbPtr];
+        }
+
+        // After the last lane, multiple holds 8 times delta, the step between vectors.
+        scalarOverflowed |= AddScalar(multiple.data(), deltaLimbs, multiple.data());
+    }
+
+    for (int limbPtr = 0; limbPtr < _limbCount; limbPtr++)
+    {
+        result->Values[limbPtr] = _mm256_loadu_si256((__m256i const*) (&laneValues[(size_t)limbPtr * LANES]));
+    }
+
+    // Each successive vector is the previous vector plus 8 times delta.
+    __m256i* step = _vMath->CreateLimbSet();
+
+    for (int limbPtr = 0; limbPtr < _limbCount; limbPtr++)
+    {
+        step[limbPtr] = _mm256_set1_epi32(multiple[limbPtr]);
+    }
+
+    _vMath->ClearOverflowFlags();
+
+    for (int vecPtr = 1; vecPtr < vectorCount; vecPtr++)
+    {
+        _vMath->Add(&result->Values[(vecPtr - 1) * _limbCount], step, &result->Values[vecPtr * _limbCount]);
+    }
+
+    delete[] step;
+
+    __m256i overflowFlags = _vMath->GetOverflowFlags();
+    overflowed = scalarOverflowed || !_mm256_testz_si256(overflowFlags, overflowFlags);
+
+    return result;
+}
+
+bool SamplePointGenerator::AddOffsets(uint32_t* startLimbs, SamplePointOffsets* offsets, int vectorCount, __m256i* result)
+{
+    __m256i* start = _vMath->CreateLimbSet();
+
+    for (int limbPtr = 0; limbPtr < _limbCount; limbPtr++)
+    {
+        start[limbPtr] = _mm256_set1_epi32(startLimbs[limbPtr]);
+    }
+
+    _vMath->ClearOverflowFlags();
+
+    for (int vecPtr = 0; vecPtr < vectorCount; vecPtr++)
+    {
+        _vMath->Add(start, &offsets->Values[vecPtr * _limbCount], &result[vecPtr * _limbCount]);
+    }
+
+    delete[] start;
+
+    __m256i overflowFlags = _vMath->GetOverflowFlags();
+    return _mm256_testz_si256(overflowFlags, overflowFlags);
+}
+
+// Returns true if the sum has overflowed.
+bool SamplePointGenerator::AddScalar(uint32_t* left, uint32_t* right, uint32_t* result)
+{
+    // The result may be one of the operands, save the msls used to detect overflow.
+    uint32_t leftMsl = left[_limbCount - 1];
+    uint32_t rightMsl = right[_limbCount - 1];
+
+    uint32_t carry = 0;
+
+    for (int limbPtr = 0; limbPtr < _limbCount; limbPtr++)
+    {
+        uint32_t sum = left[limbPtr] + right[limbPtr] + carry;
+        result[limbPtr] = sum & LOW31_BITS_SET;
+        carry = sum >> EFFECTIVE_BITS_PER_LIMB;
+    }
+
+    uint32_t resultMsl = result[_limbCount - 1];
+    return (((leftMsl ^ resultMsl) & (rightMsl ^ resultMsl)) & TEST_BIT_30) != 0;
+}
+
+uint32_t SamplePointGenerator::GetBit(uint64_t lo, int64_t hi, int bitPos)
+{
+    if (bitPos < 0)
+    {
+        return 0;
+    }
+    else if (bitPos < 64)
+    {
+        return (uint32_t)((lo >> bitPos) & 1);
+    }
+    else if (bitPos < 128)
+    {
+        return (uint32_t)(((uint64_t)hi >> (bitPos - 64)) & 1);
+    }
+    else
+    {
+        return hi < 0 ? 1 : 0;
+    }
+}
+
+#pragma endregion
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "pch.h"
+#include <immintrin.h>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Bit flags returned by GenerateSamplePoints
+const int SAMPLE_POINTS_RESULT_UNSUPPORTED_EXPONENT = 1;
+const int SAMPLE_POINTS_RESULT_OVERFLOW = 2;
+
+// The multiples of a sample point delta, 0, 1, 2, ... extent - 1, using the same layout as the crsForARow buffer.
+class SamplePointOffsets
+{
+public:
+	int LimbCount;
+	int VectorCount;
+	__m256i* Values;
+
+	SamplePointOffsets(int limbCount, int vectorCount);
+	~SamplePointOffsets();
+};
+
+class SamplePointGenerator
+{
+	Fp31VecMath* _vMath;
+
+	int _limbCount;
+	int _targetExponent;
+
+	// The offsets are shared by all instances, keyed by the delta's limbs and the number of vectors.
+	static std::map<std::pair<std::vector<uint32_t>, int>, std::shared_ptr<SamplePointOffsets>> _offsetsCache;
+	static std::mutex _offsetsCacheMutex;
+
+	static const size_t MAX_CACHED_OFFSETS = 64;
+
+	static const int LANES = 8;
+	static const int EFFECTIVE_BITS_PER_LIMB = 31;
+
+	const uint32_t LOW31_BITS_SET = 0x7FFFFFFF; // bits 0 - 30 are set.
+	const uint32_t TEST_BIT_30 = 0x40000000; // bit 30 is set.
+
+public:
+
+	SamplePointGenerator(Fp31VecMath* const vMath, int targetExponent);
+
+	// Each value is given as N * 2^exponent, where N = value[0] * 2^63 + value[1].
+	// The block's x values are written using the crsForARow layout, the y value for each row is written as a broadcast limb set.
+	int GenerateSamplePoints(const int64_t positionX[2], const int64_t positionY[2], int positionExponent, const int64_t samplePointDelta[2], int samplePointDeltaExponent,
+		int blockSizeWidth, int blockSizeHeight, __m256i* crsForBlock, __m256i* cisForBlock);
+
+	int ConvertToFp31(const int64_t value[2], int exponent, uint32_t* limbs);
+
+	static void ClearOffsetsCache();
+
+private:
+
+	std::shared_ptr<SamplePointOffsets> GetOffsets(uint32_t* deltaLimbs, int vectorCount, bool& overflowed);
+	std::shared_ptr<SamplePointOffsets> BuildOffsets(uint32_t* deltaLimbs, int vectorCount, bool& overflowed);
+
+	bool AddOffsets(uint32_t* startLimbs, SamplePointOffsets* offsets, int vectorCount, __m256i* result);
+
+	bool AddScalar(uint32_t* left, uint32_t* right, uint32_t* result);
+	uint32_t GetBit(uint64_t lo, int64_t hi, int bitPos);
+};
+
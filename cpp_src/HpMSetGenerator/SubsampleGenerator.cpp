@@ -0,0 +1,129 @@
+#include "pch.h"
+
+#include "framework.h"
+#include <immintrin.h>
+#include "MSetGenerator.h"
+#include "Fp31VecMath.h"
+#include "Iterator.h"
+#include "SamplePointGenerator.h"
+#include "SubsampleGenerator.h"
+
+#pragma region Constructor / Destructor
+
+SubsampleGenerator::SubsampleGenerator(Fp31VecMath* const vMath, Iterator* const iterator, int subsampleFactor)
+{
+    _vMath = vMath;
+    _iterator = iterator;
+
+    _limbCount = vMath->LimbCount;
+    _subsampleFactor = subsampleFactor;
+
+    _crsForLattice = nullptr;
+    _cisForLattice = nullptr;
+
+    _latticeWidth = 0;
+    _latticeHeight = 0;
+}
+
+SubsampleGenerator::~SubsampleGenerator()
+{
+    delete[] _crsForLattice;
+    delete[] _cisForLattice;
+}
+
+#pragma endregion
+
+#pragma region Public Methods
+
+#pragma warning( push )
+#pragma warning( disable : 4316 )
+int SubsampleGenerator::BuildLattice(SamplePointGenerator* samplePointGenerator, const int64_t startX[2], const int64_t startY[2], int positionExponent,
+    const int64_t latticeDelta[2], int latticeDeltaExponent, int blockSizeWidth, int blockSizeHeight)
+{
+    _latticeWidth = blockSizeWidth * _subsampleFactor;
+    _latticeHeight = blockSizeHeight * _subsampleFactor;
+
+    delete[] _crsForLattice;
+    delete[] _cisForLattice;
+
+    // The x values are written a vector at a time, the width is rounded up to a whole number of vectors.
+    int vectorCount = (_latticeWidth + LANES - 1) / LANES;
+    _crsForLattice = new __m256i[(size_t)vectorCount * _limbCount];
+    _cisForLattice = new __m256i[(size_t)_latticeHeight * _limbCount];
+
+    return samplePointGenerator->GenerateSamplePoints(startX, startY, positionExponent, latticeDelta, latticeDeltaExponent,
+        vectorCount * LANES, _latticeHeight, _crsForLattice, _cisForLattice);
+}
+#pragma warning( pop )
+
+void SubsampleGenerator::Generate(const int* samplePositions, int sampleCount, uint16_t* counts, uint16_t* escapeVelocities)
+{
+    int subsamplesPerSample = _subsampleFactor * _subsampleFactor;
+    int subsampleCount = sampleCount * subsamplesPerSample;
+
+    __m256i* cr = _vMath->CreateLimbSet();
+    __m256i* ci = _vMath->CreateLimbSet();
+
+    alignas(32) uint32_t crLanes[LANES];
+    alignas(32) uint32_t ciLanes[LANES];
+    alignas(32) uint32_t countLanes[LANES];
+    alignas(16) uint16_t escapeVelocityLanes[LANES];
+
+    for (int start = 0; start < subsampleCount; start += LANES)
+    {
+        for (int limbPtr = 0; limbPtr < _limbCount; limbPtr++)
+        {
+            for (int lanePtr = 0; lanePtr < LANES; lanePtr++)
+            {
+                // The last vector is padded by repeating the last subsample.
+                int subsampleIndex = start + lanePtr < subsampleCount ? start + lanePtr : subsampleCount - 1;
+
+                int samplePtr = subsampleIndex / subsamplesPerSample;
+                int withinSample = subsampleIndex % subsamplesPerSample;
+
+                int latticeX = samplePositions[samplePtr * 2] * _subsampleFactor + withinSample % _subsampleFactor;
+                int latticeY = samplePositions[samplePtr * 2 + 1] * _subsampleFactor + withinSample / _subsampleFactor;
+
+                crLanes[lanePtr] = ((uint32_t*)(&_crsForLattice[(latticeX / LANES) * _limbCount + limbPtr]))[latticeX % LANES];
+
+                // Each limb of a lattice row's ci is broadcast, lane 0 is used.
+                ciLanes[lanePtr] = ((uint32_t*)(&_cisForLattice[latticeY * _limbCount + limbPtr]))[0];
+            }
+
+            cr[limbPtr] = _mm256_load_si256((__m256i const*)crLanes);
+            ci[limbPtr] = _mm256_load_si256((__m256i const*)ciLanes);
+        }
+
+        __m256i countsVec;
+
+        if (escapeVelocities == nullptr)
+        {
+            _iterator->GenerateMapCol(cr, ci, countsVec);
+        }
+        else
+        {
+            __m128i escapeVelocitiesVec;
+            _iterator->GenerateMapCol(cr, ci, countsVec, escapeVelocitiesVec);
+            _mm_store_si128((__m128i*)escapeVelocityLanes, escapeVelocitiesVec);
+        }
+
+        _mm256_store_si256((__m256i*)countLanes, countsVec);
+
+        int lanesUsed = subsampleCount - start < LANES ? subsampleCount - start : LANES;
+
+        for (int lanePtr = 0; lanePtr < lanesUsed; lanePtr++)
+        {
+            counts[start + lanePtr] = (uint16_t)countLanes[lanePtr];
+
+            if (escapeVelocities != nullptr)
+            {
+                escapeVelocities[start + lanePtr] = escapeVelocityLanes[lanePtr];
+            }
+        }
+    }
+
+    delete[] cr;
+    delete[] ci;
+}
+
+#pragma endregion
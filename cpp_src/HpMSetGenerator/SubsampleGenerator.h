@@ -0,0 +1,43 @@
+#pragma once
+
+#include "pch.h"
+#include <immintrin.h>
+#include <cstdint>
+
+// Returned by GenerateSubsamples, in addition to the SAMPLE_POINTS_RESULT flags, if the iteration overflowed.
+const int SUBSAMPLES_RESULT_OVERFLOW = 4;
+
+// Generates a grid of subsamples centered on each of a list of samples. The subsamples of all samples lie on a lattice whose
+// spacing is 1 / subsampleFactor of the sample point delta, the lattice values are built by the SamplePointGenerator and then
+// gathered, 8 subsamples at a time, so that each vector is full regardless of the subsample factor.
+class SubsampleGenerator
+{
+	Fp31VecMath* _vMath;
+	Iterator* _iterator;
+
+	int _limbCount;
+	int _subsampleFactor;
+
+	// The lattice values, crs use the crsForARow layout, cis hold one broadcast limb set per lattice row.
+	__m256i* _crsForLattice;
+	__m256i* _cisForLattice;
+
+	int _latticeWidth;
+	int _latticeHeight;
+
+	static const int LANES = 8;
+
+public:
+
+	SubsampleGenerator(Fp31VecMath* const vMath, Iterator* const iterator, int subsampleFactor);
+	~SubsampleGenerator();
+
+	// Builds the lattice for a block of blockSizeWidth x blockSizeHeight samples, see SamplePointGenerator::GenerateSamplePoints.
+	// The start position must be that of the block's first subsample and the delta must be the lattice spacing.
+	int BuildLattice(SamplePointGenerator* samplePointGenerator, const int64_t startX[2], const int64_t startY[2], int positionExponent,
+		const int64_t latticeDelta[2], int latticeDeltaExponent, int blockSizeWidth, int blockSizeHeight);
+
+	// samplePositions holds an x, y pair for each sample. The results are written sample by sample, then row by row, subsampleFactor^2 values per sample.
+	// If escapeVelocities is null, escape velocities are not calculated.
+	void Generate(const int* samplePositions, int sampleCount, uint16_t* counts, uint16_t* escapeVelocities);
+};
@@ -1,6 +1,8 @@
 #include "pch.h"
 #include "Fp31VecMath.h"
 
+#include <cmath>
+
 
 #pragma region Constructor / Destructor
 
@@ -25,6 +27,9 @@ Fp31VecMath::Fp31VecMath(int limbCount, int bitsBeforeBp, int targetExponent)
 	_shiftAmount = _bitsBeforeBp;
 	_inverseShiftAmount = EFFECTIVE_BITS_PER_LIMB - _shiftAmount;
 
+	_mslScale = std::ldexp(1.0, EFFECTIVE_BITS_PER_LIMB * (LimbCount - 1) + _targetExponent);
+	_nextLimbScale = std::ldexp(1.0, EFFECTIVE_BITS_PER_LIMB * (LimbCount - 2) + _targetExponent);
+
 	//(_squareSourceStartIndex, _skipSquareResultLow) = CalculateSqrOpParams(LimbCount);
 
 	//MathOpCounts = new MathOpCounts();
@@ -136,7 +141,7 @@ void Fp31VecMath::ShiftAndTrim(__m256i* const sourceLimbsLo, __m256i* const sour
 	// pusing 8 bits off the top and taking the two most significant limbs will return the format to 8:56.
 
 	// Check to see if any of these values are larger than the FP Format.
-	//_ = CheckForOverflow(resultLimbs);
+	CheckForOverflow(sourceLimbsLo, sourceLimbsHi);
 
 	int resultLength = LimbCount;
 	int sourceIndex = LimbCount;
@@ -178,6 +183,23 @@ void Fp31VecMath::ShiftAndTrim(__m256i* const sourceLimbsLo, __m256i* const sour
 		}
 	}
 }
+void Fp31VecMath::CheckForOverflow(__m256i* const sourceLimbsLo, __m256i* const sourceLimbsHi)
+{
+	// The result of a square is always positive, so the top shiftAmount bits of the most significant wide limb,
+	// as well as the bit that will become the result's sign bit, must all be zero.
+	// Each 64-bit lane holds a value < 2^31, so once shifted only the low half of each lane can be non-zero.
+
+	size_t mslPtr = (size_t)LimbCount * 2 - 1;
+
+	__m256i topBitsLo = _mm256_srli_epi64(sourceLimbsLo[mslPtr], _inverseShiftAmount - 1);
+	__m256i topBitsHi = _mm256_srli_epi64(sourceLimbsHi[mslPtr], _inverseShiftAmount - 1);
+
+	__m256i low256 = _mm256_permutevar8x32_epi32(topBitsLo, SHUFFLE_PACK_LOW_VEC);
+	__m256i high256 = _mm256_permutevar8x32_epi32(topBitsHi, SHUFFLE_PACK_HIGH_VEC);
+
+	_overflowFlags = _mm256_or_si256(_overflowFlags, _mm256_or_si256(high256, low256));
+}
+
 #pragma endregion
 
 #pragma region Add and Subtract
@@ -194,6 +216,10 @@ void Fp31VecMath::ShiftAndTrim(__m256i* const sourceLimbsLo, __m256i* const sour
  
 void Fp31VecMath::Add(__m256i* const left, __m256i* const right, __m256i* const result)
 {
+	// The result may be one of the operands, save the msls used to detect overflow.
+	__m256i leftMsl = left[(size_t)LimbCount - 1];
+	__m256i rightMsl = right[(size_t)LimbCount - 1];
+
 	_carryVectors = _mm256_xor_si256(_carryVectors, _carryVectors);
 
 	 for (int limbPtr = 0; limbPtr < LimbCount; limbPtr++)
@@ -205,6 +231,11 @@ void Fp31VecMath::Add(__m256i* const left, __m256i* const right, __m256i* const
 		 result[limbPtr] = _mm256_and_si256(newValuesVector, HIGH33_MASK_VEC);			// The low 31 bits of the sum is the result.
 		 _carryVectors = _mm256_srli_epi32(newValuesVector, EFFECTIVE_BITS_PER_LIMB);	// The high 31 bits of sum becomes the new carry.
 	 }
+
+	 // If both operands have the same sign and the sign of the result differs, the sum has overflowed.
+	 __m256i resultMsl = result[(size_t)LimbCount - 1];
+	 __m256i signChanges = _mm256_and_si256(_mm256_xor_si256(leftMsl, resultMsl), _mm256_xor_si256(rightMsl, resultMsl));
+	 _overflowFlags = _mm256_or_si256(_overflowFlags, _mm256_and_si256(signChanges, TEST_BIT_30_VEC));
 }
 
 #pragma endregion
@@ -217,7 +248,7 @@ void Fp31VecMath::Negate(__m256i* const source, __m256i* const result)
 
 	for (int limbPtr = 0; limbPtr < LimbCount; limbPtr++)
 	{
-		__m256i notVector = _mm256_xor_si256(source[limbPtr], ALL_BITS_SET_VEC);
+		__m256i notVector = _mm256_xor_si256(source[limbPtr], XOR_BITS_VEC);
 		__m256i newValuesVector = _mm256_add_epi32(notVector, _carryVectors);
 		//MathOpCounts.NumberOfAdditions += 2;
 
@@ -252,7 +283,7 @@ void Fp31VecMath::ConvertFrom2C(__m256i* const source, __m256i* const resultLo,
 
 		for (int limbPtr = 0; limbPtr < LimbCount; limbPtr++)
 		{
-			__m256i notVector = _mm256_xor_si256(source[limbPtr], ALL_BITS_SET_VEC);
+			__m256i notVector = _mm256_xor_si256(source[limbPtr], XOR_BITS_VEC);
 			__m256i newValuesVector = _mm256_add_epi32(notVector, _carryVectors);
 			//MathOpCounts.NumberOfAdditions += 2;
 
@@ -298,6 +329,62 @@ void Fp31VecMath::IsGreaterOrEqThan(__m256i* const source, __m256i right, __m256
 }
 
 
+#pragma endregion
+
+#pragma region Conversion
+
+void Fp31VecMath::ConvertToDoubles(__m256i* const source, __m256d& resultLo, __m256d& resultHi)
+{
+	// Only the two most significant limbs are used, the result is within 2^-(62 - BitsBeforeBp) of the value.
+	// The sign bit (bit 30) of the MSL is extended, the lower limbs hold unsigned values.
+
+	__m256i msl = source[(size_t)LimbCount - 1];
+	msl = _mm256_srai_epi32(_mm256_slli_epi32(msl, 1), 1);
+
+	resultLo = _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(msl)), _mm256_set1_pd(_mslScale));
+	resultHi = _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(msl, 1)), _mm256_set1_pd(_mslScale));
+
+	if (LimbCount > 1)
+	{
+		__m256i nextLimb = source[(size_t)LimbCount - 2];
+
+		resultLo = _mm256_add_pd(resultLo, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(nextLimb)), _mm256_set1_pd(_nextLimbScale)));
+		resultHi = _mm256_add_pd(resultHi, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(nextLimb, 1)), _mm256_set1_pd(_nextLimbScale)));
+	}
+}
+
+double Fp31VecMath::GetMslScale()
+{
+	return _mslScale;
+}
+
+#pragma endregion
+
+#pragma region Overflow Detection
+
+__m256i Fp31VecMath::GetOverflowFlags()
+{
+	// Each lane is non-zero if a Square or Add has overflowed for that lane since the flags were last cleared.
+	return _overflowFlags;
+}
+
+void Fp31VecMath::ClearOverflowFlags()
+{
+	_overflowFlags = _mm256_xor_si256(_overflowFlags, _overflowFlags);
+}
+
+bool Fp31VecMath::CheckReservedBitIsClear(__m256i* const source)
+{
+	__m256i reservedBits = _mm256_set1_epi32(0);
+
+	for (int limbPtr = 0; limbPtr < LimbCount; limbPtr++)
+	{
+		reservedBits = _mm256_or_si256(reservedBits, _mm256_and_si256(source[limbPtr], RESERVED_BIT_MASK_VEC));
+	}
+
+	return _mm256_testz_si256(reservedBits, reservedBits) != 0;
+}
+
 #pragma endregion
 
 #pragma region Value Support
@@ -23,6 +23,9 @@ class Fp31VecMath
 	const __m256i ZERO_VEC = _mm256_set1_epi32(0);
 	const __m256i ALL_BITS_SET_VEC = _mm256_set1_epi32(-1);
 
+	// Only the low 31 bits are inverted when negating, otherwise bit 31 produces a carry into every limb.
+	const __m256i XOR_BITS_VEC = _mm256_set1_epi32(LOW31_BITS_SET);
+
 	//const __m256i SHUFFLE_EXP_LOW_VEC = _mm256_set_epi32(0u, 0u, 1u, 1u, 2u, 2u, 3u, 3u);
 	//const __m256i SHUFFLE_EXP_HIGH_VEC = _mm256_set_epi32(4u, 4u, 5u, 5u, 6u, 6u, 7u, 7u);
 
@@ -54,6 +57,12 @@ class Fp31VecMath
 
 	__m256i _signBitVecs = _mm256_set1_epi32(0);
 
+	__m256i _overflowFlags = _mm256_set1_epi32(0);
+
+	// The value of one unit in the most significant limb and in the limb below it.
+	double _mslScale;
+	double _nextLimbScale;
+
 	int _shiftAmount;
 	int _inverseShiftAmount;
 
@@ -79,6 +88,13 @@ public:
 
 	void IsGreaterOrEqThan(__m256i* const source, __m256i right, __m256i& escapedFlagsVec);
 
+	void ConvertToDoubles(__m256i* const source, __m256d& resultLo, __m256d& resultHi);
+	double GetMslScale();
+
+	__m256i GetOverflowFlags();
+	void ClearOverflowFlags();
+	bool CheckReservedBitIsClear(__m256i* const source);
+
 	__m256i* CreateLimbSet();
 	__m256i* CreateWideLimbSet();
 
@@ -90,6 +106,7 @@ private:
 	void SquareInternal(__m256i* const source, __m256i* const result);
 	void SumThePartials(__m256i* const source, __m256i* const result);
 	void ShiftAndTrim(__m256i* const sourceLimbsLo, __m256i* const sourceLimbsHi, __m256i* const resultLimbs);
+	void CheckForOverflow(__m256i* const sourceLimbsLo, __m256i* const sourceLimbsHi);
 
 	void Negate(__m256i* const source, __m256i* const result);
 	void ConvertFrom2C(__m256i* const source, __m256i* const resultLo, __m256i* const resultHi);
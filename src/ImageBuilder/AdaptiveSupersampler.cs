@@ -0,0 +1,226 @@
+﻿using MSS.Common;
+using MSS.Types;
+using MSS.Types.MSet;
+using System;
+using System.Collections.Generic;
+using System.Linq;
+
+namespace ImageBuilder
+{
+	/// <summary>
+	/// Anti-aliases a block by supersampling only the samples that lie on an edge: those whose count, plus escape velocity if used,
+	/// differs from that of one of its four neighbors by more than the Threshold. The neighbors of the samples along the block's boundary
+	/// are taken from the adjacent blocks, when these are available. Each edge sample is replaced by the average color of a
+	/// SubsampleFactor x SubsampleFactor grid of subsamples centered on the sample.
+	/// </summary>
+	public class AdaptiveSupersampler
+	{
+		private const double VALUE_FACTOR = 10000;
+
+		private readonly ISubsampleGenerator _subsampleGenerator;
+
+		#region Constructor
+
+		public AdaptiveSupersampler(ISubsampleGenerator subsampleGenerator, int subsampleFactor = 4, double threshold = 1.0, double subsampleBudget = 3.0)
+		{
+			_subsampleGenerator = subsampleGenerator;
+
+			SubsampleFactor = subsampleFactor;
+			Threshold = threshold;
+			SubsampleBudget = subsampleBudget;
+		}
+
+		#endregion
+
+		#region Public Properties
+
+		public int SubsampleFactor { get; init; }
+
+		public double Threshold { get; init; }
+
+		/// <summary>
+		/// The maximum number of subsamples, as a multiple of the number of samples processed so far. If a block has more edge samples
+		/// than the remaining budget allows, those with the largest difference from their neighbors are supersampled.
+		/// </summary>
+		public double SubsampleBudget { get; init; }
+
+		public long SamplesProcessed { get; private set; }
+		public long SamplesSupersampled { get; private set; }
+		public long SubsamplesGenerated { get; private set; }
+
+		/// <summary>
+		/// The total number of samples generated, including the subsamples, per sample processed.
+		/// </summary>
+		public double CostFactor => SamplesProcessed == 0 ? 1 : 1 + SubsamplesGenerated / (double)SamplesProcessed;
+
+		#endregion
+
+		#region Public Methods
+
+		public void ResetCounts()
+		{
+			SamplesProcessed = 0;
+			SamplesSupersampled = 0;
+			SubsamplesGenerated = 0;
+		}
+
+		/// <summary>
+		/// Returns the BGRA values for each edge sample of the block, keyed by the sample's index into the block's counts.
+		/// </summary>
+		/// <param name="neighbors">If not null, the samples along the block's boundary are also compared with those of the adjacent blocks.</param>
+		public IDictionary<int, byte[]>? Supersample(MapSectionRequest mapSectionRequest, MapSectionVectors mapSectionVectors, ColorMap colorMap, BlockNeighbors? neighbors = null)
+		{
+			var blockSize = mapSectionVectors.BlockSize;
+			SamplesProcessed += mapSectionVectors.ValueCount;
+
+			var edgeSamples = GetEdgeSamples(mapSectionVectors, neighbors, colorMap.UseEscapeVelocities);
+
+			if (edgeSamples.Count == 0)
+			{
+				return null;
+			}
+
+			var subsamplesPerSample = SubsampleFactor * SubsampleFactor;
+			var budgetRemaining = (long)(SubsampleBudget * SamplesProcessed) - SubsamplesGenerated;
+			var samplesAllowed = (int)Math.Min(edgeSamples.Count, Math.Max(0, budgetRemaining / subsamplesPerSample));
+
+			if (samplesAllowed == 0)
+			{
+				return null;
+			}
+
+			var samplePositions = edgeSamples
+				.OrderByDescending(x => x.difference)
+				.Take(samplesAllowed)
+				.Select(x => new PointInt(x.index % blockSize.Width, x.index / blockSize.Width))
+				.ToList();
+
+			var counts = new ushort[samplePositions.Count * subsamplesPerSample];
+			var escapeVelocities = new ushort[counts.Length];
+
+			if (!_subsampleGenerator.GenerateSubsamples(mapSectionRequest, SubsampleFactor, samplePositions, counts, escapeVelocities))
+			{
+				return null;
+			}
+
+			SamplesSupersampled += samplePositions.Count;
+			SubsamplesGenerated += counts.Length;
+
+			var result = new Dictionary<int, byte[]>(samplePositions.Count);
+			var cComps = new byte[4];
+			var dest = new Span<byte>(cComps);
+
+			for (var i = 0; i < samplePositions.Count; i++)
+			{
+				int blue = 0, green = 0, red = 0;
+
+				for (var j = i * subsamplesPerSample; j < (i + 1) * subsamplesPerSample; j++)
+				{
+					var escapeVelocity = colorMap.UseEscapeVelocities ? escapeVelocities[j] / VALUE_FACTOR : 0;
+					colorMap.PlaceColor(counts[j], escapeVelocity, dest);
+
+					blue += cComps[0];
+					green += cComps[1];
+					red += cComps[2];
+				}
+
+				var samplePosition = samplePositions[i];
+				var color = new byte[] { (byte)(blue / subsamplesPerSample), (byte)(green / subsamplesPerSample), (byte)(red / subsamplesPerSample), 255 };
+
+				result.Add(samplePosition.Y * blockSize.Width + samplePosition.X, color);
+			}
+
+			return result;
+		}
+
+		public override string ToString()
+		{
+			return $"Supersampled {SamplesSupersampled} of {SamplesProcessed} samples, generating {SubsamplesGenerated} subsamples. Cost factor: {CostFactor:F2}.";
+		}
+
+		#endregion
+
+		#region Private Methods
+
+		private List<(int index, double difference)> GetEdgeSamples(MapSectionVectors mapSectionVectors, BlockNeighbors? neighbors, bool useEscapeVelocities)
+		{
+			var result = new List<(int index, double difference)>();
+
+			var width = mapSectionVectors.BlockSize.Width;
+			var height = mapSectionVectors.BlockSize.Height;
+
+			var values = new double[mapSectionVectors.ValueCount];
+
+			for (var i = 0; i < values.Length; i++)
+			{
+				values[i] = GetValue(mapSectionVectors, i, useEscapeVelocities);
+			}
+
+			var left = neighbors?.Left;
+			var right = neighbors?.Right;
+			var bottom = neighbors?.Bottom;
+			var top = neighbors?.Top;
+
+			for (var y = 0; y < height; y++)
+			{
+				for (var x = 0; x < width; x++)
+				{
+					var index = y * width + x;
+					var value = values[index];
+					var difference = 0.0;
+
+					if (x > 0)
+					{
+						difference = Math.Max(difference, Math.Abs(value - values[index - 1]));
+					}
+					else if (left != null)
+					{
+						difference = Math.Max(difference, Math.Abs(value - GetValue(left, index + width - 1, useEscapeVelocities)));
+					}
+
+					if (x < width - 1)
+					{
+						difference = Math.Max(difference, Math.Abs(value - values[index + 1]));
+					}
+					else if (right != null)
+					{
+						difference = Math.Max(difference, Math.Abs(value - GetValue(right, index - width + 1, useEscapeVelocities)));
+					}
+
+					if (y > 0)
+					{
+						difference = Math.Max(difference, Math.Abs(value - values[index - width]));
+					}
+					else if (bottom != null)
+					{
+						difference = Math.Max(difference, Math.Abs(value - GetValue(bottom, neighbors!.BottomLinePtr * width + x, useEscapeVelocities)));
+					}
+
+					if (y < height - 1)
+					{
+						difference = Math.Max(difference, Math.Abs(value - values[index + width]));
+					}
+					else if (top != null)
+					{
+						difference = Math.Max(difference, Math.Abs(value - GetValue(top, neighbors!.TopLinePtr * width + x, useEscapeVelocities)));
+					}
+
+					if (difference > Threshold)
+					{
+						result.Add((index, difference));
+					}
+				}
+			}
+
+			return result;
+		}
+
+		private double GetValue(MapSectionVectors mapSectionVectors, int index, bool useEscapeVelocities)
+		{
+			var result = mapSectionVectors.Counts[index] + (useEscapeVelocities ? mapSectionVectors.EscapeVelocities[index] / VALUE_FACTOR : 0);
+			return result;
+		}
+
+		#endregion
+	}
+}
@@ -18,6 +18,7 @@ namespace ImageBuilder
 
 		private readonly IMapLoaderManager _mapLoaderManager;
 		private readonly MapSectionBuilder _mapSectionBuilder;
+		private readonly IBlockColorizer? _blockColorizer;
 
 		private int? _currentJobNumber;
 		private IDictionary<int, MapSection?>? _currentResponses;
@@ -27,10 +28,12 @@ namespace ImageBuilder
 
 		#region Constructor
 
-		public BitmapBuilder(IMapLoaderManager mapLoaderManager)
+		/// <param name="blockColorizer">If not null, each block is colored as a whole using a ColorBandTable built from the ColorMap, instead of one sample at a time.</param>
+		public BitmapBuilder(IMapLoaderManager mapLoaderManager, IBlockColorizer? blockColorizer = null)
 		{
 			_mapLoaderManager = mapLoaderManager;
 			_mapSectionBuilder = new MapSectionBuilder();
+			_blockColorizer = blockColorizer;
 
 			_currentJobNumber = null;
 			_currentResponses = null;
@@ -62,6 +65,10 @@ namespace ImageBuilder
 
 			var result = new byte[imageSize.NumberOfCells * 4];
 
+			// The table reflects the ColorMap's settings, these do not change during the build.
+			var colorBandTable = _blockColorizer != null ? colorMap.GetColorBandTable() : null;
+			byte[]?[]? blockPixels = null;
+
 			try
 			{
 				//var numberOfWholeBlocks = RMapHelper.GetMapExtentInBlocks(imageSize, canvasControlOffset, blockSize);
@@ -75,6 +82,12 @@ namespace ImageBuilder
 
 				var segmentLengths = BitmapHelper.GetSegmentLengths(extentInBlocks.Width, sizeOfFirstBlock.Width, sizeOfLastBlock.Width, blockSize.Width);
 
+				if (colorBandTable != null)
+				{
+					// One buffer for each block in a row, reused for each row.
+					blockPixels = new byte[]?[extentInBlocks.Width];
+				}
+
 				var destPixPtr = 0;
 
 				for (var blockPtrY = h - 1; blockPtrY >= 0 && !ct.IsCancellationRequested; blockPtrY--)
@@ -103,7 +116,12 @@ namespace ImageBuilder
 
 					var (startingLinePtr, numberOfLines, lineIncrement) = BitmapHelper.GetNumberOfLines(blockPtrY, invert, extentInBlocks.Height, sizeOfFirstBlock.Height, sizeOfLastBlock.Height, blockSize.Height);
 
-					destPixPtr = BuildARow(result, destPixPtr, blockPtrY, invert, startingLinePtr, numberOfLines, lineIncrement, extentInBlocks.Width, blocksForThisRow, segmentLengths, colorMap, blockSize.Width, ct);
+					if (blockPixels != null)
+					{
+						ColorizeBlocks(blocksForThisRow, blockPixels, colorBandTable!);
+					}
+
+					destPixPtr = BuildARow(result, destPixPtr, blockPtrY, invert, startingLinePtr, numberOfLines, lineIncrement, extentInBlocks.Width, blocksForThisRow, blockPixels, segmentLengths, colorMap, blockSize.Width, ct);
 
 					var percentageCompleted = (h - blockPtrY) / (double)h;
 					statusCallBack?.Invoke(100 * percentageCompleted);
@@ -126,7 +144,7 @@ namespace ImageBuilder
 		#region Private Methods
 
 		private int BuildARow(byte[] result, int destPixPtr, int blockPtrY, bool isInverted, int startingPtr, int numberOfLines, int increment, int extentInBlocksWidth,
-			IDictionary<int, MapSection?> blocksForThisRow, ValueTuple<int, int>[] segmentLengths, ColorMap colorMap, int blockSizeWidth, CancellationToken ct)
+			IDictionary<int, MapSection?> blocksForThisRow, byte[]?[]? blockPixels, ValueTuple<int, int>[] segmentLengths, ColorMap colorMap, int blockSizeWidth, CancellationToken ct)
 		{
 			var linePtr = startingPtr;
 			for (var cntr = 0; cntr < numberOfLines; cntr++)
@@ -147,7 +165,16 @@ namespace ImageBuilder
 
 					try
 					{
-						BitmapHelper.FillImageLineSegment(result, destPixPtr, countsForThisLine, escVelsForThisLine, lineLength, samplesToSkip, colorMap);
+						var pixelsForThisBlock = blockPixels?[blockPtrX];
+
+						if (pixelsForThisBlock != null && countsForThisLine != null)
+						{
+							Array.Copy(pixelsForThisBlock, (linePtr * blockSizeWidth + samplesToSkip) * 4, result, destPixPtr * 4, lineLength * 4);
+						}
+						else
+						{
+							BitmapHelper.FillImageLineSegment(result, destPixPtr, countsForThisLine, escVelsForThisLine, lineLength, samplesToSkip, colorMap);
+						}
 
 						destPixPtr += lineLength;
 					}
@@ -167,6 +194,32 @@ namespace ImageBuilder
 			return destPixPtr;
 		}
 
+		// Colors each block of the row, a block that has not been received is left uncolored.
+		private void ColorizeBlocks(IDictionary<int, MapSection?> blocksForThisRow, byte[]?[] blockPixels, ColorBandTable colorBandTable)
+		{
+			for (var blockPtrX = 0; blockPtrX < blockPixels.Length; blockPtrX++)
+			{
+				var mapSectionVectors = blocksForThisRow.TryGetValue(blockPtrX, out var mapSection) ? mapSection?.MapSectionVectors : null;
+
+				if (mapSectionVectors == null)
+				{
+					// Makes sure that the colors of the block used for this position in the previous row are not used.
+					blockPixels[blockPtrX] = null;
+					continue;
+				}
+
+				var pixels = blockPixels[blockPtrX];
+
+				if (pixels == null || pixels.Length < mapSectionVectors.ValueCount * 4)
+				{
+					pixels = new byte[mapSectionVectors.ValueCount * 4];
+				}
+
+				_blockColorizer!.ColorizeBlock(colorBandTable, mapSectionVectors.Counts, mapSectionVectors.EscapeVelocities, mapSectionVectors.ValueCount, pixels);
+				blockPixels[blockPtrX] = pixels;
+			}
+		}
+
 		private async Task<IDictionary<int, MapSection?>> GetAllBlocksForRowAsync(ObjectId jobId, OwnerType ownerType, Subdivision subdivision, ObjectId originalSourceSubdivisionId, BigVector mapBlockOffset, int rowPtr, int blockIndexY, int stride, MapCalcSettings mapCalcSettings, int precision)
 		{
 			var jobType = JobType.SizeEditorPreview;
@@ -1,6 +1,7 @@
 ﻿using MSS.Common;
 using PngImageLib;
 using System;
+using System.Collections.Generic;
 using System.Diagnostics;
 using System.Runtime.CompilerServices;
 
@@ -62,7 +63,8 @@ namespace ImageBuilder
 		}
 
 		[MethodImpl(MethodImplOptions.AggressiveInlining)]
-		public static void FillPngImageLineSegment(ImageLine iLine, int pixPtr, ushort[]? counts, ushort[]? escapeVelocities, int lineLength, int samplesToSkip, ColorMap colorMap)
+		public static void FillPngImageLineSegment(ImageLine iLine, int pixPtr, ushort[]? counts, ushort[]? escapeVelocities, int lineLength, int samplesToSkip, ColorMap colorMap,
+			IDictionary<int, byte[]>? supersampledColors = null, int lineStartIndex = 0)
 		{
 			if (counts == null || escapeVelocities == null)
 			{
@@ -92,6 +94,13 @@ namespace ImageBuilder
 					Debug.WriteLine($"The Escape Velocity is greater that 1.0");
 				}
 
+				// Samples that have been supersampled are given the average color of their subsamples, keyed by the sample's index into the block.
+				if (supersampledColors != null && supersampledColors.TryGetValue(lineStartIndex + xPtr + samplesToSkip, out var supersampledColor))
+				{
+					ImageLineHelper.SetPixel(iLine, pixPtr++, supersampledColor[2], supersampledColor[1], supersampledColor[0]);
+					continue;
+				}
+
 				colorMap.PlaceColor(countVal, escapeVelocity, dest);
 
 				ImageLineHelper.SetPixel(iLine, pixPtr++, cComps[2], cComps[1], cComps[0]);
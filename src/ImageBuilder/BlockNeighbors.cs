@@ -0,0 +1,28 @@
+﻿using MSS.Types;
+
+namespace ImageBuilder
+{
+	/// <summary>
+	/// The blocks adjacent to a block, used to find the edges that lie along the block's boundary.
+	/// Top and Bottom refer to the orientation of the block's counts: the Bottom block is adjacent to the first row of counts, the Top block to the last.
+	/// </summary>
+	public class BlockNeighbors
+	{
+		// The neighbor's column that borders the block is its last for the Left block and its first for the Right block.
+		public MapSectionVectors? Left { get; init; }
+		public MapSectionVectors? Right { get; init; }
+
+		public MapSectionVectors? Bottom { get; init; }
+		public MapSectionVectors? Top { get; init; }
+
+		/// <summary>
+		/// The row of the Bottom block's counts that borders the block. The rows of an inverted block are in the opposite order.
+		/// </summary>
+		public int BottomLinePtr { get; init; }
+
+		/// <summary>
+		/// The row of the Top block's counts that borders the block.
+		/// </summary>
+		public int TopLinePtr { get; init; }
+	}
+}
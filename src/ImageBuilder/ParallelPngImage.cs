@@ -0,0 +1,424 @@
+﻿using PngImageLib;
+using PngImageLib.Zlib;
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.IO.Compression;
+using System.Threading.Tasks;
+
+namespace ImageBuilder
+{
+	/// <summary>
+	/// Writes an RGB PNG a strip of lines at a time. Each strip is filtered and deflated on the thread pool, independently of the other strips,
+	/// and the compressed strips are joined using the byte boundary left by a sync flush. The strips are written in order, as each completes,
+	/// at most MaxStripsInFlight strips are held in memory.
+	/// </summary>
+	public sealed class ParallelPngImage : IDisposable
+	{
+		private const int BYTES_PER_PIXEL = 3;
+
+		private static readonly byte[] PNG_SIGNATURE = new byte[] { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+		// Deflate with a 32K window, default compression.
+		private static readonly byte[] ZLIB_HEADER = new byte[] { 0x78, 0x9C };
+
+		private const int ADLER_BASE = 65521;
+
+		private readonly Stream _outputStream;
+		private readonly ImageInfo _imageInfo;
+		private readonly int _rowLength;
+
+		private readonly Queue<Task<EncodedStrip>> _pendingStrips;
+
+		private byte[] _currentStrip;
+		private byte[]? _previousRow;
+		private int _rowsInCurrentStrip;
+		private int _rowsSubmitted;
+
+		private uint _adler;
+		private bool _zlibHeaderWritten;
+		private bool _weOwnTheStream;
+		private bool _isClosed;
+
+		#region Constructor
+
+		public ParallelPngImage(string path, int width, int height, int stripHeight = 128, int maxStripsInFlight = 0) 
+			: this(File.Open(path, FileMode.Create, FileAccess.Write, FileShare.Read), path, width, height, stripHeight, maxStripsInFlight)
+		{
+			_weOwnTheStream = true;
+		}
+
+		/// <summary>
+		/// The outputStream is closed by End or Abort.
+		/// </summary>
+		/// <param name="maxStripsInFlight">If zero, the number of processors plus one is used.</param>
+		public ParallelPngImage(Stream outputStream, string path, int width, int height, int stripHeight = 128, int maxStripsInFlight = 0)
+		{
+			if (stripHeight < 1)
+			{
+				throw new ArgumentOutOfRangeException(nameof(stripHeight), "The StripHeight must be at least one line.");
+			}
+
+			_outputStream = outputStream;
+			Path = path;
+
+			_imageInfo = new ImageInfo(width, height, 8, false); // 8 bits per channel, no alpha
+			ImageLine = new ImageLine(_imageInfo);
+			_rowLength = width * BYTES_PER_PIXEL;
+
+			StripHeight = stripHeight;
+			MaxStripsInFlight = maxStripsInFlight > 0 ? maxStripsInFlight : Environment.ProcessorCount + 1;
+
+			_pendingStrips = new Queue<Task<EncodedStrip>>();
+			_currentStrip = new byte[StripHeight * _rowLength];
+			_previousRow = null;
+			_rowsInCurrentStrip = 0;
+			_rowsSubmitted = 0;
+
+			_adler = 1;
+			_zlibHeaderWritten = false;
+			_weOwnTheStream = false;
+			_isClosed = false;
+
+			WriteSignatureAndHeader();
+		}
+
+		#endregion
+
+		#region Public Properties
+
+		public string Path { get; }
+		public ImageLine ImageLine { get; }
+
+		public int StripHeight { get; }
+		public int MaxStripsInFlight { get; }
+
+		public CompressionLevel CompressionLevel { get; init; } = CompressionLevel.Optimal;
+
+		public long CompressedBytesWritten { get; private set; }
+
+		#endregion
+
+		#region Public Methods
+
+		public void WriteLine(ImageLine iline)
+		{
+			if (_rowsSubmitted + _rowsInCurrentStrip >= _imageInfo.Rows)
+			{
+				throw new InvalidOperationException("All rows have already been written.");
+			}
+
+			var scanline = iline.Scanline;
+			var offset = _rowsInCurrentStrip * _rowLength;
+
+			for (var i = 0; i < _rowLength; i++)
+			{
+				_currentStrip[offset + i] = (byte)scanline[i];
+			}
+
+			_rowsInCurrentStrip++;
+
+			if (_rowsInCurrentStrip == StripHeight || _rowsSubmitted + _rowsInCurrentStrip == _imageInfo.Rows)
+			{
+				SubmitCurrentStrip();
+			}
+		}
+
+		public void End()
+		{
+			if (_rowsSubmitted != _imageInfo.Rows)
+			{
+				throw new InvalidOperationException("All rows have not been written.");
+			}
+
+			while (_pendingStrips.Count > 0)
+			{
+				WriteStrip(_pendingStrips.Dequeue().Result);
+			}
+
+			WriteChunk("IEND", Array.Empty<byte>(), 0);
+			Close();
+		}
+
+		public void Abort()
+		{
+			try
+			{
+				// Let the strips already submitted finish, their results are discarded.
+				Task.WaitAll(_pendingStrips.ToArray());
+			}
+			catch (AggregateException)
+			{ }
+
+			_pendingStrips.Clear();
+			Close();
+		}
+
+		#endregion
+
+		#region Private Methods
+
+		private void SubmitCurrentStrip()
+		{
+			var strip = _currentStrip;
+			var rowCount = _rowsInCurrentStrip;
+			var previousRow = _previousRow;
+			var isLast = _rowsSubmitted + rowCount == _imageInfo.Rows;
+
+			_pendingStrips.Enqueue(Task.Run(() => EncodeStrip(strip, rowCount, previousRow, _rowLength, isLast, CompressionLevel)));
+
+			// The first line of the next strip is filtered using the last line of this strip.
+			_previousRow = new byte[_rowLength];
+			Array.Copy(strip, (rowCount - 1) * _rowLength, _previousRow, 0, _rowLength);
+
+			_rowsSubmitted += rowCount;
+			_rowsInCurrentStrip = 0;
+			_currentStrip = new byte[StripHeight * _rowLength];
+
+			// Bound the memory in use by waiting for the oldest strip, strips complete roughly in order.
+			while (_pendingStrips.Count >= MaxStripsInFlight)
+			{
+				WriteStrip(_pendingStrips.Dequeue().Result);
+			}
+		}
+
+		private void WriteStrip(EncodedStrip encodedStrip)
+		{
+			var prefixLength = _zlibHeaderWritten ? 0 : ZLIB_HEADER.Length;
+			var suffixLength = encodedStrip.IsLast ? 4 : 0;
+
+			var data = new byte[prefixLength + encodedStrip.Length + suffixLength];
+
+			if (!_zlibHeaderWritten)
+			{
+				Array.Copy(ZLIB_HEADER, data, prefixLength);
+				_zlibHeaderWritten = true;
+			}
+
+			Array.Copy(encodedStrip.Data, 0, data, prefixLength, encodedStrip.Length);
+
+			_adler = CombineAdler32(_adler, encodedStrip.Adler32, encodedStrip.UncompressedLength);
+
+			if (encodedStrip.IsLast)
+			{
+				WriteInt(data, data.Length - 4, _adler);
+			}
+
+			WriteChunk("IDAT", data, data.Length);
+			CompressedBytesWritten += data.Length;
+		}
+
+		private void WriteSignatureAndHeader()
+		{
+			_outputStream.Write(PNG_SIGNATURE, 0, PNG_SIGNATURE.Length);
+
+			var ihdr = new byte[13];
+			WriteInt(ihdr, 0, (uint)_imageInfo.Cols);
+			WriteInt(ihdr, 4, (uint)_imageInfo.Rows);
+			ihdr[8] = 8;    // Bit depth
+			ihdr[9] = 2;    // Color type: RGB
+			ihdr[10] = 0;   // Compression: deflate
+			ihdr[11] = 0;   // Filter method: adaptive
+			ihdr[12] = 0;   // No interlace
+
+			WriteChunk("IHDR", ihdr, ihdr.Length);
+		}
+
+		private void WriteChunk(string chunkType, byte[] data, int length)
+		{
+			var header = new byte[8];
+			WriteInt(header, 0, (uint)length);
+
+			for (var i = 0; i < 4; i++)
+			{
+				header[4 + i] = (byte)chunkType[i];
+			}
+
+			var crc = new CRC32();
+			crc.Update(header, 4, 4);
+			crc.Update(data, 0, length);
+
+			var trailer = new byte[4];
+			WriteInt(trailer, 0, crc.GetValue());
+
+			_outputStream.Write(header, 0, header.Length);
+			_outputStream.Write(data, 0, length);
+			_outputStream.Write(trailer, 0, trailer.Length);
+		}
+
+		private void Close()
+		{
+			if (_isClosed)
+			{
+				return;
+			}
+
+			_isClosed = true;
+			_outputStream.Close();
+		}
+
+		private static void WriteInt(byte[] buffer, int offset, uint value)
+		{
+			buffer[offset] = (byte)(value >> 24);
+			buffer[offset + 1] = (byte)(value >> 16);
+			buffer[offset + 2] = (byte)(value >> 8);
+			buffer[offset + 3] = (byte)value;
+		}
+
+		// Returns the Adler-32 checksum of two sequences, given the checksum of each and the length of the second.
+		private static uint CombineAdler32(uint adler1, uint adler2, long length2)
+		{
+			var remainder = (uint)(length2 % ADLER_BASE);
+
+			var sum1 = adler1 & 0xFFFF;
+			var sum2 = (uint)((ulong)remainder * sum1 % ADLER_BASE);
+
+			sum1 += (adler2 & 0xFFFF) + ADLER_BASE - 1;
+			sum2 += (adler1 >> 16) + (adler2 >> 16) + ADLER_BASE - remainder;
+
+			if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+			if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+			if (sum2 >= (ADLER_BASE << 1)) sum2 -= (ADLER_BASE << 1);
+			if (sum2 >= ADLER_BASE) sum2 -= ADLER_BASE;
+
+			return sum1 | (sum2 << 16);
+		}
+
+		#endregion
+
+		#region Strip Encoding
+
+		// Filters each line of the strip and deflates the result. All but the last strip end with a sync flush, which leaves the compressed data on
+		// a byte boundary without marking the end of the stream, so that the next strip's compressed data can follow it.
+		private static EncodedStrip EncodeStrip(byte[] strip, int rowCount, byte[]? previousRow, int rowLength, bool isLast, CompressionLevel compressionLevel)
+		{
+			var filteredLength = rowLength + 1;
+			var filtered = new byte[rowCount * filteredLength];
+			var candidates = new byte[5][];
+
+			for (var i = 0; i < candidates.Length; i++)
+			{
+				candidates[i] = new byte[rowLength];
+			}
+
+			for (var rowPtr = 0; rowPtr < rowCount; rowPtr++)
+			{
+				var row = new ReadOnlySpan<byte>(strip, rowPtr * rowLength, rowLength);
+				var prior = rowPtr > 0
+					? new ReadOnlySpan<byte>(strip, (rowPtr - 1) * rowLength, rowLength)
+					: previousRow != null ? new ReadOnlySpan<byte>(previousRow) : ReadOnlySpan<byte>.Empty;
+
+				var filterType = FilterRow(row, prior, candidates);
+
+				filtered[rowPtr * filteredLength] = (byte)filterType;
+				Array.Copy(candidates[filterType], 0, filtered, rowPtr * filteredLength + 1, rowLength);
+			}
+
+			var adler32 = new Adler32();
+			adler32.Update(filtered);
+
+			var compressed = new MemoryStream(filtered.Length / 2);
+			int length;
+
+			using (var deflateStream = new DeflateStream(compressed, compressionLevel, leaveOpen: true))
+			{
+				deflateStream.Write(filtered, 0, filtered.Length);
+				deflateStream.Flush();
+
+				// The final block, written when the stream is disposed, is only kept for the last strip.
+				length = (int)compressed.Length;
+			}
+
+			if (isLast)
+			{
+				length = (int)compressed.Length;
+			}
+
+			return new EncodedStrip(compressed.GetBuffer(), length, adler32.GetValue(), filtered.Length, isLast);
+		}
+
+		// Applies each of the five PNG filters and returns the type of the one with the smallest sum of absolute differences.
+		private static int FilterRow(ReadOnlySpan<byte> row, ReadOnlySpan<byte> prior, byte[][] candidates)
+		{
+			var hasPrior = !prior.IsEmpty;
+			var sums = new long[5];
+
+			for (var i = 0; i < row.Length; i++)
+			{
+				int left = i >= BYTES_PER_PIXEL ? row[i - BYTES_PER_PIXEL] : 0;
+				int up = hasPrior ? prior[i] : 0;
+				int upLeft = hasPrior && i >= BYTES_PER_PIXEL ? prior[i - BYTES_PER_PIXEL] : 0;
+				int raw = row[i];
+
+				candidates[0][i] = (byte)raw;
+				candidates[1][i] = (byte)(raw - left);
+				candidates[2][i] = (byte)(raw - up);
+				candidates[3][i] = (byte)(raw - ((left + up) >> 1));
+				candidates[4][i] = (byte)(raw - PaethPredictor(left, up, upLeft));
+
+				for (var f = 0; f < 5; f++)
+				{
+					sums[f] += Math.Abs((int)(sbyte)candidates[f][i]);
+				}
+			}
+
+			var result = 0;
+
+			for (var f = 1; f < 5; f++)
+			{
+				if (sums[f] < sums[result])
+				{
+					result = f;
+				}
+			}
+
+			return result;
+		}
+
+		private static int PaethPredictor(int a, int b, int c)
+		{
+			var p = a + b - c;
+			var pa = Math.Abs(p - a);
+			var pb = Math.Abs(p - b);
+			var pc = Math.Abs(p - c);
+
+			return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+		}
+
+		private record EncodedStrip(byte[] Data, int Length, uint Adler32, long UncompressedLength, bool IsLast);
+
+		#endregion
+
+		#region IDisposable Support
+
+		private bool disposedValue; // To detect redundant calls
+
+		private void Dispose(bool disposing)
+		{
+			if (!disposedValue)
+			{
+				if (disposing && _weOwnTheStream && !_isClosed)
+				{
+					// An image that is missing rows cannot be ended, the strips written so far are discarded.
+					if (_rowsSubmitted == _imageInfo.Rows)
+					{
+						End();
+					}
+					else
+					{
+						Abort();
+					}
+				}
+
+				disposedValue = true;
+			}
+		}
+
+		public void Dispose()
+		{
+			Dispose(true);
+		}
+
+		#endregion
+	}
+}
@@ -7,6 +7,7 @@ using System;
 using System.Collections.Generic;
 using System.Diagnostics;
 using System.IO;
+using System.Linq;
 using System.Runtime.CompilerServices;
 using System.Threading;
 using System.Threading.Tasks;
@@ -21,21 +22,23 @@ namespace ImageBuilder
 
 		private readonly IMapLoaderManager _mapLoaderManager;
 		private readonly MapSectionBuilder _mapSectionBuilder;
-
-		private int? _currentJobNumber;
-		private IDictionary<int, MapSection?>? _currentResponses;
+		private readonly AdaptiveSupersampler? _supersampler;
+		private readonly MapSectionVectorProvider? _mapSectionVectorProvider;
 
 		#endregion
 
 		#region Constructor
 
-		public PngBuilder(IMapLoaderManager mapLoaderManager)
+		/// <param name="mapSectionVectorProvider">If not null, the MapSectionVectors of each row of blocks are returned to the pool once the row has been written.</param>
+		/// <param name="lookAheadRows">The number of rows of blocks, beyond the one being written, that are requested ahead of time.</param>
+		public PngBuilder(IMapLoaderManager mapLoaderManager, AdaptiveSupersampler? supersampler = null, MapSectionVectorProvider? mapSectionVectorProvider = null, int lookAheadRows = 2)
 		{
 			_mapLoaderManager = mapLoaderManager;
 			_mapSectionBuilder = new MapSectionBuilder();
+			_supersampler = supersampler;
+			_mapSectionVectorProvider = mapSectionVectorProvider;
 
-			_currentJobNumber = null;
-			_currentResponses = null;
+			LookAheadRows = Math.Max(0, lookAheadRows);
 		}
 
 		#endregion
@@ -44,6 +47,22 @@ namespace ImageBuilder
 
 		public long NumberOfCountValSwitches { get; private set; }
 
+		/// <summary>
+		/// The number of rows of blocks that are generated ahead of the row being written. Only these rows, and the
+		/// strips waiting to be compressed, are held in memory, regardless of the size of the image.
+		/// </summary>
+		public int LookAheadRows { get; }
+
+		/// <summary>
+		/// The largest number of rows of blocks held at one time during the last build.
+		/// </summary>
+		public int PeakRowsInMemory { get; private set; }
+
+		/// <summary>
+		/// If not null, samples along edges are supersampled. Its counts report the subsamples generated by the last build.
+		/// </summary>
+		public AdaptiveSupersampler? Supersampler => _supersampler;
+
 		#endregion
 
 		#region Public Methods
@@ -60,14 +79,27 @@ namespace ImageBuilder
 				UseEscapeVelocities = useEscapeVelocities
 			};
 
-			PngImage? pngImage = null;
+			ParallelPngImage? pngImage = null;
+			_supersampler?.ResetCounts();
+
+			// Set once every row has been written, otherwise the image is abandoned.
+			var allRowsWritten = false;
+
+			// The rows of blocks that have been requested, but not yet written, in the order they will be written.
+			var pendingRows = new Queue<BlockRow>();
+			PeakRowsInMemory = 0;
+
+			// When supersampling, the row written last is kept until this row has been written, its blocks border this row's blocks.
+			BlockRow? previousRow = null;
+			IDictionary<int, MapSection?>? previousBlocks = null;
 
 			try
 			{
 				var stream = File.Open(imageFilePath, FileMode.Create, FileAccess.Write, FileShare.Read);
 
 				var imageSize = mapAreaInfo.CanvasSize.Round();
-				pngImage = new PngImage(stream, imageFilePath, imageSize.Width, imageSize.Height);
+				// Lines are filtered and compressed on other threads, one strip per row of blocks.
+				pngImage = new ParallelPngImage(stream, imageFilePath, imageSize.Width, imageSize.Height, stripHeight: blockSize.Height);
 
 				var extentInBlocks = RMapHelper.GetMapExtentInBlocks(imageSize, canvasControlOffset, blockSize, out var sizeOfFirstBlock, out var sizeOfLastBlock);
 				var h = extentInBlocks.Height;
@@ -76,13 +108,29 @@ namespace ImageBuilder
 
 				var segmentLengths = BitmapHelper.GetSegmentLengths(extentInBlocks.Width, sizeOfFirstBlock.Width, sizeOfLastBlock.Width, blockSize.Width);
 
+				var nextBlockPtrToRequest = h - 1;
+
 				for (var blockPtr = h - 1; blockPtr >= 0 && !ct.IsCancellationRequested; blockPtr--)
 				{
-					var blockIndexY = blockPtr - (h / 2);
-					var blocksForThisRow = await GetAllBlocksForRowAsync(jobId, ownerType, mapAreaInfo.Subdivision, mapAreaInfo.OriginalSourceSubdivisionId, mapBlockOffset, blockPtr, blockIndexY, 
-						extentInBlocks.Width, mapCalcSettings, mapAreaInfo.Precision);
+					// Keep the rows that follow this one being generated while this row is colored and written.
+					for (; nextBlockPtrToRequest >= 0 && nextBlockPtrToRequest >= blockPtr - LookAheadRows; nextBlockPtrToRequest--)
+					{
+						var blockIndexY = nextBlockPtrToRequest - (h / 2);
+						pendingRows.Enqueue(RequestBlockRow(jobId, ownerType, mapAreaInfo.Subdivision, mapAreaInfo.OriginalSourceSubdivisionId, mapBlockOffset, nextBlockPtrToRequest, blockIndexY,
+							extentInBlocks.Width, mapCalcSettings, mapAreaInfo.Precision));
+					}
+
+					PeakRowsInMemory = Math.Max(PeakRowsInMemory, pendingRows.Count + (previousRow == null ? 0 : 1));
 
-					Debug.Assert(blocksForThisRow.Count == extentInBlocks.Width);
+					var blockRow = pendingRows.Dequeue();
+					Debug.Assert(blockRow.BlockPtrY == blockPtr, "The rows of blocks are not being received in order.");
+
+					var blocksForThisRow = await GetAllBlocksForRowAsync(blockRow);
+
+					if (blocksForThisRow.Count != extentInBlocks.Width)
+					{
+						Debug.WriteLine($"WARNING: The PngBuilder received {blocksForThisRow.Count} of the {extentInBlocks.Width} blocks for row {blockPtr}. The missing blocks are left blank.");
+					}
 
 					// An Inverted MapSection should be processed from first to last instead of as we do normally from last to first.
 
@@ -91,15 +139,42 @@ namespace ImageBuilder
 					// But the screen coordinates increase from the top of the display to be bottom.
 					// We set the invert flag to indicate that the contents should be processed from last y to first y to compensate for the Map/Screen direction difference.
 
-					var invert = !blocksForThisRow[0]?.IsInverted ?? false; // Invert the coordinates if the MapSection is not Inverted. Do not invert if the MapSection is inverted.
+					// Every block in a row has the same value of IsInverted, a block that was not received is written as a blank block.
+					var firstBlock = blocksForThisRow.Values.FirstOrDefault(x => x != null);
+					var invert = !firstBlock?.IsInverted ?? false; // Invert the coordinates if the MapSection is not Inverted. Do not invert if the MapSection is inverted.
 
 					var (startingLinePtr, numberOfLines, lineIncrement) = BitmapHelper.GetNumberOfLines(blockPtr, invert, extentInBlocks.Height, sizeOfFirstBlock.Height, sizeOfLastBlock.Height, blockSize.Height);
 
-					BuildARow(pngImage, blockPtr, invert, startingLinePtr, numberOfLines, lineIncrement, extentInBlocks.Width, blocksForThisRow, segmentLengths, colorMap, blockSize.Width, ct);
+					// The row that follows this one holds the blocks with the next lower map coordinates.
+					var nextBlocks = _supersampler != null && pendingRows.Count > 0 ? await GetAllBlocksForRowAsync(pendingRows.Peek()) : null;
+
+					var supersampledColors = GetSupersampledColors(blocksForThisRow, previousBlocks, nextBlocks, blockRow.Requests, extentInBlocks.Width, colorMap);
+
+					BuildARow(pngImage, blockPtr, invert, startingLinePtr, numberOfLines, lineIncrement, extentInBlocks.Width, blocksForThisRow, supersampledColors, segmentLengths, colorMap, blockSize.Width, ct);
+
+					// The lines have been handed to the encoder, the blocks of the previous row are no longer needed.
+					if (previousRow != null)
+					{
+						ReleaseBlockRow(previousRow);
+						previousRow = null;
+						previousBlocks = null;
+					}
+
+					if (_supersampler != null)
+					{
+						previousRow = blockRow;
+						previousBlocks = blocksForThisRow;
+					}
+					else
+					{
+						ReleaseBlockRow(blockRow);
+					}
 
 					var percentageCompleted = (h - blockPtr) / (double)h;
 					statusCallBack(100 * percentageCompleted);
 				}
+
+				allRowsWritten = !ct.IsCancellationRequested;
 			}
 			catch (Exception e)
 			{
@@ -112,7 +187,32 @@ namespace ImageBuilder
 			}
 			finally
 			{
-				if (!ct.IsCancellationRequested)
+				if (previousRow != null)
+				{
+					ReleaseBlockRow(previousRow);
+				}
+
+				while (pendingRows.Count > 0)
+				{
+					var blockRow = pendingRows.Dequeue();
+
+					if (blockRow.JobNumber.HasValue)
+					{
+						_mapLoaderManager.StopJob(blockRow.JobNumber.Value);
+					}
+
+					ReleaseBlockRow(blockRow);
+				}
+
+				Debug.WriteLine($"The PngBuilder held at most {PeakRowsInMemory} rows of blocks.");
+
+				if (_supersampler != null)
+				{
+					Debug.WriteLine($"The PngBuilder {_supersampler}");
+				}
+
+				// If the build was cancelled or faulted, ending the image would throw, hiding the exception being propagated.
+				if (allRowsWritten)
 				{
 					pngImage?.End();
 				}
@@ -129,8 +229,8 @@ namespace ImageBuilder
 
 		#region Private Methods
 
-		private void BuildARow(PngImage pngImage, int blockPtrY, bool isInverted, int startingPtr, int numberOfLines, int increment, int extentInBlocksWidth, 
-			IDictionary<int, MapSection?> blocksForThisRow, ValueTuple<int, int>[] segmentLengths, ColorMap colorMap, int blockSizeWidth, CancellationToken ct)
+		private void BuildARow(ParallelPngImage pngImage, int blockPtrY, bool isInverted, int startingPtr, int numberOfLines, int increment, int extentInBlocksWidth, 
+			IDictionary<int, MapSection?> blocksForThisRow, IDictionary<int, byte[]>?[] supersampledColors, ValueTuple<int, int>[] segmentLengths, ColorMap colorMap, int blockSizeWidth, CancellationToken ct)
 		{
 			var linePtr = startingPtr;
 			for (var cntr = 0; cntr < numberOfLines; cntr++)
@@ -140,10 +240,9 @@ namespace ImageBuilder
 
 				for (var blockPtrX = 0; blockPtrX < extentInBlocksWidth; blockPtrX++)
 				{
-					var mapSection = blocksForThisRow[blockPtrX];
-					var invertThisBlock = !mapSection?.IsInverted ?? false;
+					var mapSection = GetMapSection(blocksForThisRow, blockPtrX);
 
-					Debug.Assert(invertThisBlock == isInverted, $"The block at {blockPtrX}, {blockPtrY} has a differnt value of isInverted as does the block at 0, {blockPtrY}.");
+					Debug.Assert(mapSection == null || !mapSection.IsInverted == isInverted, $"The block at {blockPtrX}, {blockPtrY} has a differnt value of isInverted as does the first block of row {blockPtrY}.");
 
 					var countsForThisLine = BitmapHelper.GetOneLineFromCountsBlock(mapSection?.MapSectionVectors?.Counts, linePtr, blockSizeWidth);
 					var escVelsForThisLine = BitmapHelper.GetOneLineFromCountsBlock(mapSection?.MapSectionVectors?.EscapeVelocities, linePtr, blockSizeWidth);
@@ -154,7 +253,8 @@ namespace ImageBuilder
 
 					try
 					{
-						BitmapHelper.FillPngImageLineSegment(iLine, destPixPtr, countsForThisLine, escVelsForThisLine, lineLength, samplesToSkip, colorMap);
+						BitmapHelper.FillPngImageLineSegment(iLine, destPixPtr, countsForThisLine, escVelsForThisLine, lineLength, samplesToSkip, colorMap,
+							supersampledColors[blockPtrX], linePtr * blockSizeWidth);
 						destPixPtr += lineLength;
 					}
 					catch (Exception e)
@@ -173,6 +273,78 @@ namespace ImageBuilder
 			}
 		}
 
+		/// <param name="previousBlocks">The blocks of the row written before this one, these have the next higher map coordinates.</param>
+		/// <param name="nextBlocks">The blocks of the row to be written after this one, these have the next lower map coordinates.</param>
+		private IDictionary<int, byte[]>?[] GetSupersampledColors(IDictionary<int, MapSection?> blocksForThisRow, IDictionary<int, MapSection?>? previousBlocks, IDictionary<int, MapSection?>? nextBlocks,
+			IList<MapSectionRequest>? requests, int extentInBlocksWidth, ColorMap colorMap)
+		{
+			var result = new IDictionary<int, byte[]>?[extentInBlocksWidth];
+
+			if (_supersampler == null || requests == null)
+			{
+				return result;
+			}
+
+			for (var blockPtrX = 0; blockPtrX < extentInBlocksWidth; blockPtrX++)
+			{
+				var mapSection = GetMapSection(blocksForThisRow, blockPtrX);
+				var mapSectionVectors = mapSection?.MapSectionVectors;
+
+				if (mapSection != null && mapSectionVectors != null)
+				{
+					var neighbors = GetBlockNeighbors(mapSection, blockPtrX, blocksForThisRow, previousBlocks, nextBlocks);
+
+					// The subsamples are generated using the request's position, in the same orientation as the block's counts.
+					result[blockPtrX] = _supersampler.Supersample(requests[blockPtrX], mapSectionVectors, colorMap, neighbors);
+				}
+			}
+
+			return result;
+		}
+
+		private BlockNeighbors GetBlockNeighbors(MapSection mapSection, int blockPtrX, IDictionary<int, MapSection?> blocksForThisRow, IDictionary<int, MapSection?>? previousBlocks, IDictionary<int, MapSection?>? nextBlocks)
+		{
+			var lastLinePtr = mapSection.MapSectionVectors!.BlockSize.Height - 1;
+
+			// The first row of an inverted block's counts has the largest map coordinate, the last row of any other block's counts does.
+			var above = GetMapSection(previousBlocks, blockPtrX);
+			var below = GetMapSection(nextBlocks, blockPtrX);
+
+			var top = mapSection.IsInverted ? below : above;
+			var bottom = mapSection.IsInverted ? above : below;
+
+			var result = new BlockNeighbors
+			{
+				Left = GetMapSection(blocksForThisRow, blockPtrX - 1)?.MapSectionVectors,
+				Right = GetMapSection(blocksForThisRow, blockPtrX + 1)?.MapSectionVectors,
+				Bottom = bottom?.MapSectionVectors,
+				Top = top?.MapSectionVectors,
+				BottomLinePtr = bottom == null ? 0 : GetBorderingLinePtr(bottom, isAbove: mapSection.IsInverted, lastLinePtr),
+				TopLinePtr = top == null ? 0 : GetBorderingLinePtr(top, isAbove: !mapSection.IsInverted, lastLinePtr)
+			};
+
+			return result;
+		}
+
+		// Returns the row of the neighbor's counts with the lowest map coordinate if it is above the block, otherwise the row with the highest.
+		private int GetBorderingLinePtr(MapSection neighbor, bool isAbove, int lastLinePtr)
+		{
+			var result = isAbove == neighbor.IsInverted ? lastLinePtr : 0;
+			return result;
+		}
+
+		private MapSection? GetMapSection(IDictionary<int, MapSection?>? blocks, int blockPtrX)
+		{
+			if (blocks != null && blocks.TryGetValue(blockPtrX, out var mapSection))
+			{
+				return mapSection;
+			}
+			else
+			{
+				return null;
+			}
+		}
+
 		///// <summary>
 		///// 
 		///// </summary>
@@ -288,7 +460,7 @@ namespace ImageBuilder
 		//	return segmentLengths;
 		//}
 
-		private async Task<IDictionary<int, MapSection?>> GetAllBlocksForRowAsync(ObjectId jobId, OwnerType ownerType, Subdivision subdivision, ObjectId originalSourceSubdivisionId, BigVector mapBlockOffset, int rowPtr, int blockIndexY, int stride, MapCalcSettings mapCalcSettings, int precision)
+		private BlockRow RequestBlockRow(ObjectId jobId, OwnerType ownerType, Subdivision subdivision, ObjectId originalSourceSubdivisionId, BigVector mapBlockOffset, int rowPtr, int blockIndexY, int stride, MapCalcSettings mapCalcSettings, int precision)
 		{
 			var jobType = JobType.Image;
 			var requests = new List<MapSectionRequest>();
@@ -305,18 +477,28 @@ namespace ImageBuilder
 				requests.Add(mapSectionRequest);
 			}
 
-			//_currentJobNumber = _mapLoaderManager.Push(requests, MapSectionReady);
-			var mapSectionResponses = _mapLoaderManager.Push(requests, MapSectionReady, out var newJobNumber, out var _);
-			_currentJobNumber = newJobNumber;
+			var result = new BlockRow(rowPtr, requests);
 
-			_currentResponses = new Dictionary<int, MapSection?>();
+			// Each row is a separate job, the callback adds the MapSection to the row for which it was requested.
+			var mapSectionResponses = _mapLoaderManager.Push(requests, mapSection => MapSectionReady(result, mapSection), out var newJobNumber, out var _);
+			result.JobNumber = newJobNumber;
 
-			foreach (var response in mapSectionResponses)
+			lock (result.Responses)
 			{
-				_currentResponses.Add(response.ScreenPosition.X, response);
+				foreach (var response in mapSectionResponses)
+				{
+					result.Responses[response.ScreenPosition.X] = response;
+				}
 			}
 
-			var task = _mapLoaderManager.GetTaskForJob(_currentJobNumber.Value);
+			result.Task = _mapLoaderManager.GetTaskForJob(newJobNumber);
+
+			return result;
+		}
+
+		private async Task<IDictionary<int, MapSection?>> GetAllBlocksForRowAsync(BlockRow blockRow)
+		{
+			var task = blockRow.Task;
 
 			if (task != null)
 			{
@@ -330,16 +512,50 @@ namespace ImageBuilder
 				}
 			}
 
-			return _currentResponses ?? new Dictionary<int, MapSection?>();
+			lock (blockRow.Responses)
+			{
+				return new Dictionary<int, MapSection?>(blockRow.Responses);
+			}
 		}
 
-		private void MapSectionReady(MapSection mapSection)
+		private void ReleaseBlockRow(BlockRow blockRow)
 		{
-			if (mapSection.JobNumber == _currentJobNumber)
+			lock (blockRow.Responses)
+			{
+				if (_mapSectionVectorProvider != null)
+				{
+					foreach (var mapSection in blockRow.Responses.Values)
+					{
+						if (mapSection != null)
+						{
+							_mapSectionVectorProvider.ReturnMapSection(mapSection);
+						}
+					}
+				}
+
+				blockRow.Responses.Clear();
+				blockRow.IsReleased = true;
+			}
+		}
+
+		private void MapSectionReady(BlockRow blockRow, MapSection mapSection)
+		{
+			if (mapSection.JobNumber == blockRow.JobNumber || !blockRow.JobNumber.HasValue)
 			{
 				if (!mapSection.IsEmpty)
 				{
-					_currentResponses?.Add(mapSection.ScreenPosition.X, mapSection);
+					lock (blockRow.Responses)
+					{
+						if (blockRow.IsReleased)
+						{
+							// The row was abandoned before this section arrived.
+							_mapSectionVectorProvider?.ReturnMapSection(mapSection);
+						}
+						else
+						{
+							blockRow.Responses[mapSection.ScreenPosition.X] = mapSection;
+						}
+					}
 				}
 				else
 				{
@@ -349,6 +565,33 @@ namespace ImageBuilder
 		}
 
 		#endregion
+
+		#region Private Classes
+
+		private class BlockRow
+		{
+			public BlockRow(int blockPtrY, IList<MapSectionRequest> requests)
+			{
+				BlockPtrY = blockPtrY;
+				Requests = requests;
+				Responses = new Dictionary<int, MapSection?>();
+				JobNumber = null;
+				Task = null;
+				IsReleased = false;
+			}
+
+			public int BlockPtrY { get; }
+			public IList<MapSectionRequest> Requests { get; }
+
+			// Keyed by the block's X position, updated by the MapLoaderManager's callback.
+			public IDictionary<int, MapSection?> Responses { get; }
+
+			public int? JobNumber { get; set; }
+			public Task? Task { get; set; }
+			public bool IsReleased { get; set; }
+		}
+
+		#endregion
 	}
 }
 
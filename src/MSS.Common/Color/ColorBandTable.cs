@@ -0,0 +1,82 @@
+﻿using System;
+
+namespace MSS.Common
+{
+	/// <summary>
+	/// The ColorBands of a ColorMap flattened into arrays, so that a count can be colored using table lookups instead of a search.
+	/// The values reflect the ColorMap's UseEscapeVelocities, HighlightSelectedColorBand and selected band at the time the table was built.
+	/// </summary>
+	public class ColorBandTable
+	{
+		// The order of the values held for each band in BandValues.
+		public const int STARTING_CUTOFF = 0;
+		public const int BUCKET_WIDTH = 1;
+		public const int START_RED = 2;
+		public const int START_GREEN = 3;
+		public const int START_BLUE = 4;
+		public const int DIFF_RED = 5;
+		public const int DIFF_GREEN = 6;
+		public const int DIFF_BLUE = 7;
+
+		public const int VALUES_PER_BAND = 8;
+
+		#region Constructor
+
+		public ColorBandTable(int bandCount, int highCutoff, bool useEscapeVelocities)
+		{
+			if (highCutoff < 0)
+			{
+				throw new ArgumentOutOfRangeException(nameof(highCutoff), "The HighCutoff cannot be negative.");
+			}
+
+			BandCount = bandCount;
+			HighCutoff = highCutoff;
+			UseEscapeVelocities = useEscapeVelocities;
+
+			BandIndexes = new int[highCutoff + 1];
+			BandValues = new double[VALUES_PER_BAND * bandCount];
+			Opacities = new int[bandCount];
+		}
+
+		#endregion
+
+		#region Public Properties
+
+		public int BandCount { get; init; }
+		public int HighCutoff { get; init; }
+		public bool UseEscapeVelocities { get; init; }
+
+		/// <summary>
+		/// The index of the band used for each count from 0 to the HighCutoff, counts above the HighCutoff use the last band.
+		/// </summary>
+		public int[] BandIndexes { get; init; }
+
+		/// <summary>
+		/// The values for each band, stored value by value: the value for band b is at index: value * BandCount + b.
+		/// The BucketWidth includes the extra count used when escape velocities are in use.
+		/// Bands that are not blended have a difference of zero, so that the start color is used for every count.
+		/// </summary>
+		public double[] BandValues { get; init; }
+
+		/// <summary>
+		/// The alpha value for each band.
+		/// </summary>
+		public int[] Opacities { get; init; }
+
+		#endregion
+
+		#region Public Methods
+
+		public void SetBandValue(int bandIndex, int valueIndex, double value)
+		{
+			BandValues[valueIndex * BandCount + bandIndex] = value;
+		}
+
+		public double GetBandValue(int bandIndex, int valueIndex)
+		{
+			return BandValues[valueIndex * BandCount + bandIndex];
+		}
+
+		#endregion
+	}
+}
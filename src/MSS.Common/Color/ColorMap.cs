@@ -153,6 +153,48 @@ namespace MSS.Common
             return errors;
         }
 
+        /// <summary>
+        /// Returns the ColorBands as a set of lookup tables, for use by colorizers that process many counts at a time.
+        /// The table must be rebuilt if UseEscapeVelocities, HighlightSelectedColorBand or the selected ColorBand changes.
+        /// </summary>
+        public ColorBandTable GetColorBandTable()
+        {
+            var result = new ColorBandTable(_colorBands.Length, _highColorBandCutoff, UseEscapeVelocities);
+
+            for (var countVal = 0; countVal <= _highColorBandCutoff; countVal++)
+            {
+                result.BandIndexes[countVal] = GetColorMapIndex(countVal);
+            }
+
+            for (var i = 0; i < _colorBands.Length; i++)
+            {
+                var cme = _colorBands[i];
+                var startComps = cme.StartColor.ColorComps;
+
+                result.SetBandValue(i, ColorBandTable.STARTING_CUTOFF, cme.StartingCutoff);
+                result.SetBandValue(i, ColorBandTable.START_RED, startComps[0]);
+                result.SetBandValue(i, ColorBandTable.START_GREEN, startComps[1]);
+                result.SetBandValue(i, ColorBandTable.START_BLUE, startComps[2]);
+
+                if (cme.BlendStyle == ColorBandBlendStyle.None)
+                {
+                    // The differences are zero, the width is only used as a divisor.
+                    result.SetBandValue(i, ColorBandTable.BUCKET_WIDTH, 1);
+                }
+                else
+                {
+                    result.SetBandValue(i, ColorBandTable.BUCKET_WIDTH, cme.BucketWidth + (UseEscapeVelocities ? 1 : 0));
+                    result.SetBandValue(i, ColorBandTable.DIFF_RED, cme.BlendVals.DiffRed);
+                    result.SetBandValue(i, ColorBandTable.DIFF_GREEN, cme.BlendVals.DiffGreen);
+                    result.SetBandValue(i, ColorBandTable.DIFF_BLUE, cme.BlendVals.DiffBlue);
+                }
+
+                result.Opacities[i] = HighlightSelectedColorBand && i != _selectedColorBandIndex ? 25 : 255;
+            }
+
+            return result;
+        }
+
    //     public byte[] GetColor(int countVal, double escapeVelocity)
    //     {
    //         byte[] result;
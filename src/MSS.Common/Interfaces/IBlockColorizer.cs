@@ -0,0 +1,15 @@
+﻿using System;
+
+namespace MSS.Common
+{
+	public interface IBlockColorizer
+	{
+		/// <summary>
+		/// Fills the destination with the Blue, Green, Red and Alpha values for the first valueCount counts, using the colors of the ColorBandTable.
+		/// Produces the same values as the ColorMap from which the table was built.
+		/// </summary>
+		/// <param name="escapeVelocities">Used if the table's UseEscapeVelocities is true, otherwise may be null.</param>
+		/// <returns>The number of color components that were out of range.</returns>
+		int ColorizeBlock(ColorBandTable colorBandTable, ushort[] counts, ushort[]? escapeVelocities, int valueCount, byte[] destination);
+	}
+}
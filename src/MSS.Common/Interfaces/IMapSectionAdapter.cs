@@ -19,6 +19,7 @@ namespace MSS.Common
 
 		Task<MapSectionBytes?> GetMapSectionBytesAsync(ObjectId subdivisionId, MapBlockOffset blockPosition, CancellationToken ct);
 		MapSectionBytes? GetMapSectionBytes(ObjectId subdivisionId, MapBlockOffset blockPosition);
+		IAsyncEnumerable<MapSectionBytes> GetMapSectionBytesInRectangleAsync(ObjectId subdivisionId, MapBlockOffset lowerLeft, MapBlockOffset upperRight, CancellationToken ct);
 
 		//Task<MapSectionResponse?> GetMapSectionAsync(ObjectId subdivisionId, BigVector blockPosition, MapSectionVectors mapSectionVectors, CancellationToken ct);
 		//MapSectionResponse? GetMapSection(ObjectId mapSectionId, MapSectionVectors mapSectionVectors);
@@ -29,11 +30,15 @@ namespace MSS.Common
 		Task<ObjectId?> SaveMapSectionAsync(MapSectionResponse mapSectionResponse);
 		Task<long?> UpdateCountValuesAync(MapSectionResponse mapSectionResponse);
 
+		Task<ObjectId?[]> SaveMapSectionsAsync(IList<MapSectionResponse> mapSectionResponses);
+		Task<long?> UpdateCountValuesAsync(IList<MapSectionResponse> mapSectionResponses);
+
 		//Task<ObjectId?> SaveJobMapSectionAsync(MapSectionResponse mapSectionResponse, bool isInverted);
 		//Task<ObjectId?> SaveJobMapSectionAsync(MapSectionResponse mapSectionResponse, bool isInverted, JobOwnerType jobOwnerType, JobType jobType);
 		//Task<ObjectId?> SaveJobMapSectionAsync(MapSectionResponse mapSectionResponse, string jobIdStr, JobType jobType, SizeInt blockIndex, bool isInverted, OwnerType ownerType, string jobSubdivionIdStr);
 
 		Task<ObjectId?> SaveJobMapSectionAsync(JobType jobType, ObjectId jobId, ObjectId mapSectionId, SizeInt blockIndex, bool isInverted, ObjectId mapSectionSubdivisionId, ObjectId jobSubdivisionId, OwnerType ownerType);
+		Task<int> SaveJobMapSectionsAsync(IList<JobMapSectionLink> jobMapSectionLinks);
 
 		Task<bool> DoesMapSectionZValuesExistAsync(ObjectId mapSectionId, CancellationToken ct);
 		Task<ZValues?> GetMapSectionZValuesAsync(ObjectId mapSectionId, CancellationToken ct);
@@ -0,0 +1,18 @@
+﻿using MSS.Types;
+using MSS.Types.MSet;
+using System.Collections.Generic;
+
+namespace MSS.Common
+{
+	public interface ISubsampleGenerator
+	{
+		/// <summary>
+		/// Generates a subsampleFactor x subsampleFactor grid of subsamples centered on each of the given samples of the MapSectionRequest's block.
+		/// The subsamples are spaced 1 / subsampleFactor of the SamplePointDelta apart. The SubsampleFactor must be 2, 4 or 8.
+		/// </summary>
+		/// <param name="counts">Receives subsampleFactor^2 values for each sample, in the order the samples are given, each sample's subsamples row by row.</param>
+		/// <param name="escapeVelocities">Receives the escape velocities in the same order, if the request's MapCalcSettings specify that they be calculated.</param>
+		/// <returns>False, if the subsamples could not be generated.</returns>
+		bool GenerateSubsamples(MapSectionRequest mapSectionRequest, int subsampleFactor, IList<PointInt> samplePositions, ushort[] counts, ushort[] escapeVelocities);
+	}
+}
@@ -137,7 +137,10 @@ namespace MSS.Common
 				mapCalcSettings: mapCalcSettings,
 				mapLoaderJobNumber: mapLoaderJobNumber,
 				requestNumber: requestNumber
-			);
+			)
+			{
+				SubdivisionBaseMapPosition = subdivision.BaseMapPosition
+			};
 
 			return mapSectionRequest;
 		}
@@ -416,11 +416,15 @@ namespace MSS.Common
 
 			var precision = Math.Min(a.Precision, b.Precision);
 
-			var mantissa = Add(a.Mantissa, b.Mantissa, out var carry);
+			var mantissa = Add(a.Mantissa, b.Mantissa, out _);
 
 			FP31Val result;
 
-			if (carry > 0)
+			// The values are two's complement, a carry out of the most significant limb occurs whenever the sum of a negative value and a non-negative value
+			// is non-negative. The sum has overflowed only if both values have the same sign and the sum has the other sign.
+			var sign = FP31ValHelper.GetSign(a.Mantissa);
+
+			if (sign == FP31ValHelper.GetSign(b.Mantissa) && sign != FP31ValHelper.GetSign(mantissa))
 			{
 				throw new OverflowException($"scalarMath -- Overflow on Add. {desc}");
 				//result = CreateNewMaxIntegerFP31Val(a.Precision);
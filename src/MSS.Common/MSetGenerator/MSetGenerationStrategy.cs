@@ -6,7 +6,8 @@
 		LimbFirst,
 		DepthFirst,
 		UPointers,
-		UnManaged
+		UnManaged,
+		Subdivision
 	}
 
 }
@@ -0,0 +1,44 @@
+﻿using MSS.Types.APValues;
+using System;
+using System.Collections.Generic;
+
+namespace MSS.Common
+{
+	/// <summary>
+	/// The Mandelbrot Set is symmetric about the real axis. The sample at x - yi has the same count and escape velocity
+	/// as the sample at x + yi and each of its z values is the complex conjugate of the corresponding z value.
+	/// </summary>
+	public static class RealAxisSymmetryHelper
+	{
+		/// <summary>
+		/// Finds the rows whose y coordinate is the exact negation, bit for bit, of the y coordinate of an earlier row.
+		/// </summary>
+		/// <returns>For each row, the number of the earlier row it mirrors, or -1. Null, if no row is mirrored.</returns>
+		public static int[]? GetMirroredRowSources(FP31Val[] samplePointsY)
+		{
+			int[]? result = null;
+
+			var rowNumbers = new Dictionary<FP31Val, int>(samplePointsY.Length);
+
+			for (var rowNumber = 0; rowNumber < samplePointsY.Length; rowNumber++)
+			{
+				var y = samplePointsY[rowNumber];
+
+				if (rowNumbers.TryGetValue(FP31ValHelper.Negate(y), out var sourceRowNumber))
+				{
+					if (result == null)
+					{
+						result = new int[samplePointsY.Length];
+						Array.Fill(result, -1);
+					}
+
+					result[rowNumber] = sourceRowNumber;
+				}
+
+				rowNumbers.TryAdd(y, rowNumber);
+			}
+
+			return result;
+		}
+	}
+}
@@ -0,0 +1,7 @@
+﻿using MongoDB.Bson;
+
+namespace MSS.Types.MSet
+{
+	// The values needed to record that a MapSection is used by a Job.
+	public record JobMapSectionLink(JobType JobType, ObjectId JobId, ObjectId MapSectionId, SizeInt BlockIndex, bool IsInverted, ObjectId MapSectionSubdivisionId, ObjectId JobSubdivisionId, OwnerType OwnerType);
+}
@@ -103,6 +103,12 @@ namespace MSS.Types.MSet
 		public bool IsEmpty => MapSectionVectors == null;
 
 		public bool IsLastSection { get; set; }
+
+		/// <summary>
+		/// True if the counts are an approximation, derived from MapSections generated at a higher resolution. The exact MapSection will follow.
+		/// </summary>
+		public bool IsPreview { get; set; }
+
 		public MapSectionProcessInfo? MapSectionProcessInfo { get; set; }
 		public MathOpCounts? MathOpCounts { get; set; }
 
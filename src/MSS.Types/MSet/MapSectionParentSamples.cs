@@ -0,0 +1,91 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+namespace MSS.Types.MSet
+{
+	/// <summary>
+	/// The counts and escape velocities of a previously generated MapSection whose SamplePointDelta is 2 or 4 times larger
+	/// than the SamplePointDelta of the MapSection being generated and whose sample grid coincides with the new grid.
+	/// Every ScaleFactor-th sample of every ScaleFactor-th row of the new MapSection can be copied from the parent.
+	/// </summary>
+	public class MapSectionParentSamples
+	{
+		private readonly ushort[] _counts;
+		private readonly ushort[] _escapeVelocities;
+		private readonly int _parentWidth;
+
+		#region Constructor
+
+		public MapSectionParentSamples(MapSectionVectors2 parentVectors, int scaleFactor, PointInt parentOffset, int targetIterations)
+		{
+			if (scaleFactor != 2 && scaleFactor != 4)
+			{
+				throw new ArgumentException("The ScaleFactor must be 2 or 4.", nameof(scaleFactor));
+			}
+
+			_counts = MemoryMarshal.Cast<byte, ushort>(parentVectors.Counts.AsSpan(0, parentVectors.TotalByteCount)).ToArray();
+			_escapeVelocities = MemoryMarshal.Cast<byte, ushort>(parentVectors.EscapeVelocities.AsSpan(0, parentVectors.TotalByteCount)).ToArray();
+			_parentWidth = parentVectors.ValuesPerRow;
+
+			ScaleFactor = scaleFactor;
+			ParentOffset = parentOffset;
+			TargetIterations = targetIterations;
+		}
+
+		#endregion
+
+		#region Public Properties
+
+		/// <summary>
+		/// The ratio of the parent's SamplePointDelta to the SamplePointDelta of the MapSection being generated.
+		/// </summary>
+		public int ScaleFactor { get; init; }
+
+		/// <summary>
+		/// The position within the parent MapSection of the sample that coincides with sample (0,0) of the MapSection being generated.
+		/// </summary>
+		public PointInt ParentOffset { get; init; }
+
+		/// <summary>
+		/// The TargetIterations of the MapSection being generated. Parent counts above this value are reported as having reached the target.
+		/// </summary>
+		public int TargetIterations { get; init; }
+
+		#endregion
+
+		#region Public Methods
+
+		public bool IsCoincident(int x, int y)
+		{
+			return x % ScaleFactor == 0 && y % ScaleFactor == 0;
+		}
+
+		public bool IsCoincidentRow(int y)
+		{
+			return y % ScaleFactor == 0;
+		}
+
+		/// <summary>
+		/// Get the count and escape velocity for the coincident sample at position x, y of the MapSection being generated.
+		/// </summary>
+		public void GetValues(int x, int y, out ushort count, out ushort escapeVelocity)
+		{
+			var parentIndex = (ParentOffset.Y + y / ScaleFactor) * _parentWidth + ParentOffset.X + x / ScaleFactor;
+
+			count = _counts[parentIndex];
+
+			if (count > TargetIterations)
+			{
+				// The parent was generated using a larger TargetIterations value.
+				count = (ushort)(TargetIterations + 1);
+				escapeVelocity = 0;
+			}
+			else
+			{
+				escapeVelocity = _escapeVelocities[parentIndex];
+			}
+		}
+
+		#endregion
+	}
+}
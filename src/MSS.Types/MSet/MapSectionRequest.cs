@@ -79,6 +79,11 @@ namespace MSS.Types.MSet
 		/// </summary>
 		public RPoint MapPosition { get; init; }
 
+		/// <summary>
+		/// The BaseMapPosition of the Subdivision, if known. Used to locate MapSections generated at a lower zoom level.
+		/// </summary>
+		public BigVector? SubdivisionBaseMapPosition { get; init; }
+
 		public SizeInt BlockSize { get; init; }
 		
 		public RSize SamplePointDelta { get; init; }
@@ -94,6 +99,11 @@ namespace MSS.Types.MSet
 		public MapSectionVectors2? MapSectionVectors2 { get; set; }
 		public MapSectionZVectors? MapSectionZVectors { get; set; }
 
+		/// <summary>
+		/// Samples from a MapSection generated at a lower zoom level that coincide with samples of this MapSection.
+		/// </summary>
+		public MapSectionParentSamples? ParentSamples { get; set; }
+
 		public string? ClientEndPointAddress { get; set; }
 		public bool IncreasingIterations { get; set; }
 
@@ -75,6 +75,9 @@
 		
 		public MathOpCounts? MathOpCounts { get; set; }
 
+		// The number of limbs used to generate the MapSection, this may be less than the LimbCount of the MapSectionRequest.
+		public int? LimbCount { get; set; }
+
 		public MapSectionVectors? MapSectionVectors { get; set; }
 		public MapSectionVectors2? MapSectionVectors2 { get; set; }
 		public MapSectionZVectors? MapSectionZVectors { get; set; }
@@ -87,6 +90,7 @@
 		{
 			var result = new MapSectionResponse(MapSectionId, SubdivisionId, BlockPosition, MapCalcSettings, 
 				RequestCompleted, AllRowsHaveEscaped, mapSectionVectors: null, mapSectionVectors2: null, mapSectionZVectors: null, requestCancelled: RequestCancelled);
+			result.LimbCount = LimbCount;
 			return result;
 		}
 
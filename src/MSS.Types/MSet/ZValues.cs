@@ -49,6 +49,22 @@ namespace MSS.Types.MSet
 			RowsHasEscaped = rowHasEscaped;
 		}
 
+		/// <summary>
+		/// Creates a ZValues whose Zrs, Zis and HasEscapedFlags have been encoded, the arrays are used as-is.
+		/// </summary>
+		public ZValues(SizeInt blockSize, int limbCount, byte[] zrs, byte[] zis, byte[] hasEscapedFlags, byte[] rowHasEscaped, int codecVersion)
+		{
+			BlockWidth = blockSize.Width;
+			BlockHeight = blockSize.Height;
+			LimbCount = limbCount;
+
+			Zrs = zrs;
+			Zis = zis;
+			HasEscapedFlags = hasEscapedFlags;
+			RowsHasEscaped = rowHasEscaped;
+			CodecVersion = codecVersion;
+		}
+
 		#endregion
 
 		#region Public Properties 
@@ -68,6 +84,11 @@ namespace MSS.Types.MSet
 		public byte[] HasEscapedFlags { get; set; }
 		public byte[] RowsHasEscaped { get; init; }
 
+		// Identifies how Zrs, Zis and HasEscapedFlags are encoded, records written before the values were encoded have none.
+		[BsonIgnoreIfDefault]
+		[BsonDefaultValue(0)]
+		public int CodecVersion { get; init; } = 0;
+
 		// Derived properties
 		public bool IsEmpty => Zrs.Length == 0;
 
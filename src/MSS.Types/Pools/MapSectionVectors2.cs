@@ -102,14 +102,24 @@ namespace MSS.Types
 			}
 		}
 
+		/// <summary>
+		/// Copies the counts and escape velocities of one row to another.
+		/// </summary>
+		public void CopyRow(int sourceRowNumber, int destinationRowNumber)
+		{
+			Array.Copy(Counts, BytesPerRow * sourceRowNumber, Counts, BytesPerRow * destinationRowNumber, BytesPerRow);
+			Array.Copy(EscapeVelocities, BytesPerRow * sourceRowNumber, EscapeVelocities, BytesPerRow * destinationRowNumber, BytesPerRow);
+		}
+
 		// Integer
 		public void FillCountsRow(int rowNumber, int[] dest)
 		{
+			var counts = MemoryMarshal.Cast<byte, ushort>(Counts);
 			var startIndex = ValuesPerRow * rowNumber;
 
 			for (var i = 0; i < ValuesPerRow; i++)
 			{
-				dest[i] = Counts[startIndex + i];
+				dest[i] = counts[startIndex + i];
 			}
 		}
 
@@ -14,6 +14,9 @@ namespace MSS.Types
 
 		private const int VALUE_SIZE = 4;
 
+		private const int EFFECTIVE_BITS_PER_LIMB = 31;
+		private const uint LOW31_BITS_SET = 0x7FFFFFFF; // bits 0 - 30 are set.
+
 		//public MapSectionZVectors(SizeInt blockSize, int limbCount)
 		//{
 		//	BlockSize = blockSize;
@@ -252,6 +255,40 @@ namespace MSS.Types
 			}
 		}
 
+		/// <summary>
+		/// Copies one row to another, negating the Zi values. Used for a row whose sample points are the complex conjugates of the source row's sample points.
+		/// </summary>
+		public void CopyConjugateRow(int sourceRowNumber, int destinationRowNumber)
+		{
+			Array.Copy(Zrs, BytesPerZValueRow * sourceRowNumber, Zrs, BytesPerZValueRow * destinationRowNumber, BytesPerZValueRow);
+			Array.Copy(HasEscapedFlags, BytesPerRow * sourceRowNumber, HasEscapedFlags, BytesPerRow * destinationRowNumber, BytesPerRow);
+			RowHasEscaped[destinationRowNumber] = RowHasEscaped[sourceRowNumber];
+
+			var source = MemoryMarshal.Cast<byte, uint>(Zis.AsSpan(BytesPerZValueRow * sourceRowNumber, BytesPerZValueRow));
+			var destination = MemoryMarshal.Cast<byte, uint>(Zis.AsSpan(BytesPerZValueRow * destinationRowNumber, BytesPerZValueRow));
+
+			// Each vector holds LimbCount limbs for each of 8 lanes, the least significant limb first.
+			for (var vecPtr = 0; vecPtr < VectorsPerRow; vecPtr++)
+			{
+				var vecStart = vecPtr * LimbCount * Lanes;
+
+				for (var lane = 0; lane < Lanes; lane++)
+				{
+					// Two's complement: flip the 31 value bits of each limb and add 1.
+					var carry = 1u;
+
+					for (var limbPtr = 0; limbPtr < LimbCount; limbPtr++)
+					{
+						var index = vecStart + limbPtr * Lanes + lane;
+						var limb = (~source[index] & LOW31_BITS_SET) + carry;
+
+						destination[index] = limb & LOW31_BITS_SET;
+						carry = limb >> EFFECTIVE_BITS_PER_LIMB;
+					}
+				}
+			}
+		}
+
 		public byte[] GetBytesForRowHasEscaped()
 		{
 			var result = new byte[RowHasEscaped.Length];
@@ -5,6 +5,7 @@ using MongoDB.Bson;
 using MSetExplorer.RepositoryManagement;
 using MSetGeneratorPrototype;
 using MSetRepo;
+using MSetRowGeneratorClient;
 using MSS.Common;
 using MSS.Common.MSet;
 using MSS.Types;
@@ -45,7 +46,7 @@ namespace MSetExplorer
 		private static readonly bool USE_REMOTE_ENGINES = true;
 		private static readonly bool USE_LOCAL_ENGINE = true;
 
-		//private static readonly MSetGenerationStrategy GEN_STRATEGY = MSetGenerationStrategy.DepthFirst;
+		private static readonly MSetGenerationStrategy GEN_STRATEGY = MSetGenerationStrategy.DepthFirst;
 
 		private static readonly bool CHECK_CONN_BEFORE_USE = false;
 
@@ -335,7 +336,7 @@ namespace MSetExplorer
 			}
 			else
 			{
-				repositoryAdapters = new RepositoryAdapters(repoDbServerName, repoDbPort, repoDbName);
+				repositoryAdapters = new RepositoryAdapters(repoDbServerName, repoDbPort, repoDbName, GetTileStorePath());
 				return true;
 			}
 		}
@@ -344,7 +345,7 @@ namespace MSetExplorer
 		{
 			var (repoDbServerName, repoDbPort, repoDbName) = GetConnectionSettings();
 
-			var repositoryAdapters = new RepositoryAdapters(repoDbServerName!, repoDbPort, repoDbName!);
+			var repositoryAdapters = new RepositoryAdapters(repoDbServerName!, repoDbPort, repoDbName!, GetTileStorePath());
 			return repositoryAdapters;
 		}
 
@@ -364,6 +365,14 @@ namespace MSetExplorer
 			return new(serverName, port, dbName);
 		}
 
+		private string? GetTileStorePath()
+		{
+			var appSettings = ConfigurationManager.AppSettings;
+			var result = appSettings["TileStorePath"];
+
+			return result;
+		}
+
 		private bool TryEditConnectionSettings(string? initialServerName, int initialPort, string? initialDatabaseName, [NotNullWhen(true)] out string? serverName, out int port, [NotNullWhen(true)] out string? databaseName)
 		{
 			var repoConnParametersViewModel = new RepoConnParametersViewModel(initialServerName, initialPort, initialDatabaseName);
@@ -575,7 +584,13 @@ namespace MSetExplorer
 
 		private IMapSectionGenerator CreateMapSectionGenerator()
 		{
-			var mapGeneratorService = new MapSectionGeneratorDepthFirst(RMapConstants.DEFAULT_LIMB_COUNT, RMapConstants.BLOCK_SIZE);
+			IMapSectionGenerator mapGeneratorService = GEN_STRATEGY switch
+			{
+				MSetGenerationStrategy.Subdivision => new MapSectionGeneratorSubdivision(RMapConstants.DEFAULT_LIMB_COUNT, RMapConstants.BLOCK_SIZE, verifyFilledAreas: true),
+				MSetGenerationStrategy.DepthFirst => new MapSectionGeneratorDepthFirst(RMapConstants.DEFAULT_LIMB_COUNT, RMapConstants.BLOCK_SIZE),
+				MSetGenerationStrategy.UnManaged => new MapSectionGeneratorNative(new MapSectionGeneratorDepthFirst(RMapConstants.DEFAULT_LIMB_COUNT, RMapConstants.BLOCK_SIZE)),
+				_ => throw new NotSupportedException($"The MSetGenerationStrategy: {GEN_STRATEGY} is not supported.")
+			};
 
 			return mapGeneratorService;
 		}
@@ -40,7 +40,7 @@ namespace MSetExplorer
 			_mapLoaderManager = mapLoaderManager;
 			_mapSectionRequestProcessor = mapSectionRequestProcessor;
 
-			_viewModelFactory = new ViewModelFactory(_projectAdapter, _mapSectionAdapter, _sharedColorBandSetAdapter, _mapLoaderManager, _blockSize);
+			_viewModelFactory = new ViewModelFactory(_projectAdapter, _mapSectionAdapter, _sharedColorBandSetAdapter, _mapLoaderManager, _mapSectionVectorProvider, _blockSize);
 		}
 
 		public ExplorerViewModel GetExplorerViewModel()
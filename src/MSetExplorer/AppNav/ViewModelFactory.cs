@@ -9,6 +9,7 @@ using MongoDB.Bson;
 using ImageBuilder;
 using System.Windows.Media;
 using PngImageLib;
+using MSetRowGeneratorClient;
 
 namespace MSetExplorer
 {
@@ -27,19 +28,31 @@ namespace MSetExplorer
 
 		private readonly MapJobHelper _mapJobHelper;
 		private readonly IMapLoaderManager _mapLoaderManager;
+		private readonly MapSectionVectorProvider _mapSectionVectorProvider;
 
 		private readonly SizeInt _blockSize;
 
-		public ViewModelFactory(IProjectAdapter projectAdapter, IMapSectionAdapter mapSectionAdapter, SharedColorBandSetAdapter sharedColorBandSetAdapter, IMapLoaderManager mapLoaderManager, SizeInt blockSize)
+		// Generates the subsamples used to anti-alias the edges of the images being created, it holds no state between calls and is shared by each PngBuilder.
+		private readonly ISubsampleGenerator _subsampleGenerator;
+
+		// Colors the blocks of the preview images, shared by each BitmapBuilder.
+		private readonly IBlockColorizer _blockColorizer;
+
+		public ViewModelFactory(IProjectAdapter projectAdapter, IMapSectionAdapter mapSectionAdapter, SharedColorBandSetAdapter sharedColorBandSetAdapter, IMapLoaderManager mapLoaderManager, 
+			MapSectionVectorProvider mapSectionVectorProvider, SizeInt blockSize)
 		{
 			_blockSize = blockSize;
 			_projectAdapter = projectAdapter;
 			_mapSectionAdapter = mapSectionAdapter;
 			_sharedColorBandSetAdapter = sharedColorBandSetAdapter;
 			_mapLoaderManager = mapLoaderManager;
+			_mapSectionVectorProvider = mapSectionVectorProvider;
 
 			var subdivisionProvider = new SubdivisonProvider(_mapSectionAdapter);
 			_mapJobHelper = new MapJobHelper(subdivisionProvider, toleranceFactor: 10, _blockSize);
+
+			_subsampleGenerator = new HpMSetRowClient();
+			_blockColorizer = new NativeColorizer();
 		}
 
 		// Project Open/Save
@@ -79,7 +92,9 @@ namespace MSetExplorer
 		{
 			var mapJobHelper = ProvisionAMapJopHelper();
 
-			var pngBuilder = new PngBuilder(_mapLoaderManager);
+			var supersampler = new AdaptiveSupersampler(_subsampleGenerator);
+			// The blocks of each row are returned to the pool once the row has been written.
+			var pngBuilder = new PngBuilder(_mapLoaderManager, supersampler, _mapSectionVectorProvider);
 			var result = new CreateImageProgressViewModel(pngBuilder, mapJobHelper);
 			return result;
 		}
@@ -91,7 +106,7 @@ namespace MSetExplorer
 		{
 			var mapJobHelper = ProvisionAMapJopHelper();
 
-			var bitmapBuilder = new BitmapBuilder(_mapLoaderManager);
+			var bitmapBuilder = new BitmapBuilder(_mapLoaderManager, _blockColorizer);
 			var result = new LazyMapPreviewImageProvider(mapJobHelper, bitmapBuilder, jobId, OwnerType.Poster, mapAreaInfo, posterSize, colorBandSet, mapCalcSettings, useEscapeVelocitites, fallbackColor);
 			return result;
 		}
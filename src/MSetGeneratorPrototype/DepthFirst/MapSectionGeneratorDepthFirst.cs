@@ -5,6 +5,7 @@ using MSS.Types.APValues;
 using MSS.Types.MSet;
 using System.Diagnostics;
 using System.Runtime.CompilerServices;
+using System.Runtime.InteropServices;
 using System.Runtime.Intrinsics;
 using System.Runtime.Intrinsics.X86;
 
@@ -32,6 +33,9 @@ namespace MSetGeneratorPrototype
 
 		private readonly Vector256<int> _justOne;
 
+		private int[] _newSampleIndexes;
+		private int _newSampleIndexesScaleFactor;
+
 		private const bool USE_DET_DEBUG = false;
 
 		#endregion
@@ -54,6 +58,9 @@ namespace MSetGeneratorPrototype
 			_resultZis = FP31VecMathHelper.CreateNewLimbSet(limbCount);
 
 			_justOne = Vector256.Create(1);
+
+			_newSampleIndexes = new int[0];
+			_newSampleIndexesScaleFactor = 0;
 		}
 
 		#endregion
@@ -82,6 +89,9 @@ namespace MSetGeneratorPrototype
 			//var (samplePointsX, samplePointsY, samplePointOffsets) = _samplePointBuilder.BuildSamplePointsDiag(coords);
 			//ReportSamplePoints(coords, samplePointOffsets, samplePointsX, samplePointsY);
 
+			// Rows that mirror an earlier row across the real axis are copied from that row instead of being generated.
+			var mirroredRowSources = mapSectionRequest.IncreasingIterations ? null : RealAxisSymmetryHelper.GetMirroredRowSources(samplePointsY);
+
 			var mapCalcSettings = mapSectionRequest.MapCalcSettings;
 
 			//_calculateEscapeVelocities = mapCalcSettings.CalculateEscapeVelocities;
@@ -101,15 +111,22 @@ namespace MSetGeneratorPrototype
 
 				sectionCompleted = mapSectionRequest.IncreasingIterations
 					? UpdateMapSectionRows(_iterator, iterationState, ct, out allRowsHaveEscaped)
-					: GenerateMapSectionRows(_iterator, iterationState, ct, out allRowsHaveEscaped);
+					: GenerateMapSectionRows(_iterator, iterationState, mirroredRowSources, ct, out allRowsHaveEscaped);
 
 				RollUpNumberOfCalcs(_fp31VecMath.MathOpCounts, iterationState);
 			}
 			else
 			{
 				var iterationState = new IterationStateDepthFirstNoZ(samplePointsX, samplePointsY, mapSectionVectors2, mapCalcSettings.TargetIterations);
-				sectionCompleted = GenerateMapSectionRowsNoZ(_iterator, iterationState, ct, out allRowsHaveEscaped);
+				sectionCompleted = GenerateMapSectionRowsNoZ(_iterator, iterationState, mapSectionRequest.ParentSamples, mirroredRowSources, ct, out allRowsHaveEscaped);
 				RollUpNumberOfCalcs(_fp31VecMath.MathOpCounts, iterationState);
+
+				mapSectionRequest.ParentSamples = null;
+			}
+
+			if (sectionCompleted && mirroredRowSources != null)
+			{
+				CopyMirroredRows(mirroredRowSources, mapSectionVectors2, mapCalcSettings.SaveTheZValues ? mapSectionZVectors : null);
 			}
 
 			stopwatch.Stop();
@@ -117,13 +134,14 @@ namespace MSetGeneratorPrototype
 
 			var result = new MapSectionResponse(mapSectionRequest, sectionCompleted, allRowsHaveEscaped, mapSectionVectors2, mapSectionZVectors, requestCancelled: ct.IsCancellationRequested);
 			result.MathOpCounts = _fp31VecMath.MathOpCounts.Clone();
+			result.LimbCount = _fp31VecMath.LimbCount;
 			
 			//ReportResults(coords, mapSectionRequest, result, ct);
 
 			return result;
 		}
 
-		private bool GenerateMapSectionRows(IIterator iterator, IIterationState iterationState, CancellationToken ct, out bool allRowsHaveEscaped)
+		private bool GenerateMapSectionRows(IIterator iterator, IIterationState iterationState, int[]? mirroredRowSources, CancellationToken ct, out bool allRowsHaveEscaped)
 		{
 			bool completed = true;
 
@@ -137,6 +155,12 @@ namespace MSetGeneratorPrototype
 
 			for(var rowNumber = 0; rowNumber < iterationState.RowCount; rowNumber++)
 			{
+				if (mirroredRowSources != null && mirroredRowSources[rowNumber] != -1)
+				{
+					// The source row has already been generated, its results are copied once all rows are done.
+					continue;
+				}
+
 				iterationState.SetRowNumber(rowNumber);
 
 				var allRowSamplesHaveEscaped = true;
@@ -225,7 +249,7 @@ namespace MSetGeneratorPrototype
 			return completed;
 		}
 
-		private bool GenerateMapSectionRowsNoZ(IIterator iterator, IIterationState iterationState, CancellationToken ct, out bool allRowsHaveEscaped)
+		private bool GenerateMapSectionRowsNoZ(IIterator iterator, IIterationState iterationState, MapSectionParentSamples? parentSamples, int[]? mirroredRowSources, CancellationToken ct, out bool allRowsHaveEscaped)
 		{
 			allRowsHaveEscaped = false;
 			bool completed = true;
@@ -238,11 +262,23 @@ namespace MSetGeneratorPrototype
 
 			for (var rowNumber = 0; rowNumber < iterationState.RowCount; rowNumber++)
 			{
+				if (mirroredRowSources != null && mirroredRowSources[rowNumber] != -1)
+				{
+					continue;
+				}
+
 				iterationState.SetRowNumber(rowNumber);
 
-				for (var idx = 0; idx < iterationState.VectorsPerRow; idx++)
+				if (parentSamples != null && parentSamples.IsCoincidentRow(rowNumber))
 				{
-					GenerateMapColNoZ(idx, iterator, iterationState);
+					GenerateMapRowFromParentNoZ(rowNumber, iterator, iterationState, parentSamples);
+				}
+				else
+				{
+					for (var idx = 0; idx < iterationState.VectorsPerRow; idx++)
+					{
+						GenerateMapColNoZ(idx, iterator, iterationState);
+					}
 				}
 
 				if (ct.IsCancellationRequested)
@@ -260,6 +296,20 @@ namespace MSetGeneratorPrototype
 			return completed;
 		}
 
+		private void CopyMirroredRows(int[] mirroredRowSources, MapSectionVectors2 mapSectionVectors2, MapSectionZVectors? mapSectionZVectors)
+		{
+			for (var rowNumber = 0; rowNumber < mirroredRowSources.Length; rowNumber++)
+			{
+				var sourceRowNumber = mirroredRowSources[rowNumber];
+
+				if (sourceRowNumber != -1)
+				{
+					mapSectionVectors2.CopyRow(sourceRowNumber, rowNumber);
+					mapSectionZVectors?.CopyConjugateRow(sourceRowNumber, rowNumber);
+				}
+			}
+		}
+
 		#endregion
 
 		#region Generate One Vector
@@ -409,27 +459,82 @@ namespace MSetGeneratorPrototype
 		}
 
 		private void GenerateMapColNoZ(int idx, IIterator iterator, IIterationState iterationState)
+		{
+			iterationState.FillCrLimbSet(idx, _crs);
+			_cis = iterationState.CiLimbSet;
+
+			var resultCountsV = IterateNoZ(iterator, iterationState, out var countsV, out var sumOfSquares, out var targetReachedCompVec);
+
+			TallyUsedAndUnusedCalcs(idx, iterationState.CountsRowV[idx], countsV, resultCountsV, iterationState.UsedCalcs, iterationState.UnusedCalcs);
+
+			iterationState.CountsRowV[idx] = resultCountsV;
+
+			if (_calculateEscapeVelocities)
+			{
+				var escapeVelocities = new ushort[Vector256<int>.Count];
+				CalculateEscapeVelocities(sumOfSquares, targetReachedCompVec, escapeVelocities);
+				Array.Copy(escapeVelocities, 0, iterationState.EscapeVelocities, idx * Vector256<uint>.Count, escapeVelocities.Length);
+			}
+		}
+
+		// Copy the samples that coincide with the parent's samples and calculate the rest, 8 at a time.
+		private void GenerateMapRowFromParentNoZ(int rowNumber, IIterator iterator, IIterationState iterationState, MapSectionParentSamples parentSamples)
+		{
+			var counts = MemoryMarshal.Cast<Vector256<int>, int>(iterationState.CountsRowV);
+			var scaleFactor = parentSamples.ScaleFactor;
+
+			for (var x = 0; x < iterationState.ValuesPerRow; x += scaleFactor)
+			{
+				parentSamples.GetValues(x, rowNumber, out var count, out var escapeVelocity);
+				counts[x] = count;
+				iterationState.EscapeVelocities[x] = escapeVelocity;
+			}
+
+			var newSampleIndexes = GetNewSampleIndexes(iterationState.ValuesPerRow, scaleFactor);
+			var lanes = new int[Vector256<int>.Count];
+			_cis = iterationState.CiLimbSet;
+
+			for (var ptr = 0; ptr < newSampleIndexes.Length; ptr += lanes.Length)
+			{
+				Array.Copy(newSampleIndexes, ptr, lanes, 0, lanes.Length);
+				FillCrLimbSet(iterationState.CrsRowVArray, lanes, _crs);
+
+				var resultCountsV = IterateNoZ(iterator, iterationState, out _, out var sumOfSquares, out var targetReachedCompVec);
+
+				var escapeVelocities = new ushort[Vector256<int>.Count];
+
+				if (_calculateEscapeVelocities)
+				{
+					CalculateEscapeVelocities(sumOfSquares, targetReachedCompVec, escapeVelocities);
+				}
+
+				for (var lane = 0; lane < lanes.Length; lane++)
+				{
+					counts[lanes[lane]] = resultCountsV.GetElement(lane);
+					iterationState.EscapeVelocities[lanes[lane]] = escapeVelocities[lane];
+				}
+			}
+		}
+
+		private Vector256<int> IterateNoZ(IIterator iterator, IIterationState iterationState, out Vector256<int> countsV, out Vector256<uint>[] sumOfSquares, out Vector256<int> targetReachedCompVec)
 		{
 			var hasEscapedFlagsV = Vector256<int>.Zero;
 
 			var doneFlagsV = Vector256<int>.Zero;
 
-			var countsV = Vector256<int>.Zero;
+			countsV = Vector256<int>.Zero;
 			var resultCountsV = countsV;
 
-			iterationState.FillCrLimbSet(idx, _crs);
-			_cis = iterationState.CiLimbSet;
-
 			FP31VecMathHelper.ClearLimbSet(_zrs);
 			FP31VecMathHelper.ClearLimbSet(_zis);
 
 			var escapedFlagsVec = Vector256<int>.Zero;
 
-			var sumOfSquares = iterator.IterateFirstRound(_crs, _cis, _zrs, _zis, ref doneFlagsV);
+			sumOfSquares = iterator.IterateFirstRound(_crs, _cis, _zrs, _zis, ref doneFlagsV);
 			countsV = Avx2.Add(countsV, _justOne);
 
 			// Compare the new Counts with the TargetIterations
-			var targetReachedCompVec = Avx2.CompareGreaterThan(countsV, iterationState.TargetIterationsVector);
+			targetReachedCompVec = Avx2.CompareGreaterThan(countsV, iterationState.TargetIterationsVector);
 
 			// Update the resultCounts
 			_fp31VecMath.IsGreaterOrEqThan(sumOfSquares, _thresholdVector, ref escapedFlagsVec);
@@ -453,21 +558,45 @@ namespace MSetGeneratorPrototype
 				compositeIsDone = SaveCountsForDoneItems(escapedFlagsVec, targetReachedCompVec, countsV, ref resultCountsV, ref hasEscapedFlagsV, ref doneFlagsV);
 			}
 
-			TallyUsedAndUnusedCalcs(idx, iterationState.CountsRowV[idx], countsV, resultCountsV, iterationState.UsedCalcs, iterationState.UnusedCalcs);
+			return resultCountsV;
+		}
 
-			iterationState.CountsRowV[idx] = resultCountsV;
+		#endregion
 
-			if (_calculateEscapeVelocities)
+		#region Support Methods
+
+		// The indexes of the samples in a row that do not coincide with a sample from the parent.
+		private int[] GetNewSampleIndexes(int valuesPerRow, int scaleFactor)
+		{
+			if (_newSampleIndexes.Length != valuesPerRow - valuesPerRow / scaleFactor || _newSampleIndexesScaleFactor != scaleFactor)
 			{
-				var escapeVelocities = new ushort[Vector256<int>.Count];
-				CalculateEscapeVelocities(sumOfSquares, targetReachedCompVec, escapeVelocities);
-				Array.Copy(escapeVelocities, 0, iterationState.EscapeVelocities, idx * Vector256<uint>.Count, escapeVelocities.Length);
+				_newSampleIndexes = Enumerable.Range(0, valuesPerRow).Where(x => x % scaleFactor != 0).ToArray();
+				_newSampleIndexesScaleFactor = scaleFactor;
 			}
+
+			return _newSampleIndexes;
 		}
 
-		#endregion
+		private void FillCrLimbSet(FP31ValArray crs, int[] sampleIndexes, Vector256<uint>[] limbSet)
+		{
+			var values = MemoryMarshal.Cast<Vector256<uint>, uint>(crs.Mantissas);
+			var lanes = Vector256<uint>.Count;
+			var limbCount = limbSet.Length;
 
-		#region Support Methods
+			for (var limbPtr = 0; limbPtr < limbCount; limbPtr++)
+			{
+				Vector256<uint> limb = Vector256<uint>.Zero;
+
+				for (var lane = 0; lane < lanes; lane++)
+				{
+					var sampleIndex = sampleIndexes[lane];
+					var vecPtr = sampleIndex / lanes * limbCount + limbPtr;
+					limb = limb.WithElement(lane, values[vecPtr * lanes + sampleIndex % lanes]);
+				}
+
+				limbSet[limbPtr] = limb;
+			}
+		}
 
 		[MethodImpl(MethodImplOptions.AggressiveInlining)]
 		private int SaveCountsForDoneItems(Vector256<int> escapedFlagsVec, Vector256<int> targetReachedCompVec, 
@@ -0,0 +1,598 @@
+﻿using MSS.Common;
+using MSS.Types;
+using MSS.Types.APValues;
+using MSS.Types.MSet;
+using System.Diagnostics;
+using System.Runtime.CompilerServices;
+using System.Runtime.InteropServices;
+using System.Runtime.Intrinsics;
+using System.Runtime.Intrinsics.X86;
+
+namespace MSetGeneratorPrototype
+{
+	/// <summary>
+	/// Generates a MapSection using Mariani–Silver rectangle subdivision.
+	/// The border of each rectangle is calculated first, if every sample on the border has the same count and escape velocity,
+	/// the interior is filled with that value, otherwise the rectangle is divided in two and each half is processed the same way.
+	/// Requests that include ZValues or that are increasing the target iterations are handled by the DepthFirst generator.
+	/// </summary>
+	public class MapSectionGeneratorSubdivision : IMapSectionGenerator
+	{
+		#region Private Properties
+
+		// Rectangles having a side this short, or shorter, are calculated sample by sample.
+		private const int MIN_RECTANGLE_SIZE = 6;
+
+		// When verifying, every n'th sample in each direction of a filled rectangle is calculated.
+		private const int VERIFICATION_STRIDE = 4;
+
+		private readonly bool _verifyFilledAreas;
+		private readonly MapSectionGeneratorDepthFirst _depthFirstGenerator;
+
+		private SamplePointBuilder _samplePointBuilder;
+
+		private IFP31VecMath _fp31VecMath;
+		private IIterator _iterator;
+
+		private Vector256<int> _thresholdVector;
+		private Vector256<int> _targetIterationsVector;
+		private bool _calculateEscapeVelocities;
+
+		private Vector256<uint>[] _crs;
+		private Vector256<uint>[] _cis;
+		private Vector256<uint>[] _zrs;
+		private Vector256<uint>[] _zis;
+		private Vector256<uint>[] _resultSumOfSqrs;
+
+		private readonly Vector256<int> _justOne;
+
+		// Working values for the current MapSection
+		private FP31Val[] _samplePointsX;
+		private FP31Val[] _samplePointsY;
+		private int _width;
+		private ushort[] _counts;
+		private ushort[] _escapeVelocities;
+		private bool[] _isCalculated;
+
+		private readonly List<int> _pendingIndexes;
+
+		private const bool USE_DET_DEBUG = false;
+
+		#endregion
+
+		#region Constructor
+
+		public MapSectionGeneratorSubdivision(int limbCount, SizeInt blockSize, bool verifyFilledAreas = true)
+		{
+			_verifyFilledAreas = verifyFilledAreas;
+			_depthFirstGenerator = new MapSectionGeneratorDepthFirst(limbCount, blockSize);
+
+			_samplePointBuilder = new SamplePointBuilder(new SamplePointCache(blockSize));
+
+			_fp31VecMath = _samplePointBuilder.GetVecMath(limbCount);
+			_iterator = new IteratorDepthFirst(_fp31VecMath);
+
+			_crs = FP31VecMathHelper.CreateNewLimbSet(limbCount);
+			_cis = FP31VecMathHelper.CreateNewLimbSet(limbCount);
+			_zrs = FP31VecMathHelper.CreateNewLimbSet(limbCount);
+			_zis = FP31VecMathHelper.CreateNewLimbSet(limbCount);
+			_resultSumOfSqrs = FP31VecMathHelper.CreateNewLimbSet(limbCount);
+
+			_justOne = Vector256.Create(1);
+
+			_samplePointsX = new FP31Val[0];
+			_samplePointsY = new FP31Val[0];
+			_counts = new ushort[0];
+			_escapeVelocities = new ushort[0];
+			_isCalculated = new bool[0];
+
+			_pendingIndexes = new List<int>();
+		}
+
+		#endregion
+
+		#region Public Properties
+
+		// The number of samples that were calculated, and the number that were filled in, for the last MapSection generated.
+		public int NumberOfSamplesCalculated { get; private set; }
+		public int NumberOfSamplesFilled { get; private set; }
+
+		#endregion
+
+		#region Generate MapSection
+
+		public MapSectionResponse GenerateMapSection(MapSectionRequest mapSectionRequest, CancellationToken ct)
+		{
+			var mapCalcSettings = mapSectionRequest.MapCalcSettings;
+
+			if (mapCalcSettings.SaveTheZValues || mapSectionRequest.IncreasingIterations)
+			{
+				// The ZValues of the samples that are filled in are not known.
+				return _depthFirstGenerator.GenerateMapSection(mapSectionRequest, ct);
+			}
+
+			GetMathAndAllocateTempVars(mapSectionRequest);
+
+			var coords = GetCoordinates(mapSectionRequest, _fp31VecMath.ApFixedPointFormat);
+
+			var (mapSectionVectors2, mapSectionZVectors) = mapSectionRequest.TransferMapVectorsOut2();
+			if (mapSectionVectors2 == null) throw new ArgumentException("The MapSectionVectors2 is null.");
+
+			var stopwatch = Stopwatch.StartNew();
+
+			(_samplePointsX, _samplePointsY) = _samplePointBuilder.BuildSamplePoints(coords);
+
+			_calculateEscapeVelocities = mapCalcSettings.CalculateEscapeVelocities;
+			_thresholdVector = _calculateEscapeVelocities ? _fp31VecMath.CreateVectorForComparison(RMapConstants.DEFAULT_NORMALIZED_THRESHOLD) : _fp31VecMath.CreateVectorForComparison((uint)mapCalcSettings.Threshold);
+			_targetIterationsVector = Vector256.Create(mapCalcSettings.TargetIterations);
+			_fp31VecMath.MathOpCounts.Reset();
+
+			var blockSize = mapSectionRequest.BlockSize;
+			ResetWorkingValues(blockSize);
+			SeedFromParentSamples(mapSectionRequest.ParentSamples, blockSize);
+			mapSectionRequest.ParentSamples = null;
+
+			var sectionCompleted = GenerateRectangles(blockSize, ct);
+
+			if (sectionCompleted)
+			{
+				var dstCounts = MemoryMarshal.Cast<byte, ushort>(mapSectionVectors2.Counts);
+				_counts.CopyTo(dstCounts);
+
+				var dstEscapeVelocities = MemoryMarshal.Cast<byte, ushort>(mapSectionVectors2.EscapeVelocities);
+				_escapeVelocities.CopyTo(dstEscapeVelocities);
+			}
+
+			var allRowsHaveEscaped = sectionCompleted && _counts.All(x => x <= mapCalcSettings.TargetIterations);
+
+			stopwatch.Stop();
+			mapSectionRequest.GenerationDuration = stopwatch.Elapsed;
+
+			var result = new MapSectionResponse(mapSectionRequest, sectionCompleted, allRowsHaveEscaped, mapSectionVectors2, mapSectionZVectors, requestCancelled: ct.IsCancellationRequested);
+			result.MathOpCounts = _fp31VecMath.MathOpCounts.Clone();
+			result.LimbCount = _fp31VecMath.LimbCount;
+
+			Debug.WriteLineIf(USE_DET_DEBUG, $"Subdivision calculated {NumberOfSamplesCalculated} and filled {NumberOfSamplesFilled} samples.");
+
+			return result;
+		}
+
+		private bool GenerateRectangles(SizeInt blockSize, CancellationToken ct)
+		{
+			var rectangles = new Stack<RectangleInt>();
+			rectangles.Push(new RectangleInt(new PointInt(0, 0), blockSize));
+
+			while (rectangles.Count > 0)
+			{
+				if (ct.IsCancellationRequested)
+				{
+					return false;
+				}
+
+				var rectangle = rectangles.Pop();
+
+				if (rectangle.Width <= MIN_RECTANGLE_SIZE || rectangle.Height <= MIN_RECTANGLE_SIZE)
+				{
+					CalculateInterior(rectangle);
+					continue;
+				}
+
+				CalculateBorder(rectangle);
+
+				if (BorderIsUniform(rectangle, out var count, out var escapeVelocity) && InteriorIsVerified(rectangle, count, escapeVelocity))
+				{
+					FillInterior(rectangle, count, escapeVelocity);
+				}
+				else
+				{
+					// The two halves share the row or column along which the rectangle is divided.
+					var (first, second) = Divide(rectangle);
+					rectangles.Push(second);
+					rectangles.Push(first);
+				}
+			}
+
+			return true;
+		}
+
+		#endregion
+
+		#region Rectangle Support
+
+		private void CalculateBorder(RectangleInt rectangle)
+		{
+			var x1 = rectangle.X2 - 1;
+			var y1 = rectangle.Y2 - 1;
+
+			for (var x = rectangle.X1; x <= x1; x++)
+			{
+				AddPending(x, rectangle.Y1);
+				AddPending(x, y1);
+			}
+
+			for (var y = rectangle.Y1 + 1; y < y1; y++)
+			{
+				AddPending(rectangle.X1, y);
+				AddPending(x1, y);
+			}
+
+			CalculatePending();
+		}
+
+		private void CalculateInterior(RectangleInt rectangle)
+		{
+			for (var y = rectangle.Y1; y < rectangle.Y2; y++)
+			{
+				for (var x = rectangle.X1; x < rectangle.X2; x++)
+				{
+					AddPending(x, y);
+				}
+			}
+
+			CalculatePending();
+		}
+
+		private bool BorderIsUniform(RectangleInt rectangle, out ushort count, out ushort escapeVelocity)
+		{
+			var x0 = rectangle.X1;
+			var y0 = rectangle.Y1;
+			var x1 = rectangle.X2 - 1;
+			var y1 = rectangle.Y2 - 1;
+
+			var firstIndex = y0 * _width + x0;
+			count = _counts[firstIndex];
+			escapeVelocity = _escapeVelocities[firstIndex];
+
+			for (var x = x0; x <= x1; x++)
+			{
+				if (!IsSame(x, y0, count, escapeVelocity) || !IsSame(x, y1, count, escapeVelocity))
+				{
+					return false;
+				}
+			}
+
+			for (var y = y0 + 1; y < y1; y++)
+			{
+				if (!IsSame(x0, y, count, escapeVelocity) || !IsSame(x1, y, count, escapeVelocity))
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		private bool InteriorIsVerified(RectangleInt rectangle, ushort count, ushort escapeVelocity)
+		{
+			if (!_verifyFilledAreas)
+			{
+				return true;
+			}
+
+			var x0 = rectangle.X1;
+			var y0 = rectangle.Y1;
+
+			for (var y = y0 + VERIFICATION_STRIDE / 2; y < rectangle.Y2 - 1; y += VERIFICATION_STRIDE)
+			{
+				for (var x = x0 + VERIFICATION_STRIDE / 2; x < rectangle.X2 - 1; x += VERIFICATION_STRIDE)
+				{
+					AddPending(x, y);
+				}
+			}
+
+			CalculatePending();
+
+			for (var y = y0 + VERIFICATION_STRIDE / 2; y < rectangle.Y2 - 1; y += VERIFICATION_STRIDE)
+			{
+				for (var x = x0 + VERIFICATION_STRIDE / 2; x < rectangle.X2 - 1; x += VERIFICATION_STRIDE)
+				{
+					if (!IsSame(x, y, count, escapeVelocity))
+					{
+						return false;
+					}
+				}
+			}
+
+			return true;
+		}
+
+		private void FillInterior(RectangleInt rectangle, ushort count, ushort escapeVelocity)
+		{
+			for (var y = rectangle.Y1 + 1; y < rectangle.Y2 - 1; y++)
+			{
+				for (var x = rectangle.X1 + 1; x < rectangle.X2 - 1; x++)
+				{
+					var index = y * _width + x;
+
+					if (!_isCalculated[index])
+					{
+						_counts[index] = count;
+						_escapeVelocities[index] = escapeVelocity;
+						_isCalculated[index] = true;
+						NumberOfSamplesFilled++;
+					}
+				}
+			}
+		}
+
+		private (RectangleInt first, RectangleInt second) Divide(RectangleInt rectangle)
+		{
+			var x0 = rectangle.X1;
+			var y0 = rectangle.Y1;
+
+			if (rectangle.Width >= rectangle.Height)
+			{
+				var firstWidth = rectangle.Width / 2 + 1;
+				var first = new RectangleInt(new PointInt(x0, y0), new SizeInt(firstWidth, rectangle.Height));
+				var second = new RectangleInt(new PointInt(x0 + firstWidth - 1, y0), new SizeInt(rectangle.Width - firstWidth + 1, rectangle.Height));
+
+				return (first, second);
+			}
+			else
+			{
+				var firstHeight = rectangle.Height / 2 + 1;
+				var first = new RectangleInt(new PointInt(x0, y0), new SizeInt(rectangle.Width, firstHeight));
+				var second = new RectangleInt(new PointInt(x0, y0 + firstHeight - 1), new SizeInt(rectangle.Width, rectangle.Height - firstHeight + 1));
+
+				return (first, second);
+			}
+		}
+
+		[MethodImpl(MethodImplOptions.AggressiveInlining)]
+		private bool IsSame(int x, int y, ushort count, ushort escapeVelocity)
+		{
+			var index = y * _width + x;
+			return _counts[index] == count && _escapeVelocities[index] == escapeVelocity;
+		}
+
+		#endregion
+
+		#region Calculate Samples
+
+		private void AddPending(int x, int y)
+		{
+			var index = y * _width + x;
+
+			if (!_isCalculated[index])
+			{
+				// Mark now, so that corners and shared edges are only added once.
+				_isCalculated[index] = true;
+				_pendingIndexes.Add(index);
+			}
+		}
+
+		private void CalculatePending()
+		{
+			var lanes = Vector256<uint>.Count;
+			var indexes = new int[lanes];
+
+			for (var ptr = 0; ptr < _pendingIndexes.Count; ptr += lanes)
+			{
+				for (var lane = 0; lane < lanes; lane++)
+				{
+					// Unused lanes repeat the first sample of the group.
+					indexes[lane] = _pendingIndexes[ptr + lane < _pendingIndexes.Count ? ptr + lane : ptr];
+				}
+
+				CalculateSamples(indexes);
+			}
+
+			NumberOfSamplesCalculated += _pendingIndexes.Count;
+			_pendingIndexes.Clear();
+		}
+
+		private void CalculateSamples(int[] indexes)
+		{
+			FillLimbSets(indexes);
+
+			var hasEscapedFlagsV = Vector256<int>.Zero;
+			var doneFlagsV = Vector256<int>.Zero;
+			var countsV = Vector256<int>.Zero;
+			var resultCountsV = countsV;
+
+			FP31VecMathHelper.ClearLimbSet(_zrs);
+			FP31VecMathHelper.ClearLimbSet(_zis);
+			FP31VecMathHelper.ClearLimbSet(_resultSumOfSqrs);
+
+			var escapedFlagsVec = Vector256<int>.Zero;
+
+			var sumOfSquares = _iterator.IterateFirstRound(_crs, _cis, _zrs, _zis, ref doneFlagsV);
+			countsV = Avx2.Add(countsV, _justOne);
+
+			var targetReachedCompVec = Avx2.CompareGreaterThan(countsV, _targetIterationsVector);
+
+			_fp31VecMath.IsGreaterOrEqThan(sumOfSquares, _thresholdVector, ref escapedFlagsVec);
+			var baseEscapedFlagsVec = escapedFlagsVec;
+			var compositeIsDone = SaveCountsForDoneItems(escapedFlagsVec, targetReachedCompVec, countsV, ref resultCountsV, sumOfSquares, ref hasEscapedFlagsV, ref doneFlagsV);
+
+			while (compositeIsDone != -1)
+			{
+				sumOfSquares = _iterator.Iterate(_crs, _cis, _zrs, _zis, ref doneFlagsV);
+				countsV = Avx2.Add(countsV, _justOne);
+
+				targetReachedCompVec = Avx2.CompareGreaterThan(countsV, _targetIterationsVector);
+
+				_fp31VecMath.IsGreaterOrEqThan(sumOfSquares, _thresholdVector, ref escapedFlagsVec);
+
+				// Once escaped, always escaped
+				escapedFlagsVec = Avx2.Or(baseEscapedFlagsVec, escapedFlagsVec);
+
+				compositeIsDone = SaveCountsForDoneItems(escapedFlagsVec, targetReachedCompVec, countsV, ref resultCountsV, sumOfSquares, ref hasEscapedFlagsV, ref doneFlagsV);
+			}
+
+			for (var lane = 0; lane < indexes.Length; lane++)
+			{
+				var index = indexes[lane];
+				_counts[index] = (ushort)resultCountsV.GetElement(lane);
+				_escapeVelocities[index] = _calculateEscapeVelocities && hasEscapedFlagsV.GetElement(lane) == -1
+					? CalculateEscapeVelocity(_resultSumOfSqrs, lane)
+					: (ushort)0;
+			}
+		}
+
+		private void FillLimbSets(int[] indexes)
+		{
+			var values = new uint[indexes.Length];
+
+			for (var limbPtr = 0; limbPtr < _crs.Length; limbPtr++)
+			{
+				for (var lane = 0; lane < indexes.Length; lane++)
+				{
+					values[lane] = _samplePointsX[indexes[lane] % _width].Mantissa[limbPtr];
+				}
+
+				_crs[limbPtr] = Vector256.Create(values[0], values[1], values[2], values[3], values[4], values[5], values[6], values[7]);
+
+				for (var lane = 0; lane < indexes.Length; lane++)
+				{
+					values[lane] = _samplePointsY[indexes[lane] / _width].Mantissa[limbPtr];
+				}
+
+				_cis[limbPtr] = Vector256.Create(values[0], values[1], values[2], values[3], values[4], values[5], values[6], values[7]);
+			}
+		}
+
+		[MethodImpl(MethodImplOptions.AggressiveInlining)]
+		private int SaveCountsForDoneItems(Vector256<int> escapedFlagsVec, Vector256<int> targetReachedCompVec,
+			Vector256<int> countsV, ref Vector256<int> resultCountsV, Vector256<uint>[] sumOfSqrs,
+			ref Vector256<int> hasEscapedFlagsV, ref Vector256<int> doneFlagsV)
+		{
+			// Apply the new escapedFlags, only if the doneFlags is false for each vector position
+			hasEscapedFlagsV = Avx2.BlendVariable(escapedFlagsVec, hasEscapedFlagsV, doneFlagsV);
+
+			var prevDoneFlagsV = doneFlagsV;
+
+			// If escaped or reached the target iterations, we're done
+			doneFlagsV = Avx2.Or(hasEscapedFlagsV, targetReachedCompVec);
+
+			var compositeIsDone = Avx2.MoveMask(doneFlagsV.AsByte());
+			var prevCompositeIsDone = Avx2.MoveMask(prevDoneFlagsV.AsByte());
+			if (compositeIsDone != prevCompositeIsDone)
+			{
+				var justNowDone = Avx2.CompareEqual(prevDoneFlagsV, doneFlagsV);
+
+				// Save the current count
+				resultCountsV = Avx2.BlendVariable(countsV, resultCountsV, justNowDone); // use First if Zero, second if 1
+
+				// Save the sum of the squares as of the escape, for the escape velocity.
+				for (var limbPtr = 0; limbPtr < _resultSumOfSqrs.Length; limbPtr++)
+				{
+					_resultSumOfSqrs[limbPtr] = Avx2.BlendVariable(sumOfSqrs[limbPtr].AsInt32(), _resultSumOfSqrs[limbPtr].AsInt32(), justNowDone).AsUInt32();
+				}
+			}
+
+			return compositeIsDone;
+		}
+
+		private ushort CalculateEscapeVelocity(Vector256<uint>[] sumOfSqrs, int lane)
+		{
+			var limbCount = _fp31VecMath.LimbCount;
+			var val = new uint[limbCount];
+
+			for (var j = 0; j < limbCount; j++)
+			{
+				val[j] = sumOfSqrs[j].GetElement(lane);
+			}
+
+			var rValue = FP31ValHelper.CreateRValue(sign: true, val, _fp31VecMath.ApFixedPointFormat.TargetExponent, RMapConstants.DEFAULT_PRECISION);
+			var dv = RValueHelper.ConvertToDoubles(rValue).Sum();
+
+			var nu = Math.Log2(Math.Log(dv)) / 3.55;
+
+			if (nu < 0 || nu > 1)
+			{
+				nu = 0;
+			}
+
+			return (ushort)Math.Round((1 - nu) * 10000);
+		}
+
+		#endregion
+
+		#region Support Methods
+
+		private void ResetWorkingValues(SizeInt blockSize)
+		{
+			_width = blockSize.Width;
+
+			if (_counts.Length != blockSize.NumberOfCells)
+			{
+				_counts = new ushort[blockSize.NumberOfCells];
+				_escapeVelocities = new ushort[blockSize.NumberOfCells];
+				_isCalculated = new bool[blockSize.NumberOfCells];
+			}
+			else
+			{
+				Array.Clear(_counts);
+				Array.Clear(_escapeVelocities);
+				Array.Clear(_isCalculated);
+			}
+
+			_pendingIndexes.Clear();
+
+			NumberOfSamplesCalculated = 0;
+			NumberOfSamplesFilled = 0;
+		}
+
+		// Samples that coincide with a sample from the parent are treated as already calculated.
+		private void SeedFromParentSamples(MapSectionParentSamples? parentSamples, SizeInt blockSize)
+		{
+			if (parentSamples == null)
+			{
+				return;
+			}
+
+			for (var y = 0; y < blockSize.Height; y += parentSamples.ScaleFactor)
+			{
+				for (var x = 0; x < blockSize.Width; x += parentSamples.ScaleFactor)
+				{
+					var index = y * _width + x;
+					parentSamples.GetValues(x, y, out _counts[index], out _escapeVelocities[index]);
+					_isCalculated[index] = true;
+				}
+			}
+		}
+
+		private void GetMathAndAllocateTempVars(MapSectionRequest mapSectionRequest)
+		{
+			var blockSizeForThisRequest = mapSectionRequest.BlockSize;
+
+			if (_samplePointBuilder.BlockSize != blockSizeForThisRequest)
+			{
+				_samplePointBuilder.Dispose();
+				_samplePointBuilder = new SamplePointBuilder(new SamplePointCache(blockSizeForThisRequest));
+			}
+
+			var limbCountForThisRequest = mapSectionRequest.LimbCount;
+
+			if (_fp31VecMath.LimbCount != limbCountForThisRequest)
+			{
+				_fp31VecMath = _samplePointBuilder.GetVecMath(limbCountForThisRequest);
+				_iterator = new IteratorDepthFirst(_fp31VecMath);
+
+				_crs = FP31VecMathHelper.CreateNewLimbSet(limbCountForThisRequest);
+				_cis = FP31VecMathHelper.CreateNewLimbSet(limbCountForThisRequest);
+				_zrs = FP31VecMathHelper.CreateNewLimbSet(limbCountForThisRequest);
+				_zis = FP31VecMathHelper.CreateNewLimbSet(limbCountForThisRequest);
+				_resultSumOfSqrs = FP31VecMathHelper.CreateNewLimbSet(limbCountForThisRequest);
+			}
+		}
+
+		private IteratorCoords GetCoordinates(MapSectionRequest mapSectionRequest, ApFixedPointFormat apFixedPointFormat)
+		{
+			var mapPosition = mapSectionRequest.MapPosition;
+			var samplePointDelta = mapSectionRequest.SamplePointDelta;
+
+			var startingCx = FP31ValHelper.CreateFP31Val(mapPosition.X, apFixedPointFormat);
+			var startingCy = FP31ValHelper.CreateFP31Val(mapPosition.Y, apFixedPointFormat);
+			var delta = FP31ValHelper.CreateFP31Val(samplePointDelta.Width, apFixedPointFormat);
+
+			var blockPos = mapSectionRequest.RepoBlockPosition;
+			var screenPos = mapSectionRequest.ScreenPosition;
+
+			return new IteratorCoords(blockPos, screenPos, startingCx, startingCy, delta);
+		}
+
+		#endregion
+	}
+}
@@ -0,0 +1,205 @@
+﻿using MongoDB.Bson;
+using MSetGeneratorPrototype;
+using MSS.Common;
+using MSS.Types;
+using MSS.Types.APValues;
+using MSS.Types.MSet;
+using System.Runtime.InteropServices;
+
+namespace MSetGeneratorPrototypeTest
+{
+	public class MapSectionGeneratorDepthFirstTest
+	{
+		private static readonly SizeInt BLOCK_SIZE = new SizeInt(128);
+
+		[Theory]
+		[InlineData(false)]
+		[InlineData(true)]
+		public void GenerateMapSection_StraddlingRealAxis_MirroredRowsMatchDirect(bool saveTheZValues)
+		{
+			var limbCount = 2;
+			var samplePointDelta = new RSize(1, 1, -11);
+			var mapCalcSettings = new MapCalcSettings(targetIterations: 200, threshold: 4, calculateEscapeVelocities: true, saveTheZValues);
+
+			// Rows 0 through 63 are below the real axis, row 64 is on it, rows 65 through 127 mirror rows 63 through 1.
+			var straddlingPosition = new RPoint(-1536, -64, -11);
+
+			// The block above the real axis, whose first row is a single sample point above it.
+			var abovePosition = new RPoint(-1536, 1, -11);
+
+			// Each row above the real axis must be found to mirror a row below it, otherwise the comparison below does not exercise the mirroring.
+			var mirroredRowSources = GetMirroredRowSources(straddlingPosition, samplePointDelta, limbCount);
+			Assert.NotNull(mirroredRowSources);
+
+			for (var rowNumber = 0; rowNumber < BLOCK_SIZE.Height; rowNumber++)
+			{
+				Assert.Equal(rowNumber > 64 ? 128 - rowNumber : -1, mirroredRowSources![rowNumber]);
+			}
+
+			var generator = new MapSectionGeneratorDepthFirst(limbCount, BLOCK_SIZE);
+			var mirrored = generator.GenerateMapSection(CreateRequest(straddlingPosition, samplePointDelta, limbCount, mapCalcSettings), CancellationToken.None);
+			var direct = generator.GenerateMapSection(CreateRequest(abovePosition, samplePointDelta, limbCount, mapCalcSettings), CancellationToken.None);
+
+			Assert.True(mirrored.RequestCompleted);
+			Assert.True(direct.RequestCompleted);
+
+			var mirroredCounts = GetValues(mirrored.MapSectionVectors2!.Counts);
+			var directCounts = GetValues(direct.MapSectionVectors2!.Counts);
+
+			var mirroredEscapeVelocities = GetValues(mirrored.MapSectionVectors2!.EscapeVelocities);
+			var directEscapeVelocities = GetValues(direct.MapSectionVectors2!.EscapeVelocities);
+
+			for (var rowNumber = 65; rowNumber < BLOCK_SIZE.Height; rowNumber++)
+			{
+				// The row of the direct block with the same y coordinate.
+				var directRowNumber = rowNumber - 65;
+
+				Assert.Equal(GetRow(directCounts, directRowNumber), GetRow(mirroredCounts, rowNumber));
+				Assert.Equal(GetRow(directEscapeVelocities, directRowNumber), GetRow(mirroredEscapeVelocities, rowNumber));
+
+				if (saveTheZValues)
+				{
+					// The fixed-point arithmetic is not exactly symmetric, the low bits of the z values of a directly generated row differ from those of
+					// the row it mirrors. The mirrored row's z values must be the complex conjugates of its source row's z values.
+					var zVectors = mirrored.MapSectionZVectors!;
+					var sourceRowNumber = mirroredRowSources[rowNumber];
+
+					Assert.Equal(GetBytesRow(zVectors.Zrs, zVectors.BytesPerZValueRow, sourceRowNumber), GetBytesRow(zVectors.Zrs, zVectors.BytesPerZValueRow, rowNumber));
+					Assert.Equal(GetBytesRow(zVectors.HasEscapedFlags, zVectors.BytesPerRow, sourceRowNumber), GetBytesRow(zVectors.HasEscapedFlags, zVectors.BytesPerRow, rowNumber));
+					AssertIsNegation(GetBytesRow(zVectors.Zis, zVectors.BytesPerZValueRow, sourceRowNumber), GetBytesRow(zVectors.Zis, zVectors.BytesPerZValueRow, rowNumber), limbCount);
+				}
+			}
+		}
+
+		[Theory]
+		[InlineData(2, 200)]
+		[InlineData(4, 200)]
+		[InlineData(2, 400)]	// The parent was generated using a larger TargetIterations value.
+		[InlineData(4, 400)]
+		public void GenerateMapSection_SeededFromParent_MatchesUnseeded(int scaleFactor, int parentTargetIterations)
+		{
+			var limbCount = 2;
+			var mapPosition = new RPoint(-1536, 128, -11);
+			var samplePointDelta = new RSize(1, 1, -11);
+			var mapCalcSettings = new MapCalcSettings(targetIterations: 200, threshold: 4, calculateEscapeVelocities: false, saveTheZValues: false);
+
+			// The MapSection being generated covers the lower, right quadrant of the parent after a 2x zoom, and the second column, third row after a 4x zoom.
+			var parentOffset = scaleFactor == 2 ? new PointInt(64, 64) : new PointInt(32, 64);
+			var parentSamples = GenerateParentSamples(mapPosition, samplePointDelta, limbCount, mapCalcSettings, scaleFactor, parentOffset, parentTargetIterations);
+
+			var generator = new MapSectionGeneratorDepthFirst(limbCount, BLOCK_SIZE);
+			var expected = generator.GenerateMapSection(CreateRequest(mapPosition, samplePointDelta, limbCount, mapCalcSettings), CancellationToken.None);
+
+			var seededRequest = CreateRequest(mapPosition, samplePointDelta, limbCount, mapCalcSettings);
+			seededRequest.ParentSamples = parentSamples;
+			var actual = generator.GenerateMapSection(seededRequest, CancellationToken.None);
+
+			Assert.True(actual.RequestCompleted);
+			Assert.Equal(GetValues(expected.MapSectionVectors2!.Counts), GetValues(actual.MapSectionVectors2!.Counts));
+		}
+
+		#region Support Methods
+
+		// Generates the MapSection, using a SamplePointDelta scaleFactor times larger, whose sample at parentOffset coincides with the first sample at mapPosition.
+		private MapSectionParentSamples GenerateParentSamples(RPoint mapPosition, RSize samplePointDelta, int limbCount, MapCalcSettings mapCalcSettings,
+			int scaleFactor, PointInt parentOffset, int parentTargetIterations)
+		{
+			var parentSamplePointDelta = new RSize(samplePointDelta.WidthNumerator * scaleFactor, samplePointDelta.HeightNumerator * scaleFactor, samplePointDelta.Exponent);
+			var parentMapPosition = new RPoint(mapPosition.XNumerator - parentOffset.X * parentSamplePointDelta.WidthNumerator,
+				mapPosition.YNumerator - parentOffset.Y * parentSamplePointDelta.HeightNumerator, mapPosition.Exponent);
+
+			var parentMapCalcSettings = new MapCalcSettings(parentTargetIterations, mapCalcSettings.Threshold, mapCalcSettings.CalculateEscapeVelocities, saveTheZValues: false);
+
+			var generator = new MapSectionGeneratorDepthFirst(limbCount, BLOCK_SIZE);
+			var parent = generator.GenerateMapSection(CreateRequest(parentMapPosition, parentSamplePointDelta, limbCount, parentMapCalcSettings), CancellationToken.None);
+
+			Assert.True(parent.RequestCompleted);
+
+			var result = new MapSectionParentSamples(parent.MapSectionVectors2!, scaleFactor, parentOffset, mapCalcSettings.TargetIterations);
+			return result;
+		}
+
+		private MapSectionRequest CreateRequest(RPoint mapPosition, RSize samplePointDelta, int limbCount, MapCalcSettings mapCalcSettings)
+		{
+			var subdivisionId = ObjectId.GenerateNewId().ToString();
+			var byteCount = BLOCK_SIZE.NumberOfCells * 2;
+
+			var result = new MapSectionRequest(JobType.FullScale, jobId: string.Empty, OwnerType.Project, subdivisionId, subdivisionId,
+				new PointInt(), new VectorInt(), new BigVector(), new MapBlockOffset(), mapPosition, isInverted: false,
+				precision: 0, limbCount, BLOCK_SIZE, samplePointDelta, mapCalcSettings, mapLoaderJobNumber: 0, requestNumber: 0)
+			{
+				MapSectionVectors2 = new MapSectionVectors2(BLOCK_SIZE, new byte[byteCount], new byte[byteCount])
+			};
+
+			if (mapCalcSettings.SaveTheZValues)
+			{
+				result.MapSectionZVectors = new MapSectionZVectors(BLOCK_SIZE, limbCount);
+			}
+
+			return result;
+		}
+
+		private int[]? GetMirroredRowSources(RPoint mapPosition, RSize samplePointDelta, int limbCount)
+		{
+			var apFixedPointFormat = new ApFixedPointFormat(limbCount);
+
+			var startingCx = FP31ValHelper.CreateFP31Val(mapPosition.X, apFixedPointFormat);
+			var startingCy = FP31ValHelper.CreateFP31Val(mapPosition.Y, apFixedPointFormat);
+			var delta = FP31ValHelper.CreateFP31Val(samplePointDelta.Width, apFixedPointFormat);
+			var iteratorCoords = new IteratorCoords(new MapBlockOffset(), new PointInt(), startingCx, startingCy, delta);
+
+			var samplePointBuilder = new SamplePointBuilder(new SamplePointCache(BLOCK_SIZE));
+			var (_, samplePointsY) = samplePointBuilder.BuildSamplePoints(iteratorCoords);
+
+			var result = RealAxisSymmetryHelper.GetMirroredRowSources(samplePointsY);
+
+			return result;
+		}
+
+		private ushort[] GetValues(byte[] values)
+		{
+			var result = MemoryMarshal.Cast<byte, ushort>(values).ToArray();
+			return result;
+		}
+
+		private ushort[] GetRow(ushort[] values, int rowNumber)
+		{
+			var result = values.AsSpan(rowNumber * BLOCK_SIZE.Width, BLOCK_SIZE.Width).ToArray();
+			return result;
+		}
+
+		// Each vector holds LimbCount limbs for each of 8 lanes, the least significant limb first. Adding a value and its negation produces zero in every limb.
+		private void AssertIsNegation(byte[] values, byte[] negatedValues, int limbCount)
+		{
+			const int LANES = 8;
+
+			var a = MemoryMarshal.Cast<byte, uint>(values);
+			var b = MemoryMarshal.Cast<byte, uint>(negatedValues);
+
+			for (var vecStart = 0; vecStart < a.Length; vecStart += limbCount * LANES)
+			{
+				for (var lane = 0; lane < LANES; lane++)
+				{
+					var carry = 0u;
+
+					for (var limbPtr = 0; limbPtr < limbCount; limbPtr++)
+					{
+						var index = vecStart + limbPtr * LANES + lane;
+						var sum = a[index] + b[index] + carry;
+
+						Assert.Equal(0u, sum & 0x7FFFFFFF);
+						carry = sum >> 31;
+					}
+				}
+			}
+		}
+
+		private byte[] GetBytesRow(byte[] values, int bytesPerRow, int rowNumber)
+		{
+			var result = values.AsSpan(rowNumber * bytesPerRow, bytesPerRow).ToArray();
+			return result;
+		}
+
+		#endregion
+	}
+}
@@ -0,0 +1,109 @@
+﻿using MongoDB.Bson;
+using MSetGeneratorPrototype;
+using MSS.Types;
+using MSS.Types.MSet;
+using System.Runtime.InteropServices;
+
+namespace MSetGeneratorPrototypeTest
+{
+	public class MapSectionGeneratorSubdivisionTest
+	{
+		private static readonly SizeInt BLOCK_SIZE = new SizeInt(128);
+
+		[Theory]
+		[InlineData(-1536, 128, false)]		// Near the neck between the main cardioid and the period-2 bulb.
+		[InlineData(-1536, 128, true)]
+		[InlineData(-2048, 512, false)]		// Above the period-2 bulb.
+		[InlineData(4096, 4096, false)]		// Entirely outside the set.
+		public void GenerateMapSection_MatchesDepthFirst(long x, long y, bool calculateEscapeVelocities)
+		{
+			var limbCount = 2;
+			var mapPosition = new RPoint(x, y, -11);
+			var samplePointDelta = new RSize(1, 1, -11);
+			var mapCalcSettings = new MapCalcSettings(targetIterations: 200, threshold: 4, calculateEscapeVelocities, saveTheZValues: false);
+
+			var depthFirstGenerator = new MapSectionGeneratorDepthFirst(limbCount, BLOCK_SIZE);
+			var expected = depthFirstGenerator.GenerateMapSection(CreateRequest(mapPosition, samplePointDelta, limbCount, mapCalcSettings), CancellationToken.None);
+
+			var subdivisionGenerator = new MapSectionGeneratorSubdivision(limbCount, BLOCK_SIZE);
+			var actual = subdivisionGenerator.GenerateMapSection(CreateRequest(mapPosition, samplePointDelta, limbCount, mapCalcSettings), CancellationToken.None);
+
+			Assert.True(actual.RequestCompleted);
+
+			// An escape velocity is calculated from the sample's z value after its vector is done, which depends on the other samples
+			// iterated in the same vector. The two generators group the samples differently, so only the counts are compared.
+			Assert.Equal(GetValues(expected.MapSectionVectors2!.Counts), GetValues(actual.MapSectionVectors2!.Counts));
+		}
+
+		[Theory]
+		[InlineData(2, 200)]
+		[InlineData(4, 200)]
+		[InlineData(2, 400)]	// The parent was generated using a larger TargetIterations value.
+		[InlineData(4, 400)]
+		public void GenerateMapSection_SeededFromParent_MatchesUnseeded(int scaleFactor, int parentTargetIterations)
+		{
+			var limbCount = 2;
+			var mapPosition = new RPoint(-1536, 128, -11);
+			var samplePointDelta = new RSize(1, 1, -11);
+			var mapCalcSettings = new MapCalcSettings(targetIterations: 200, threshold: 4, calculateEscapeVelocities: false, saveTheZValues: false);
+
+			// The MapSection being generated covers the lower, right quadrant of the parent after a 2x zoom, and the second column, third row after a 4x zoom.
+			var parentOffset = scaleFactor == 2 ? new PointInt(64, 64) : new PointInt(32, 64);
+			var parentSamples = GenerateParentSamples(mapPosition, samplePointDelta, limbCount, mapCalcSettings, scaleFactor, parentOffset, parentTargetIterations);
+
+			var generator = new MapSectionGeneratorSubdivision(limbCount, BLOCK_SIZE);
+			var expected = generator.GenerateMapSection(CreateRequest(mapPosition, samplePointDelta, limbCount, mapCalcSettings), CancellationToken.None);
+
+			var seededRequest = CreateRequest(mapPosition, samplePointDelta, limbCount, mapCalcSettings);
+			seededRequest.ParentSamples = parentSamples;
+			var actual = generator.GenerateMapSection(seededRequest, CancellationToken.None);
+
+			Assert.True(actual.RequestCompleted);
+			Assert.Equal(GetValues(expected.MapSectionVectors2!.Counts), GetValues(actual.MapSectionVectors2!.Counts));
+		}
+
+		#region Support Methods
+
+		// Generates the MapSection, using a SamplePointDelta scaleFactor times larger, whose sample at parentOffset coincides with the first sample at mapPosition.
+		private MapSectionParentSamples GenerateParentSamples(RPoint mapPosition, RSize samplePointDelta, int limbCount, MapCalcSettings mapCalcSettings,
+			int scaleFactor, PointInt parentOffset, int parentTargetIterations)
+		{
+			var parentSamplePointDelta = new RSize(samplePointDelta.WidthNumerator * scaleFactor, samplePointDelta.HeightNumerator * scaleFactor, samplePointDelta.Exponent);
+			var parentMapPosition = new RPoint(mapPosition.XNumerator - parentOffset.X * parentSamplePointDelta.WidthNumerator,
+				mapPosition.YNumerator - parentOffset.Y * parentSamplePointDelta.HeightNumerator, mapPosition.Exponent);
+
+			var parentMapCalcSettings = new MapCalcSettings(parentTargetIterations, mapCalcSettings.Threshold, mapCalcSettings.CalculateEscapeVelocities, saveTheZValues: false);
+
+			var generator = new MapSectionGeneratorDepthFirst(limbCount, BLOCK_SIZE);
+			var parent = generator.GenerateMapSection(CreateRequest(parentMapPosition, parentSamplePointDelta, limbCount, parentMapCalcSettings), CancellationToken.None);
+
+			Assert.True(parent.RequestCompleted);
+
+			var result = new MapSectionParentSamples(parent.MapSectionVectors2!, scaleFactor, parentOffset, mapCalcSettings.TargetIterations);
+			return result;
+		}
+
+		private MapSectionRequest CreateRequest(RPoint mapPosition, RSize samplePointDelta, int limbCount, MapCalcSettings mapCalcSettings)
+		{
+			var subdivisionId = ObjectId.GenerateNewId().ToString();
+			var byteCount = BLOCK_SIZE.NumberOfCells * 2;
+
+			var result = new MapSectionRequest(JobType.FullScale, jobId: string.Empty, OwnerType.Project, subdivisionId, subdivisionId,
+				new PointInt(), new VectorInt(), new BigVector(), new MapBlockOffset(), mapPosition, isInverted: false,
+				precision: 0, limbCount, BLOCK_SIZE, samplePointDelta, mapCalcSettings, mapLoaderJobNumber: 0, requestNumber: 0)
+			{
+				MapSectionVectors2 = new MapSectionVectors2(BLOCK_SIZE, new byte[byteCount], new byte[byteCount])
+			};
+
+			return result;
+		}
+
+		private ushort[] GetValues(byte[] values)
+		{
+			var result = MemoryMarshal.Cast<byte, ushort>(values).ToArray();
+			return result;
+		}
+
+		#endregion
+	}
+}
@@ -0,0 +1,107 @@
+﻿using MongoDB.Bson;
+using MongoDB.Bson.Serialization;
+using MSS.Types;
+using ProjectRepo;
+using ProjectRepo.Entities;
+using System.Numerics;
+
+namespace MSetGeneratorPrototypeTest
+{
+	public class MapSectionRangeFilterTest
+	{
+		private const string HI_FIELD = "BlockPosXHi";
+		private const string LO_FIELD = "BlockPosXLo";
+
+		private static readonly BigInteger LONG_FACTOR = BigInteger.Pow(2, 63);
+
+		[Theory]
+		[InlineData("-5", "3")]												// Both bounds have a Hi value of 0, the Lo values have different signs.
+		[InlineData("-12", "-4")]
+		[InlineData("-9223372036854775813", "7")]							// The lower bound has a Hi value of -1.
+		[InlineData("-18446744073709551615", "-9223372036854775808")]		// Both bounds have a Hi value of -1, the upper bound has a Lo value of 0.
+		[InlineData("-9223372036854775810", "9223372036854775810")]		// The bounds have Hi values of -1 and 1.
+		public void GetRangeFilter_NegativeOffsets_MatchesTheValuesInRange(string from, string to)
+		{
+			var fromValue = BigInteger.Parse(from);
+			var toValue = BigInteger.Parse(to);
+
+			var fromPair = BigIntegerHelper.ToLongPairs(fromValue);
+			var toPair = BigIntegerHelper.ToLongPairs(toValue);
+
+			var filter = MapSectionReaderWriter.GetRangeFilter(HI_FIELD, LO_FIELD, fromPair[0], fromPair[1], toPair[0], toPair[1]);
+			var renderedFilter = filter.Render(BsonSerializer.SerializerRegistry.GetSerializer<MapSectionRecord>(), BsonSerializer.SerializerRegistry);
+
+			foreach (var value in GetValuesToTry(fromValue, toValue))
+			{
+				var pair = BigIntegerHelper.ToLongPairs(value);
+				var document = new BsonDocument { { HI_FIELD, pair[0] }, { LO_FIELD, pair[1] } };
+
+				var expected = value >= fromValue && value <= toValue;
+				Assert.True(expected == Matches(renderedFilter, document), $"The filter for {from} to {to} should {(expected ? "" : "not ")}match {value} ({pair[0]}, {pair[1]}).");
+			}
+		}
+
+		#region Support Methods
+
+		private IEnumerable<BigInteger> GetValuesToTry(BigInteger fromValue, BigInteger toValue)
+		{
+			var landmarks = new BigInteger[] { -2 * LONG_FACTOR + 1, -LONG_FACTOR, -1, 0, 1, LONG_FACTOR, 2 * LONG_FACTOR - 1, fromValue, toValue, (fromValue + toValue) / 2 };
+			var result = landmarks.SelectMany(x => new[] { x - 1, x, x + 1 }).Where(x => BigInteger.Abs(x) < 2 * LONG_FACTOR).Distinct();
+
+			return result;
+		}
+
+		// Evaluates the subset of the query language produced by GetRangeFilter: $and, $or, equality and the comparison operators.
+		private bool Matches(BsonDocument filter, BsonDocument document)
+		{
+			foreach (var element in filter)
+			{
+				var isMatch = element.Name switch
+				{
+					"$and" => element.Value.AsBsonArray.All(x => Matches(x.AsBsonDocument, document)),
+					"$or" => element.Value.AsBsonArray.Any(x => Matches(x.AsBsonDocument, document)),
+					_ => MatchesField(document[element.Name], element.Value)
+				};
+
+				if (!isMatch)
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		private bool MatchesField(BsonValue value, BsonValue condition)
+		{
+			if (!(condition is BsonDocument operators && operators.ElementCount > 0 && operators.GetElement(0).Name.StartsWith("$")))
+			{
+				return value.CompareTo(condition) == 0;
+			}
+
+			foreach (var element in operators)
+			{
+				var comparison = value.CompareTo(element.Value);
+
+				var isMatch = element.Name switch
+				{
+					"$eq" => comparison == 0,
+					"$gt" => comparison > 0,
+					"$gte" => comparison >= 0,
+					"$lt" => comparison < 0,
+					"$lte" => comparison <= 0,
+					_ => throw new NotSupportedException($"The operator {element.Name} is not supported.")
+				};
+
+				if (!isMatch)
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		#endregion
+	}
+}
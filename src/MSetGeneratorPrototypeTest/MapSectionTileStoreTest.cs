@@ -0,0 +1,306 @@
+﻿using MongoDB.Bson;
+using MSetRepo;
+using MSS.Types.MSet;
+
+namespace MSetGeneratorPrototypeTest
+{
+	public class MapSectionTileStoreTest : IDisposable
+	{
+		private const int VALUE_COUNT = 32 * 32;
+
+		private readonly string _folder;
+		private readonly string _filePath;
+
+		public MapSectionTileStoreTest()
+		{
+			_folder = Path.Combine(Path.GetTempPath(), "MapSectionTileStoreTest_" + Guid.NewGuid().ToString("N"));
+			_filePath = Path.Combine(_folder, "tiles.msts");
+		}
+
+		public void Dispose()
+		{
+			if (Directory.Exists(_folder))
+			{
+				Directory.Delete(_folder, recursive: true);
+			}
+		}
+
+		[Fact]
+		public void Reopen_AfterPutAndRemove_RestoresTheStoredMapSections()
+		{
+			var subdivisionId = ObjectId.GenerateNewId();
+			var tiles = Enumerable.Range(0, 4).Select(x => CreateMapSectionBytes(subdivisionId, x, seed: x)).ToList();
+
+			using (var store = new MapSectionTileStore(_filePath))
+			{
+				tiles.ForEach(store.Put);
+
+				tiles[1] = CreateMapSectionBytes(subdivisionId, 1, seed: 100);
+				store.Put(tiles[1]);
+
+				Assert.True(store.Remove(subdivisionId, tiles[2].BlockPosition));
+			}
+
+			using (var store = new MapSectionTileStore(_filePath))
+			{
+				Assert.Equal(3, store.Count);
+				Assert.False(store.TryGet(subdivisionId, tiles[2].BlockPosition, out _));
+
+				foreach (var tile in tiles.Where((x, i) => i != 2))
+				{
+					AssertIsStored(store, tile);
+				}
+			}
+		}
+
+		[Theory]
+		[InlineData(3, 0)]			// The magic number of the last record is missing, the record was not completed.
+		[InlineData(3, 8)]			// The payload length of the last record is wrong.
+		[InlineData(3, 200)]		// A payload byte of the last record does not match the checksum.
+		[InlineData(1, 0)]			// A record in the middle ends the scan, the records after it are dropped as well.
+		[InlineData(1, 200)]
+		public void Reopen_TornRecord_DropsThatRecordAndThoseAfterIt(int recordNumber, int byteOffset)
+		{
+			var subdivisionId = ObjectId.GenerateNewId();
+			var tiles = Enumerable.Range(0, 4).Select(x => CreateMapSectionBytes(subdivisionId, x, seed: x)).ToList();
+
+			using (var store = new MapSectionTileStore(_filePath))
+			{
+				tiles.ForEach(store.Put);
+			}
+
+			var recordOffsets = GetRecordOffsets(_filePath);
+			Assert.Equal(tiles.Count, recordOffsets.Count);
+
+			CorruptByte(_filePath, recordOffsets[recordNumber] + byteOffset);
+
+			using (var store = new MapSectionTileStore(_filePath))
+			{
+				Assert.Equal(recordNumber, store.Count);
+				Assert.Equal(recordOffsets[recordNumber], store.FileBytes);
+
+				for (var i = 0; i < tiles.Count; i++)
+				{
+					if (i < recordNumber)
+					{
+						AssertIsStored(store, tiles[i]);
+					}
+					else
+					{
+						Assert.False(store.TryGet(subdivisionId, tiles[i].BlockPosition, out _));
+					}
+				}
+
+				// The next record overwrites the torn record.
+				store.Put(tiles[3]);
+			}
+
+			using (var store = new MapSectionTileStore(_filePath))
+			{
+				Assert.Equal(recordNumber + 1, store.Count);
+				AssertIsStored(store, tiles[3]);
+			}
+		}
+
+		[Fact]
+		public void Compact_ReclaimsReplacedAndRemovedRecords()
+		{
+			var subdivisionId = ObjectId.GenerateNewId();
+			var tiles = Enumerable.Range(0, 6).Select(x => CreateMapSectionBytes(subdivisionId, x, seed: x)).ToList();
+
+			using (var store = new MapSectionTileStore(_filePath))
+			{
+				tiles.ForEach(store.Put);
+
+				tiles[0] = CreateMapSectionBytes(subdivisionId, 0, seed: 100);
+				store.Put(tiles[0]);
+
+				store.Remove(subdivisionId, tiles[5].BlockPosition);
+				tiles.RemoveAt(5);
+
+				Assert.True(store.FileBytes > store.LiveBytes);
+
+				store.Compact();
+
+				Assert.Equal(store.LiveBytes, store.FileBytes);
+				Assert.Equal(tiles.Count, store.Count);
+				tiles.ForEach(x => AssertIsStored(store, x));
+
+				// The compacted file can be appended to.
+				tiles.Add(CreateMapSectionBytes(subdivisionId, 6, seed: 6));
+				store.Put(tiles[^1]);
+			}
+
+			using (var store = new MapSectionTileStore(_filePath))
+			{
+				Assert.Equal(store.LiveBytes, store.FileBytes);
+				Assert.Equal(tiles.Count, store.Count);
+				tiles.ForEach(x => AssertIsStored(store, x));
+			}
+		}
+
+		[Fact]
+		public void Put_BeyondMaxBytes_KeepsTheMostRecentlyStoredMapSections()
+		{
+			var subdivisionId = ObjectId.GenerateNewId();
+			var tiles = Enumerable.Range(0, 20).Select(x => CreateMapSectionBytes(subdivisionId, x, seed: x)).ToList();
+			var maxBytes = 10L * 4 * VALUE_COUNT;
+
+			using var store = new MapSectionTileStore(_filePath, maxBytes);
+			tiles.ForEach(store.Put);
+
+			Assert.True(store.FileBytes <= maxBytes);
+			Assert.InRange(store.Count, 1, tiles.Count - 1);
+
+			// The MapSections kept are those stored last.
+			var firstKept = tiles.Count - store.Count;
+
+			for (var i = 0; i < tiles.Count; i++)
+			{
+				if (i < firstKept)
+				{
+					Assert.False(store.TryGet(subdivisionId, tiles[i].BlockPosition, out _));
+				}
+				else
+				{
+					AssertIsStored(store, tiles[i]);
+				}
+			}
+		}
+
+		[Fact]
+		public void Put_Concurrently_StoresEachMapSection()
+		{
+			var subdivisionId = ObjectId.GenerateNewId();
+			var tiles = Enumerable.Range(0, 64).Select(x => CreateMapSectionBytes(subdivisionId, x, seed: x)).ToList();
+
+			using (var store = new MapSectionTileStore(_filePath))
+			{
+				Parallel.ForEach(tiles, new ParallelOptions { MaxDegreeOfParallelism = 8 }, tile =>
+				{
+					store.Put(tile);
+					AssertIsStored(store, tile);
+				});
+
+				Assert.Equal(tiles.Count, store.Count);
+			}
+
+			using (var store = new MapSectionTileStore(_filePath))
+			{
+				Assert.Equal(tiles.Count, store.Count);
+				tiles.ForEach(x => AssertIsStored(store, x));
+			}
+		}
+
+		[Fact]
+		public void Flush_ConcurrentlyWithCompact_KeepsEachMapSection()
+		{
+			var subdivisionId = ObjectId.GenerateNewId();
+			var tiles = Enumerable.Range(0, 64).Select(x => CreateMapSectionBytes(subdivisionId, x, seed: x)).ToList();
+
+			using (var store = new MapSectionTileStore(_filePath) { FlushOnWrite = false })
+			{
+				var writer = Task.Run(() =>
+				{
+					foreach (var tile in tiles)
+					{
+						store.Put(tile);
+
+						// Replaced records give each compaction something to reclaim.
+						store.Put(tile);
+					}
+				});
+
+				var flusher = Task.Run(() =>
+				{
+					while (!writer.IsCompleted)
+					{
+						store.Flush();
+					}
+				});
+
+				var compactor = Task.Run(() =>
+				{
+					while (!writer.IsCompleted)
+					{
+						store.Compact();
+					}
+				});
+
+				Task.WaitAll(writer, flusher, compactor);
+
+				Assert.Equal(tiles.Count, store.Count);
+				tiles.ForEach(x => AssertIsStored(store, x));
+			}
+
+			using (var store = new MapSectionTileStore(_filePath))
+			{
+				Assert.Equal(tiles.Count, store.Count);
+				tiles.ForEach(x => AssertIsStored(store, x));
+			}
+		}
+
+		#region Support Methods
+
+		private MapSectionBytes CreateMapSectionBytes(ObjectId subdivisionId, int x, int seed)
+		{
+			var random = new Random(seed);
+
+			var counts = new byte[VALUE_COUNT * 2];
+			var escapeVelocities = new byte[VALUE_COUNT * 2];
+
+			random.NextBytes(counts);
+			random.NextBytes(escapeVelocities);
+
+			var mapCalcSettings = new MapCalcSettings(targetIterations: 100 + seed, threshold: 4, calculateEscapeVelocities: true, saveTheZValues: false);
+			var dateCreated = new DateTime(2023, 1, 1, 0, 0, 0, DateTimeKind.Utc).AddMinutes(seed);
+
+			var result = new MapSectionBytes(ObjectId.GenerateNewId(), dateCreated, dateCreated, dateCreated, subdivisionId, new MapBlockOffset(0, x, 0, -x),
+				mapCalcSettings, requestWasCompleted: true, allRowsHaveEscaped: seed % 2 == 0, counts, escapeVelocities);
+
+			return result;
+		}
+
+		private void AssertIsStored(MapSectionTileStore store, MapSectionBytes expected)
+		{
+			Assert.True(store.TryGet(expected.SubdivisionId, expected.BlockPosition, out var actual));
+
+			Assert.Equal(expected.Id, actual!.Id);
+			Assert.Equal(expected.DateCreatedUtc, actual.DateCreatedUtc);
+			Assert.Equal(expected.MapCalcSettings.TargetIterations, actual.MapCalcSettings.TargetIterations);
+			Assert.Equal(expected.AllRowsHaveEscaped, actual.AllRowsHaveEscaped);
+			Assert.Equal(expected.Counts, actual.Counts);
+			Assert.Equal(expected.EscapeVelocities, actual.EscapeVelocities);
+		}
+
+		// Each record starts with a 16 byte header, holding the magic number and the length of the payload at offset 8. Records are 8-byte aligned.
+		private List<long> GetRecordOffsets(string filePath)
+		{
+			var bytes = File.ReadAllBytes(filePath);
+			var result = new List<long>();
+			var offset = 0;
+
+			while (offset + 16 <= bytes.Length && BitConverter.ToUInt32(bytes, offset) != 0)
+			{
+				result.Add(offset);
+				var payloadLength = BitConverter.ToInt32(bytes, offset + 8);
+				offset += (16 + payloadLength + 7) / 8 * 8;
+			}
+
+			return result;
+		}
+
+		private void CorruptByte(string filePath, long offset)
+		{
+			using var fileStream = new FileStream(filePath, FileMode.Open, FileAccess.ReadWrite);
+
+			fileStream.Position = offset;
+			var value = fileStream.ReadByte();
+
+			fileStream.Position = offset;
+			fileStream.WriteByte((byte)(value ^ 0x5A));
+		}
+
+		#endregion
+	}
+}
@@ -0,0 +1,113 @@
+﻿using MongoDB.Bson;
+using MSetRepo;
+using MSS.Common.DataTransferObjects;
+using MSS.Types.MSet;
+using ProjectRepo.Entities;
+using System.Runtime.InteropServices;
+
+namespace MSetGeneratorPrototypeTest
+{
+	public class MapSectionValuesCodecTest
+	{
+		[Theory]
+		[InlineData("Constant", 128, 128)]
+		[InlineData("Random", 128, 128)]
+		[InlineData("Bands", 128, 128)]
+		[InlineData("Constant", 37, 5)]		// Odd widths, the first value of each row is predicted from the value above.
+		[InlineData("Random", 37, 5)]
+		[InlineData("Bands", 127, 3)]
+		[InlineData("Random", 1, 9)]
+		public void Encode_Decode_RoundTrips(string kind, int width, int height)
+		{
+			var values = BuildValues(kind, width, height);
+
+			var encoded = MapSectionValuesCodec.Encode(values, width);
+			var decoded = MapSectionValuesCodec.Decode(encoded, MapSectionValuesCodec.CURRENT_VERSION, values.Length, width);
+
+			Assert.Equal(values, decoded);
+
+			if (kind == "Constant")
+			{
+				// A constant block is a single run of zero differences after the first value.
+				Assert.True(encoded.Length < 32, $"The constant block was encoded using {encoded.Length} bytes.");
+			}
+		}
+
+		[Fact]
+		public void Encode_Decode_EmptyValues_RoundTrips()
+		{
+			var encoded = MapSectionValuesCodec.Encode(Array.Empty<byte>(), 128);
+			Assert.Empty(encoded);
+
+			var decoded = MapSectionValuesCodec.Decode(encoded, MapSectionValuesCodec.CURRENT_VERSION, byteCount: 0, 128);
+			Assert.Empty(decoded);
+		}
+
+		[Fact]
+		public void Decode_TruncatedValues_Throws()
+		{
+			var values = BuildValues("Random", 128, 128);
+			var encoded = MapSectionValuesCodec.Encode(values, 128);
+
+			Assert.Throws<InvalidDataException>(() => MapSectionValuesCodec.Decode(encoded.Take(encoded.Length / 2).ToArray(), MapSectionValuesCodec.CURRENT_VERSION, values.Length, 128));
+		}
+
+		[Fact]
+		public void MapFrom_RawVersionRecord_ReturnsStoredValues()
+		{
+			var width = 128;
+			var height = 128;
+
+			var counts = BuildValues("Bands", width, height);
+			var escapeVelocities = BuildValues("Random", width, height);
+
+			// Records saved before the values were compressed have no CodecVersion, which reads back as RAW_VERSION.
+			var record = new MapSectionRecord(DateTime.UtcNow, ObjectId.GenerateNewId(), 0, 1, 0, 2,
+				new MapCalcSettings(targetIterations: 400, threshold: 4, calculateEscapeVelocities: true, saveTheZValues: false),
+				AllRowsHaveEscaped: false, counts, escapeVelocities);
+
+			Assert.Equal(MapSectionValuesCodec.RAW_VERSION, record.CodecVersion);
+
+			var mapper = new MSetRecordMapper(new DtoMapper());
+			var mapSectionBytes = mapper.MapFrom(record);
+
+			Assert.Equal(counts, mapSectionBytes.Counts);
+			Assert.Equal(escapeVelocities, mapSectionBytes.EscapeVelocities);
+		}
+
+		[Fact]
+		public void Decode_UnknownVersion_Throws()
+		{
+			var values = BuildValues("Constant", 8, 8);
+			Assert.Throws<NotSupportedException>(() => MapSectionValuesCodec.Decode(values, MapSectionValuesCodec.CURRENT_VERSION + 1, values.Length, 8));
+		}
+
+		#region Support Methods
+
+		private byte[] BuildValues(string kind, int width, int height)
+		{
+			var random = new Random(23);
+			var values = new ushort[width * height];
+
+			for (var i = 0; i < values.Length; i++)
+			{
+				var x = i % width;
+				var y = i / width;
+
+				values[i] = kind switch
+				{
+					"Constant" => 1000,
+					"Random" => (ushort)random.Next(ushort.MaxValue + 1),
+					// Concentric bands of equal counts, with the occasional large jump.
+					_ => (ushort)((x - width / 2) * (x - width / 2) / 40 + (y - height / 2) * (y - height / 2) / 40 + (random.Next(50) == 0 ? 60000 : 0))
+				};
+			}
+
+			var result = MemoryMarshal.AsBytes(values.AsSpan()).ToArray();
+
+			return result;
+		}
+
+		#endregion
+	}
+}
@@ -0,0 +1,109 @@
+﻿using MSetRepo;
+using MSS.Types;
+using MSS.Types.MSet;
+
+namespace MSetGeneratorPrototypeTest
+{
+	public class ZValuesCodecTest
+	{
+		private const int VALUE_SIZE = 4;
+		private const int LANES = 8;
+
+		[Theory]
+		[InlineData(128, 128, 2, 50)]
+		[InlineData(16, 4, 3, 0)]		// No sample has escaped.
+		[InlineData(16, 4, 3, 100)]		// Every sample has escaped.
+		[InlineData(24, 3, 1, 30)]
+		[InlineData(128, 2, 4, 90)]
+		public void Encode_Decode_MixedEscapedLanes_RoundTripsBitExact(int width, int height, int limbCount, int escapedPercentage)
+		{
+			var blockSize = new SizeInt(width, height);
+			var zValues = BuildZValues(blockSize, limbCount, escapedPercentage);
+
+			var encoded = ZValuesCodec.Encode(zValues);
+			Assert.Equal(ZValuesCodec.CURRENT_VERSION, encoded.CodecVersion);
+
+			var decoded = ZValuesCodec.Decode(encoded);
+
+			Assert.Equal(ZValuesCodec.RAW_VERSION, decoded.CodecVersion);
+			Assert.Equal(width, decoded.BlockWidth);
+			Assert.Equal(height, decoded.BlockHeight);
+			Assert.Equal(limbCount, decoded.LimbCount);
+
+			Assert.Equal(zValues.HasEscapedFlags, decoded.HasEscapedFlags);
+			Assert.Equal(zValues.RowsHasEscaped, decoded.RowsHasEscaped);
+
+			// The Z value of an escaped sample is not stored, it comes back as zero. Every other byte comes back unchanged.
+			Assert.Equal(GetExpectedValues(zValues.Zrs, zValues), decoded.Zrs);
+			Assert.Equal(GetExpectedValues(zValues.Zis, zValues), decoded.Zis);
+		}
+
+		[Fact]
+		public void Decode_RawVersion_ReturnsTheSameValues()
+		{
+			var zValues = BuildZValues(new SizeInt(16, 2), limbCount: 2, escapedPercentage: 50);
+
+			var decoded = ZValuesCodec.Decode(zValues);
+
+			Assert.Same(zValues, decoded);
+		}
+
+		#region Support Methods
+
+		private ZValues BuildZValues(SizeInt blockSize, int limbCount, int escapedPercentage)
+		{
+			var random = new Random(31);
+			var valueCount = blockSize.NumberOfCells;
+
+			var zrs = new byte[valueCount * limbCount * VALUE_SIZE];
+			var zis = new byte[zrs.Length];
+			random.NextBytes(zrs);
+			random.NextBytes(zis);
+
+			var hasEscapedFlags = new byte[valueCount * VALUE_SIZE];
+			var rowsHasEscaped = new byte[blockSize.Height * VALUE_SIZE];
+
+			for (var i = 0; i < valueCount; i++)
+			{
+				if (random.Next(100) < escapedPercentage)
+				{
+					// Any non-zero value marks the sample as escaped, the flags must be stored exactly.
+					BitConverter.GetBytes(random.Next(1, int.MaxValue)).CopyTo(hasEscapedFlags, i * VALUE_SIZE);
+					rowsHasEscaped[i / blockSize.Width * VALUE_SIZE] = 1;
+				}
+			}
+
+			var result = new ZValues(blockSize, limbCount, zrs, zis, hasEscapedFlags, rowsHasEscaped);
+
+			return result;
+		}
+
+		// The values are stored row by row, within a row the limbs of 8 consecutive samples are stored together, limb by limb.
+		private byte[] GetExpectedValues(byte[] values, ZValues zValues)
+		{
+			var result = (byte[])values.Clone();
+			var limbCount = zValues.LimbCount;
+
+			for (var y = 0; y < zValues.BlockHeight; y++)
+			{
+				for (var x = 0; x < zValues.BlockWidth; x++)
+				{
+					if (BitConverter.ToInt32(zValues.HasEscapedFlags, (y * zValues.BlockWidth + x) * VALUE_SIZE) == 0)
+					{
+						continue;
+					}
+
+					for (var limbPtr = 0; limbPtr < limbCount; limbPtr++)
+					{
+						var index = (y * zValues.BlockWidth * limbCount + ((x / LANES) * limbCount + limbPtr) * LANES + x % LANES) * VALUE_SIZE;
+						Array.Clear(result, index, VALUE_SIZE);
+					}
+				}
+			}
+
+			return result;
+		}
+
+		#endregion
+	}
+}
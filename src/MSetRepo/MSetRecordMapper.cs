@@ -239,6 +239,7 @@ namespace MSetRepo
 
 			MapSectionRecord result;
 
+			var blockWidth = source.MapSectionVectors2.BlockSize.Width;
 
 			result = new MapSectionRecord
 				(
@@ -252,13 +253,16 @@ namespace MSetRepo
 
 				MapCalcSettings: source.MapCalcSettings ?? throw new ArgumentNullException(),
 
-				Counts: source.MapSectionVectors2.Counts,
-				EscapeVelocities: source.MapSectionVectors2.EscapeVelocities,
+				Counts: MapSectionValuesCodec.Encode(source.MapSectionVectors2.Counts, blockWidth),
+				EscapeVelocities: MapSectionValuesCodec.Encode(source.MapSectionVectors2.EscapeVelocities, blockWidth),
 
 				AllRowsHaveEscaped: source.AllRowsHaveEscaped
 				)
 			{
 				Id = source.MapSectionId is null ? ObjectId.GenerateNewId() : new ObjectId(source.MapSectionId),
+				BlockWidth = blockWidth,
+				BlockHeight = source.MapSectionVectors2.BlockSize.Height,
+				CodecVersion = MapSectionValuesCodec.CURRENT_VERSION,
 				Complete = source.RequestCompleted,
 				LastAccessed = DateTime.UtcNow,
 			};
@@ -288,6 +292,9 @@ namespace MSetRepo
 		{
 			var blockPosition = GetBlockPosition(target.BlockPosXHi, target.BlockPosXLo, target.BlockPosYHi, target.BlockPosYLo);
 
+			// Two bytes per value.
+			var byteCount = target.BlockWidth * target.BlockHeight * 2;
+
 			var result = new MapSectionBytes
 			(
 				mapSectionId: target.Id,
@@ -296,8 +303,8 @@ namespace MSetRepo
 				mapCalcSettings: target.MapCalcSettings,
 				requestWasCompleted: target.RequestWasCompleted,
 				allRowsHaveEscaped: target.AllRowsHaveEscaped,
-				counts: target.Counts,
-				escapeVelocities: target.EscapeVelocities
+				counts: MapSectionValuesCodec.Decode(target.Counts, target.CodecVersion, byteCount, target.BlockWidth),
+				escapeVelocities: MapSectionValuesCodec.Decode(target.EscapeVelocities, target.CodecVersion, byteCount, target.BlockWidth)
 			);
 
 			return result;
@@ -11,6 +11,7 @@ using System.Collections.Generic;
 using System.Diagnostics;
 using System.Diagnostics.CodeAnalysis;
 using System.Linq;
+using System.Runtime.CompilerServices;
 using System.Text;
 using System.Threading;
 using System.Threading.Tasks;
@@ -28,9 +29,11 @@ namespace MSetRepo
 		private readonly JobMapSectionReaderWriter _jobMapSectionReaderWriter;
 		private readonly SubdivisonReaderWriter _subdivisionReaderWriter;
 
+		private readonly MapSectionTileStore? _tileStore;
+
 		#region Constructor
 
-		public MapSectionAdapter(DbProvider dbProvider, MSetRecordMapper mSetRecordMapper)
+		public MapSectionAdapter(DbProvider dbProvider, MSetRecordMapper mSetRecordMapper, MapSectionTileStore? tileStore = null)
 		{
 			_dbProvider = dbProvider;
 			_mSetRecordMapper = mSetRecordMapper;
@@ -41,6 +44,8 @@ namespace MSetRepo
 			_jobMapSectionReaderWriter = new JobMapSectionReaderWriter(_dbProvider);
 			_subdivisionReaderWriter = new SubdivisonReaderWriter(_dbProvider);
 
+			_tileStore = tileStore;
+
 			//BsonSerializer.RegisterSerializer(new ZValuesSerializer());
 
 			//BsonClassMap.RegisterClassMap<ZValues>(cm => {
@@ -67,6 +72,9 @@ namespace MSetRepo
 				_mapSectionReaderWriter.CreateSubAndPosIndex();
 			}
 
+			// Added after the collection was first created, creating an index that already exists has no effect.
+			_mapSectionReaderWriter.CreateSubAndBlockRangeIndex();
+
 			_ = _subdivisionReaderWriter.CreateCollection();
 
 			if (_mapSectionZValuesReaderWriter.CreateCollection())
@@ -81,12 +89,15 @@ namespace MSetRepo
 			_jobMapSectionReaderWriter.CreateMapSectionIdIndex();
 
 			_mapSectionReaderWriter.CreateSubAndPosIndex();
+			_mapSectionReaderWriter.CreateSubAndBlockRangeIndex();
 
 			_mapSectionZValuesReaderWriter.CreateSectionIdIndex();
 		}
 
 		public void DropMapSections()
 		{
+			_tileStore?.Clear();
+
 			_jobMapSectionReaderWriter.DropCollection();
 
 			_mapSectionZValuesReaderWriter.DropCollection();
@@ -96,6 +107,8 @@ namespace MSetRepo
 
 		public void DropMapSectionsAndSubdivisions()
 		{
+			_tileStore?.Clear();
+
 			_jobMapSectionReaderWriter.DropCollection();
 
 			_mapSectionZValuesReaderWriter.DropCollection();
@@ -123,12 +136,18 @@ namespace MSetRepo
 
 		public MapSectionBytes? GetMapSectionBytes(ObjectId subdivisionId, MapBlockOffset blockPosition)
 		{
+			if (_tileStore != null && _tileStore.TryGet(subdivisionId, blockPosition, out var storedMapSectionBytes))
+			{
+				return storedMapSectionBytes;
+			}
+
 			try
 			{
 				var mapSectionRecord = _mapSectionReaderWriter.Get(subdivisionId, blockPosition);
 				if (mapSectionRecord != null)
 				{
 					var result = _mSetRecordMapper.MapFrom(mapSectionRecord);
+					_tileStore?.Put(result);
 
 					return result;
 				}
@@ -147,6 +166,11 @@ namespace MSetRepo
 
 		public async Task<MapSectionBytes?> GetMapSectionBytesAsync(ObjectId subdivisionId, MapBlockOffset blockPosition, CancellationToken ct)
 		{
+			if (_tileStore != null && _tileStore.TryGet(subdivisionId, blockPosition, out var storedMapSectionBytes))
+			{
+				return storedMapSectionBytes;
+			}
+
 			try
 			{
 				var mapSectionRecord = await _mapSectionReaderWriter.GetAsync(subdivisionId, blockPosition, ct);
@@ -154,6 +178,7 @@ namespace MSetRepo
 				if (mapSectionRecord != null)
 				{
 					var result = _mSetRecordMapper.MapFrom(mapSectionRecord);
+					_tileStore?.Put(result);
 
 					return result;
 				}
@@ -174,6 +199,21 @@ namespace MSetRepo
 			}
 		}
 
+		/// <summary>
+		/// Returns the MapSections of the Subdivision whose block position is within the rectangle, the corners are inclusive, using a single query.
+		/// Each MapSection is returned as soon as it has been decoded.
+		/// </summary>
+		public async IAsyncEnumerable<MapSectionBytes> GetMapSectionBytesInRectangleAsync(ObjectId subdivisionId, MapBlockOffset lowerLeft, MapBlockOffset upperRight, [EnumeratorCancellation] CancellationToken ct)
+		{
+			await foreach (var mapSectionRecord in _mapSectionReaderWriter.GetInRectangleAsync(subdivisionId, lowerLeft, upperRight, ct))
+			{
+				var result = _mSetRecordMapper.MapFrom(mapSectionRecord);
+				_tileStore?.Put(result);
+
+				yield return result;
+			}
+		}
+
 		//public async Task<MapSectionResponse?> GetMapSectionAsync(ObjectId subdivisionId, BigVector blockPosition, MapSectionVectors mapSectionVectors, CancellationToken ct)
 		//{
 		//	try
@@ -299,23 +339,112 @@ namespace MSetRepo
 
 			var mapSectionId = await _mapSectionReaderWriter.InsertAsync(mapSectionRecord);
 
-			if (mapSectionRecord.Id != ObjectId.Empty && mapSectionId != mapSectionRecord.Id)
+			if (mapSectionId != mapSectionRecord.Id)
 			{
-				mapSectionResponse.MapSectionId = mapSectionRecord.Id.ToString();
+				// A MapSection for the same block is already on file, it is updated to hold the counts the caller will associate with its Id.
+				mapSectionRecord = mapSectionRecord with { Id = mapSectionId };
+				_ = await _mapSectionReaderWriter.UpdateCountValuesAync(mapSectionRecord, mapSectionResponse.RequestCompleted);
 			}
 
+			PutInTileStore(mapSectionRecord, mapSectionResponse);
+
 			return mapSectionId;
 		}
 
+		/// <summary>
+		/// Inserts the MapSections using a single bulk write. Returns the Id of each MapSection, if a MapSection for the same block is already on file,
+		/// its Id is returned and its counts are updated using a second bulk write.
+		/// </summary>
+		public async Task<ObjectId?[]> SaveMapSectionsAsync(IList<MapSectionResponse> mapSectionResponses)
+		{
+			Debug.Assert(mapSectionResponses.All(x => x.MapSectionId == null), "MapSectionId is not null on call to SaveMapSectionsAsync.");
+
+			var mapSectionRecords = mapSectionResponses.Select(x => _mSetRecordMapper.MapTo(x)).ToList();
+
+			var mapSectionIds = await _mapSectionReaderWriter.InsertManyAsync(mapSectionRecords);
+			var duplicates = new List<(MapSectionRecord mapSectionRecord, bool requestCompleted)>();
+
+			for (var i = 0; i < mapSectionRecords.Count; i++)
+			{
+				if (mapSectionIds[i] is ObjectId mapSectionId && mapSectionId != mapSectionRecords[i].Id)
+				{
+					// The caller associates the counts with the Id of the MapSection on file.
+					mapSectionRecords[i] = mapSectionRecords[i] with { Id = mapSectionId };
+					duplicates.Add((mapSectionRecords[i], mapSectionResponses[i].RequestCompleted));
+				}
+			}
+
+			if (duplicates.Count > 0)
+			{
+				_ = await _mapSectionReaderWriter.UpdateManyCountValuesAsync(duplicates);
+			}
+
+			for (var i = 0; i < mapSectionRecords.Count; i++)
+			{
+				if (mapSectionIds[i] != null)
+				{
+					PutInTileStore(mapSectionRecords[i], mapSectionResponses[i]);
+				}
+			}
+
+			return mapSectionIds;
+		}
+
 		public async Task<long?> UpdateCountValuesAync(MapSectionResponse mapSectionResponse)
 		{
 			var mapSectionRecord = _mSetRecordMapper.MapTo(mapSectionResponse);
 
 			var result = await _mapSectionReaderWriter.UpdateCountValuesAync(mapSectionRecord, mapSectionResponse.RequestCompleted);
 
+			PutInTileStore(mapSectionRecord, mapSectionResponse);
+
 			return result;
 		}
 
+		/// <summary>
+		/// Updates the MapSections using a single bulk write.
+		/// </summary>
+		public async Task<long?> UpdateCountValuesAsync(IList<MapSectionResponse> mapSectionResponses)
+		{
+			var mapSectionRecords = mapSectionResponses.Select(x => _mSetRecordMapper.MapTo(x)).ToList();
+
+			var result = await _mapSectionReaderWriter.UpdateManyCountValuesAsync(mapSectionRecords.Select((x, i) => (x, mapSectionResponses[i].RequestCompleted)).ToList());
+
+			for (var i = 0; i < mapSectionRecords.Count; i++)
+			{
+				PutInTileStore(mapSectionRecords[i], mapSectionResponses[i]);
+			}
+
+			return result;
+		}
+
+		// The values are stored in the MapSectionRecord encoded, the tile store holds them as-is.
+		private void PutInTileStore(MapSectionRecord mapSectionRecord, MapSectionResponse mapSectionResponse)
+		{
+			var mapSectionVectors2 = mapSectionResponse.MapSectionVectors2;
+
+			if (_tileStore == null || mapSectionVectors2 == null)
+			{
+				return;
+			}
+
+			var byteCount = mapSectionRecord.BlockWidth * mapSectionRecord.BlockHeight * 2;
+
+			var mapSectionBytes = new MapSectionBytes
+			(
+				mapSectionId: mapSectionRecord.Id,
+				dateCreatedUtc: mapSectionRecord.DateCreatedUtc, lastSavedUtc: DateTime.UtcNow, lastAccessed: DateTime.UtcNow, subdivisionId: mapSectionRecord.SubdivisionId,
+				blockPosition: mapSectionResponse.BlockPosition,
+				mapCalcSettings: mapSectionRecord.MapCalcSettings,
+				requestWasCompleted: mapSectionResponse.RequestCompleted,
+				allRowsHaveEscaped: mapSectionRecord.AllRowsHaveEscaped,
+				counts: mapSectionVectors2.Counts[..byteCount],
+				escapeVelocities: mapSectionVectors2.EscapeVelocities[..byteCount]
+			);
+
+			_tileStore.Put(mapSectionBytes);
+		}
+
 		public void UpdateJobMapSectionSubdivisionIds(ObjectId jobMapSectionId, ObjectId mapSectionSubdivisionId, ObjectId jobSubdivisionId)
 		{
 			_jobMapSectionReaderWriter.SetSubdivisionId(jobMapSectionId, mapSectionSubdivisionId, jobSubdivisionId);
@@ -330,6 +459,9 @@ namespace MSetRepo
 
 		public long? DeleteMapSectionsCreatedSince(DateTime dateCreatedUtc, bool overrideRecentGuard = false)
 		{
+			// The tile store does not record when each MapSection was created.
+			_tileStore?.Clear();
+
 			var result = _mapSectionReaderWriter.DeleteMapSectionsSince(dateCreatedUtc, overrideRecentGuard) ?? 0;
 			var result2 = _mapSectionZValuesReaderWriter.DeleteMapSectionsSince(dateCreatedUtc, overrideRecentGuard) ?? 0;
 			result += result2;
@@ -365,7 +497,7 @@ namespace MSetRepo
 		{
 			var result = await _mapSectionZValuesReaderWriter.GetBySectionIdAsync(mapSectionId, ct);
 
-			return result?.ZValues;
+			return result == null ? null : ZValuesCodec.Decode(result.ZValues);
 		}
 
 		public async Task<ObjectId?> SaveMapSectionZValuesAsync(MapSectionResponse mapSectionResponse, ObjectId mapSectionId)
@@ -400,7 +532,7 @@ namespace MSetRepo
 				throw new InvalidOperationException("The MapSectionResponse has a null MapSectionZVectors.");
 			}
 
-			var zValues = new ZValues(zVectors.BlockSize, zVectors.LimbCount, zVectors.Zrs, zVectors.Zis, zVectors.HasEscapedFlags, zVectors.GetBytesForRowHasEscaped());
+			var zValues = ZValuesCodec.Encode(new ZValues(zVectors.BlockSize, zVectors.LimbCount, zVectors.Zrs, zVectors.Zis, zVectors.HasEscapedFlags, zVectors.GetBytesForRowHasEscaped()));
 
 			var result = new MapSectionZValuesRecord
 				(
@@ -462,6 +594,51 @@ namespace MSetRepo
 			}
 		}
 
+		/// <summary>
+		/// Inserts a JobMapSectionRecord for each link not already on file, using one query to find those on file and a single, unordered, bulk insert.
+		/// Returns the number of records inserted.
+		/// </summary>
+		public async Task<int> SaveJobMapSectionsAsync(IList<JobMapSectionLink> jobMapSectionLinks)
+		{
+			var mapSectionIds = jobMapSectionLinks.Select(x => x.MapSectionId).Distinct().ToList();
+			var jobIds = jobMapSectionLinks.Select(x => x.JobId).Distinct().ToList();
+
+			var existingRecords = (await _jobMapSectionReaderWriter.GetByMapSectionIdsAndJobIdsAsync(mapSectionIds, jobIds))
+				.GroupBy(x => (x.MapSectionId, x.JobId, x.JobType))
+				.ToDictionary(x => x.Key, x => x.First());
+
+			var jobMapSectionRecords = new List<JobMapSectionRecord>();
+			var linksSeen = new HashSet<(ObjectId, ObjectId, JobType)>();
+
+			foreach (var link in jobMapSectionLinks)
+			{
+				var key = (link.MapSectionId, link.JobId, link.JobType);
+
+				if (existingRecords.TryGetValue(key, out var existingRecord))
+				{
+					if (existingRecord.JobSubdivisionId != link.JobSubdivisionId || existingRecord.MapSectionSubdivisionId != link.MapSectionSubdivisionId)
+					{
+						Debug.WriteLine($"The SubdivisionIds on the existing JobMapSectionRecord: {existingRecord.Id} do not match. JobId: {link.JobId}, MapSectionId: {link.MapSectionId}.");
+						await _jobMapSectionReaderWriter.SetSubdivisionIdAsync(existingRecord.Id, link.MapSectionSubdivisionId, link.JobSubdivisionId);
+					}
+				}
+				else if (linksSeen.Add(key))
+				{
+					var blockIndexRec = _mSetRecordMapper.MapTo(link.BlockIndex);
+
+					jobMapSectionRecords.Add(new JobMapSectionRecord(link.JobType, link.JobId, link.MapSectionId, blockIndexRec, link.IsInverted, DateCreatedUtc: DateTime.UtcNow, LastSavedUtc: DateTime.UtcNow,
+						link.MapSectionSubdivisionId, link.JobSubdivisionId, link.OwnerType));
+				}
+			}
+
+			if (jobMapSectionRecords.Count > 0)
+			{
+				await _jobMapSectionReaderWriter.InsertManyAsync(jobMapSectionRecords);
+			}
+
+			return jobMapSectionRecords.Count;
+		}
+
 		public bool InsertIfNotFoundJobMapSection(JobType jobType, ObjectId jobId, ObjectId mapSectionId, SizeInt blockIndex, bool isInverted, ObjectId mapSectionSubdivisionId, ObjectId jobSubdivisionId, OwnerType ownerType, out ObjectId jobMapSectionId)
 		{
 			var existingRecord = _jobMapSectionReaderWriter.GetByMapSectionIdJobIdAndJobType(mapSectionId, jobId, jobType);
@@ -577,6 +754,7 @@ namespace MSetRepo
 			var foundMapSectionRefs = _jobMapSectionReaderWriter.GetJobMapSectionIds(mapSectionIds).ToArray();
 			var mapSectionsNotReferenced = mapSectionIds.Where(x => !foundMapSectionRefs.Contains(x)).ToList();
 
+			_tileStore?.Remove(mapSectionsNotReferenced);
 			var numberDeleted = _mapSectionReaderWriter.Delete(mapSectionsNotReferenced);
 
 			numberOfZValueRecordsDeleted = _mapSectionZValuesReaderWriter.Delete(mapSectionsNotReferenced);
@@ -593,6 +771,7 @@ namespace MSetRepo
 			var foundMapSectionRefs = _jobMapSectionReaderWriter.GetJobMapSectionIds(mapSectionIds).ToArray();
 			var mapSectionsNotReferenced = mapSectionIds.Where(x => !foundMapSectionRefs.Contains(x)).ToList();
 
+			_tileStore?.Remove(mapSectionsNotReferenced);
 			var numberDeleted = _mapSectionReaderWriter.Delete(mapSectionsNotReferenced);
 
 			return numberDeleted;
@@ -606,6 +785,7 @@ namespace MSetRepo
 
 			var mapSectionsNotReferenced = mapSectionIds.Where(x => !foundMapSectionRefs.Contains(x)).ToList();
 
+			_tileStore?.Remove(mapSectionsNotReferenced);
 			var numberDeleted = _mapSectionReaderWriter.Delete(mapSectionsNotReferenced);
 
 			Debug.WriteLine($"DeleteMapSectionsWithJobType removed {numberOfMapSectionRefsDeleted} JobMapSection records and deleted {numberDeleted} MapSectionRecoreds.");
@@ -788,6 +968,7 @@ namespace MSetRepo
 
 		public long DeleteMapSectionsInList(IList<ObjectId> mapSectionIds)
 		{
+			_tileStore?.Remove(mapSectionIds);
 			var numberDeleted = _mapSectionReaderWriter.Delete(mapSectionIds);
 
 			return numberDeleted;
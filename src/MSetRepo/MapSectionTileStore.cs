@@ -0,0 +1,806 @@
+﻿using MongoDB.Bson;
+using MSS.Types.MSet;
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Diagnostics.CodeAnalysis;
+using System.IO;
+using System.IO.MemoryMappedFiles;
+using System.Linq;
+using System.Threading;
+
+namespace MSetRepo
+{
+	/// <summary>
+	/// A local, first-level store of MapSections, so that revisiting a location does not cost a database round trip per block.
+	/// The MapSections are appended to a single memory-mapped file, the counts and escape velocities are stored as-is,
+	/// a read is a single copy out of the mapped view. The index, keyed by SubdivisionId and BlockPosition, is held in memory
+	/// and is rebuilt by scanning the file when the store is opened.
+	/// Each record carries a checksum, the scan stops at the first record that is incomplete, so that a record torn by a crash
+	/// is discarded along with anything after it. Records that have been replaced or removed are reclaimed by Compact,
+	/// which is called once they account for half of the file, or once the file exceeds MaxBytes.
+	/// Reads share the lock, only writes are serialized. Records are flushed to disk after the write lock is released,
+	/// only the range written since the previous flush is flushed, so that writes that complete while a flush is in progress are flushed together.
+	/// </summary>
+	public sealed class MapSectionTileStore : IDisposable
+	{
+		#region Private Fields
+
+		private const uint MAGIC = 0x5354534D; // "MSTS"
+
+		private const int TILE_RECORD = 1;
+		private const int TOMBSTONE_RECORD = 2;
+
+		// Magic, record type, payload length and payload checksum.
+		private const int HEADER_SIZE = 16;
+
+		// SubdivisionId, XHi, XLo, YHi, YLo
+		private const int KEY_SIZE = 12 + 4 * 8;
+
+		// MapSectionId, DateCreatedUtc, LastSavedUtc, TargetIterations, Threshold, Flags, Counts length, EscapeVelocities length
+		private const int TILE_FIXED_SIZE = KEY_SIZE + 12 + 2 * 8 + 5 * 4;
+
+		private const int RECORD_ALIGNMENT = 8;
+
+		// The cleared magic number written after the last record.
+		private const int TERMINATOR_SIZE = 4;
+
+		private const long INITIAL_CAPACITY = 16 * 1024 * 1024;
+		private const long MIN_BYTES_TO_COMPACT = 64 * 1024 * 1024;
+
+		private const int FLAG_CALCULATE_ESCAPE_VELOCITIES = 1;
+		private const int FLAG_SAVE_THE_ZVALUES = 2;
+		private const int FLAG_REQUEST_WAS_COMPLETED = 4;
+		private const int FLAG_ALL_ROWS_HAVE_ESCAPED = 8;
+
+		private static readonly uint[] _crcTable = CreateCrcTable();
+
+		private readonly ReaderWriterLockSlim _stateLock = new();
+		private readonly object _flushLock = new();
+
+		private readonly Dictionary<TileKey, TileEntry> _index;
+		private readonly Dictionary<ObjectId, TileKey> _keysByMapSectionId;
+
+		private MemoryMappedFile _memoryMappedFile;
+		private MemoryMappedViewAccessor _accessor;
+		private long _capacity;
+
+		private long _endOffset;
+		private long _liveBytes;
+
+		// The records before this offset have been flushed to disk.
+		private long _flushedOffset;
+
+		private long _hits;
+		private long _misses;
+
+		private bool _disposedValue;
+
+		#endregion
+
+		#region Constructor
+
+		public MapSectionTileStore(string filePath, long maxBytes = 2L * 1024 * 1024 * 1024)
+		{
+			FilePath = filePath;
+			MaxBytes = maxBytes;
+
+			_index = new Dictionary<TileKey, TileEntry>();
+			_keysByMapSectionId = new Dictionary<ObjectId, TileKey>();
+
+			var folder = Path.GetDirectoryName(Path.GetFullPath(filePath));
+
+			if (folder != null)
+			{
+				Directory.CreateDirectory(folder);
+			}
+
+			(_memoryMappedFile, _accessor, _capacity) = OpenFile(filePath, minimumCapacity: INITIAL_CAPACITY);
+			LoadIndex();
+		}
+
+		#endregion
+
+		#region Public Properties
+
+		public string FilePath { get; }
+
+		/// <summary>
+		/// Once the file grows beyond this size, it is compacted, keeping the most recently stored MapSections that fit within half of this size.
+		/// </summary>
+		public long MaxBytes { get; }
+
+		/// <summary>
+		/// If true, Put and Remove flush the records written since the last flush before returning, otherwise they are flushed by Flush or Dispose.
+		/// </summary>
+		public bool FlushOnWrite { get; set; } = true;
+
+		public int Count
+		{
+			get
+			{
+				return DoWithReadLock(() => _index.Count);
+			}
+		}
+
+		public long LiveBytes => Volatile.Read(ref _liveBytes);
+		public long FileBytes => Volatile.Read(ref _endOffset);
+
+		public long Hits => Volatile.Read(ref _hits);
+		public long Misses => Volatile.Read(ref _misses);
+
+		#endregion
+
+		#region Public Methods
+
+		public bool TryGet(ObjectId subdivisionId, MapBlockOffset blockPosition, [NotNullWhen(true)] out MapSectionBytes? mapSectionBytes)
+		{
+			var key = new TileKey(subdivisionId, blockPosition);
+
+			_stateLock.EnterReadLock();
+
+			try
+			{
+				if (_disposedValue || !_index.TryGetValue(key, out var entry))
+				{
+					Interlocked.Increment(ref _misses);
+					mapSectionBytes = null;
+					return false;
+				}
+
+				mapSectionBytes = ReadTile(entry.Offset + HEADER_SIZE, blockPosition);
+			}
+			finally
+			{
+				_stateLock.ExitReadLock();
+			}
+
+			Interlocked.Increment(ref _hits);
+			return true;
+		}
+
+		/// <summary>
+		/// Adds the MapSection, replacing any MapSection previously stored for the same SubdivisionId and BlockPosition.
+		/// </summary>
+		public void Put(MapSectionBytes mapSectionBytes)
+		{
+			var key = new TileKey(mapSectionBytes.SubdivisionId, mapSectionBytes.BlockPosition);
+			var payloadLength = TILE_FIXED_SIZE + mapSectionBytes.Counts.Length + mapSectionBytes.EscapeVelocities.Length;
+			var compactionNeeded = false;
+
+			DoWithWriteLock(() =>
+			{
+				if (_disposedValue)
+				{
+					return;
+				}
+
+				var offset = Append(TILE_RECORD, payloadLength, (payloadOffset) => WriteTile(payloadOffset, key, mapSectionBytes));
+				var recordLength = GetRecordLength(payloadLength);
+
+				RemoveFromIndex(key);
+				_index[key] = new TileEntry(offset, recordLength, mapSectionBytes.Id);
+				_keysByMapSectionId[mapSectionBytes.Id] = key;
+				_liveBytes += recordLength;
+
+				compactionNeeded = IsCompactionNeeded();
+			});
+
+			if (compactionNeeded)
+			{
+				CompactIfNeeded();
+			}
+
+			if (FlushOnWrite)
+			{
+				Flush();
+			}
+		}
+
+		public bool Remove(ObjectId subdivisionId, MapBlockOffset blockPosition)
+		{
+			var result = false;
+			var compactionNeeded = false;
+
+			DoWithWriteLock(() =>
+			{
+				result = RemoveAndWriteTombstone(new TileKey(subdivisionId, blockPosition));
+				compactionNeeded = result && IsCompactionNeeded();
+			});
+
+			if (compactionNeeded)
+			{
+				CompactIfNeeded();
+			}
+
+			if (result && FlushOnWrite)
+			{
+				Flush();
+			}
+
+			return result;
+		}
+
+		/// <summary>
+		/// Removes the MapSections with the given MapSectionIds, returns the number removed.
+		/// </summary>
+		public int Remove(IEnumerable<ObjectId> mapSectionIds)
+		{
+			var result = 0;
+			var compactionNeeded = false;
+
+			DoWithWriteLock(() =>
+			{
+				foreach (var mapSectionId in mapSectionIds)
+				{
+					if (_keysByMapSectionId.TryGetValue(mapSectionId, out var key) && RemoveAndWriteTombstone(key))
+					{
+						result++;
+					}
+				}
+
+				compactionNeeded = result > 0 && IsCompactionNeeded();
+			});
+
+			if (compactionNeeded)
+			{
+				CompactIfNeeded();
+			}
+
+			if (result > 0 && FlushOnWrite)
+			{
+				Flush();
+			}
+
+			return result;
+		}
+
+		public void Clear()
+		{
+			// The file cannot be deleted while a flush holds a view of it.
+			lock (_flushLock)
+			{
+				DoWithWriteLock(() =>
+				{
+					if (_disposedValue)
+					{
+						return;
+					}
+
+					_accessor.Dispose();
+					_memoryMappedFile.Dispose();
+
+					try
+					{
+						File.Delete(FilePath);
+					}
+					finally
+					{
+						// If the file could not be deleted, the store continues with the records it holds.
+						ReopenFile();
+					}
+				});
+			}
+		}
+
+		/// <summary>
+		/// Rewrites the file keeping only the records in the index. If the stored MapSections exceed half of MaxBytes, the least recently stored are dropped.
+		/// </summary>
+		public void Compact()
+		{
+			// The file cannot be replaced while a flush holds a view of it.
+			lock (_flushLock)
+			{
+				DoWithWriteLock(() =>
+				{
+					if (!_disposedValue)
+					{
+						CompactInternal();
+					}
+				});
+			}
+		}
+
+		/// <summary>
+		/// Flushes the records written since the last flush to disk.
+		/// </summary>
+		public void Flush()
+		{
+			// A caller that waits here while another flush is in progress finds its records already flushed, or flushes them along with any written since.
+			lock (_flushLock)
+			{
+				MemoryMappedViewAccessor pendingView;
+
+				_stateLock.EnterReadLock();
+
+				try
+				{
+					if (_disposedValue || _flushedOffset >= _endOffset)
+					{
+						return;
+					}
+
+					pendingView = CreatePendingView();
+					_flushedOffset = _endOffset;
+				}
+				finally
+				{
+					_stateLock.ExitReadLock();
+				}
+
+				// The view holds its own mapping, so the flush does not hold the state lock. Compact and Clear wait on the flush lock, the file
+				// is not replaced while the view is open.
+				using (pendingView)
+				{
+					pendingView.Flush();
+				}
+			}
+		}
+
+		public override string ToString()
+		{
+			return $"MapSectionTileStore: {Count} MapSections, {LiveBytes / (1024 * 1024)} of {FileBytes / (1024 * 1024)} MB live. Hits: {Hits}, Misses: {Misses}.";
+		}
+
+		#endregion
+
+		#region Private Methods - Records
+
+		private long Append(int recordType, int payloadLength, Action<long> writePayload)
+		{
+			var recordLength = GetRecordLength(payloadLength);
+			EnsureCapacity(_endOffset + recordLength + TERMINATOR_SIZE);
+
+			var offset = _endOffset;
+
+			// The magic number of the record that follows is cleared, so that the scan ends after this record, even if it replaced
+			// a torn record that was followed by other records.
+			_accessor.Write(offset + recordLength, 0u);
+
+			writePayload(offset + HEADER_SIZE);
+
+			_accessor.Write(offset + 4, recordType);
+			_accessor.Write(offset + 8, payloadLength);
+			_accessor.Write(offset + 12, ComputeChecksum(offset + HEADER_SIZE, payloadLength));
+
+			// The magic number is written last, a record without one ends the scan.
+			_accessor.Write(offset, MAGIC);
+
+			_endOffset += recordLength;
+
+			return offset;
+		}
+
+		private void WriteTile(long position, TileKey key, MapSectionBytes mapSectionBytes)
+		{
+			position = WriteKey(position, key);
+			position = WriteObjectId(position, mapSectionBytes.Id);
+
+			_accessor.Write(position, mapSectionBytes.DateCreatedUtc.Ticks);
+			_accessor.Write(position + 8, mapSectionBytes.LastSavedUtc.Ticks);
+			position += 16;
+
+			var mapCalcSettings = mapSectionBytes.MapCalcSettings;
+
+			var flags = (mapCalcSettings.CalculateEscapeVelocities ? FLAG_CALCULATE_ESCAPE_VELOCITIES : 0)
+				| (mapCalcSettings.SaveTheZValues ? FLAG_SAVE_THE_ZVALUES : 0)
+				| (mapSectionBytes.RequestWasCompleted ? FLAG_REQUEST_WAS_COMPLETED : 0)
+				| (mapSectionBytes.AllRowsHaveEscaped ? FLAG_ALL_ROWS_HAVE_ESCAPED : 0);
+
+			_accessor.Write(position, mapCalcSettings.TargetIterations);
+			_accessor.Write(position + 4, mapCalcSettings.Threshold);
+			_accessor.Write(position + 8, flags);
+			_accessor.Write(position + 12, mapSectionBytes.Counts.Length);
+			_accessor.Write(position + 16, mapSectionBytes.EscapeVelocities.Length);
+			position += 20;
+
+			_accessor.WriteArray(position, mapSectionBytes.Counts, 0, mapSectionBytes.Counts.Length);
+			position += mapSectionBytes.Counts.Length;
+
+			_accessor.WriteArray(position, mapSectionBytes.EscapeVelocities, 0, mapSectionBytes.EscapeVelocities.Length);
+		}
+
+		private MapSectionBytes ReadTile(long position, MapBlockOffset blockPosition)
+		{
+			var subdivisionId = ReadObjectId(position);
+			position += KEY_SIZE;
+
+			var mapSectionId = ReadObjectId(position);
+			position += 12;
+
+			var dateCreatedUtc = new DateTime(_accessor.ReadInt64(position), DateTimeKind.Utc);
+			var lastSavedUtc = new DateTime(_accessor.ReadInt64(position + 8), DateTimeKind.Utc);
+			position += 16;
+
+			var targetIterations = _accessor.ReadInt32(position);
+			var threshold = _accessor.ReadInt32(position + 4);
+			var flags = _accessor.ReadInt32(position + 8);
+			var countsLength = _accessor.ReadInt32(position + 12);
+			var escapeVelocitiesLength = _accessor.ReadInt32(position + 16);
+			position += 20;
+
+			var counts = new byte[countsLength];
+			_accessor.ReadArray(position, counts, 0, countsLength);
+			position += countsLength;
+
+			var escapeVelocities = new byte[escapeVelocitiesLength];
+			_accessor.ReadArray(position, escapeVelocities, 0, escapeVelocitiesLength);
+
+			var mapCalcSettings = new MapCalcSettings(targetIterations, threshold,
+				calculateEscapeVelocities: (flags & FLAG_CALCULATE_ESCAPE_VELOCITIES) != 0,
+				saveTheZValues: (flags & FLAG_SAVE_THE_ZVALUES) != 0);
+
+			var result = new MapSectionBytes
+			(
+				mapSectionId: mapSectionId,
+				dateCreatedUtc: dateCreatedUtc, lastSavedUtc: lastSavedUtc, lastAccessed: DateTime.UtcNow, subdivisionId: subdivisionId,
+				blockPosition: blockPosition,
+				mapCalcSettings: mapCalcSettings,
+				requestWasCompleted: (flags & FLAG_REQUEST_WAS_COMPLETED) != 0,
+				allRowsHaveEscaped: (flags & FLAG_ALL_ROWS_HAVE_ESCAPED) != 0,
+				counts: counts,
+				escapeVelocities: escapeVelocities
+			);
+
+			return result;
+		}
+
+		private long WriteKey(long position, TileKey key)
+		{
+			position = WriteObjectId(position, key.SubdivisionId);
+
+			_accessor.Write(position, key.XHi);
+			_accessor.Write(position + 8, key.XLo);
+			_accessor.Write(position + 16, key.YHi);
+			_accessor.Write(position + 24, key.YLo);
+
+			return position + 32;
+		}
+
+		private TileKey ReadKey(long position)
+		{
+			var subdivisionId = ReadObjectId(position);
+			position += 12;
+
+			var result = new TileKey(subdivisionId, _accessor.ReadInt64(position), _accessor.ReadInt64(position + 8), _accessor.ReadInt64(position + 16), _accessor.ReadInt64(position + 24));
+
+			return result;
+		}
+
+		private long WriteObjectId(long position, ObjectId objectId)
+		{
+			var bytes = objectId.ToByteArray();
+			_accessor.WriteArray(position, bytes, 0, bytes.Length);
+
+			return position + bytes.Length;
+		}
+
+		private ObjectId ReadObjectId(long position)
+		{
+			var bytes = new byte[12];
+			_accessor.ReadArray(position, bytes, 0, bytes.Length);
+
+			return new ObjectId(bytes);
+		}
+
+		private static int GetRecordLength(int payloadLength)
+		{
+			var result = (HEADER_SIZE + payloadLength + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+			return result;
+		}
+
+		#endregion
+
+		#region Private Methods - Index
+
+		// Scans the records from the start of the file, the first record that is incomplete, or fails the checksum, marks the end.
+		private void LoadIndex()
+		{
+			var offset = 0L;
+
+			while (offset + HEADER_SIZE <= _capacity && _accessor.ReadUInt32(offset) == MAGIC)
+			{
+				var recordType = _accessor.ReadInt32(offset + 4);
+				var payloadLength = _accessor.ReadInt32(offset + 8);
+				var checksum = _accessor.ReadUInt32(offset + 12);
+
+				if (payloadLength < KEY_SIZE || offset + HEADER_SIZE + payloadLength > _capacity
+					|| ComputeChecksum(offset + HEADER_SIZE, payloadLength) != checksum)
+				{
+					Debug.WriteLine($"WARNING: MapSectionTileStore. The record at offset: {offset} is incomplete, the remainder of the file will be overwritten.");
+					break;
+				}
+
+				var key = ReadKey(offset + HEADER_SIZE);
+				var recordLength = GetRecordLength(payloadLength);
+
+				RemoveFromIndex(key);
+
+				if (recordType == TILE_RECORD)
+				{
+					var mapSectionId = ReadObjectId(offset + HEADER_SIZE + KEY_SIZE);
+
+					_index[key] = new TileEntry(offset, recordLength, mapSectionId);
+					_keysByMapSectionId[mapSectionId] = key;
+					_liveBytes += recordLength;
+				}
+
+				offset += recordLength;
+			}
+
+			_endOffset = offset;
+			_flushedOffset = offset;
+
+			Debug.WriteLine($"MapSectionTileStore. Loaded {_index.Count} MapSections from {FilePath}, {_liveBytes} of {_endOffset} bytes are live.");
+		}
+
+		private bool RemoveAndWriteTombstone(TileKey key)
+		{
+			if (_disposedValue || !RemoveFromIndex(key))
+			{
+				return false;
+			}
+
+			Append(TOMBSTONE_RECORD, KEY_SIZE, (payloadOffset) => WriteKey(payloadOffset, key));
+
+			return true;
+		}
+
+		private bool RemoveFromIndex(TileKey key)
+		{
+			if (_index.Remove(key, out var existing))
+			{
+				_keysByMapSectionId.Remove(existing.MapSectionId);
+				_liveBytes -= existing.RecordLength;
+
+				return true;
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		#endregion
+
+		#region Private Methods - File
+
+		private bool IsCompactionNeeded()
+		{
+			var result = _endOffset > MaxBytes || (_endOffset > MIN_BYTES_TO_COMPACT && _liveBytes < _endOffset / 2);
+			return result;
+		}
+
+		// Called without holding the state lock, the flush lock must be taken first.
+		private void CompactIfNeeded()
+		{
+			lock (_flushLock)
+			{
+				DoWithWriteLock(() =>
+				{
+					if (!_disposedValue && IsCompactionNeeded())
+					{
+						CompactInternal();
+					}
+				});
+			}
+		}
+
+		private void CompactInternal()
+		{
+			// Keep the most recently stored MapSections that fit within the budget.
+			var budget = MaxBytes / 2;
+			var entries = new List<KeyValuePair<TileKey, TileEntry>>();
+			var bytesKept = 0L;
+
+			foreach (var kvp in _index.OrderByDescending(x => x.Value.Offset))
+			{
+				if (bytesKept + kvp.Value.RecordLength > budget)
+				{
+					break;
+				}
+
+				entries.Add(kvp);
+				bytesKept += kvp.Value.RecordLength;
+			}
+
+			entries.Reverse();
+
+			var tempPath = FilePath + ".compact";
+			var buffer = new byte[0];
+
+			using (var fileStream = new FileStream(tempPath, FileMode.Create, FileAccess.Write))
+			{
+				foreach (var kvp in entries)
+				{
+					var recordLength = kvp.Value.RecordLength;
+
+					if (buffer.Length < recordLength)
+					{
+						buffer = new byte[recordLength];
+					}
+
+					_accessor.ReadArray(kvp.Value.Offset, buffer, 0, recordLength);
+					fileStream.Write(buffer, 0, recordLength);
+				}
+
+				fileStream.Flush(flushToDisk: true);
+			}
+
+			_accessor.Dispose();
+			_memoryMappedFile.Dispose();
+
+			var previousCount = _index.Count;
+
+			try
+			{
+				// The original file is replaced in one step, a crash leaves either the old or the new file in place.
+				File.Move(tempPath, FilePath, overwrite: true);
+			}
+			finally
+			{
+				// If the file could not be replaced, the original file is mapped again.
+				ReopenFile();
+			}
+
+			Debug.WriteLine($"MapSectionTileStore. Compacted the store, kept {_index.Count} of {previousCount} MapSections.");
+		}
+
+		private void ReopenFile()
+		{
+			_index.Clear();
+			_keysByMapSectionId.Clear();
+			_liveBytes = 0;
+
+			(_memoryMappedFile, _accessor, _capacity) = OpenFile(FilePath, minimumCapacity: INITIAL_CAPACITY);
+			LoadIndex();
+		}
+
+		private void EnsureCapacity(long requiredCapacity)
+		{
+			if (requiredCapacity <= _capacity)
+			{
+				return;
+			}
+
+			var newCapacity = Math.Max(_capacity * 2, requiredCapacity);
+
+			// The file is mapped again without being flushed, the records not yet flushed keep their offsets and are flushed from the new view.
+			_accessor.Dispose();
+			_memoryMappedFile.Dispose();
+
+			(_memoryMappedFile, _accessor, _capacity) = OpenFile(FilePath, newCapacity);
+		}
+
+		// The file is extended to the minimum capacity, the extension is zero-filled and so ends the scan.
+		private static (MemoryMappedFile memoryMappedFile, MemoryMappedViewAccessor accessor, long capacity) OpenFile(string filePath, long minimumCapacity)
+		{
+			var fileLength = File.Exists(filePath) ? new FileInfo(filePath).Length : 0;
+			var capacity = Math.Max(fileLength, minimumCapacity);
+
+			var memoryMappedFile = MemoryMappedFile.CreateFromFile(filePath, FileMode.OpenOrCreate, mapName: null, capacity, MemoryMappedFileAccess.ReadWrite);
+			var accessor = memoryMappedFile.CreateViewAccessor(0, capacity, MemoryMappedFileAccess.ReadWrite);
+
+			return (memoryMappedFile, accessor, capacity);
+		}
+
+		// A view of the records written since the last flush, along with the terminator that follows them.
+		private MemoryMappedViewAccessor CreatePendingView()
+		{
+			var result = _memoryMappedFile.CreateViewAccessor(_flushedOffset, _endOffset + TERMINATOR_SIZE - _flushedOffset, MemoryMappedFileAccess.ReadWrite);
+			return result;
+		}
+
+		#endregion
+
+		#region Lock Support
+
+		private T DoWithReadLock<T>(Func<T> function)
+		{
+			_stateLock.EnterReadLock();
+
+			try
+			{
+				return function();
+			}
+			finally
+			{
+				_stateLock.ExitReadLock();
+			}
+		}
+
+		private void DoWithWriteLock(Action action)
+		{
+			_stateLock.EnterWriteLock();
+
+			try
+			{
+				action();
+			}
+			finally
+			{
+				_stateLock.ExitWriteLock();
+			}
+		}
+
+		#endregion
+
+		#region Private Methods - Checksum
+
+		private uint ComputeChecksum(long position, int length)
+		{
+			var buffer = new byte[Math.Min(length, 64 * 1024)];
+			var crc = 0xFFFFFFFFu;
+
+			for (var start = 0; start < length; start += buffer.Length)
+			{
+				var count = Math.Min(buffer.Length, length - start);
+				_accessor.ReadArray(position + start, buffer, 0, count);
+
+				for (var i = 0; i < count; i++)
+				{
+					crc = _crcTable[(crc ^ buffer[i]) & 0xFF] ^ (crc >> 8);
+				}
+			}
+
+			return crc ^ 0xFFFFFFFFu;
+		}
+
+		private static uint[] CreateCrcTable()
+		{
+			var result = new uint[256];
+
+			for (var n = 0u; n < 256; n++)
+			{
+				var c = n;
+
+				for (var k = 0; k < 8; k++)
+				{
+					c = (c & 1) != 0 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				}
+
+				result[n] = c;
+			}
+
+			return result;
+		}
+
+		#endregion
+
+		#region Private Types
+
+		private readonly record struct TileKey(ObjectId SubdivisionId, long XHi, long XLo, long YHi, long YLo)
+		{
+			public TileKey(ObjectId subdivisionId, MapBlockOffset blockPosition) : this(subdivisionId, blockPosition.XHi, blockPosition.XLo, blockPosition.YHi, blockPosition.YLo)
+			{ }
+		}
+
+		private readonly record struct TileEntry(long Offset, int RecordLength, ObjectId MapSectionId);
+
+		#endregion
+
+		#region IDisposable Support
+
+		public void Dispose()
+		{
+			DoWithWriteLock(() =>
+			{
+				if (!_disposedValue)
+				{
+					if (_flushedOffset < _endOffset)
+					{
+						using var pendingView = CreatePendingView();
+						pendingView.Flush();
+					}
+
+					_accessor.Dispose();
+					_memoryMappedFile.Dispose();
+
+					_disposedValue = true;
+				}
+			});
+		}
+
+		#endregion
+	}
+}
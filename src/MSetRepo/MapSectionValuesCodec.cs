@@ -0,0 +1,193 @@
+﻿using System;
+using System.IO;
+using System.IO.Compression;
+using System.Runtime.InteropServices;
+
+namespace MSetRepo
+{
+	/// <summary>
+	/// Compresses the Counts and EscapeVelocities of a MapSection before they are stored.
+	/// Each value is predicted from its neighbor to the left, or for the first value in a row, the value above.
+	/// Neighboring counts are usually equal, so most differences are zero. The differences are written as runs of zeros,
+	/// each followed by one non-zero difference, using a variable length encoding. The result is deflated.
+	/// </summary>
+	public static class MapSectionValuesCodec
+	{
+		// The values of MapSectionRecord.CodecVersion
+		public const int RAW_VERSION = 0;
+		public const int DELTA_RLE_DEFLATE_VERSION = 1;
+
+		public const int CURRENT_VERSION = DELTA_RLE_DEFLATE_VERSION;
+
+		#region Public Methods
+
+		public static byte[] Encode(byte[] values, int blockWidth)
+		{
+			if (values.Length == 0)
+			{
+				return values;
+			}
+
+			var source = MemoryMarshal.Cast<byte, ushort>(values);
+			var tokens = new MemoryStream(values.Length / 4);
+
+			var zeroRun = 0u;
+
+			for (var i = 0; i < source.Length; i++)
+			{
+				var difference = (ushort)(source[i] - GetPrediction(source, i, blockWidth));
+
+				if (difference == 0)
+				{
+					zeroRun++;
+				}
+				else
+				{
+					WriteVarInt(tokens, zeroRun);
+					WriteVarInt(tokens, ZigZag(difference));
+					zeroRun = 0;
+				}
+			}
+
+			// The decoder knows the number of values, the trailing run is written without a difference.
+			WriteVarInt(tokens, zeroRun);
+
+			var result = new MemoryStream((int)tokens.Length / 2);
+
+			using (var deflateStream = new DeflateStream(result, CompressionLevel.Fastest, leaveOpen: true))
+			{
+				deflateStream.Write(tokens.GetBuffer(), 0, (int)tokens.Length);
+			}
+
+			return result.ToArray();
+		}
+
+		/// <param name="byteCount">The length of the values before they were encoded.</param>
+		public static byte[] Decode(byte[] encoded, int byteCount, int blockWidth)
+		{
+			if (encoded.Length == 0)
+			{
+				return encoded;
+			}
+
+			byte[] tokens;
+
+			using (var deflateStream = new DeflateStream(new MemoryStream(encoded), CompressionMode.Decompress))
+			using (var tokenStream = new MemoryStream(byteCount / 4))
+			{
+				deflateStream.CopyTo(tokenStream);
+				tokens = tokenStream.ToArray();
+			}
+
+			var result = new byte[byteCount];
+			var dest = MemoryMarshal.Cast<byte, ushort>(result);
+
+			var tokenPtr = 0;
+			var i = 0;
+
+			while (i < dest.Length)
+			{
+				var zeroRun = ReadVarInt(tokens, ref tokenPtr);
+
+				if (zeroRun > dest.Length - i)
+				{
+					throw new InvalidDataException("The encoded MapSection values hold more values than expected.");
+				}
+
+				for (var j = 0; j < zeroRun; j++, i++)
+				{
+					dest[i] = GetPrediction(dest, i, blockWidth);
+				}
+
+				if (i < dest.Length)
+				{
+					var difference = UnZigZag(ReadVarInt(tokens, ref tokenPtr));
+					dest[i] = (ushort)(GetPrediction(dest, i, blockWidth) + difference);
+					i++;
+				}
+			}
+
+			return result;
+		}
+
+		public static byte[] Decode(byte[] values, int codecVersion, int byteCount, int blockWidth)
+		{
+			var result = codecVersion switch
+			{
+				RAW_VERSION => values,
+				DELTA_RLE_DEFLATE_VERSION => Decode(values, byteCount, blockWidth),
+				_ => throw new NotSupportedException($"The MapSection values were stored using codec version: {codecVersion}, which is not supported."),
+			};
+
+			return result;
+		}
+
+		#endregion
+
+		#region Private Methods
+
+		private static ushort GetPrediction(ReadOnlySpan<ushort> values, int index, int blockWidth)
+		{
+			if (index % blockWidth != 0)
+			{
+				return values[index - 1];
+			}
+			else
+			{
+				return index >= blockWidth ? values[index - blockWidth] : (ushort)0;
+			}
+		}
+
+		private static ushort GetPrediction(Span<ushort> values, int index, int blockWidth)
+		{
+			return GetPrediction((ReadOnlySpan<ushort>)values, index, blockWidth);
+		}
+
+		// Maps differences near zero, positive or negative, to small values.
+		private static uint ZigZag(ushort difference)
+		{
+			var signed = (short)difference;
+			return (uint)(ushort)((signed << 1) ^ (signed >> 15));
+		}
+
+		private static ushort UnZigZag(uint value)
+		{
+			return (ushort)((value >> 1) ^ (uint)-(int)(value & 1));
+		}
+
+		private static void WriteVarInt(Stream stream, uint value)
+		{
+			while (value >= 0x80)
+			{
+				stream.WriteByte((byte)(value | 0x80));
+				value >>= 7;
+			}
+
+			stream.WriteByte((byte)value);
+		}
+
+		private static uint ReadVarInt(byte[] buffer, ref int ptr)
+		{
+			var result = 0u;
+			var shift = 0;
+			byte b;
+
+			do
+			{
+				if (ptr >= buffer.Length)
+				{
+					throw new InvalidDataException("The encoded MapSection values are incomplete.");
+				}
+
+				b = buffer[ptr++];
+				result |= (uint)(b & 0x7F) << shift;
+				shift += 7;
+
+			} while ((b & 0x80) != 0);
+
+			return result;
+		}
+
+		#endregion
+	}
+}
@@ -7,7 +7,8 @@ namespace MSetRepo
 {
 	public class RepositoryAdapters
 	{
-		public RepositoryAdapters(string server, int port, string databaseName)
+		/// <param name="tileStorePath">If not null or empty, MapSections are also kept in a local MapSectionTileStore at this path.</param>
+		public RepositoryAdapters(string server, int port, string databaseName, string? tileStorePath = null)
 		{
 			var dbProvider = new DbProvider(server, port, databaseName);
 
@@ -16,7 +17,8 @@ namespace MSetRepo
 
 			ProjectAdapter = new ProjectAdapter(dbProvider, mSetRecordMapper);
 
-			MapSectionAdapter = new MapSectionAdapter(dbProvider, mSetRecordMapper);
+			var tileStore = string.IsNullOrWhiteSpace(tileStorePath) ? null : new MapSectionTileStore(tileStorePath);
+			MapSectionAdapter = new MapSectionAdapter(dbProvider, mSetRecordMapper, tileStore);
 
 			SharedColorBandSetAdapter = new SharedColorBandSetAdapter(dbProvider, mSetRecordMapper);
 		}
@@ -0,0 +1,209 @@
+﻿using MSS.Types.MSet;
+using System;
+using System.IO;
+using System.IO.Compression;
+
+namespace MSetRepo
+{
+	/// <summary>
+	/// Compresses the Z values of a MapSection before they are stored, so that sections can be resumed at deep zoom without
+	/// the Z values taking more space than is practical. A sample that has escaped is never iterated again, its Z value is
+	/// dropped and comes back as zero. The limbs of the remaining samples are arranged so that each byte of each limb is
+	/// stored together for all samples, the high bytes of the high limbs vary the least, and the result is deflated.
+	/// The HasEscapedFlags, which are needed to place the remaining values, are deflated as-is.
+	/// </summary>
+	public static class ZValuesCodec
+	{
+		private const int VALUE_SIZE = 4;
+		private const int LANES = 8;
+
+		// The values of ZValues.CodecVersion
+		public const int RAW_VERSION = 0;
+		public const int UNESCAPED_SHUFFLE_DEFLATE_VERSION = 1;
+
+		public const int CURRENT_VERSION = UNESCAPED_SHUFFLE_DEFLATE_VERSION;
+
+		#region Public Methods
+
+		public static ZValues Encode(ZValues zValues)
+		{
+			if (zValues.CodecVersion != RAW_VERSION || zValues.IsEmpty)
+			{
+				return zValues;
+			}
+
+			var valueCount = zValues.BlockWidth * zValues.BlockHeight;
+			var unescapedCount = GetUnescapedCount(zValues.HasEscapedFlags, valueCount);
+
+			var zrs = Deflate(Pack(zValues.Zrs, zValues, unescapedCount));
+			var zis = Deflate(Pack(zValues.Zis, zValues, unescapedCount));
+			var hasEscapedFlags = Deflate(zValues.HasEscapedFlags);
+
+			var result = new ZValues(zValues.BlockSize, zValues.LimbCount, zrs, zis, hasEscapedFlags, zValues.RowsHasEscaped, UNESCAPED_SHUFFLE_DEFLATE_VERSION);
+
+			return result;
+		}
+
+		public static ZValues Decode(ZValues zValues)
+		{
+			if (zValues.CodecVersion == RAW_VERSION)
+			{
+				return zValues;
+			}
+
+			if (zValues.CodecVersion != UNESCAPED_SHUFFLE_DEFLATE_VERSION)
+			{
+				throw new NotSupportedException($"The ZValues codec version: {zValues.CodecVersion} is not supported.");
+			}
+
+			var valueCount = zValues.BlockWidth * zValues.BlockHeight;
+			var hasEscapedFlags = Inflate(zValues.HasEscapedFlags, valueCount * VALUE_SIZE);
+			var unescapedCount = GetUnescapedCount(hasEscapedFlags, valueCount);
+			var packedByteCount = unescapedCount * zValues.LimbCount * VALUE_SIZE;
+
+			var zrs = Unpack(Inflate(zValues.Zrs, packedByteCount), zValues, hasEscapedFlags, unescapedCount);
+			var zis = Unpack(Inflate(zValues.Zis, packedByteCount), zValues, hasEscapedFlags, unescapedCount);
+
+			var result = new ZValues(zValues.BlockSize, zValues.LimbCount, zrs, zis, hasEscapedFlags, zValues.RowsHasEscaped);
+
+			return result;
+		}
+
+		#endregion
+
+		#region Private Methods
+
+		// The values are stored row by row. Within a row, the limbs of 8 consecutive samples are stored together, limb by limb.
+		// The packed values hold one plane for each byte of each limb, each plane has one byte for each unescaped sample.
+		private static byte[] Pack(byte[] values, ZValues zValues, int unescapedCount)
+		{
+			var limbCount = zValues.LimbCount;
+			var result = new byte[unescapedCount * limbCount * VALUE_SIZE];
+			var valuePtr = 0;
+
+			for (var y = 0; y < zValues.BlockHeight; y++)
+			{
+				for (var x = 0; x < zValues.BlockWidth; x++)
+				{
+					if (HasEscaped(zValues.HasEscapedFlags, y * zValues.BlockWidth + x))
+					{
+						continue;
+					}
+
+					for (var limbPtr = 0; limbPtr < limbCount; limbPtr++)
+					{
+						var sourceIndex = GetByteIndex(zValues, x, y, limbPtr);
+
+						for (var bytePtr = 0; bytePtr < VALUE_SIZE; bytePtr++)
+						{
+							result[(limbPtr * VALUE_SIZE + bytePtr) * unescapedCount + valuePtr] = values[sourceIndex + bytePtr];
+						}
+					}
+
+					valuePtr++;
+				}
+			}
+
+			return result;
+		}
+
+		private static byte[] Unpack(byte[] packed, ZValues zValues, byte[] hasEscapedFlags, int unescapedCount)
+		{
+			var limbCount = zValues.LimbCount;
+			var result = new byte[zValues.BlockWidth * zValues.BlockHeight * limbCount * VALUE_SIZE];
+			var valuePtr = 0;
+
+			for (var y = 0; y < zValues.BlockHeight; y++)
+			{
+				for (var x = 0; x < zValues.BlockWidth; x++)
+				{
+					if (HasEscaped(hasEscapedFlags, y * zValues.BlockWidth + x))
+					{
+						continue;
+					}
+
+					for (var limbPtr = 0; limbPtr < limbCount; limbPtr++)
+					{
+						var destinationIndex = GetByteIndex(zValues, x, y, limbPtr);
+
+						for (var bytePtr = 0; bytePtr < VALUE_SIZE; bytePtr++)
+						{
+							result[destinationIndex + bytePtr] = packed[(limbPtr * VALUE_SIZE + bytePtr) * unescapedCount + valuePtr];
+						}
+					}
+
+					valuePtr++;
+				}
+			}
+
+			return result;
+		}
+
+		private static int GetByteIndex(ZValues zValues, int x, int y, int limbPtr)
+		{
+			var rowStart = y * zValues.BlockWidth * zValues.LimbCount;
+			var result = (rowStart + ((x / LANES) * zValues.LimbCount + limbPtr) * LANES + x % LANES) * VALUE_SIZE;
+
+			return result;
+		}
+
+		private static bool HasEscaped(byte[] hasEscapedFlags, int valueIndex)
+		{
+			var result = BitConverter.ToInt32(hasEscapedFlags, valueIndex * VALUE_SIZE) != 0;
+			return result;
+		}
+
+		private static int GetUnescapedCount(byte[] hasEscapedFlags, int valueCount)
+		{
+			var result = 0;
+
+			for (var i = 0; i < valueCount; i++)
+			{
+				if (!HasEscaped(hasEscapedFlags, i))
+				{
+					result++;
+				}
+			}
+
+			return result;
+		}
+
+		private static byte[] Deflate(byte[] source)
+		{
+			var result = new MemoryStream(source.Length / 2);
+
+			using (var deflateStream = new DeflateStream(result, CompressionLevel.Fastest, leaveOpen: true))
+			{
+				deflateStream.Write(source, 0, source.Length);
+			}
+
+			return result.ToArray();
+		}
+
+		private static byte[] Inflate(byte[] source, int byteCount)
+		{
+			var result = new byte[byteCount];
+
+			using (var deflateStream = new DeflateStream(new MemoryStream(source), CompressionMode.Decompress))
+			{
+				var bytesRead = 0;
+
+				while (bytesRead < byteCount)
+				{
+					var n = deflateStream.Read(result, bytesRead, byteCount - bytesRead);
+
+					if (n == 0)
+					{
+						throw new InvalidDataException($"The encoded Z values hold {bytesRead} bytes, expected {byteCount}.");
+					}
+
+					bytesRead += n;
+				}
+			}
+
+			return result;
+		}
+
+		#endregion
+	}
+}
@@ -0,0 +1,12 @@
+﻿using System.Runtime.InteropServices;
+
+namespace MSetRowGeneratorClient
+{
+	[StructLayout(LayoutKind.Sequential, CharSet = CharSet.Ansi)]
+	public struct ColorBandTableRequestStruct
+	{
+		public int BandCount;
+		public int HighCutoff;
+		public int UseEscapeVelocities;
+	}
+}
@@ -3,12 +3,40 @@ using System.Runtime.InteropServices;
 
 namespace MSetRowGeneratorClient
 {
+	// Called by GenerateBlockProgressive after each pass, return a non-zero value to stop before the next pass.
+	[UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+	internal delegate int PassCompletedCallback(int passNumber, int stepSize);
+
 	internal static class HpMSetGeneratorImports
     {
 		//	..\\.\\source\repos\MandelbrotSetStudio\x64\Debug
 		[DllImport("..\\..\\..\\..\\..\\..\\x64\\Debug\\HpMSetGenerator.dll", CallingConvention = CallingConvention.Cdecl)]
 		internal static extern int GenerateMapSectionRow(MSetRowRequestStruct requestStruct, IntPtr crsForARow, IntPtr ciVec, IntPtr countsForARow);
 
+		[DllImport("..\\..\\..\\..\\..\\..\\x64\\Debug\\HpMSetGenerator.dll", CallingConvention = CallingConvention.Cdecl)]
+		internal static extern int GenerateMapSectionRowWithEscapeVelocities(MSetRowRequestStruct requestStruct, IntPtr crsForARow, IntPtr ciVec, IntPtr countsForARow, IntPtr escapeVelocitiesForARow);
+
+		[DllImport("..\\..\\..\\..\\..\\..\\x64\\Debug\\HpMSetGenerator.dll", CallingConvention = CallingConvention.Cdecl)]
+		internal static extern int GenerateMapSectionRowWithDistanceEstimates(MSetRowRequestStruct requestStruct, IntPtr crsForARow, IntPtr ciVec, IntPtr countsForARow, IntPtr distanceEstimatesForARow);
+
+		[DllImport("..\\..\\..\\..\\..\\..\\x64\\Debug\\HpMSetGenerator.dll", CallingConvention = CallingConvention.Cdecl)]
+		internal static extern int GenerateSamplePoints(SamplePointsRequestStruct requestStruct, IntPtr crsForBlock, IntPtr cisForBlock);
+
+		[DllImport("..\\..\\..\\..\\..\\..\\x64\\Debug\\HpMSetGenerator.dll", CallingConvention = CallingConvention.Cdecl)]
+		internal static extern int GenerateBlockProgressive(MSetRowRequestStruct requestStruct, IntPtr crsForBlock, IntPtr cisForBlock, IntPtr countsForBlock, IntPtr escapeVelocitiesForBlock,
+			PassCompletedCallback? passCompleted, out int samplesIterated);
+
+		[DllImport("..\\..\\..\\..\\..\\..\\x64\\Debug\\HpMSetGenerator.dll", CallingConvention = CallingConvention.Cdecl)]
+		internal static extern int GenerateSubsamples(SamplePointsRequestStruct samplePointsRequestStruct, MSetRowRequestStruct requestStruct, int subsampleFactor, int[] samplePositions, int sampleCount,
+			ushort[] counts, ushort[]? escapeVelocities);
+
+		[DllImport("..\\..\\..\\..\\..\\..\\x64\\Debug\\HpMSetGenerator.dll", CallingConvention = CallingConvention.Cdecl)]
+		internal static extern int ColorizeSamples(ColorBandTableRequestStruct colorBandTable, int[] bandIndexes, double[] bandValues, int[] opacities,
+			ushort[] counts, ushort[]? escapeVelocities, int valueCount, IntPtr pixels);
+
+		[DllImport("..\\..\\..\\..\\..\\..\\x64\\Debug\\HpMSetGenerator.dll", CallingConvention = CallingConvention.Cdecl)]
+		internal static extern int ProbeMapSectionRowPrecision(MSetRowRequestStruct requestStruct, IntPtr crsForARow, IntPtr ciVec, int vectorStride);
+
 		[DllImport("..\\..\\..\\..\\..\\..\\x64\\Debug\\HpMSetGenerator.dll", CallingConvention = CallingConvention.Cdecl)]
 		internal static extern int BaseSimdTest();
 
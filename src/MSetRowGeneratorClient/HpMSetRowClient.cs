@@ -3,28 +3,62 @@ using MSS.Types;
 using MSS.Types.APValues;
 using MSS.Types.MSet;
 using System;
+using System.Collections.Generic;
 using System.Diagnostics;
+using System.Numerics;
 using System.Runtime.InteropServices;
 using System.Runtime.Intrinsics;
 
 namespace MSetRowGeneratorClient
 {
-	public class HpMSetRowClient : IDisposable
+	public class HpMSetRowClient : ISubsampleGenerator, IDisposable
 	{
+		public const int MAX_LIMB_COUNT = 4;
+
 		private const int MEM_ALLOCATION_ALIGNMENT = 32;
 
 		private const int BLOCK_WIDTH = 128;
+		private const int BLOCK_HEIGHT = 128;
 		private const int VALUE_SIZE = 4;
+		private const int ESCAPE_VELOCITY_SIZE = 2;
+		private const int BLOCK_COUNT_SIZE = 2;
 		private const int LANES = 8;
-		private const int MAX_LIMB_COUNT = 4;
+
+		// Bit flags returned by GenerateMapSectionRow
+		private const int ROW_RESULT_ALL_ESCAPED = 1;
+		private const int ROW_RESULT_OVERFLOW = 2;
+
+		// Bit flag returned by GenerateBlockProgressive, in addition to the GenerateMapSectionRow flags
+		private const int PROGRESSIVE_RESULT_CANCELLED = 4;
+
+		// By default, the precision probe visits every 16th row and every 4th vector of each of those rows.
+		private const int PROBE_ROW_STRIDE = 16;
+		private const int PROBE_VECTOR_STRIDE = 4;
 
 		private const int COUNTS_BUFFER_SIZE = BLOCK_WIDTH * VALUE_SIZE;								//	128 x 4  
 		private const int SAMPLE_POINTS_X_BUFFER_SIZE = MAX_LIMB_COUNT * BLOCK_WIDTH * VALUE_SIZE;		//	4 x 128 x 4
 		private const int SAMPLE_POINT_Y_BUFFER_SIZE = MAX_LIMB_COUNT * LANES * VALUE_SIZE;				//	4 x 8 x 4
+		private const int ESCAPE_VELOCITIES_BUFFER_SIZE = BLOCK_WIDTH * ESCAPE_VELOCITY_SIZE;			//	128 x 2
+		private const int DISTANCE_ESTIMATES_BUFFER_SIZE = BLOCK_WIDTH * VALUE_SIZE;					//	128 x 4
+		private const int BLOCK_SAMPLE_POINTS_Y_BUFFER_SIZE = BLOCK_HEIGHT * SAMPLE_POINT_Y_BUFFER_SIZE;	//	128 x 4 x 8 x 4
+		private const int BLOCK_COUNTS_BUFFER_SIZE = BLOCK_WIDTH * BLOCK_HEIGHT * BLOCK_COUNT_SIZE;	//	128 x 128 x 2
+		private const int BLOCK_ESCAPE_VELOCITIES_BUFFER_SIZE = BLOCK_WIDTH * BLOCK_HEIGHT * ESCAPE_VELOCITY_SIZE;	//	128 x 128 x 2
+
+		// Values are passed to the native sample point generator as Hi * 2^63 + Lo.
+		private static readonly BigInteger LONG_FACTOR = BigInteger.Pow(2, 63);
 
 		private readonly IntPtr _countsBuffer;
 		private readonly IntPtr _samplePointsXBuffer;
 		private readonly IntPtr _yPointBuffer;
+		private readonly IntPtr _escapeVelocitiesBuffer;
+		private readonly IntPtr _distanceEstimatesBuffer;
+
+		private readonly IntPtr _blockSamplePointsXBuffer;
+		private readonly IntPtr _blockSamplePointsYBuffer;
+		private int _blockSamplePointsLimbCount;
+
+		private readonly IntPtr _blockCountsBuffer;
+		private readonly IntPtr _blockEscapeVelocitiesBuffer;
 
 		public HpMSetRowClient()
 		{
@@ -33,14 +67,275 @@ namespace MSetRowGeneratorClient
 				_countsBuffer = (IntPtr)NativeMemory.AlignedAlloc(COUNTS_BUFFER_SIZE, MEM_ALLOCATION_ALIGNMENT);
 				_samplePointsXBuffer = (IntPtr)NativeMemory.AlignedAlloc(SAMPLE_POINTS_X_BUFFER_SIZE, MEM_ALLOCATION_ALIGNMENT);
 				_yPointBuffer = (IntPtr)NativeMemory.AlignedAlloc(SAMPLE_POINT_Y_BUFFER_SIZE, MEM_ALLOCATION_ALIGNMENT);
+				_escapeVelocitiesBuffer = (IntPtr)NativeMemory.AlignedAlloc(ESCAPE_VELOCITIES_BUFFER_SIZE, MEM_ALLOCATION_ALIGNMENT);
+				_distanceEstimatesBuffer = (IntPtr)NativeMemory.AlignedAlloc(DISTANCE_ESTIMATES_BUFFER_SIZE, MEM_ALLOCATION_ALIGNMENT);
+				_blockSamplePointsXBuffer = (IntPtr)NativeMemory.AlignedAlloc(SAMPLE_POINTS_X_BUFFER_SIZE, MEM_ALLOCATION_ALIGNMENT);
+				_blockSamplePointsYBuffer = (IntPtr)NativeMemory.AlignedAlloc(BLOCK_SAMPLE_POINTS_Y_BUFFER_SIZE, MEM_ALLOCATION_ALIGNMENT);
+				_blockCountsBuffer = (IntPtr)NativeMemory.AlignedAlloc(BLOCK_COUNTS_BUFFER_SIZE, MEM_ALLOCATION_ALIGNMENT);
+				_blockEscapeVelocitiesBuffer = (IntPtr)NativeMemory.AlignedAlloc(BLOCK_ESCAPE_VELOCITIES_BUFFER_SIZE, MEM_ALLOCATION_ALIGNMENT);
 			}
+
+			_blockSamplePointsLimbCount = 0;
 		}
 
+		#region Public Properties
+
+		/// <summary>
+		/// If greater than 1, the native generator iterates this many times between escape checks. A batch in which a sample
+		/// escapes is rolled back and repeated one iteration at a time, so the counts are the same. This pays off for regions
+		/// with high counts, where few batches need to be repeated. Set to -1 to check after every iteration.
+		/// </summary>
+		public int IterationsPerStep { get; set; } = -1;
+
+		/// <summary>
+		/// If true, the native generator gives samples within the main cardioid or the period-2 bulb the target count without iterating them.
+		/// </summary>
+		public bool SkipInteriorSamples { get; set; } = true;
+
+		#endregion
+
 		#region Public Methods
 
-		unsafe public bool GenerateMapSectionRow(IIterationState iterationState, ApFixedPointFormat apFixedPointFormat, MapCalcSettings mapCalcSettings, CancellationToken ct)
+		/// <summary>
+		/// Generates the current row of the IterationState.
+		/// </summary>
+		/// <returns>True, if all samples in the row have escaped.</returns>
+		/// <remarks>If the MapCalcSettings specify that EscapeVelocities be calculated, the IterationState's EscapeVelocities are updated as well.</remarks>
+		/// <param name="overflowDetected">Set to true, if the ApFixedPointFormat's BitsBeforeBinaryPoint is too small for one or more of the row's samples.
+		/// The row's counts cannot be trusted and the row should be generated again using a wider format.</param>
+		unsafe public bool GenerateMapSectionRow(IIterationState iterationState, ApFixedPointFormat apFixedPointFormat, MapCalcSettings mapCalcSettings, CancellationToken ct, out bool overflowDetected)
+		{
+			var requestStruct = GetRequestStruct(iterationState, apFixedPointFormat, mapCalcSettings);
+
+			// SamplePointsX
+			GetSamplePointsX(iterationState);
+
+			// SamplePointY
+			GetYPointVecs(iterationState);
+
+			return GenerateMapSectionRow(requestStruct, iterationState, mapCalcSettings, _samplePointsXBuffer, _yPointBuffer, out overflowDetected);
+		}
+
+		/// <summary>
+		/// Builds the sample points for an entire block using the native generator. Once built, rows can be generated using
+		/// GenerateMapSectionRowFromBlockSamplePoints without copying the IterationState's sample points for each row.
+		/// </summary>
+		/// <param name="position">The position of the block's first sample.</param>
+		/// <returns>False, if a value is too large for the ApFixedPointFormat, or has more fractional bits than the format.
+		/// The sample points must be built by the SamplePointBuilder in this case.</returns>
+		public bool BuildBlockSamplePoints(RPoint position, RSize samplePointDelta, ApFixedPointFormat apFixedPointFormat, SizeInt blockSize)
+		{
+			if (apFixedPointFormat.LimbCount > MAX_LIMB_COUNT || blockSize.Width > BLOCK_WIDTH || blockSize.Height > BLOCK_HEIGHT)
+			{
+				throw new ArgumentException($"The LimbCount must not exceed {MAX_LIMB_COUNT} and the BlockSize must not exceed {BLOCK_WIDTH} x {BLOCK_HEIGHT}.");
+			}
+
+			_blockSamplePointsLimbCount = 0;
+
+			if (!TryGetLongs(position.XNumerator, out var xHi, out var xLo) || !TryGetLongs(position.YNumerator, out var yHi, out var yLo)
+				|| !TryGetLongs(samplePointDelta.WidthNumerator, out var dHi, out var dLo))
+			{
+				return false;
+			}
+
+			var requestStruct = new SamplePointsRequestStruct
+			{
+				PositionXHi = xHi,
+				PositionXLo = xLo,
+				PositionYHi = yHi,
+				PositionYLo = yLo,
+				SamplePointDeltaHi = dHi,
+				SamplePointDeltaLo = dLo,
+
+				PositionExponent = position.Exponent,
+				SamplePointDeltaExponent = samplePointDelta.Exponent,
+
+				BlockSizeWidth = blockSize.Width,
+				BlockSizeHeight = blockSize.Height,
+
+				BitsBeforeBinaryPoint = apFixedPointFormat.BitsBeforeBinaryPoint,
+				LimbCount = apFixedPointFormat.LimbCount,
+				TargetExponent = apFixedPointFormat.TargetExponent
+			};
+
+			var intResult = HpMSetGeneratorImports.GenerateSamplePoints(requestStruct, _blockSamplePointsXBuffer, _blockSamplePointsYBuffer);
+
+			if (intResult != 0)
+			{
+				return false;
+			}
+
+			_blockSamplePointsLimbCount = apFixedPointFormat.LimbCount;
+
+			return true;
+		}
+
+		/// <summary>
+		/// Generates the current row of the IterationState using the sample points created by the last call to BuildBlockSamplePoints.
+		/// </summary>
+		/// <returns>True, if all samples in the row have escaped.</returns>
+		public bool GenerateMapSectionRowFromBlockSamplePoints(IIterationState iterationState, ApFixedPointFormat apFixedPointFormat, MapCalcSettings mapCalcSettings, CancellationToken ct, out bool overflowDetected)
+		{
+			if (_blockSamplePointsLimbCount != apFixedPointFormat.LimbCount)
+			{
+				throw new InvalidOperationException("The block's sample points have not been built using the given ApFixedPointFormat.");
+			}
+
+			var requestStruct = GetRequestStruct(iterationState, apFixedPointFormat, mapCalcSettings);
+
+			// The y values for each row are stored one after the other.
+			var ciVec = IntPtr.Add(_blockSamplePointsYBuffer, requestStruct.RowNumber * apFixedPointFormat.LimbCount * LANES * VALUE_SIZE);
+
+			return GenerateMapSectionRow(requestStruct, iterationState, mapCalcSettings, _blockSamplePointsXBuffer, ciVec, out overflowDetected);
+		}
+
+		/// <summary>
+		/// Generates an entire block using the sample points created by the last call to BuildBlockSamplePoints. The block is generated in three passes:
+		/// every 4th sample of every 4th row, then every 2nd, then every sample. Samples added by the 2nd and 3rd passes whose neighbors on the previous pass
+		/// all have the same count are given that count without being iterated, and are only iterated if a neighbor calculated by the same pass disagrees.
+		/// </summary>
+		/// <param name="mapSectionVectors">Receives the counts and, if the MapCalcSettings specify that EscapeVelocities be calculated, the escape velocities.</param>
+		/// <param name="passCompleted">If not null, called after each pass with the pass's step size: 4, 2 and then 1. At that point the MapSectionVectors hold
+		/// a preview of the block, each sample not yet calculated has the value of the nearest calculated sample above and to the left.</param>
+		/// <param name="samplesIterated">The number of samples that were iterated, the remainder were guessed.</param>
+		/// <param name="overflowDetected">Set to true, if the ApFixedPointFormat's BitsBeforeBinaryPoint is too small for one or more of the block's samples.</param>
+		/// <param name="cancelled">Set to true, if the CancellationToken was cancelled before the last pass. The MapSectionVectors hold the preview created by the last pass that was completed.</param>
+		/// <returns>True, if all samples have escaped. Always false if cancelled.</returns>
+		public bool GenerateBlockProgressive(MapSectionVectors2 mapSectionVectors, ApFixedPointFormat apFixedPointFormat, MapCalcSettings mapCalcSettings, Action<int>? passCompleted,
+			CancellationToken ct, out int samplesIterated, out bool overflowDetected, out bool cancelled)
+		{
+			if (_blockSamplePointsLimbCount != apFixedPointFormat.LimbCount)
+			{
+				throw new InvalidOperationException("The block's sample points have not been built using the given ApFixedPointFormat.");
+			}
+
+			if (mapSectionVectors.BlockSize.Width > BLOCK_WIDTH || mapSectionVectors.BlockSize.Height > BLOCK_HEIGHT)
+			{
+				throw new ArgumentException($"The BlockSize must not exceed {BLOCK_WIDTH} x {BLOCK_HEIGHT}.");
+			}
+
+			var requestStruct = GetRequestStruct(mapSectionVectors.BlockSize, apFixedPointFormat, mapCalcSettings, rowNumber: 0);
+			var escapeVelocitiesBuffer = mapCalcSettings.CalculateEscapeVelocities ? _blockEscapeVelocitiesBuffer : IntPtr.Zero;
+
+			PassCompletedCallback callback = (passNumber, stepSize) =>
+			{
+				if (passCompleted != null)
+				{
+					PutBlockValues(mapSectionVectors, escapeVelocitiesBuffer != IntPtr.Zero);
+					passCompleted(stepSize);
+				}
+
+				return ct.IsCancellationRequested ? 1 : 0;
+			};
+
+			var intResult = HpMSetGeneratorImports.GenerateBlockProgressive(requestStruct, _blockSamplePointsXBuffer, _blockSamplePointsYBuffer, _blockCountsBuffer, escapeVelocitiesBuffer,
+				callback, out samplesIterated);
+
+			GC.KeepAlive(callback);
+
+			PutBlockValues(mapSectionVectors, escapeVelocitiesBuffer != IntPtr.Zero);
+
+			overflowDetected = (intResult & ROW_RESULT_OVERFLOW) != 0;
+			cancelled = (intResult & PROGRESSIVE_RESULT_CANCELLED) != 0;
+
+			var allSamplesHaveEscaped = (intResult & ROW_RESULT_ALL_ESCAPED) != 0 && !cancelled;
+
+			return allSamplesHaveEscaped;
+		}
+
+		/// <summary>
+		/// Generates a subsampleFactor x subsampleFactor grid of subsamples centered on each of the given samples of the MapSectionRequest's block.
+		/// The subsamples of the block lie on a lattice offset by half a subsample from the block's position, whose spacing is 1 / subsampleFactor of the SamplePointDelta.
+		/// </summary>
+		/// <returns>False, if the lattice cannot be represented using at most MAX_LIMB_COUNT limbs or the iteration overflowed.</returns>
+		public bool GenerateSubsamples(MapSectionRequest mapSectionRequest, int subsampleFactor, IList<PointInt> samplePositions, ushort[] counts, ushort[] escapeVelocities)
+		{
+			if (subsampleFactor != 2 && subsampleFactor != 4 && subsampleFactor != 8)
+			{
+				throw new ArgumentException("The SubsampleFactor must be 2, 4 or 8.", nameof(subsampleFactor));
+			}
+
+			var position = mapSectionRequest.MapPosition;
+			var delta = mapSectionRequest.SamplePointDelta;
+
+			// The first subsample is (1 - subsampleFactor) / (2 * subsampleFactor) of the delta from the block's position.
+			var halfSubsampleShift = BitOperations.Log2((uint)subsampleFactor * 2);
+			var exponent = Math.Min(position.Exponent, delta.Exponent - halfSubsampleShift);
+
+			var offset = (1 - subsampleFactor) * (delta.WidthNumerator << (delta.Exponent - halfSubsampleShift - exponent));
+			var startX = (position.XNumerator << (position.Exponent - exponent)) + offset;
+			var startY = (position.YNumerator << (position.Exponent - exponent)) + offset;
+
+			var latticeDeltaExponent = delta.Exponent - halfSubsampleShift + 1;
+
+			if (!TryGetLongs(startX, out var xHi, out var xLo) || !TryGetLongs(startY, out var yHi, out var yLo) || !TryGetLongs(delta.WidthNumerator, out var dHi, out var dLo))
+			{
+				return false;
+			}
+
+			// Use the fewest limbs, starting with the request's LimbCount, that hold the additional fractional bits.
+			var apFixedPointFormat = new ApFixedPointFormat(mapSectionRequest.LimbCount);
+
+			while (apFixedPointFormat.TargetExponent > Math.Min(exponent, latticeDeltaExponent))
+			{
+				if (apFixedPointFormat.LimbCount == MAX_LIMB_COUNT)
+				{
+					return false;
+				}
+
+				apFixedPointFormat = new ApFixedPointFormat(apFixedPointFormat.LimbCount + 1);
+			}
+
+			var samplePointsRequestStruct = new SamplePointsRequestStruct
+			{
+				PositionXHi = xHi,
+				PositionXLo = xLo,
+				PositionYHi = yHi,
+				PositionYLo = yLo,
+				SamplePointDeltaHi = dHi,
+				SamplePointDeltaLo = dLo,
+
+				PositionExponent = exponent,
+				SamplePointDeltaExponent = latticeDeltaExponent,
+
+				BlockSizeWidth = mapSectionRequest.BlockSize.Width,
+				BlockSizeHeight = mapSectionRequest.BlockSize.Height,
+
+				BitsBeforeBinaryPoint = apFixedPointFormat.BitsBeforeBinaryPoint,
+				LimbCount = apFixedPointFormat.LimbCount,
+				TargetExponent = apFixedPointFormat.TargetExponent
+			};
+
+			var mapCalcSettings = mapSectionRequest.MapCalcSettings;
+			var requestStruct = GetRequestStruct(mapSectionRequest.BlockSize, apFixedPointFormat, mapCalcSettings, rowNumber: 0);
+
+			var positions = new int[samplePositions.Count * 2];
+
+			for (var i = 0; i < samplePositions.Count; i++)
+			{
+				positions[i * 2] = samplePositions[i].X;
+				positions[i * 2 + 1] = samplePositions[i].Y;
+			}
+
+			var intResult = HpMSetGeneratorImports.GenerateSubsamples(samplePointsRequestStruct, requestStruct, subsampleFactor, positions, samplePositions.Count,
+				counts, mapCalcSettings.CalculateEscapeVelocities ? escapeVelocities : null);
+
+			return intResult == 0;
+		}
+
+		/// <summary>
+		/// Generates the current row of the IterationState along with an estimate of the distance from each sample to the boundary of the set.
+		/// </summary>
+		/// <returns>True, if all samples in the row have escaped.</returns>
+		/// <param name="distanceEstimates">Receives one value for each sample of the row, in the same units as the sample points.
+		/// The true distance is between 1/4 of the estimate and the estimate. Samples that did not escape are given a distance of zero.</param>
+		/// <remarks>A sample whose distance estimate is less than the SamplePointDelta is adjacent to the boundary.
+		/// The larger, normalized threshold is used to improve the accuracy of the estimate.</remarks>
+		unsafe public bool GenerateMapSectionRowWithDistanceEstimates(IIterationState iterationState, ApFixedPointFormat apFixedPointFormat, MapCalcSettings mapCalcSettings, float[] distanceEstimates,
+			CancellationToken ct, out bool overflowDetected)
 		{
 			var requestStruct = GetRequestStruct(iterationState, apFixedPointFormat, mapCalcSettings);
+			requestStruct.ThresholdForComparison = GetThresholdValueForCompare(RMapConstants.DEFAULT_NORMALIZED_THRESHOLD, apFixedPointFormat);
 
 			// SamplePointsX
 			GetSamplePointsX(iterationState);
@@ -52,20 +347,77 @@ namespace MSetRowGeneratorClient
 			GetCounts(iterationState);
 
 			// Generate a MapSectionRow
-			var intResult = HpMSetGeneratorImports.GenerateMapSectionRow(requestStruct, _samplePointsXBuffer, _yPointBuffer, _countsBuffer);
+			var intResult = HpMSetGeneratorImports.GenerateMapSectionRowWithDistanceEstimates(requestStruct, _samplePointsXBuffer, _yPointBuffer, _countsBuffer, _distanceEstimatesBuffer);
 
 			// Counts
 			PutCounts(iterationState);
 
-			//FreeInteropBuffer(ypBuffer);
-			//FreeInteropBuffer(spxBuffer);
+			// DistanceEstimates
+			PutDistanceEstimates(distanceEstimates);
 
-			var allRowSamplesHaveEscaped = intResult == 0 ? false : true;
-			//Debug.WriteLine($"All row samples have escaped: {allRowSamplesHaveEscaped}.");
+			var allRowSamplesHaveEscaped = (intResult & ROW_RESULT_ALL_ESCAPED) != 0;
+			overflowDetected = (intResult & ROW_RESULT_OVERFLOW) != 0;
 
 			return allRowSamplesHaveEscaped;
 		}
 
+		/// <summary>
+		/// Determines whether a MapSection can be generated using one less limb than given by the ApFixedPointFormat.
+		/// A sparse set of rows is generated at both precisions using the sample points created by the last call to BuildBlockSamplePoints and the resulting counts are compared.
+		/// </summary>
+		/// <param name="apFixedPointFormat">The higher of the two precisions to compare, its LimbCount must be at least 2.</param>
+		/// <returns>The lowest LimbCount that produces the same counts for each of the probed samples.</returns>
+		public int GetLimbCountForMapSection(SizeInt blockSize, ApFixedPointFormat apFixedPointFormat, MapCalcSettings mapCalcSettings, CancellationToken ct,
+			int rowStride = PROBE_ROW_STRIDE, int vectorStride = PROBE_VECTOR_STRIDE)
+		{
+			var limbCount = apFixedPointFormat.LimbCount;
+
+			if (limbCount < 2 || limbCount > MAX_LIMB_COUNT)
+			{
+				throw new ArgumentException($"The ApFixedPointFormat's LimbCount must be between 2 and {MAX_LIMB_COUNT}, inclusive.");
+			}
+
+			for (var rowNumber = rowStride / 2; rowNumber < blockSize.Height; rowNumber += rowStride)
+			{
+				if (ct.IsCancellationRequested)
+				{
+					return limbCount;
+				}
+
+				var numberOfMismatches = ProbeMapSectionRowPrecision(blockSize, apFixedPointFormat, mapCalcSettings, rowNumber, vectorStride);
+
+				if (numberOfMismatches != 0)
+				{
+					// Either some counts differ or the probe overflowed, in both cases the higher precision is required.
+					return limbCount;
+				}
+			}
+
+			return limbCount - 1;
+		}
+
+		/// <summary>
+		/// Generates every vectorStride'th vector of the specified row using the given ApFixedPointFormat and again using one less limb.
+		/// The sample points created by the last call to BuildBlockSamplePoints are used.
+		/// </summary>
+		/// <returns>The number of samples whose counts differ, or -1 if an overflow was detected.</returns>
+		public int ProbeMapSectionRowPrecision(SizeInt blockSize, ApFixedPointFormat apFixedPointFormat, MapCalcSettings mapCalcSettings, int rowNumber, int vectorStride)
+		{
+			if (_blockSamplePointsLimbCount != apFixedPointFormat.LimbCount)
+			{
+				throw new InvalidOperationException("The block's sample points have not been built using the given ApFixedPointFormat.");
+			}
+
+			var requestStruct = GetRequestStruct(blockSize, apFixedPointFormat, mapCalcSettings, rowNumber);
+
+			// The y values for each row are stored one after the other.
+			var ciVec = IntPtr.Add(_blockSamplePointsYBuffer, rowNumber * apFixedPointFormat.LimbCount * LANES * VALUE_SIZE);
+
+			var numberOfMismatches = HpMSetGeneratorImports.ProbeMapSectionRowPrecision(requestStruct, _blockSamplePointsXBuffer, ciVec, vectorStride);
+
+			return numberOfMismatches;
+		}
+
 		#endregion
 
 		#region Test Support 
@@ -154,14 +506,15 @@ namespace MSetRowGeneratorClient
 			return allRowSamplesHaveEscaped;
 		}
 
-		unsafe public bool RoundTripCounts(IIterationState iterationState, ApFixedPointFormat apFixedPointFormat, MapCalcSettings mapCalcSettings)
+		unsafe public bool RoundTripCounts(IIterationState iterationState, MapSectionVectors2 mapSectionVectors, ApFixedPointFormat apFixedPointFormat, MapCalcSettings mapCalcSettings)
 		{
 			var requestStruct = GetRequestStruct(iterationState, apFixedPointFormat, mapCalcSettings);
 
+			var counts = MemoryMarshal.Cast<byte, ushort>(mapSectionVectors.Counts);
 
 			ushort cVal = 0;
 
-			for (var i = 0; i < iterationState.MapSectionVectors.Counts.Length; i++)
+			for (var i = 0; i < counts.Length; i++)
 			{
 				if (ushort.MaxValue - cVal < 30)
 				{
@@ -170,19 +523,15 @@ namespace MSetRowGeneratorClient
 
 				cVal += 27;
 
-				iterationState.MapSectionVectors.Counts[i] = cVal;
+				counts[i] = cVal;
 			}
 
-			// Sum the first row from the original source.
-			var totalBefore = iterationState.MapSectionVectors.Counts.Take(iterationState.ValuesPerRow).Sum(x => (long)x);
-
 			// Update the Iterations state's current row of Vector256<int>s
-			iterationState.MapSectionVectors.FillCountsRow(0, iterationState.CountsRowV);
-
+			mapSectionVectors.FillCountsRow(0, iterationState.CountsRowV);
 
 			// Load into an array of integers the contents of CountsRowV
-			var diagCounts = new int[iterationState.MapSectionVectors.ValuesPerRow];
-			iterationState.MapSectionVectors.FillCountsRow(iterationState.RowNumber!.Value, diagCounts);
+			var diagCounts = new int[mapSectionVectors.ValuesPerRow];
+			mapSectionVectors.FillCountsRow(iterationState.RowNumber!.Value, diagCounts);
 
 			// Measure
 			var rowSumBefore = diagCounts.Sum();
@@ -193,9 +542,11 @@ namespace MSetRowGeneratorClient
 			// Updated the interation state from this buffer.
 			PutCounts(iterationState);
 
-			// Refresh the counts
+			// Write the row back to the source and refresh the counts
+			mapSectionVectors.UpdateFromCountsRow(iterationState.RowNumber!.Value, iterationState.CountsRowV);
+
 			Array.Clear(diagCounts);
-			iterationState.MapSectionVectors.FillCountsRow(iterationState.RowNumber!.Value, diagCounts);
+			mapSectionVectors.FillCountsRow(iterationState.RowNumber!.Value, diagCounts);
 
 			// And re-measure.
 			var rowSumAfter = diagCounts.Sum();
@@ -207,6 +558,40 @@ namespace MSetRowGeneratorClient
 
 		#region Support Methods
 
+		private bool GenerateMapSectionRow(MSetRowRequestStruct requestStruct, IIterationState iterationState, MapCalcSettings mapCalcSettings, IntPtr crsForARow, IntPtr ciVec, out bool overflowDetected)
+		{
+			// Counts
+			GetCounts(iterationState);
+
+			// Generate a MapSectionRow
+			int intResult;
+
+			if (mapCalcSettings.CalculateEscapeVelocities)
+			{
+				intResult = HpMSetGeneratorImports.GenerateMapSectionRowWithEscapeVelocities(requestStruct, crsForARow, ciVec, _countsBuffer, _escapeVelocitiesBuffer);
+
+				// EscapeVelocities
+				PutEscapeVelocities(iterationState);
+			}
+			else
+			{
+				intResult = HpMSetGeneratorImports.GenerateMapSectionRow(requestStruct, crsForARow, ciVec, _countsBuffer);
+			}
+
+			// Counts
+			PutCounts(iterationState);
+
+			//FreeInteropBuffer(ypBuffer);
+			//FreeInteropBuffer(spxBuffer);
+
+			var allRowSamplesHaveEscaped = (intResult & ROW_RESULT_ALL_ESCAPED) != 0;
+			//Debug.WriteLine($"All row samples have escaped: {allRowSamplesHaveEscaped}.");
+
+			overflowDetected = (intResult & ROW_RESULT_OVERFLOW) != 0;
+
+			return allRowSamplesHaveEscaped;
+		}
+
 		private void GetCounts(IIterationState iterationState)
 		{
 			var srcSpan = MemoryMarshal.Cast<Vector256<int>, byte>(iterationState.CountsRowV);
@@ -251,6 +636,60 @@ namespace MSetRowGeneratorClient
 			}
 		}
 
+		private void PutBlockValues(MapSectionVectors2 mapSectionVectors, bool includeEscapeVelocities)
+		{
+			unsafe
+			{
+				// The counts and escape velocities are stored row by row, one ushort per sample, as they are in the MapSectionVectors.
+				var srcSpan = new Span<byte>((void*)_blockCountsBuffer, mapSectionVectors.TotalByteCount);
+				srcSpan.CopyTo(mapSectionVectors.Counts);
+
+				if (includeEscapeVelocities)
+				{
+					srcSpan = new Span<byte>((void*)_blockEscapeVelocitiesBuffer, mapSectionVectors.TotalByteCount);
+					srcSpan.CopyTo(mapSectionVectors.EscapeVelocities);
+				}
+			}
+		}
+
+		private void PutDistanceEstimates(float[] distanceEstimates)
+		{
+			var dstSpan = MemoryMarshal.Cast<float, byte>(distanceEstimates);
+
+			unsafe
+			{
+				var srcSpan = new Span<byte>((void*)_distanceEstimatesBuffer, DISTANCE_ESTIMATES_BUFFER_SIZE);
+				srcSpan.CopyTo(dstSpan);
+			}
+		}
+
+		private void PutEscapeVelocities(IIterationState iterationState)
+		{
+			var dstSpan = MemoryMarshal.Cast<ushort, byte>(iterationState.EscapeVelocities);
+
+			unsafe
+			{
+				var srcSpan = new Span<byte>((void*)_escapeVelocitiesBuffer, ESCAPE_VELOCITIES_BUFFER_SIZE);
+				srcSpan.CopyTo(dstSpan);
+			}
+		}
+
+		private bool TryGetLongs(BigInteger value, out long hi, out long lo)
+		{
+			var bHi = BigInteger.DivRem(value, LONG_FACTOR, out var bLo);
+
+			if (bHi < long.MinValue || bHi > long.MaxValue)
+			{
+				hi = 0;
+				lo = 0;
+				return false;
+			}
+
+			hi = (long)bHi;
+			lo = (long)bLo;
+			return true;
+		}
+
 		unsafe private void FreeInteropBuffer(void* buffer)
 		{
 			NativeMemory.AlignedFree(buffer);
@@ -258,15 +697,25 @@ namespace MSetRowGeneratorClient
 
 		private MSetRowRequestStruct GetRequestStruct(IIterationState iterationState, ApFixedPointFormat apFixedPointFormat, MapCalcSettings mapCalcSettings)
 		{
-			var result = new MSetRowRequestStruct();
-
 			if (!iterationState.RowNumber.HasValue)
 			{
 				throw new ArgumentException("The iteration state must have a non-null row number.");
 			}
 
-			result.BlockSizeWidth = iterationState.ValuesPerRow;
-			result.BlockSizeHeight = iterationState.RowCount;
+			return GetRequestStruct(iterationState, apFixedPointFormat, mapCalcSettings, iterationState.RowNumber.Value);
+		}
+
+		private MSetRowRequestStruct GetRequestStruct(IIterationState iterationState, ApFixedPointFormat apFixedPointFormat, MapCalcSettings mapCalcSettings, int rowNumber)
+		{
+			return GetRequestStruct(new SizeInt(iterationState.ValuesPerRow, iterationState.RowCount), apFixedPointFormat, mapCalcSettings, rowNumber);
+		}
+
+		private MSetRowRequestStruct GetRequestStruct(SizeInt blockSize, ApFixedPointFormat apFixedPointFormat, MapCalcSettings mapCalcSettings, int rowNumber)
+		{
+			var result = new MSetRowRequestStruct();
+
+			result.BlockSizeWidth = blockSize.Width;
+			result.BlockSizeHeight = blockSize.Height;
 
 			result.BitsBeforeBinaryPoint = apFixedPointFormat.BitsBeforeBinaryPoint;
 			result.LimbCount = apFixedPointFormat.LimbCount;
@@ -275,19 +724,22 @@ namespace MSetRowGeneratorClient
 			result.TargetExponent = apFixedPointFormat.TargetExponent;
 
 			result.Lanes = Vector256<int>.Count;
-			result.VectorsPerRow = iterationState.VectorsPerRow;
+			result.VectorsPerRow = blockSize.Width / Vector256<int>.Count;
 
 			//result.subdivisionId = ObjectId.Empty.ToString();
 
 			// The RowNumber to calculate
-			result.RowNumber = iterationState.RowNumber.Value;
+			result.RowNumber = rowNumber;
 
 			result.TargetIterations = mapCalcSettings.TargetIterations;
 
-			var thresholdForComparison = GetThresholdValueForCompare(mapCalcSettings.Threshold, apFixedPointFormat);
+			// The escape velocity calculation expects the larger, normalized threshold.
+			var threshold = mapCalcSettings.CalculateEscapeVelocities ? RMapConstants.DEFAULT_NORMALIZED_THRESHOLD : mapCalcSettings.Threshold;
+			var thresholdForComparison = GetThresholdValueForCompare(threshold, apFixedPointFormat);
 
 			result.ThresholdForComparison = thresholdForComparison;
-			result.IterationsPerStep = -1;
+			result.IterationsPerStep = IterationsPerStep;
+			result.SkipInteriorSamples = SkipInteriorSamples ? 1 : 0;
 
 			return result;
 		}
@@ -318,6 +770,12 @@ namespace MSetRowGeneratorClient
 						FreeInteropBuffer((void*)_countsBuffer);
 						FreeInteropBuffer((void*)_samplePointsXBuffer);
 						FreeInteropBuffer((void*)_yPointBuffer);
+						FreeInteropBuffer((void*)_escapeVelocitiesBuffer);
+						FreeInteropBuffer((void*)_distanceEstimatesBuffer);
+						FreeInteropBuffer((void*)_blockSamplePointsXBuffer);
+						FreeInteropBuffer((void*)_blockSamplePointsYBuffer);
+						FreeInteropBuffer((void*)_blockCountsBuffer);
+						FreeInteropBuffer((void*)_blockEscapeVelocitiesBuffer);
 					}
 				}
 
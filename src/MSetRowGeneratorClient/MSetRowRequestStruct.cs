@@ -29,5 +29,6 @@ namespace MSetRowGeneratorClient
 		public int TargetIterations;
 		public int ThresholdForComparison;
 		public int IterationsPerStep;
+		public int SkipInteriorSamples;
 	}
 }
@@ -0,0 +1,179 @@
+﻿using MSS.Common;
+using MSS.Types;
+using MSS.Types.MSet;
+using System.Diagnostics;
+
+namespace MSetRowGeneratorClient
+{
+	/// <summary>
+	/// Generates a MapSection using the HpMSetGenerator's progressive block generator.
+	/// If a sparse set of samples have the same counts using one less limb than the request specifies, the block is generated using the lower precision.
+	/// If the generator reports that a sample overflowed, the block is generated again using a format with more bits before the binary point.
+	/// Requests that include ZValues, that are increasing the target iterations or that cannot be represented by the native sample point generator
+	/// are handled by the fallback generator.
+	/// </summary>
+	public class MapSectionGeneratorNative : IMapSectionGenerator, IDisposable
+	{
+		#region Private Properties
+
+		// The number of bits before the binary point added each time the block is generated again after an overflow.
+		private const int OVERFLOW_BITS_INCREMENT = 8;
+
+		// The threshold is compared using the most significant limb, so the bits before the binary point must fit in one limb.
+		private const int MAX_BITS_BEFORE_BP = ApFixedPointFormat.EFFECTIVE_BITS_PER_LIMB;
+
+		private readonly IMapSectionGenerator _fallbackGenerator;
+		private readonly HpMSetRowClient _hpMSetRowClient;
+
+		#endregion
+
+		#region Constructor
+
+		public MapSectionGeneratorNative(IMapSectionGenerator fallbackGenerator)
+		{
+			_fallbackGenerator = fallbackGenerator;
+			_hpMSetRowClient = new HpMSetRowClient();
+		}
+
+		#endregion
+
+		#region Generate MapSection
+
+		public MapSectionResponse GenerateMapSection(MapSectionRequest mapSectionRequest, CancellationToken ct)
+		{
+			var mapCalcSettings = mapSectionRequest.MapCalcSettings;
+			var apFixedPointFormat = new ApFixedPointFormat(mapSectionRequest.LimbCount);
+
+			if (mapCalcSettings.SaveTheZValues || mapSectionRequest.IncreasingIterations || !TryBuildBlockSamplePoints(mapSectionRequest, apFixedPointFormat))
+			{
+				return _fallbackGenerator.GenerateMapSection(mapSectionRequest, ct);
+			}
+
+			var (mapSectionVectors2, mapSectionZVectors) = mapSectionRequest.TransferMapVectorsOut2();
+			if (mapSectionVectors2 == null) throw new ArgumentException("The MapSectionVectors2 is null.");
+
+			var stopwatch = Stopwatch.StartNew();
+
+			apFixedPointFormat = GetLowestSufficientFormat(mapSectionRequest, apFixedPointFormat, ct);
+
+			// The native generator iterates every sample, the samples of the parent section are not used.
+			mapSectionRequest.ParentSamples = null;
+
+			bool allSamplesHaveEscaped;
+			bool overflowDetected;
+			bool cancelled;
+
+			while (true)
+			{
+				allSamplesHaveEscaped = _hpMSetRowClient.GenerateBlockProgressive(mapSectionVectors2, apFixedPointFormat, mapCalcSettings, passCompleted: null, ct,
+					out _, out overflowDetected, out cancelled);
+
+				if (!overflowDetected || cancelled || !TryGetWiderFormat(mapSectionRequest, apFixedPointFormat, out var widerFormat))
+				{
+					break;
+				}
+
+				apFixedPointFormat = widerFormat;
+			}
+
+			if (overflowDetected)
+			{
+				Debug.WriteLine($"WARNING: The MapSection: {mapSectionRequest} overflowed using {apFixedPointFormat}. It is being marked as not completed.");
+			}
+
+			stopwatch.Stop();
+			mapSectionRequest.GenerationDuration = stopwatch.Elapsed;
+
+			// A section whose samples overflowed using the widest format available is not completed, so that it is generated again when next requested.
+			var result = new MapSectionResponse(mapSectionRequest, requestCompleted: !cancelled && !overflowDetected, allSamplesHaveEscaped, mapSectionVectors2, mapSectionZVectors,
+				requestCancelled: cancelled);
+
+			result.LimbCount = apFixedPointFormat.LimbCount;
+
+			return result;
+		}
+
+		private ApFixedPointFormat GetLowestSufficientFormat(MapSectionRequest mapSectionRequest, ApFixedPointFormat apFixedPointFormat, CancellationToken ct)
+		{
+			if (apFixedPointFormat.LimbCount < 2)
+			{
+				return apFixedPointFormat;
+			}
+
+			var limbCount = _hpMSetRowClient.GetLimbCountForMapSection(mapSectionRequest.BlockSize, apFixedPointFormat, mapSectionRequest.MapCalcSettings, ct);
+
+			if (limbCount == apFixedPointFormat.LimbCount)
+			{
+				return apFixedPointFormat;
+			}
+
+			var lowerFormat = new ApFixedPointFormat(apFixedPointFormat.BitsBeforeBinaryPoint, apFixedPointFormat.NumberOfFractionalBits - ApFixedPointFormat.EFFECTIVE_BITS_PER_LIMB);
+
+			if (TryBuildBlockSamplePoints(mapSectionRequest, lowerFormat))
+			{
+				return lowerFormat;
+			}
+
+			// The position has more fractional bits than the lower precision holds, the sample points are built again using the format that succeeded before.
+			TryBuildBlockSamplePoints(mapSectionRequest, apFixedPointFormat);
+
+			return apFixedPointFormat;
+		}
+
+		private bool TryGetWiderFormat(MapSectionRequest mapSectionRequest, ApFixedPointFormat apFixedPointFormat, out ApFixedPointFormat widerFormat)
+		{
+			if (apFixedPointFormat.BitsBeforeBinaryPoint >= MAX_BITS_BEFORE_BP)
+			{
+				widerFormat = apFixedPointFormat;
+				return false;
+			}
+
+			var bitsBeforeBp = Math.Min(apFixedPointFormat.BitsBeforeBinaryPoint + OVERFLOW_BITS_INCREMENT, MAX_BITS_BEFORE_BP);
+			widerFormat = new ApFixedPointFormat((byte)bitsBeforeBp, apFixedPointFormat.NumberOfFractionalBits);
+
+			var result = TryBuildBlockSamplePoints(mapSectionRequest, widerFormat);
+
+			return result;
+		}
+
+		private bool TryBuildBlockSamplePoints(MapSectionRequest mapSectionRequest, ApFixedPointFormat apFixedPointFormat)
+		{
+			if (apFixedPointFormat.LimbCount > HpMSetRowClient.MAX_LIMB_COUNT)
+			{
+				return false;
+			}
+
+			var result = _hpMSetRowClient.BuildBlockSamplePoints(mapSectionRequest.MapPosition, mapSectionRequest.SamplePointDelta, apFixedPointFormat, mapSectionRequest.BlockSize);
+
+			return result;
+		}
+
+		#endregion
+
+		#region IDisposable
+
+		private bool disposedValue;
+
+		protected virtual void Dispose(bool disposing)
+		{
+			if (!disposedValue)
+			{
+				if (disposing)
+				{
+					_hpMSetRowClient.Dispose();
+				}
+
+				disposedValue = true;
+			}
+		}
+
+		public void Dispose()
+		{
+			// Do not change this code. Put cleanup code in 'Dispose(bool disposing)' method
+			Dispose(disposing: true);
+			GC.SuppressFinalize(this);
+		}
+
+		#endregion
+	}
+}
@@ -0,0 +1,61 @@
+﻿using MSS.Common;
+using System;
+
+namespace MSetRowGeneratorClient
+{
+	/// <summary>
+	/// Colors a block of counts and escape velocities using the HpMSetGenerator's vectorized colorizer.
+	/// Produces the same BGRA values as ColorMap.PlaceColor, using the ColorMap's state when the ColorBandTable was built.
+	/// It holds no state, a single instance can be shared.
+	/// </summary>
+	public class NativeColorizer : IBlockColorizer
+	{
+		private const int BYTES_PER_PIXEL = 4;
+
+		#region Public Methods
+
+		public int ColorizeBlock(ColorMap colorMap, ushort[] counts, ushort[]? escapeVelocities, byte[] destination)
+		{
+			return ColorizeBlock(colorMap.GetColorBandTable(), counts, escapeVelocities, counts.Length, destination);
+		}
+
+		/// <summary>
+		/// Fills the destination with the Blue, Green, Red and Alpha values for the first valueCount counts.
+		/// Returns the number of color components that were out of range.
+		/// </summary>
+		public unsafe int ColorizeBlock(ColorBandTable colorBandTable, ushort[] counts, ushort[]? escapeVelocities, int valueCount, byte[] destination)
+		{
+			if (counts.Length < valueCount)
+			{
+				throw new ArgumentException("There must be a count for each value.", nameof(counts));
+			}
+
+			if (colorBandTable.UseEscapeVelocities && (escapeVelocities == null || escapeVelocities.Length < valueCount))
+			{
+				throw new ArgumentException("There must be an escape velocity for each count.", nameof(escapeVelocities));
+			}
+
+			if (destination.Length < valueCount * BYTES_PER_PIXEL)
+			{
+				throw new ArgumentException($"The destination must have {BYTES_PER_PIXEL} bytes for each count.", nameof(destination));
+			}
+
+			var requestStruct = new ColorBandTableRequestStruct
+			{
+				BandCount = colorBandTable.BandCount,
+				HighCutoff = colorBandTable.HighCutoff,
+				UseEscapeVelocities = colorBandTable.UseEscapeVelocities ? 1 : 0
+			};
+
+			fixed (byte* pixels = destination)
+			{
+				var escapeVelocitiesToUse = colorBandTable.UseEscapeVelocities ? escapeVelocities : null;
+
+				return HpMSetGeneratorImports.ColorizeSamples(requestStruct, colorBandTable.BandIndexes, colorBandTable.BandValues, colorBandTable.Opacities,
+					counts, escapeVelocitiesToUse, valueCount, (IntPtr)pixels);
+			}
+		}
+
+		#endregion
+	}
+}
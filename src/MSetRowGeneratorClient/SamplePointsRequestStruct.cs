@@ -0,0 +1,28 @@
+﻿using System.Runtime.InteropServices;
+
+namespace MSetRowGeneratorClient
+{
+	[StructLayout(LayoutKind.Sequential, CharSet = CharSet.Ansi)]
+	public struct SamplePointsRequestStruct
+	{
+		// Each value is N * 2^Exponent, where N = Hi * 2^63 + Lo.
+		public long PositionXHi;
+		public long PositionXLo;
+		public long PositionYHi;
+		public long PositionYLo;
+		public long SamplePointDeltaHi;
+		public long SamplePointDeltaLo;
+
+		public int PositionExponent;
+		public int SamplePointDeltaExponent;
+
+		// BlockSize
+		public int BlockSizeWidth;
+		public int BlockSizeHeight;
+
+		// ApFixedPointFormat
+		public int BitsBeforeBinaryPoint;
+		public int LimbCount;
+		public int TargetExponent;
+	}
+}
@@ -0,0 +1,125 @@
+﻿using ImageBuilder;
+using MongoDB.Bson;
+using MSS.Common;
+using MSS.Types;
+using MSS.Types.MSet;
+
+namespace MSetRowGeneratorClientTest
+{
+	public class AdaptiveSupersamplerTest
+	{
+		private static readonly SizeInt BLOCK_SIZE = new SizeInt(128);
+
+		private const ushort BLOCK_COUNT = 10;
+		private const ushort NEIGHBOR_COUNT = 50;
+
+		[Fact]
+		public void Supersample_UniformBlock_WithoutNeighbors_ReturnsNull()
+		{
+			var supersampler = new AdaptiveSupersampler(new ConstantSubsampleGenerator(NEIGHBOR_COUNT));
+			var colorMap = new ColorMap(RMapConstants.BuildInitialColorBandSet(200));
+
+			var result = supersampler.Supersample(CreateRequest(), BuildMapSectionVectors(BLOCK_COUNT), colorMap);
+
+			Assert.Null(result);
+			Assert.Equal(0, supersampler.SubsamplesGenerated);
+		}
+
+		[Theory]
+		[InlineData("Left")]
+		[InlineData("Right")]
+		[InlineData("Bottom")]
+		[InlineData("Top")]
+		public void Supersample_UniformBlock_NeighborDiffers_SupersamplesBorderingSamples(string side)
+		{
+			var supersampler = new AdaptiveSupersampler(new ConstantSubsampleGenerator(NEIGHBOR_COUNT));
+			var colorMap = new ColorMap(RMapConstants.BuildInitialColorBandSet(200));
+
+			var width = BLOCK_SIZE.Width;
+			var height = BLOCK_SIZE.Height;
+
+			// Only the neighbor's column or row that borders the block differs from the block.
+			var neighbors = side switch
+			{
+				"Left" => new BlockNeighbors { Left = BuildMapSectionVectors(BLOCK_COUNT, i => i % width == width - 1) },
+				"Right" => new BlockNeighbors { Right = BuildMapSectionVectors(BLOCK_COUNT, i => i % width == 0) },
+				"Bottom" => new BlockNeighbors { Bottom = BuildMapSectionVectors(BLOCK_COUNT, i => i / width == height - 1), BottomLinePtr = height - 1 },
+				_ => new BlockNeighbors { Top = BuildMapSectionVectors(BLOCK_COUNT, i => i / width == 0), TopLinePtr = 0 }
+			};
+
+			var expectedIndexes = Enumerable.Range(0, BLOCK_SIZE.NumberOfCells)
+				.Where(i => side switch
+				{
+					"Left" => i % width == 0,
+					"Right" => i % width == width - 1,
+					"Bottom" => i / width == 0,
+					_ => i / width == height - 1
+				})
+				.ToList();
+
+			var result = supersampler.Supersample(CreateRequest(), BuildMapSectionVectors(BLOCK_COUNT), colorMap, neighbors);
+
+			Assert.NotNull(result);
+			Assert.Equal(expectedIndexes, result!.Keys.OrderBy(x => x).ToList());
+
+			// Every subsample has the same count, so the average color of an edge sample is the color of that count.
+			var expectedColor = new byte[4];
+			colorMap.PlaceColor(NEIGHBOR_COUNT, 0, expectedColor);
+
+			foreach (var color in result.Values)
+			{
+				Assert.Equal(expectedColor, color);
+			}
+		}
+
+		#region Support Methods
+
+		private MapSectionRequest CreateRequest()
+		{
+			var subdivisionId = ObjectId.GenerateNewId().ToString();
+			var mapCalcSettings = new MapCalcSettings(targetIterations: 200, threshold: 4, calculateEscapeVelocities: false, saveTheZValues: false);
+
+			var result = new MapSectionRequest(JobType.FullScale, jobId: string.Empty, OwnerType.Project, subdivisionId, subdivisionId,
+				new PointInt(), new VectorInt(), new BigVector(), new MapBlockOffset(), new RPoint(-1536, 128, -11), isInverted: false,
+				precision: 0, limbCount: 2, BLOCK_SIZE, new RSize(1, 1, -11), mapCalcSettings, mapLoaderJobNumber: 0, requestNumber: 0);
+
+			return result;
+		}
+
+		private MapSectionVectors BuildMapSectionVectors(ushort count, Func<int, bool>? differs = null)
+		{
+			var counts = new ushort[BLOCK_SIZE.NumberOfCells];
+
+			for (var i = 0; i < counts.Length; i++)
+			{
+				counts[i] = differs != null && differs(i) ? NEIGHBOR_COUNT : count;
+			}
+
+			var result = new MapSectionVectors(BLOCK_SIZE, counts, new ushort[counts.Length], new byte[counts.Length * 4]);
+
+			return result;
+		}
+
+		#endregion
+
+		#region Private Classes
+
+		private class ConstantSubsampleGenerator : ISubsampleGenerator
+		{
+			private readonly ushort _count;
+
+			public ConstantSubsampleGenerator(ushort count)
+			{
+				_count = count;
+			}
+
+			public bool GenerateSubsamples(MapSectionRequest mapSectionRequest, int subsampleFactor, IList<PointInt> samplePositions, ushort[] counts, ushort[] escapeVelocities)
+			{
+				Array.Fill(counts, _count);
+				return true;
+			}
+		}
+
+		#endregion
+	}
+}
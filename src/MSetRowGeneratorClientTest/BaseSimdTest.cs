@@ -1,3 +1,4 @@
+﻿using MongoDB.Bson;
 using MSetGeneratorPrototype;
 using MSetRowGeneratorClient;
 using MSS.Common;
@@ -5,6 +6,7 @@ using MSS.Types;
 using MSS.Types.APValues;
 using MSS.Types.MSet;
 using System.Diagnostics;
+using System.Runtime.InteropServices;
 using System.Runtime.Intrinsics;
 
 namespace MSetRowGeneratorClientTest
@@ -14,6 +16,12 @@ namespace MSetRowGeneratorClientTest
 		private static SizeInt BLOCK_SIZE = new SizeInt(128);
 
 		private SamplePointBuilder? _samplePointBuilder;
+		private readonly MapSectionVectors2 _mapSectionVectors;
+
+		public BaseSimdTest()
+		{
+			_mapSectionVectors = BuildMapSectionVectors();
+		}
 
 		[Fact]
 		public void Test1()
@@ -25,8 +33,8 @@ namespace MSetRowGeneratorClientTest
 			var threshold = 4;
 			var apfixedPointFormat = new ApFixedPointFormat(limbCount);
 
-			var mapCalcSettings = new MapCalcSettings(targetIterations: targetIterations, threshold: threshold);
-			var iteratorCoords = GetCoordinates(new BigVector(2, 2), new PointInt(2, 2), new RPoint(1, 1, -2), new RSize(1, 1, -8), apfixedPointFormat);
+			var mapCalcSettings = new MapCalcSettings(targetIterations, threshold, calculateEscapeVelocities: false, saveTheZValues: false);
+			var iteratorCoords = GetCoordinates(new MapBlockOffset(0, 2, 0, 2), new PointInt(2, 2), new RPoint(1, 1, -2), new RSize(1, 1, -8), apfixedPointFormat);
 			var iterationState = BuildIterationState(limbCount, mapCalcSettings, iteratorCoords);
 			iterationState.SetRowNumber(ROW_NUMBER);
 
@@ -45,8 +53,8 @@ namespace MSetRowGeneratorClientTest
 			var threshold = 4;
 			var apfixedPointFormat = new ApFixedPointFormat(limbCount);
 
-			var mapCalcSettings = new MapCalcSettings(targetIterations: targetIterations, threshold: threshold);
-			var iteratorCoords = GetCoordinates(new BigVector(2, 2), new PointInt(2, 2), new RPoint(1, 1, -2), new RSize(1, 1, -8), apfixedPointFormat);
+			var mapCalcSettings = new MapCalcSettings(targetIterations, threshold, calculateEscapeVelocities: false, saveTheZValues: false);
+			var iteratorCoords = GetCoordinates(new MapBlockOffset(0, 2, 0, 2), new PointInt(2, 2), new RPoint(1, 1, -2), new RSize(1, 1, -8), apfixedPointFormat);
 
 			var iterationState = BuildIterationState(limbCount, mapCalcSettings, iteratorCoords);
 			iterationState.SetRowNumber(ROW_NUMBER);
@@ -56,7 +64,7 @@ namespace MSetRowGeneratorClientTest
 
 			// Just for diagnostics
 			var counts = new int[blockSize.NumberOfCells];
-			iterationState.MapSectionVectors.FillCountsRow(iterationState.RowNumber!.Value, counts);
+			_mapSectionVectors.FillCountsRow(iterationState.RowNumber!.Value, counts);
 
 			iterationState.SetRowNumber(iterationState.RowCount); //Closeout the Interation State.
 
@@ -75,7 +83,7 @@ namespace MSetRowGeneratorClientTest
 			var threshold = 4;
 			var apfixedPointFormat = new ApFixedPointFormat(limbCount);
 
-			var mapCalcSettings = new MapCalcSettings(targetIterations: targetIterations, threshold: threshold);
+			var mapCalcSettings = new MapCalcSettings(targetIterations, threshold, calculateEscapeVelocities: false, saveTheZValues: false);
 			var iteratorCoords = GetCoordinatesSample1(apfixedPointFormat);
 
 			var iterationState = BuildIterationState(limbCount, mapCalcSettings, iteratorCoords);
@@ -86,7 +94,7 @@ namespace MSetRowGeneratorClientTest
 
 			// Just for diagnostics
 			var counts = new int[BLOCK_SIZE.NumberOfCells];
-			iterationState.MapSectionVectors.FillCountsRow(iterationState.RowNumber!.Value, counts);
+			_mapSectionVectors.FillCountsRow(iterationState.RowNumber!.Value, counts);
 
 			iterationState.SetRowNumber(iterationState.RowCount); //Closeout the Interation State.
 
@@ -103,7 +111,7 @@ namespace MSetRowGeneratorClientTest
 			var threshold = 4;
 			var apfixedPointFormat = new ApFixedPointFormat(limbCount);
 
-			var mapCalcSettings = new MapCalcSettings(targetIterations: targetIterations, threshold: threshold);
+			var mapCalcSettings = new MapCalcSettings(targetIterations, threshold, calculateEscapeVelocities: false, saveTheZValues: false);
 			var iteratorCoords = GetCoordinatesSample1(apfixedPointFormat);
 
 			var iterationState = BuildIterationState(limbCount, mapCalcSettings, iteratorCoords);
@@ -116,8 +124,8 @@ namespace MSetRowGeneratorClientTest
 				mSetRowClient.BaseSimdTest3(iterationState, apfixedPointFormat, mapCalcSettings);
 
 				// Just for diagnostics
-				var counts = new int[iterationState.MapSectionVectors.ValuesPerRow];
-				iterationState.MapSectionVectors.FillCountsRow(iterationState.RowNumber!.Value, counts);
+				var counts = new int[_mapSectionVectors.ValuesPerRow];
+				_mapSectionVectors.FillCountsRow(iterationState.RowNumber!.Value, counts);
 
 				var rowSum = counts.Sum();
 				var firstTen = string.Join("; ", counts.Take(10));
@@ -139,7 +147,7 @@ namespace MSetRowGeneratorClientTest
 			var threshold = 4;
 			var apfixedPointFormat = new ApFixedPointFormat(limbCount);
 
-			var mapCalcSettings = new MapCalcSettings(targetIterations: targetIterations, threshold: threshold);
+			var mapCalcSettings = new MapCalcSettings(targetIterations, threshold, calculateEscapeVelocities: false, saveTheZValues: false);
 			var iteratorCoords = GetCoordinatesSample1(apfixedPointFormat);
 
 			var iterationState = BuildIterationState(limbCount, mapCalcSettings, iteratorCoords);
@@ -154,8 +162,8 @@ namespace MSetRowGeneratorClientTest
 
 			// Load into an array of integers the integer counts for RowNumber = 0
 			// From the IterationState's source.
-			var diagCounts = new int[iterationState.MapSectionVectors.ValuesPerRow];
-			iterationState.MapSectionVectors.FillCountsRow(0, diagCounts);
+			var diagCounts = new int[_mapSectionVectors.ValuesPerRow];
+			_mapSectionVectors.FillCountsRow(0, diagCounts);
 
 			// Measure
 			var rowSum = diagCounts.Sum();
@@ -172,7 +180,7 @@ namespace MSetRowGeneratorClientTest
 			var threshold = 4;
 			var apfixedPointFormat = new ApFixedPointFormat(limbCount);
 
-			var mapCalcSettings = new MapCalcSettings(targetIterations: targetIterations, threshold: threshold);
+			var mapCalcSettings = new MapCalcSettings(targetIterations, threshold, calculateEscapeVelocities: false, saveTheZValues: false);
 			var iteratorCoords = GetCoordinatesSample1(apfixedPointFormat);
 
 			var iterationState = BuildIterationState(limbCount, mapCalcSettings, iteratorCoords);
@@ -180,7 +188,7 @@ namespace MSetRowGeneratorClientTest
 			iterationState.SetRowNumber(0);
 
 			var mSetRowClient = new HpMSetRowClient();
-			var success = mSetRowClient.RoundTripCounts(iterationState, apfixedPointFormat, mapCalcSettings);
+			var success = mSetRowClient.RoundTripCounts(iterationState, _mapSectionVectors, apfixedPointFormat, mapCalcSettings);
 			
 			Assert.True(success);
 
@@ -188,26 +196,471 @@ namespace MSetRowGeneratorClientTest
 
 		}
 
+		[Fact]
+		public void ProbePrecision_ShallowMap_UsesFewerLimbs()
+		{
+			var limbCount = 3;
+			var targetIterations = 20;
+			var threshold = 4;
+			var apfixedPointFormat = new ApFixedPointFormat(limbCount);
+
+			var mapCalcSettings = new MapCalcSettings(targetIterations, threshold, calculateEscapeVelocities: false, saveTheZValues: false);
+
+			var mSetRowClient = new HpMSetRowClient();
+			Assert.True(mSetRowClient.BuildBlockSamplePoints(new RPoint(-1536, 128, -11), new RSize(1, 1, -11), apfixedPointFormat, BLOCK_SIZE));
+
+			var chosenLimbCount = mSetRowClient.GetLimbCountForMapSection(BLOCK_SIZE, apfixedPointFormat, mapCalcSettings, CancellationToken.None);
+
+			// The sample points are 2^-11 apart, two limbs provide more than enough precision.
+			Assert.Equal(limbCount - 1, chosenLimbCount);
+		}
+
+		[Fact]
+		public void GenerateBlockProgressive_MatchesRowByRow()
+		{
+			var limbCount = 1;
+			var targetIterations = 100;
+			var threshold = 4;
+			var apfixedPointFormat = new ApFixedPointFormat(limbCount);
+
+			var mapCalcSettings = new MapCalcSettings(targetIterations, threshold, calculateEscapeVelocities: false, saveTheZValues: false);
+
+			// The block straddles the boundary near the neck between the main cardioid and the period-2 bulb.
+			var mapPosition = new RPoint(-1536, 128, -11);
+			var samplePointDelta = new RSize(1, 1, -11);
+
+			var mSetRowClient = new HpMSetRowClient();
+			Assert.True(mSetRowClient.BuildBlockSamplePoints(mapPosition, samplePointDelta, apfixedPointFormat, BLOCK_SIZE));
+
+			// Generate each row using the same sample points.
+			var iteratorCoords = GetCoordinates(new MapBlockOffset(), new PointInt(), mapPosition, samplePointDelta, apfixedPointFormat);
+			var iterationState = BuildIterationState(limbCount, mapCalcSettings, iteratorCoords);
+
+			for (var rowNumber = 0; rowNumber < iterationState.RowCount; rowNumber++)
+			{
+				iterationState.SetRowNumber(rowNumber);
+				mSetRowClient.GenerateMapSectionRowFromBlockSamplePoints(iterationState, apfixedPointFormat, mapCalcSettings, CancellationToken.None, out _);
+			}
+
+			iterationState.SetRowNumber(iterationState.RowCount); //Closeout the Interation State.
+
+			// Generate the block progressively.
+			var mapSectionVectors = BuildMapSectionVectors();
+			var stepSizes = new List<int>();
+
+			mSetRowClient.GenerateBlockProgressive(mapSectionVectors, apfixedPointFormat, mapCalcSettings, stepSizes.Add, CancellationToken.None,
+				out var samplesIterated, out var overflowDetected, out var cancelled);
+
+			Assert.False(cancelled);
+			Assert.False(overflowDetected);
+			Assert.Equal(new[] { 4, 2, 1 }, stepSizes);
+			Assert.True(samplesIterated < BLOCK_SIZE.NumberOfCells);
+
+			var expectedCounts = new int[BLOCK_SIZE.Width];
+			var counts = new int[BLOCK_SIZE.Width];
+			var numberOfMismatches = 0;
+
+			for (var rowNumber = 0; rowNumber < BLOCK_SIZE.Height; rowNumber++)
+			{
+				_mapSectionVectors.FillCountsRow(rowNumber, expectedCounts);
+				mapSectionVectors.FillCountsRow(rowNumber, counts);
+
+				for (var i = 0; i < counts.Length; i++)
+				{
+					if (counts[i] != expectedCounts[i])
+					{
+						// The samples of the first pass are always iterated.
+						Assert.False(rowNumber % 4 == 0 && i % 4 == 0, $"The sample at {i}, {rowNumber} was iterated by the first pass, but its count differs.");
+						numberOfMismatches++;
+					}
+				}
+			}
+
+			Debug.WriteLine($"{samplesIterated} of {BLOCK_SIZE.NumberOfCells} samples were iterated, {numberOfMismatches} were guessed incorrectly.");
+			Assert.True(numberOfMismatches * 100 < BLOCK_SIZE.NumberOfCells);
+		}
+
+		[Fact]
+		public void GenerateBlockProgressive_Cancelled_ReturnsPreview()
+		{
+			var limbCount = 1;
+			var targetIterations = 100;
+			var threshold = 4;
+			var apfixedPointFormat = new ApFixedPointFormat(limbCount);
+
+			var mapCalcSettings = new MapCalcSettings(targetIterations, threshold, calculateEscapeVelocities: false, saveTheZValues: false);
+
+			var mapPosition = new RPoint(-1536, 128, -11);
+			var samplePointDelta = new RSize(1, 1, -11);
+
+			var mSetRowClient = new HpMSetRowClient();
+			Assert.True(mSetRowClient.BuildBlockSamplePoints(mapPosition, samplePointDelta, apfixedPointFormat, BLOCK_SIZE));
+
+			var cts = new CancellationTokenSource();
+			var stepSizes = new List<int>();
+
+			var allSamplesHaveEscaped = mSetRowClient.GenerateBlockProgressive(_mapSectionVectors, apfixedPointFormat, mapCalcSettings,
+				stepSize => { stepSizes.Add(stepSize); cts.Cancel(); }, cts.Token,
+				out var samplesIterated, out var overflowDetected, out var cancelled);
+
+			Assert.True(cancelled);
+			Assert.False(allSamplesHaveEscaped);
+			Assert.Equal(new[] { 4 }, stepSizes);
+			Assert.True(samplesIterated <= BLOCK_SIZE.NumberOfCells / 16);
+
+			// Each sample of the preview has the value of the first pass' sample at the top, left corner of its cell.
+			var cornerCounts = new int[BLOCK_SIZE.Width];
+			var counts = new int[BLOCK_SIZE.Width];
+
+			for (var rowNumber = 0; rowNumber < BLOCK_SIZE.Height; rowNumber++)
+			{
+				_mapSectionVectors.FillCountsRow(rowNumber - rowNumber % 4, cornerCounts);
+				_mapSectionVectors.FillCountsRow(rowNumber, counts);
+
+				for (var i = 0; i < counts.Length; i++)
+				{
+					Assert.Equal(cornerCounts[i - i % 4], counts[i]);
+				}
+			}
+		}
+
+		[Fact]
+		public void GenerateMapSectionRow_EscapeVelocities_MatchReference()
+		{
+			var limbCount = 2;
+			var targetIterations = 100;
+			var threshold = 4;
+			var apfixedPointFormat = new ApFixedPointFormat(limbCount);
+
+			var mapCalcSettings = new MapCalcSettings(targetIterations, threshold, calculateEscapeVelocities: true, saveTheZValues: false);
+
+			var mapPosition = new RPoint(-1536, 128, -11);
+			var samplePointDelta = new RSize(1, 1, -11);
+
+			var iteratorCoords = GetCoordinates(new MapBlockOffset(), new PointInt(), mapPosition, samplePointDelta, apfixedPointFormat);
+			var iterationState = BuildIterationState(limbCount, mapCalcSettings, iteratorCoords);
+
+			var mSetRowClient = new HpMSetRowClient();
+
+			for (var rowNumber = 0; rowNumber < iterationState.RowCount; rowNumber++)
+			{
+				iterationState.SetRowNumber(rowNumber);
+				mSetRowClient.GenerateMapSectionRow(iterationState, apfixedPointFormat, mapCalcSettings, CancellationToken.None, out var overflowDetected);
+
+				Assert.False(overflowDetected);
+			}
+
+			iterationState.SetRowNumber(iterationState.RowCount); //Closeout the Interation State.
+
+			// The counts must match those of the managed generator, which also uses the normalized threshold.
+			var expected = GenerateMapSectionManaged(mapPosition, samplePointDelta, limbCount, mapCalcSettings);
+			var counts = MemoryMarshal.Cast<byte, ushort>(_mapSectionVectors.Counts);
+			AssertCountsMatch(MemoryMarshal.Cast<byte, ushort>(expected.Counts), counts);
+
+			var escapeVelocities = MemoryMarshal.Cast<byte, ushort>(_mapSectionVectors.EscapeVelocities);
+
+			var (x0, y0, delta) = GetSamplePointValues(mapPosition, samplePointDelta);
+			var numberEscaped = 0;
+			var numberOfMismatches = 0;
+
+			for (var i = 0; i < counts.Length; i++)
+			{
+				if (counts[i] > targetIterations)
+				{
+					Assert.Equal(0, escapeVelocities[i]);
+					continue;
+				}
+
+				numberEscaped++;
+
+				var cr = x0 + delta * (i % BLOCK_SIZE.Width);
+				var ci = y0 + delta * (i / BLOCK_SIZE.Width);
+				var expectedEscapeVelocity = GetReferenceEscapeVelocity(cr, ci, counts[i]);
+
+				if (Math.Abs(escapeVelocities[i] - expectedEscapeVelocity) > 10)
+				{
+					numberOfMismatches++;
+				}
+			}
+
+			Debug.WriteLine($"{numberEscaped} samples escaped, the escape velocities of {numberOfMismatches} differ from the reference.");
+			Assert.True(numberEscaped > 0);
+			Assert.True(numberOfMismatches * 100 < numberEscaped);
+		}
+
+		[Fact]
+		public void GenerateMapSectionRowWithDistanceEstimates_MatchesReference()
+		{
+			var limbCount = 2;
+			var targetIterations = 100;
+			var threshold = 4;
+			var apfixedPointFormat = new ApFixedPointFormat(limbCount);
+
+			var mapCalcSettings = new MapCalcSettings(targetIterations, threshold, calculateEscapeVelocities: false, saveTheZValues: false);
+
+			var mapPosition = new RPoint(-1536, 128, -11);
+			var samplePointDelta = new RSize(1, 1, -11);
+
+			var iteratorCoords = GetCoordinates(new MapBlockOffset(), new PointInt(), mapPosition, samplePointDelta, apfixedPointFormat);
+			var iterationState = BuildIterationState(limbCount, mapCalcSettings, iteratorCoords);
+
+			var mSetRowClient = new HpMSetRowClient();
+
+			var (x0, y0, delta) = GetSamplePointValues(mapPosition, samplePointDelta);
+			var distanceEstimates = new float[BLOCK_SIZE.Width];
+			var numberEscaped = 0;
+			var numberOfMismatches = 0;
+
+			for (var rowNumber = 0; rowNumber < iterationState.RowCount; rowNumber++)
+			{
+				iterationState.SetRowNumber(rowNumber);
+				mSetRowClient.GenerateMapSectionRowWithDistanceEstimates(iterationState, apfixedPointFormat, mapCalcSettings, distanceEstimates, CancellationToken.None, out var overflowDetected);
+
+				Assert.False(overflowDetected);
+
+				var counts = MemoryMarshal.Cast<Vector256<int>, int>(iterationState.CountsRowV);
+
+				for (var i = 0; i < counts.Length; i++)
+				{
+					if (counts[i] > targetIterations)
+					{
+						Assert.Equal(0f, distanceEstimates[i]);
+						continue;
+					}
+
+					numberEscaped++;
+
+					var expectedDistanceEstimate = GetReferenceDistanceEstimate(x0 + delta * i, y0 + delta * rowNumber, counts[i]);
+
+					if (Math.Abs(distanceEstimates[i] - expectedDistanceEstimate) > expectedDistanceEstimate * 0.001)
+					{
+						numberOfMismatches++;
+					}
+				}
+			}
+
+			iterationState.SetRowNumber(iterationState.RowCount); //Closeout the Interation State.
+
+			Debug.WriteLine($"{numberEscaped} samples escaped, the distance estimates of {numberOfMismatches} differ from the reference.");
+			Assert.True(numberEscaped > 0);
+			Assert.True(numberOfMismatches * 100 < numberEscaped);
+		}
+
+		[Fact]
+		public void GenerateMapSectionRow_IterationsPerStep_MatchesEveryIteration()
+		{
+			var limbCount = 2;
+			var targetIterations = 100;
+			var threshold = 4;
+			var apfixedPointFormat = new ApFixedPointFormat(limbCount);
+
+			var mapCalcSettings = new MapCalcSettings(targetIterations, threshold, calculateEscapeVelocities: false, saveTheZValues: false);
+
+			var mapPosition = new RPoint(-1536, 128, -11);
+			var samplePointDelta = new RSize(1, 1, -11);
+
+			var iteratorCoords = GetCoordinates(new MapBlockOffset(), new PointInt(), mapPosition, samplePointDelta, apfixedPointFormat);
+			var mSetRowClient = new HpMSetRowClient();
+
+			// Check for escape after every iteration.
+			mSetRowClient.IterationsPerStep = -1;
+			var expectedCounts = GenerateMapSectionRows(mSetRowClient, BuildIterationState(limbCount, mapCalcSettings, iteratorCoords), apfixedPointFormat, mapCalcSettings);
+
+			// Check for escape after every 8th iteration, a batch in which a sample escapes is rolled back and repeated one iteration at a time.
+			mSetRowClient.IterationsPerStep = 8;
+			var counts = GenerateMapSectionRows(mSetRowClient, BuildIterationState(limbCount, mapCalcSettings, iteratorCoords), apfixedPointFormat, mapCalcSettings);
+
+			Assert.Equal(expectedCounts, counts);
+
+			var managedCounts = GenerateMapSectionManaged(mapPosition, samplePointDelta, limbCount, mapCalcSettings).Counts;
+			AssertCountsMatch(MemoryMarshal.Cast<byte, ushort>(managedCounts), counts);
+		}
+
+		[Theory]
+		[InlineData(-1536, 128)]	// The neck between the main cardioid and the period-2 bulb.
+		[InlineData(-2112, 448)]	// The top of the period-2 bulb.
+		[InlineData(-64, 1280)]		// The top of the main cardioid.
+		public void GenerateMapSectionRow_SkipInteriorSamples_MatchesEveryIteration(long x, long y)
+		{
+			var limbCount = 2;
+			var targetIterations = 100;
+			var threshold = 4;
+			var apfixedPointFormat = new ApFixedPointFormat(limbCount);
+
+			var mapCalcSettings = new MapCalcSettings(targetIterations, threshold, calculateEscapeVelocities: false, saveTheZValues: false);
+
+			var mapPosition = new RPoint(x, y, -11);
+			var samplePointDelta = new RSize(1, 1, -11);
+
+			var iteratorCoords = GetCoordinates(new MapBlockOffset(), new PointInt(), mapPosition, samplePointDelta, apfixedPointFormat);
+			var mSetRowClient = new HpMSetRowClient();
+
+			// Iterate every sample.
+			mSetRowClient.SkipInteriorSamples = false;
+			var expectedCounts = GenerateMapSectionRows(mSetRowClient, BuildIterationState(limbCount, mapCalcSettings, iteratorCoords), apfixedPointFormat, mapCalcSettings);
+
+			// Give the samples found to be within the main cardioid or the period-2 bulb the target count without iterating them.
+			mSetRowClient.SkipInteriorSamples = true;
+			var counts = GenerateMapSectionRows(mSetRowClient, BuildIterationState(limbCount, mapCalcSettings, iteratorCoords), apfixedPointFormat, mapCalcSettings);
+
+			// The block must straddle the boundary.
+			Assert.Contains(expectedCounts, count => count > targetIterations);
+			Assert.Contains(expectedCounts, count => count <= targetIterations);
+
+			Assert.Equal(expectedCounts, counts);
+		}
+
+		[Fact]
+		public void BuildBlockSamplePoints_MatchesSamplePointBuilder()
+		{
+			var limbCount = 2;
+			var targetIterations = 100;
+			var threshold = 4;
+			var apfixedPointFormat = new ApFixedPointFormat(limbCount);
+
+			var mapCalcSettings = new MapCalcSettings(targetIterations, threshold, calculateEscapeVelocities: false, saveTheZValues: false);
+
+			// The position has more fractional bits than the delta.
+			var mapPosition = new RPoint(-98305, 8193, -17);
+			var samplePointDelta = new RSize(1, 1, -11);
+
+			var iteratorCoords = GetCoordinates(new MapBlockOffset(), new PointInt(), mapPosition, samplePointDelta, apfixedPointFormat);
+			var mSetRowClient = new HpMSetRowClient();
+
+			// Use the sample points built by the managed SamplePointBuilder.
+			var expectedCounts = GenerateMapSectionRows(mSetRowClient, BuildIterationState(limbCount, mapCalcSettings, iteratorCoords), apfixedPointFormat, mapCalcSettings);
+
+			// Use the sample points built natively.
+			Assert.True(mSetRowClient.BuildBlockSamplePoints(mapPosition, samplePointDelta, apfixedPointFormat, BLOCK_SIZE));
+
+			var iterationState = BuildIterationState(limbCount, mapCalcSettings, iteratorCoords);
+
+			for (var rowNumber = 0; rowNumber < iterationState.RowCount; rowNumber++)
+			{
+				iterationState.SetRowNumber(rowNumber);
+				mSetRowClient.GenerateMapSectionRowFromBlockSamplePoints(iterationState, apfixedPointFormat, mapCalcSettings, CancellationToken.None, out var overflowDetected);
+
+				Assert.False(overflowDetected);
+			}
+
+			iterationState.SetRowNumber(iterationState.RowCount); //Closeout the Interation State.
+
+			Assert.Equal(expectedCounts, MemoryMarshal.Cast<byte, ushort>(_mapSectionVectors.Counts).ToArray());
+		}
+
 		#region Support Methods
 
+		private ushort[] GenerateMapSectionRows(HpMSetRowClient mSetRowClient, IIterationState iterationState, ApFixedPointFormat apFixedPointFormat, MapCalcSettings mapCalcSettings)
+		{
+			for (var rowNumber = 0; rowNumber < iterationState.RowCount; rowNumber++)
+			{
+				iterationState.SetRowNumber(rowNumber);
+				mSetRowClient.GenerateMapSectionRow(iterationState, apFixedPointFormat, mapCalcSettings, CancellationToken.None, out var overflowDetected);
+
+				Assert.False(overflowDetected);
+			}
+
+			iterationState.SetRowNumber(iterationState.RowCount); //Closeout the Interation State.
+
+			var result = MemoryMarshal.Cast<byte, ushort>(_mapSectionVectors.Counts).ToArray();
+
+			return result;
+		}
+
+		private MapSectionVectors2 GenerateMapSectionManaged(RPoint mapPosition, RSize samplePointDelta, int limbCount, MapCalcSettings mapCalcSettings)
+		{
+			var subdivisionId = ObjectId.GenerateNewId().ToString();
+
+			var mapSectionRequest = new MapSectionRequest(JobType.FullScale, jobId: string.Empty, OwnerType.Project, subdivisionId, subdivisionId,
+				new PointInt(), new VectorInt(), new BigVector(), new MapBlockOffset(), mapPosition, isInverted: false,
+				precision: 0, limbCount, BLOCK_SIZE, samplePointDelta, mapCalcSettings, mapLoaderJobNumber: 0, requestNumber: 0)
+			{
+				MapSectionVectors2 = BuildMapSectionVectors()
+			};
+
+			var generator = new MapSectionGeneratorDepthFirst(limbCount, BLOCK_SIZE);
+			var mapSectionResponse = generator.GenerateMapSection(mapSectionRequest, CancellationToken.None);
+
+			Assert.True(mapSectionResponse.RequestCompleted);
+
+			return mapSectionResponse.MapSectionVectors2!;
+		}
+
+		// The managed and native fixed-point math round differently, a sample that escapes in the same iteration
+		// as it crosses the threshold may be counted one iteration earlier or later.
+		private void AssertCountsMatch(ReadOnlySpan<ushort> expected, ReadOnlySpan<ushort> counts)
+		{
+			var numberOfMismatches = 0;
+
+			for (var i = 0; i < counts.Length; i++)
+			{
+				if (counts[i] != expected[i])
+				{
+					Assert.True(Math.Abs(counts[i] - expected[i]) == 1, $"The count at {i % BLOCK_SIZE.Width}, {i / BLOCK_SIZE.Width} is {counts[i]}, expected {expected[i]}.");
+					numberOfMismatches++;
+				}
+			}
+
+			Assert.True(numberOfMismatches * 1000 < counts.Length, $"{numberOfMismatches} counts differ from the managed generator's counts.");
+		}
+
+		private (double x0, double y0, double delta) GetSamplePointValues(RPoint mapPosition, RSize samplePointDelta)
+		{
+			var x0 = Math.ScaleB((double)mapPosition.XNumerator, mapPosition.Exponent);
+			var y0 = Math.ScaleB((double)mapPosition.YNumerator, mapPosition.Exponent);
+			var delta = Math.ScaleB((double)samplePointDelta.WidthNumerator, samplePointDelta.Exponent);
+
+			return (x0, y0, delta);
+		}
+
+		// EV = k + 1 - log2(log(|z(n + k)|) / log(R)), using k = 3 extra iterations, clamped to 0..1 and scaled by 10,000.
+		private ushort GetReferenceEscapeVelocity(double cr, double ci, int count)
+		{
+			const int EXTRA_ITERATIONS = 3;
+
+			var zr = 0d;
+			var zi = 0d;
+
+			for (var i = 0; i < count + EXTRA_ITERATIONS; i++)
+			{
+				var nextZr = zr * zr - zi * zi + cr;
+				zi = 2 * zr * zi + ci;
+				zr = nextZr;
+			}
+
+			var ratio = Math.Log2(zr * zr + zi * zi) / Math.Log2(RMapConstants.DEFAULT_NORMALIZED_THRESHOLD);
+			var escapeVelocity = Math.Clamp(EXTRA_ITERATIONS + 1 - Math.Log2(ratio), 0, 1);
+
+			return (ushort)Math.Round(escapeVelocity * 10000);
+		}
+
+
 		private IIterationState BuildIterationState(int limbCount, MapCalcSettings mapCalcSettings, IteratorCoords iteratorCoords)
 		{
 			_samplePointBuilder = new SamplePointBuilder(new SamplePointCache(BLOCK_SIZE));
 			var (samplePointsX, samplePointsY) = _samplePointBuilder.BuildSamplePoints(iteratorCoords);
 
-			var mapSectionVectors = new MapSectionVectors(BLOCK_SIZE);
 			var mapSectionZVectors = new MapSectionZVectors(BLOCK_SIZE, limbCount);
 
-			var result = new IterationStateDepthFirst(samplePointsX, samplePointsY, mapSectionVectors, mapSectionZVectors, increasingIterations: false, mapCalcSettings.TargetIterations);
+			var result = new IterationStateDepthFirst(samplePointsX, samplePointsY, _mapSectionVectors, mapSectionZVectors, increasingIterations: false, mapCalcSettings.TargetIterations);
 
 			//result.SetRowNumber(0);
 
 			return result;
 		}
 
+		private MapSectionVectors2 BuildMapSectionVectors()
+		{
+			// Use zeroed arrays, those rented from the ArrayPool may hold the values of a previous MapSection.
+			var byteCount = BLOCK_SIZE.NumberOfCells * 2;
+			var result = new MapSectionVectors2(BLOCK_SIZE, new byte[byteCount], new byte[byteCount]);
+
+			return result;
+		}
+
 		private IteratorCoords GetCoordinatesSample1(ApFixedPointFormat apFixedPointFormat)
 		{
-			var blockPosition = new BigVector(-1, 1);
+			var blockPosition = new MapBlockOffset(0, -1, 0, 1);
 			var screenPosition = new PointInt(1, 1);
 			var mapPosition = new RPoint(-128, 128, -11);
 			var samplePointDelta = new RSize(1, 1, -11);
@@ -228,7 +681,7 @@ namespace MSetRowGeneratorClientTest
 		*/
 
 
-		private IteratorCoords GetCoordinates(BigVector blockPosition, PointInt screenPosition, RPoint mapPosition, RSize samplePointDelta, ApFixedPointFormat apFixedPointFormat)
+		private IteratorCoords GetCoordinates(MapBlockOffset blockPosition, PointInt screenPosition, RPoint mapPosition, RSize samplePointDelta, ApFixedPointFormat apFixedPointFormat)
 		{
 			var startingCx = FP31ValHelper.CreateFP31Val(mapPosition.X, apFixedPointFormat);
 			var startingCy = FP31ValHelper.CreateFP31Val(mapPosition.Y, apFixedPointFormat);
@@ -237,6 +690,31 @@ namespace MSetRowGeneratorClientTest
 			return new IteratorCoords(blockPosition, screenPosition, startingCx, startingCy, delta);
 		}
 
+		// b = 2 * |z| * ln|z| / |dz/dc|, where dz(n+1) = 2 * z(n) * dz(n) + 1
+		private double GetReferenceDistanceEstimate(double cr, double ci, int count)
+		{
+			var zr = 0d;
+			var zi = 0d;
+			var dzr = 0d;
+			var dzi = 0d;
+
+			for (var i = 0; i < count; i++)
+			{
+				var nextDzr = 2 * (zr * dzr - zi * dzi) + 1;
+				dzi = 2 * (zr * dzi + zi * dzr);
+				dzr = nextDzr;
+
+				var nextZr = zr * zr - zi * zi + cr;
+				zi = 2 * zr * zi + ci;
+				zr = nextZr;
+			}
+
+			var magZ = Math.Sqrt(zr * zr + zi * zi);
+			var magDz = Math.Sqrt(dzr * dzr + dzi * dzi);
+
+			return 2 * magZ * Math.Log(magZ) / magDz;
+		}
+
 		#endregion
 	}
 }
\ No newline at end of file
@@ -0,0 +1,159 @@
+﻿using MongoDB.Bson;
+using MSetGeneratorPrototype;
+using MSetRowGeneratorClient;
+using MSS.Types;
+using MSS.Types.MSet;
+using System.Runtime.InteropServices;
+
+namespace MSetRowGeneratorClientTest
+{
+	public class MapSectionGeneratorNativeTest
+	{
+		private static readonly SizeInt BLOCK_SIZE = new SizeInt(128);
+
+		[Fact]
+		public void GenerateMapSection_MatchesDepthFirst()
+		{
+			var limbCount = 2;
+			var mapPosition = new RPoint(-1536, 128, -11);
+			var samplePointDelta = new RSize(1, 1, -11);
+			var mapCalcSettings = new MapCalcSettings(targetIterations: 200, threshold: 4, calculateEscapeVelocities: false, saveTheZValues: false);
+
+			var depthFirstGenerator = new MapSectionGeneratorDepthFirst(limbCount, BLOCK_SIZE);
+			var expected = depthFirstGenerator.GenerateMapSection(CreateRequest(mapPosition, samplePointDelta, limbCount, mapCalcSettings), CancellationToken.None);
+
+			using var nativeGenerator = new MapSectionGeneratorNative(depthFirstGenerator);
+			var actual = nativeGenerator.GenerateMapSection(CreateRequest(mapPosition, samplePointDelta, limbCount, mapCalcSettings), CancellationToken.None);
+
+			Assert.True(actual.RequestCompleted);
+			AssertCountsMatch(GetValues(expected.MapSectionVectors2!.Counts), GetValues(actual.MapSectionVectors2!.Counts));
+		}
+
+		[Fact]
+		public void GenerateMapSection_ShallowMap_UsesFewerLimbs()
+		{
+			var limbCount = 3;
+			var mapPosition = new RPoint(-1536, 128, -11);
+			var samplePointDelta = new RSize(1, 1, -11);
+			var mapCalcSettings = new MapCalcSettings(targetIterations: 200, threshold: 4, calculateEscapeVelocities: false, saveTheZValues: false);
+
+			var depthFirstGenerator = new MapSectionGeneratorDepthFirst(limbCount, BLOCK_SIZE);
+			var expected = depthFirstGenerator.GenerateMapSection(CreateRequest(mapPosition, samplePointDelta, limbCount, mapCalcSettings), CancellationToken.None);
+
+			using var nativeGenerator = new MapSectionGeneratorNative(depthFirstGenerator);
+			var actual = nativeGenerator.GenerateMapSection(CreateRequest(mapPosition, samplePointDelta, limbCount, mapCalcSettings), CancellationToken.None);
+
+			// The sample points are 2^-11 apart, two limbs provide more than enough precision.
+			Assert.True(actual.RequestCompleted);
+			Assert.Equal(limbCount - 1, actual.LimbCount);
+			AssertCountsMatch(GetValues(expected.MapSectionVectors2!.Counts), GetValues(actual.MapSectionVectors2!.Counts));
+		}
+
+		[Fact]
+		public void GenerateMapSection_Overflow_UsesWiderFormat()
+		{
+			// A sample whose |z|^2 is just below a threshold of 10,000 has a |z|^2 of nearly 10^8 on the next iteration, which overflows the default 16 bits before the binary point.
+			var limbCount = 2;
+			var mapPosition = new RPoint(2048, 2048, -11);
+			var samplePointDelta = new RSize(1, 1, -11);
+			var mapCalcSettings = new MapCalcSettings(targetIterations: 200, threshold: 10000, calculateEscapeVelocities: false, saveTheZValues: false);
+
+			using var hpMSetRowClient = new HpMSetRowClient();
+			var apFixedPointFormat = new ApFixedPointFormat(limbCount);
+			Assert.True(hpMSetRowClient.BuildBlockSamplePoints(mapPosition, samplePointDelta, apFixedPointFormat, BLOCK_SIZE));
+
+			var mapSectionVectors = BuildMapSectionVectors();
+			hpMSetRowClient.GenerateBlockProgressive(mapSectionVectors, apFixedPointFormat, mapCalcSettings, passCompleted: null, CancellationToken.None, out _, out var overflowDetected, out _);
+			Assert.True(overflowDetected);
+
+			using var nativeGenerator = new MapSectionGeneratorNative(new MapSectionGeneratorDepthFirst(limbCount, BLOCK_SIZE));
+			var actual = nativeGenerator.GenerateMapSection(CreateRequest(mapPosition, samplePointDelta, limbCount, mapCalcSettings), CancellationToken.None);
+
+			Assert.True(actual.RequestCompleted);
+			Assert.True(actual.LimbCount > limbCount);
+
+			var expected = GetReferenceCounts(mapPosition, samplePointDelta, mapCalcSettings);
+			AssertCountsMatch(expected, GetValues(actual.MapSectionVectors2!.Counts));
+		}
+
+		#region Support Methods
+
+		private MapSectionRequest CreateRequest(RPoint mapPosition, RSize samplePointDelta, int limbCount, MapCalcSettings mapCalcSettings)
+		{
+			var subdivisionId = ObjectId.GenerateNewId().ToString();
+
+			var result = new MapSectionRequest(JobType.FullScale, jobId: string.Empty, OwnerType.Project, subdivisionId, subdivisionId,
+				new PointInt(), new VectorInt(), new BigVector(), new MapBlockOffset(), mapPosition, isInverted: false,
+				precision: 0, limbCount, BLOCK_SIZE, samplePointDelta, mapCalcSettings, mapLoaderJobNumber: 0, requestNumber: 0)
+			{
+				MapSectionVectors2 = BuildMapSectionVectors()
+			};
+
+			return result;
+		}
+
+		private MapSectionVectors2 BuildMapSectionVectors()
+		{
+			var byteCount = BLOCK_SIZE.NumberOfCells * 2;
+			var result = new MapSectionVectors2(BLOCK_SIZE, new byte[byteCount], new byte[byteCount]);
+
+			return result;
+		}
+
+		// Iterates each sample using doubles, a sample that does not escape is given a count of TargetIterations + 1.
+		private ushort[] GetReferenceCounts(RPoint mapPosition, RSize samplePointDelta, MapCalcSettings mapCalcSettings)
+		{
+			var x0 = Math.ScaleB((double)mapPosition.XNumerator, mapPosition.Exponent);
+			var y0 = Math.ScaleB((double)mapPosition.YNumerator, mapPosition.Exponent);
+			var delta = Math.ScaleB((double)samplePointDelta.WidthNumerator, samplePointDelta.Exponent);
+
+			var result = new ushort[BLOCK_SIZE.NumberOfCells];
+
+			for (var i = 0; i < result.Length; i++)
+			{
+				var cr = x0 + delta * (i % BLOCK_SIZE.Width);
+				var ci = y0 + delta * (i / BLOCK_SIZE.Width);
+
+				var zr = cr;
+				var zi = ci;
+				var count = 1;
+
+				while (count <= mapCalcSettings.TargetIterations && zr * zr + zi * zi < mapCalcSettings.Threshold)
+				{
+					var nextZr = zr * zr - zi * zi + cr;
+					zi = 2 * zr * zi + ci;
+					zr = nextZr;
+					count++;
+				}
+
+				result[i] = (ushort)count;
+			}
+
+			return result;
+		}
+
+		// The progressive generator gives some samples the count of their neighbors without iterating them, a few of these guesses are wrong.
+		private void AssertCountsMatch(ReadOnlySpan<ushort> expected, ReadOnlySpan<ushort> counts)
+		{
+			var numberOfMismatches = 0;
+
+			for (var i = 0; i < counts.Length; i++)
+			{
+				if (counts[i] != expected[i])
+				{
+					numberOfMismatches++;
+				}
+			}
+
+			Assert.True(numberOfMismatches * 100 < counts.Length, $"{numberOfMismatches} counts differ from the expected counts.");
+		}
+
+		private ushort[] GetValues(byte[] values)
+		{
+			var result = MemoryMarshal.Cast<byte, ushort>(values).ToArray();
+			return result;
+		}
+
+		#endregion
+	}
+}
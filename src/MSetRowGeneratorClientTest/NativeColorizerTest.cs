@@ -0,0 +1,57 @@
+﻿using MSetRowGeneratorClient;
+using MSS.Common;
+using MSS.Types;
+
+namespace MSetRowGeneratorClientTest
+{
+	public class NativeColorizerTest
+	{
+		private const double VALUE_FACTOR = 10000;
+		private const int TARGET_ITERATIONS = 400;
+
+		[Theory]
+		[InlineData(false, false)]
+		[InlineData(true, false)]
+		[InlineData(false, true)]
+		[InlineData(true, true)]
+		public void ColorizeBlock_MatchesPlaceColor(bool useEscapeVelocities, bool highlightSelectedColorBand)
+		{
+			var colorMap = new ColorMap(RMapConstants.BuildInitialColorBandSet(TARGET_ITERATIONS))
+			{
+				UseEscapeVelocities = useEscapeVelocities,
+				HighlightSelectedColorBand = highlightSelectedColorBand
+			};
+
+			// Every count from zero to beyond the high cutoff, the last vector only partly filled.
+			var valueCount = TARGET_ITERATIONS + 13;
+			var counts = new ushort[valueCount + 3];
+			var escapeVelocities = new ushort[counts.Length];
+
+			var random = new Random(17);
+
+			for (var i = 0; i < counts.Length; i++)
+			{
+				counts[i] = (ushort)i;
+				escapeVelocities[i] = (ushort)random.Next((int)VALUE_FACTOR);
+			}
+
+			var expected = new byte[valueCount * 4];
+
+			for (var i = 0; i < valueCount; i++)
+			{
+				var escapeVelocity = useEscapeVelocities ? escapeVelocities[i] / VALUE_FACTOR : 0;
+				colorMap.PlaceColor(counts[i], escapeVelocity, new Span<byte>(expected, i * 4, 4));
+			}
+
+			// The values beyond the valueCount must not be written.
+			var actual = new byte[valueCount * 4 + 4];
+			Array.Fill(actual, (byte)7);
+
+			var colorizer = new NativeColorizer();
+			colorizer.ColorizeBlock(colorMap.GetColorBandTable(), counts, escapeVelocities, valueCount, actual);
+
+			Assert.Equal(expected, actual.Take(expected.Length).ToArray());
+			Assert.Equal(new byte[] { 7, 7, 7, 7 }, actual.Skip(expected.Length).ToArray());
+		}
+	}
+}
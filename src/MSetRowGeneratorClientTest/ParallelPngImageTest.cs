@@ -0,0 +1,212 @@
+﻿using ImageBuilder;
+using PngImageLib.Zlib;
+using System.IO.Compression;
+
+namespace MSetRowGeneratorClientTest
+{
+	public class ParallelPngImageTest
+	{
+		private const int BYTES_PER_PIXEL = 3;
+		private const int ADLER_BASE = 65521;
+
+		[Theory]
+		[InlineData(33, 50, 7)]		// Several strips, the last one partly filled.
+		[InlineData(1, 3, 1)]		// One line per strip.
+		[InlineData(64, 64, 64)]	// A single strip.
+		public void End_ConcatenatedStrips_DecodeToTheLinesWritten(int width, int height, int stripHeight)
+		{
+			var pixels = BuildPixels(width, height);
+			var stream = new MemoryStream();
+
+			var pngImage = new ParallelPngImage(stream, "test.png", width, height, stripHeight, maxStripsInFlight: 2);
+
+			for (var rowPtr = 0; rowPtr < height; rowPtr++)
+			{
+				var iLine = pngImage.ImageLine;
+
+				for (var i = 0; i < width * BYTES_PER_PIXEL; i++)
+				{
+					iLine.Scanline[i] = pixels[rowPtr][i];
+				}
+
+				pngImage.WriteLine(iLine);
+			}
+
+			pngImage.End();
+
+			var zlibData = GetImageData(stream.ToArray(), width, height);
+
+			// The zlib header: deflate with a 32K window and a valid check value.
+			Assert.Equal(0x78, zlibData[0]);
+			Assert.Equal(0, (zlibData[0] * 256 + zlibData[1]) % 31);
+
+			var filtered = Inflate(zlibData, 2, zlibData.Length - 6);
+			Assert.Equal(height * (width * BYTES_PER_PIXEL + 1), filtered.Length);
+
+			// The Adler-32 of the uncompressed data follows the deflate stream, most significant byte first.
+			var expectedAdler = GetAdler32(filtered);
+			var adler = (uint)(zlibData[^4] << 24 | zlibData[^3] << 16 | zlibData[^2] << 8 | zlibData[^1]);
+			Assert.Equal(expectedAdler, adler);
+
+			var rows = Unfilter(filtered, width, height);
+
+			for (var rowPtr = 0; rowPtr < height; rowPtr++)
+			{
+				Assert.Equal(pixels[rowPtr], rows[rowPtr]);
+			}
+		}
+
+		[Fact]
+		public void End_NotAllRowsWritten_Throws_Abort_DoesNot()
+		{
+			var width = 16;
+			var stream = new MemoryStream();
+			var pngImage = new ParallelPngImage(stream, "test.png", width, height: 20, stripHeight: 4);
+
+			for (var rowPtr = 0; rowPtr < 10; rowPtr++)
+			{
+				pngImage.WriteLine(pngImage.ImageLine);
+			}
+
+			Assert.Throws<InvalidOperationException>(() => pngImage.End());
+
+			pngImage.Abort();
+			Assert.False(stream.CanWrite);
+		}
+
+		#region Support Methods
+
+		private byte[][] BuildPixels(int width, int height)
+		{
+			var random = new Random(11);
+			var result = new byte[height][];
+
+			for (var rowPtr = 0; rowPtr < height; rowPtr++)
+			{
+				result[rowPtr] = new byte[width * BYTES_PER_PIXEL];
+
+				for (var i = 0; i < result[rowPtr].Length; i++)
+				{
+					// Smooth gradients, so that each filter type is chosen for some rows, with some noise.
+					result[rowPtr][i] = (byte)(rowPtr * 3 + i / BYTES_PER_PIXEL * (i % BYTES_PER_PIXEL + 1) + (random.Next(8) == 0 ? random.Next(256) : 0));
+				}
+			}
+
+			return result;
+		}
+
+		// Checks the signature, the IHDR and the CRC of each chunk and returns the contents of the IDAT chunks, in order.
+		private byte[] GetImageData(byte[] png, int width, int height)
+		{
+			Assert.Equal(new byte[] { 137, 80, 78, 71, 13, 10, 26, 10 }, png.Take(8).ToArray());
+
+			var result = new MemoryStream();
+			var chunkTypes = new List<string>();
+			var ptr = 8;
+
+			while (ptr < png.Length)
+			{
+				var length = (int)ReadInt(png, ptr);
+				var chunkType = new string(png.Skip(ptr + 4).Take(4).Select(x => (char)x).ToArray());
+
+				var crc = new CRC32();
+				crc.Update(png, ptr + 4, length + 4);
+				Assert.Equal(crc.GetValue(), ReadInt(png, ptr + 8 + length));
+
+				if (chunkType == "IHDR")
+				{
+					Assert.Equal((uint)width, ReadInt(png, ptr + 8));
+					Assert.Equal((uint)height, ReadInt(png, ptr + 12));
+				}
+				else if (chunkType == "IDAT")
+				{
+					result.Write(png, ptr + 8, length);
+				}
+
+				chunkTypes.Add(chunkType);
+				ptr += length + 12;
+			}
+
+			Assert.Equal(png.Length, ptr);
+			Assert.Equal("IHDR", chunkTypes[0]);
+			Assert.Equal("IEND", chunkTypes[^1]);
+
+			return result.ToArray();
+		}
+
+		private byte[] Inflate(byte[] data, int offset, int length)
+		{
+			using var deflateStream = new DeflateStream(new MemoryStream(data, offset, length), CompressionMode.Decompress);
+			var result = new MemoryStream();
+			deflateStream.CopyTo(result);
+
+			return result.ToArray();
+		}
+
+		private uint GetAdler32(byte[] data)
+		{
+			uint a = 1, b = 0;
+
+			foreach (var value in data)
+			{
+				a = (a + value) % ADLER_BASE;
+				b = (b + a) % ADLER_BASE;
+			}
+
+			return b << 16 | a;
+		}
+
+		private byte[][] Unfilter(byte[] filtered, int width, int height)
+		{
+			var rowLength = width * BYTES_PER_PIXEL;
+			var result = new byte[height][];
+			var prior = new byte[rowLength];
+
+			for (var rowPtr = 0; rowPtr < height; rowPtr++)
+			{
+				var filterType = filtered[rowPtr * (rowLength + 1)];
+				var row = new byte[rowLength];
+
+				for (var i = 0; i < rowLength; i++)
+				{
+					int raw = filtered[rowPtr * (rowLength + 1) + 1 + i];
+					int left = i >= BYTES_PER_PIXEL ? row[i - BYTES_PER_PIXEL] : 0;
+					int up = prior[i];
+					int upLeft = i >= BYTES_PER_PIXEL ? prior[i - BYTES_PER_PIXEL] : 0;
+
+					row[i] = filterType switch
+					{
+						0 => (byte)raw,
+						1 => (byte)(raw + left),
+						2 => (byte)(raw + up),
+						3 => (byte)(raw + ((left + up) >> 1)),
+						4 => (byte)(raw + PaethPredictor(left, up, upLeft)),
+						_ => throw new InvalidOperationException($"Unknown filter type: {filterType}.")
+					};
+				}
+
+				result[rowPtr] = row;
+				prior = row;
+			}
+
+			return result;
+		}
+
+		private int PaethPredictor(int a, int b, int c)
+		{
+			var p = a + b - c;
+			var pa = Math.Abs(p - a);
+			var pb = Math.Abs(p - b);
+			var pc = Math.Abs(p - c);
+
+			return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+		}
+
+		private uint ReadInt(byte[] buffer, int offset)
+		{
+			return (uint)(buffer[offset] << 24 | buffer[offset + 1] << 16 | buffer[offset + 2] << 8 | buffer[offset + 3]);
+		}
+
+		#endregion
+	}
+}
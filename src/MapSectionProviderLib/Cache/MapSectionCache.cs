@@ -0,0 +1,333 @@
+﻿using MSS.Types.MSet;
+using System;
+using System.Collections.Generic;
+using System.Threading;
+
+namespace MapSectionProviderLib
+{
+	/// <summary>
+	/// Holds recently fetched MapSections, decoded, so that a block delivered to one job can be delivered to another,
+	/// e.g., on undo / redo or to a poster preview, without going back to the repository.
+	/// The least recently used MapSections are evicted once the total size exceeds the ByteBudget.
+	/// A MapSection pinned by one or more owners is never evicted, the pinned MapSections may take the total over the budget.
+	/// </summary>
+	public class MapSectionCache
+	{
+		// An allowance for the MapSectionBytes and the cache's own bookkeeping.
+		private const int ENTRY_OVERHEAD_BYTES = 256;
+
+		private readonly object _stateLock = new();
+
+		private readonly Dictionary<CacheKey, LinkedListNode<CacheEntry>> _entries;
+		private readonly LinkedList<CacheEntry> _lruList;
+		private readonly Dictionary<int, HashSet<CacheKey>> _pinsByOwner;
+
+		private long _bytesInUse;
+		private long _pinnedBytes;
+
+		private long _hits;
+		private long _misses;
+		private long _evictions;
+
+		#region Constructor
+
+		public MapSectionCache(long byteBudget)
+		{
+			ByteBudget = byteBudget;
+
+			_entries = new Dictionary<CacheKey, LinkedListNode<CacheEntry>>();
+			_lruList = new LinkedList<CacheEntry>();
+			_pinsByOwner = new Dictionary<int, HashSet<CacheKey>>();
+		}
+
+		#endregion
+
+		#region Public Properties
+
+		public long ByteBudget { get; }
+
+		public int Count
+		{
+			get
+			{
+				lock (_stateLock)
+				{
+					return _entries.Count;
+				}
+			}
+		}
+
+		public long BytesInUse => Interlocked.Read(ref _bytesInUse);
+		public long PinnedBytes => Interlocked.Read(ref _pinnedBytes);
+
+		public long Hits => Interlocked.Read(ref _hits);
+		public long Misses => Interlocked.Read(ref _misses);
+		public long Evictions => Interlocked.Read(ref _evictions);
+
+		public double HitRatio
+		{
+			get
+			{
+				var hits = Hits;
+				var total = hits + Misses;
+
+				return total == 0 ? 0 : hits / (double)total;
+			}
+		}
+
+		#endregion
+
+		#region Public Methods
+
+		/// <summary>
+		/// Returns the MapSection, if found. The MapSectionBytes are shared with other callers and must not be modified.
+		/// </summary>
+		/// <param name="pinOwner">If not null, the MapSection is pinned on behalf of this owner, see UnpinAll.</param>
+		public bool TryGet(string subdivisionId, MapBlockOffset blockPosition, out MapSectionBytes? mapSectionBytes, int? pinOwner = null)
+		{
+			var key = new CacheKey(subdivisionId, blockPosition);
+
+			lock (_stateLock)
+			{
+				if (_entries.TryGetValue(key, out var node))
+				{
+					_lruList.Remove(node);
+					_lruList.AddFirst(node);
+
+					if (pinOwner.HasValue)
+					{
+						PinInternal(key, node.Value, pinOwner.Value);
+					}
+
+					_hits++;
+					mapSectionBytes = node.Value.MapSectionBytes;
+					return true;
+				}
+				else
+				{
+					_misses++;
+					mapSectionBytes = null;
+					return false;
+				}
+			}
+		}
+
+		/// <summary>
+		/// Adds the MapSection, replacing any MapSection held for the same SubdivisionId and BlockPosition.
+		/// The MapSectionBytes are shared with later callers and must not be modified after being added.
+		/// </summary>
+		public void Add(string subdivisionId, MapSectionBytes mapSectionBytes, int? pinOwner = null)
+		{
+			var key = new CacheKey(subdivisionId, mapSectionBytes.BlockPosition);
+			var entry = new CacheEntry(key, mapSectionBytes, GetSize(mapSectionBytes));
+
+			lock (_stateLock)
+			{
+				if (_entries.TryGetValue(key, out var existing))
+				{
+					RemoveInternal(existing);
+				}
+
+				// The new MapSection keeps the pins held on the one it replaces, or on one that was removed.
+				var pinCount = CountPins(key);
+				entry.PinCount = pinCount;
+
+				var node = _lruList.AddFirst(entry);
+				_entries.Add(key, node);
+				_bytesInUse += entry.Size;
+
+				if (pinCount > 0)
+				{
+					_pinnedBytes += entry.Size;
+				}
+
+				if (pinOwner.HasValue)
+				{
+					PinInternal(key, entry, pinOwner.Value);
+				}
+
+				EvictToBudget();
+			}
+		}
+
+		public bool Remove(string subdivisionId, MapBlockOffset blockPosition)
+		{
+			var key = new CacheKey(subdivisionId, blockPosition);
+
+			lock (_stateLock)
+			{
+				if (_entries.TryGetValue(key, out var node))
+				{
+					RemoveInternal(node);
+					return true;
+				}
+				else
+				{
+					return false;
+				}
+			}
+		}
+
+		/// <summary>
+		/// Releases all of the pins held by the owner, the MapSections that are no longer pinned are evicted as needed.
+		/// </summary>
+		public void UnpinAll(int pinOwner)
+		{
+			lock (_stateLock)
+			{
+				if (!_pinsByOwner.Remove(pinOwner, out var keys))
+				{
+					return;
+				}
+
+				foreach (var key in keys)
+				{
+					if (_entries.TryGetValue(key, out var node))
+					{
+						var entry = node.Value;
+						entry.PinCount--;
+
+						if (entry.PinCount == 0)
+						{
+							_pinnedBytes -= entry.Size;
+						}
+					}
+				}
+
+				EvictToBudget();
+			}
+		}
+
+		public void Clear()
+		{
+			lock (_stateLock)
+			{
+				_entries.Clear();
+				_lruList.Clear();
+				_pinsByOwner.Clear();
+
+				_bytesInUse = 0;
+				_pinnedBytes = 0;
+			}
+		}
+
+		public void ResetCounts()
+		{
+			lock (_stateLock)
+			{
+				_hits = 0;
+				_misses = 0;
+				_evictions = 0;
+			}
+		}
+
+		public override string ToString()
+		{
+			return $"MapSectionCache: {Count} MapSections, {BytesInUse / (1024 * 1024)} of {ByteBudget / (1024 * 1024)} MB in use, {PinnedBytes / (1024 * 1024)} MB pinned. Hits: {Hits}, Misses: {Misses}, Evictions: {Evictions}.";
+		}
+
+		#endregion
+
+		#region Private Methods
+
+		private int CountPins(CacheKey key)
+		{
+			var result = 0;
+
+			foreach (var keys in _pinsByOwner.Values)
+			{
+				if (keys.Contains(key))
+				{
+					result++;
+				}
+			}
+
+			return result;
+		}
+
+		private void PinInternal(CacheKey key, CacheEntry entry, int pinOwner)
+		{
+			if (!_pinsByOwner.TryGetValue(pinOwner, out var keys))
+			{
+				keys = new HashSet<CacheKey>();
+				_pinsByOwner.Add(pinOwner, keys);
+			}
+
+			if (keys.Add(key))
+			{
+				if (entry.PinCount == 0)
+				{
+					_pinnedBytes += entry.Size;
+				}
+
+				entry.PinCount++;
+			}
+		}
+
+		// Pins held on a MapSection that has been removed are left in place, they apply to the next MapSection added with the same key.
+		private void RemoveInternal(LinkedListNode<CacheEntry> node)
+		{
+			var entry = node.Value;
+
+			_lruList.Remove(node);
+			_entries.Remove(entry.Key);
+			_bytesInUse -= entry.Size;
+
+			if (entry.PinCount > 0)
+			{
+				_pinnedBytes -= entry.Size;
+			}
+		}
+
+		private void EvictToBudget()
+		{
+			var node = _lruList.Last;
+
+			while (node != null && _bytesInUse - _pinnedBytes > 0 && _bytesInUse > ByteBudget)
+			{
+				var previous = node.Previous;
+
+				if (node.Value.PinCount == 0)
+				{
+					RemoveInternal(node);
+					_evictions++;
+				}
+
+				node = previous;
+			}
+		}
+
+		private static long GetSize(MapSectionBytes mapSectionBytes)
+		{
+			var result = mapSectionBytes.Counts.Length + mapSectionBytes.EscapeVelocities.Length + ENTRY_OVERHEAD_BYTES;
+			return result;
+		}
+
+		#endregion
+
+		#region Private Types
+
+		private readonly record struct CacheKey(string SubdivisionId, long XHi, long XLo, long YHi, long YLo)
+		{
+			public CacheKey(string subdivisionId, MapBlockOffset blockPosition) : this(subdivisionId, blockPosition.XHi, blockPosition.XLo, blockPosition.YHi, blockPosition.YLo)
+			{ }
+		}
+
+		private class CacheEntry
+		{
+			public CacheEntry(CacheKey key, MapSectionBytes mapSectionBytes, long size)
+			{
+				Key = key;
+				MapSectionBytes = mapSectionBytes;
+				Size = size;
+			}
+
+			public CacheKey Key { get; }
+			public MapSectionBytes MapSectionBytes { get; }
+			public long Size { get; }
+			public int PinCount { get; set; }
+		}
+
+		#endregion
+	}
+}
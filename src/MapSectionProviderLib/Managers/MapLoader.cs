@@ -11,9 +11,15 @@ namespace MapSectionProviderLib
 {
 	public class MapLoader
 	{
+		// The MapSections are fetched from the repository for this many requests at a time, just before the requests are submitted.
+		private const int BULK_FETCH_REQUEST_COUNT = 256;
+
 		private readonly Action<MapSection> _callback;
 		private readonly MapSectionRequestProcessor _mapSectionRequestProcessor;
 
+		// Cancelled when the MapLoader is stopped, ends any bulk fetch in progress.
+		private readonly CancellationTokenSource _cts;
+
 		private IList<MapSectionRequest>? _mapSectionRequests;
 		private bool _isStopping;
 		private int _sectionsRequested;
@@ -31,6 +37,8 @@ namespace MapSectionProviderLib
 			_mapSectionRequestProcessor = mapSectionRequestProcessor ?? throw new ArgumentNullException(nameof(mapSectionRequestProcessor));
 			//JobNumber = _mapSectionRequestProcessor.GetNextRequestId();
 
+			_cts = new CancellationTokenSource();
+
 			_mapSectionRequests = null;
 			_isStopping = false;
 			_sectionsRequested = 0;
@@ -78,7 +86,7 @@ namespace MapSectionProviderLib
 			}
 
 			_stopwatch.Start();
-			_ = Task.Run(SubmitSectionRequests);
+			_ = Task.Run(SubmitSectionRequestsAsync);
 
 			_tcs = new TaskCompletionSource();
 			return _tcs.Task;
@@ -95,6 +103,7 @@ namespace MapSectionProviderLib
 			{
 				_mapSectionRequestProcessor.CancelJob(JobNumber);
 				_isStopping = true;
+				_cts.Cancel();
 			}
 		}
 
@@ -124,15 +133,23 @@ namespace MapSectionProviderLib
 
 		#region Private Methods
 
-		private void SubmitSectionRequests()
+		private async Task SubmitSectionRequestsAsync()
 		{
 			if (_mapSectionRequests == null)
 			{
 				return;
 			}
 
-			foreach(var mapSectionRequest in _mapSectionRequests)
+			for (var requestPtr = 0; requestPtr < _mapSectionRequests.Count; requestPtr++)
 			{
+				var mapSectionRequest = _mapSectionRequests[requestPtr];
+
+				if (requestPtr % BULK_FETCH_REQUEST_COUNT == 0 && !_isStopping)
+				{
+					var requestsToFetch = GetRange(_mapSectionRequests, requestPtr, BULK_FETCH_REQUEST_COUNT);
+					await _mapSectionRequestProcessor.FetchInBulkAsync(requestsToFetch, _cts.Token);
+				}
+
 				if (_isStopping)
 				{
 					if (_sectionsCompleted == _sectionsRequested && _tcs?.Task.IsCompleted == false)
@@ -148,7 +165,9 @@ namespace MapSectionProviderLib
 				if (!mapSectionRequest.CancellationTokenSource.IsCancellationRequested)
 				{
 					mapSectionRequest.ProcessingStartTime = DateTime.UtcNow;
-					_mapSectionRequestProcessor.AddWork(JobNumber, mapSectionRequest, HandleResponse);
+					// Previews are only useful when the MapSections are being displayed.
+					var previewHandler = mapSectionRequest.JobType == JobType.FullScale ? HandlePreview : (Action<MapSectionRequest, MapSection>?)null;
+					_mapSectionRequestProcessor.AddWork(JobNumber, mapSectionRequest, HandleResponse, previewHandler);
 					mapSectionRequest.Sent = true;
 
 					_ = Interlocked.Increment(ref _sectionsRequested);
@@ -162,6 +181,19 @@ namespace MapSectionProviderLib
 			}
 		}
 
+		private List<MapSectionRequest> GetRange(IList<MapSectionRequest> mapSectionRequests, int startIndex, int count)
+		{
+			var endIndex = Math.Min(startIndex + count, mapSectionRequests.Count);
+			var result = new List<MapSectionRequest>(endIndex - startIndex);
+
+			for (var i = startIndex; i < endIndex; i++)
+			{
+				result.Add(mapSectionRequests[i]);
+			}
+
+			return result;
+		}
+
 		private void HandleResponse(MapSectionRequest mapSectionRequest, MapSection mapSection)
 		{
 			Debug.Assert(mapSection.JobNumber == JobNumber, "The MapSection's JobNumber does not match the MapLoader's JobNumber as the MapLoader's HandleResponse is being called from the Response Processor.");
@@ -223,6 +255,18 @@ namespace MapSectionProviderLib
 			}
 		}
 
+		// A preview does not complete the request, the MapSection that follows it does.
+		private void HandlePreview(MapSectionRequest mapSectionRequest, MapSection mapSection)
+		{
+			if (_isStopping || mapSection.IsEmpty || mapSectionRequest.CancellationTokenSource.IsCancellationRequested)
+			{
+				return;
+			}
+
+			mapSection.IsLastSection = false;
+			_callback(mapSection);
+		}
+
 		private void ReportStats()
 		{
 			var numberOfPendingRequests = _mapSectionRequestProcessor.GetNumberOfPendingRequests(JobNumber);
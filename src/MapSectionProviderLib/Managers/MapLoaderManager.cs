@@ -68,6 +68,12 @@ namespace MapSectionProviderLib
 			var mapSectionRequests = _mapSectionBuilder.CreateSectionRequestsFromMapSections(jobType, jobId, jobOwnerType, mapAreaInfo, mapCalcSettings, emptyMapSections);
 			var result = Push(mapSectionRequests, callback, out jobNumber, out var pendingGeneration);
 
+			if (jobType == JobType.FullScale)
+			{
+				// The MapSections the user is likely to view next are generated once those on screen are done.
+				_mapSectionRequestProcessor.SetSpeculationTarget(jobType, jobId, jobOwnerType, mapAreaInfo, mapCalcSettings);
+			}
+
 			mapSectionsPendingGeneration = new List<MapSection>();
 
 			foreach(var mapSectionRequest in pendingGeneration)
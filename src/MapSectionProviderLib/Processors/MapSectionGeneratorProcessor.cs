@@ -21,6 +21,9 @@ namespace MapSectionProviderLib
 		private readonly CancellationTokenSource _cts;
 		private readonly BlockingCollection<MapSectionGenerateRequest> _workQueue;
 
+		// Not bounded, requests replacing a generation that was cancelled are taken before those on the WorkQueue.
+		private readonly BlockingCollection<MapSectionGenerateRequest> _requeuedWork;
+
 		private readonly IList<Task> _workQueueProcessors;
 
 		private readonly object _jobsStatusLock = new();
@@ -42,6 +45,7 @@ namespace MapSectionProviderLib
 
 			_cts = new CancellationTokenSource();
 			_workQueue = new BlockingCollection<MapSectionGenerateRequest>(QUEUE_CAPACITY);
+			_requeuedWork = new BlockingCollection<MapSectionGenerateRequest>();
 			_jobs = new Dictionary<int, CancellationTokenSource>();
 
 			_workQueueProcessors = CreateTheQueueProcessors(mEngineClients);
@@ -64,7 +68,7 @@ namespace MapSectionProviderLib
 
 		#region Public Properties
 
-		public int NumberOfRequestsPending => _workQueue.Count;
+		public int NumberOfRequestsPending => _workQueue.Count + _requeuedWork.Count;
 
 		#endregion
 
@@ -82,6 +86,22 @@ namespace MapSectionProviderLib
 			}
 		}
 
+		// Does not wait for room on the WorkQueue. Returns false only if the processor has been stopped.
+		internal bool AddRequeuedWork(MapSectionGenerateRequest mapSectionWorkItem)
+		{
+			lock (_jobsStatusLock)
+			{
+				if (_stopped)
+				{
+					Debug.WriteLine($"Not adding: {mapSectionWorkItem.Request}, The MapSectionGeneratorProcessor has been stopped.");
+					return false;
+				}
+
+				_requeuedWork.Add(mapSectionWorkItem);
+				return true;
+			}
+		}
+
 		// TODO: Keep track of the current request's cancellation token and cancel it as well as the job's token.
 		public void CancelJob(int jobId)
 		{
@@ -130,6 +150,11 @@ namespace MapSectionProviderLib
 					{
 						_workQueue.CompleteAdding();
 					}
+
+					if (!_requeuedWork.IsAddingCompleted)
+					{
+						_requeuedWork.CompleteAdding();
+					}
 				}
 
 				_stopped = true;
@@ -159,19 +184,30 @@ namespace MapSectionProviderLib
 
 		private void ProcessTheQueue(IMEngineClient mEngineClient, CancellationToken ct)
 		{
-			while (!ct.IsCancellationRequested && !_workQueue.IsCompleted)
+			var queues = new[] { _requeuedWork, _workQueue };
+
+			while (!ct.IsCancellationRequested && !(_workQueue.IsCompleted && _requeuedWork.IsCompleted))
 			{
 				try
 				{
-					var mapSectionGenerateRequest = _workQueue.Take(ct);
+					if (BlockingCollection<MapSectionGenerateRequest>.TryTakeFromAny(queues, out var mapSectionGenerateRequest, Timeout.Infinite, ct) < 0)
+					{
+						// Both queues are completed.
+						continue;
+					}
 
 					// The original request is in the Request's Request property.
 					var mapSectionRequest = mapSectionGenerateRequest.Request.Request;
 
 					MapSectionResponse mapSectionResponse;
 					var jobIsCancelled = IsJobCancelled(mapSectionGenerateRequest.JobId);
+					var requestIsCancelled = mapSectionRequest.CancellationTokenSource.IsCancellationRequested;
+
+					var isWanted = mapSectionGenerateRequest.IsWanted != null
+						? mapSectionGenerateRequest.IsWanted()
+						: !(jobIsCancelled || requestIsCancelled);
 
-					if (jobIsCancelled || mapSectionRequest.CancellationTokenSource.IsCancellationRequested)
+					if (!isWanted)
 					{
 						mapSectionResponse = new MapSectionResponse(mapSectionRequest, isCancelled: true);
 						var (msv, mszv) = mapSectionRequest.TransferMapVectorsOut2();
@@ -189,7 +225,9 @@ namespace MapSectionProviderLib
 
 						Debug.WriteLineIf(_useDetailedDebug, $"Generating MapSection for Request: {mapSectionRequest.MapLoaderJobNumber}/{mapSectionRequest.RequestNumber}. BlockPos: {mapSectionRequest.RepoBlockPosition}. {sendingVectorsMsg} {haveZValuesMsg}");
 						mapSectionRequest.ProcessingStartTime = DateTime.UtcNow;
-						mapSectionResponse = mEngineClient.GenerateMapSection(mapSectionRequest, mapSectionRequest.CancellationTokenSource.Token);
+						// The requests waiting on the MapSection may have their own CancellationToken for the generation.
+						var generationCt = mapSectionGenerateRequest.CancellationToken ?? mapSectionRequest.CancellationTokenSource.Token;
+						mapSectionResponse = mEngineClient.GenerateMapSection(mapSectionRequest, generationCt);
 
 						if (mapSectionResponse.MapSectionVectors2 == null)
 						{
@@ -286,6 +324,11 @@ namespace MapSectionProviderLib
 					{
 						_workQueue.Dispose();
 					}
+
+					if (_requeuedWork != null)
+					{
+						_requeuedWork.Dispose();
+					}
 				}
 
 				disposedValue = true;
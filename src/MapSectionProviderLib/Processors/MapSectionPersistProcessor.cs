@@ -5,7 +5,9 @@ using MSS.Types.MSet;
 using ProjectRepo.Entities;
 using System;
 using System.Collections.Concurrent;
+using System.Collections.Generic;
 using System.Diagnostics;
+using System.Linq;
 using System.Threading;
 using System.Threading.Tasks;
 
@@ -17,6 +19,10 @@ namespace MapSectionProviderLib
 		private readonly IMapSectionAdapter _mapSectionAdapter;
 
 		private const int QUEUE_CAPACITY = 200;
+
+		// A batch is written once it has this many requests, or once this long has passed since its first request was received.
+		private const int MAX_BATCH_SIZE = 64;
+		private const int MAX_BATCH_LATENCY_MS = 250;
 		private readonly CancellationTokenSource _cts;
 		private readonly BlockingCollection<MapSectionPersistRequest> _workQueue;
 
@@ -93,37 +99,31 @@ namespace MapSectionProviderLib
 
 		private async Task ProcessTheQueueAsync(CancellationToken ct)
 		{
+			var batch = new List<MapSectionPersistRequest>(MAX_BATCH_SIZE);
+			var stopwatch = new Stopwatch();
+
 			while (!ct.IsCancellationRequested && !_workQueue.IsCompleted)
 			{
 				try
 				{
-					var mapSectionPersistRequest = _workQueue.Take(ct);
-
-					var mapSectionRequest = mapSectionPersistRequest.Request;
-					var mapSectionResponse = mapSectionPersistRequest.Response;
+					batch.Clear();
+					batch.Add(_workQueue.Take(ct));
+					stopwatch.Restart();
 
-					if (mapSectionPersistRequest.OnlyInsertJobMapSectionRecord)
+					// Gather the requests that arrive within the latency limit.
+					while (batch.Count < MAX_BATCH_SIZE)
 					{
-						Debug.Assert(mapSectionResponse.AllVectorPropertiesAreNull, "MapSectionPersistProcessor: MapSectionResponse should not have any non-null Vector properties upon OnlyInsertJobMapSectionRecord.");
+						var millisecondsRemaining = MAX_BATCH_LATENCY_MS - (int)stopwatch.ElapsedMilliseconds;
 
-						var mapSectionIdStr = mapSectionResponse.MapSectionId ?? throw new InvalidOperationException("The Response's MapSectionId is null on call to SaveJobMapSection.");
-						var mapSectionId = new ObjectId(mapSectionIdStr);
-
-						_ = await SaveJobMapSection(mapSectionId, mapSectionRequest, mapSectionResponse);
-					}
-					else
-					{
-						if (mapSectionResponse.MapSectionVectors2 != null)
+						if (millisecondsRemaining <= 0 || !_workQueue.TryTake(out var mapSectionPersistRequest, millisecondsRemaining, ct))
 						{
-							await PersistTheCountAndZValuesAsync(mapSectionRequest, mapSectionResponse, ct);
-						}
-						else
-						{
-							Debug.WriteLine($"The MapSectionPersist Processor received an empty MapSectionResponse.");
+							break;
 						}
 
-						_mapSectionVectorProvider.ReturnMapSectionResponse(mapSectionResponse);
+						batch.Add(mapSectionPersistRequest);
 					}
+
+					await PersistBatchAsync(batch, ct);
 				}
 				catch (OperationCanceledException)
 				{
@@ -138,113 +138,230 @@ namespace MapSectionProviderLib
 			}
 		}
 
-		private async Task PersistTheCountAndZValuesAsync(MapSectionRequest mapSectionRequest, MapSectionResponse mapSectionResponse, CancellationToken ct)
+		// Responses for the same block are coalesced, only the one generated using the largest TargetIterations is written, e.g., after successive increases to the target iterations.
+		// The new MapSections are inserted, and the existing MapSections updated, using one bulk write each and a JobMapSectionRecord is saved for every Job request.
+		// If a bulk write fails, the MapSections are written one at a time.
+		private async Task PersistBatchAsync(IList<MapSectionPersistRequest> batch, CancellationToken ct)
 		{
-			var mapSectionId = await PersistTheCountValuesAsync(mapSectionRequest, mapSectionResponse, ct);
+			var jobMapSectionLinks = new List<JobMapSectionLink>();
+			var selectedRequests = new Dictionary<(string subdivisionId, MapBlockOffset blockPosition), MapSectionPersistRequest>();
+			var requestsByBlock = new Dictionary<(string subdivisionId, MapBlockOffset blockPosition), List<MapSectionRequest>>();
 
-			if (mapSectionId.HasValue)
+			try
 			{
-				if (mapSectionResponse.AllRowsHaveEscaped)
+				foreach (var mapSectionPersistRequest in batch)
 				{
-					var zValuesRecordOnFile = await _mapSectionAdapter.DoesMapSectionZValuesExistAsync(mapSectionId.Value, ct);
+					var mapSectionRequest = mapSectionPersistRequest.Request;
+					var mapSectionResponse = mapSectionPersistRequest.Response;
 
-					if (zValuesRecordOnFile)
+					if (mapSectionPersistRequest.OnlyInsertJobMapSectionRecord)
 					{
-						_ = await _mapSectionAdapter.DeleteZValuesAync(mapSectionId.Value);
+						Debug.Assert(mapSectionResponse.AllVectorPropertiesAreNull, "MapSectionPersistProcessor: MapSectionResponse should not have any non-null Vector properties upon OnlyInsertJobMapSectionRecord.");
+
+						var mapSectionIdStr = mapSectionResponse.MapSectionId ?? throw new InvalidOperationException("The Response's MapSectionId is null on call to SaveJobMapSection.");
+						jobMapSectionLinks.AddRange(mapSectionPersistRequest.JobRequests.Select(x => CreateJobMapSectionLink(new ObjectId(mapSectionIdStr), x, mapSectionResponse)));
+
+						continue;
 					}
-				}
-				else
-				{
-					if (mapSectionResponse.MapSectionZVectors != null)
+
+					if (mapSectionResponse.MapSectionVectors2 == null)
 					{
-						await PersistTheZValuesAsync(mapSectionId.Value, mapSectionResponse, ct);
+						Debug.WriteLine($"The MapSectionPersist Processor received an empty MapSectionResponse.");
+						continue;
+					}
+
+					CheckMapSectionId(mapSectionRequest, mapSectionResponse);
+
+					var key = (mapSectionResponse.SubdivisionId, mapSectionResponse.BlockPosition);
+
+					if (selectedRequests.TryGetValue(key, out var selectedRequest))
+					{
+						Debug.WriteLineIf(_useDetailedDebug, $"PersistProc: Coalescing the responses for bp: {mapSectionResponse.BlockPosition}.");
+						requestsByBlock[key].AddRange(mapSectionPersistRequest.JobRequests);
+
+						if (mapSectionResponse.MapCalcSettings.TargetIterations < selectedRequest.Response.MapCalcSettings.TargetIterations)
+						{
+							// A response that arrives late, e.g., from a job that was still using a lower TargetIterations value, must not overwrite the better one.
+							continue;
+						}
 					}
 					else
 					{
-						if (mapSectionRequest.MapCalcSettings.SaveTheZValues)
+						requestsByBlock.Add(key, new List<MapSectionRequest>(mapSectionPersistRequest.JobRequests));
+					}
+
+					selectedRequests[key] = mapSectionPersistRequest;
+				}
+
+				var inserts = selectedRequests.Values.Where(x => x.Response.MapSectionId == null).ToList();
+				var updates = selectedRequests.Values.Where(x => x.Response.MapSectionId != null).ToList();
+
+				if (inserts.Count > 0)
+				{
+					await InsertMapSectionsAsync(inserts);
+				}
+
+				if (updates.Count > 0)
+				{
+					await UpdateMapSectionsAsync(updates);
+				}
+
+				foreach (var (key, mapSectionPersistRequest) in selectedRequests)
+				{
+					var mapSectionResponse = mapSectionPersistRequest.Response;
+
+					if (mapSectionResponse.MapSectionId != null)
+					{
+						var mapSectionId = new ObjectId(mapSectionResponse.MapSectionId);
+						var wasUpdated = mapSectionPersistRequest.Request.MapSectionId != null;
+
+						try
+						{
+							await PersistTheZValuesAsync(mapSectionId, mapSectionPersistRequest.Request, mapSectionResponse, wasUpdated, ct);
+						}
+						catch (Exception e) when (e is not OperationCanceledException)
 						{
-							Debug.WriteLine("WARNING: MapSectionPersistProcessor: The MapSectionZValues is null, but the SaveTheZValues setting is true.");
+							Debug.WriteLine($"WARNING: MapSectionPersistProcessor: Could not persist the ZValues for {mapSectionId}, bp: {mapSectionResponse.BlockPosition}. Got exception: {e}.");
 						}
+
+						mapSectionPersistRequest.MapSectionSaved?.Invoke(mapSectionResponse);
+
+						foreach (var mapSectionRequest in requestsByBlock[key])
+						{
+							jobMapSectionLinks.Add(CreateJobMapSectionLink(mapSectionId, mapSectionRequest, mapSectionResponse));
+						}
+					}
+				}
+
+				if (jobMapSectionLinks.Count > 0)
+				{
+					// A JobMapSectionRecord (identified by the triplet of mapSectionId, jobId and jobType) may already be on file, only those not on file are inserted.
+					_ = await _mapSectionAdapter.SaveJobMapSectionsAsync(jobMapSectionLinks);
+				}
+			}
+			finally
+			{
+				// Return the vectors held by every response in the batch, including those that were coalesced or not written because of an exception.
+				foreach (var mapSectionPersistRequest in batch)
+				{
+					if (!mapSectionPersistRequest.OnlyInsertJobMapSectionRecord)
+					{
+						_mapSectionVectorProvider.ReturnMapSectionResponse(mapSectionPersistRequest.Response);
 					}
 				}
 			}
 		}
 
-		private async Task<ObjectId?> PersistTheCountValuesAsync(MapSectionRequest mapSectionRequest, MapSectionResponse mapSectionResponse, CancellationToken ct)
+		private async Task InsertMapSectionsAsync(IList<MapSectionPersistRequest> inserts)
 		{
-			CheckMapSectionId(mapSectionRequest, mapSectionResponse);
-
-			var mapSectionIdStr = mapSectionResponse.MapSectionId;
-			ObjectId? mapSectionId;
+			Debug.WriteLineIf(_useDetailedDebug, $"PersistProc: Inserting {inserts.Count} MapSections.");
 
-			if (mapSectionIdStr != null)
+			try
 			{
-				// UPDATE
-				mapSectionId = new ObjectId(mapSectionIdStr);
-				Debug.WriteLineIf(_useDetailedDebug, $"Updating Count Values for {mapSectionId}, bp: {mapSectionResponse.BlockPosition}.");
-
-				_ = await _mapSectionAdapter.UpdateCountValuesAync(mapSectionResponse);
+				var mapSectionIds = await _mapSectionAdapter.SaveMapSectionsAsync(inserts.Select(x => x.Response).ToList());
 
-				// A JobMapSectionRecord (identified by the triplet of mapSectionId, ownerId and jobOwnerType) may not be on file.
-				// This will insert one if not already present.
-				_ = await SaveJobMapSection(mapSectionId.Value, mapSectionRequest, mapSectionResponse);
+				for (var i = 0; i < inserts.Count; i++)
+				{
+					inserts[i].Response.MapSectionId = mapSectionIds[i]?.ToString();
+				}
 			}
-			else
+			catch (Exception e)
 			{
-				// INSERT
-				//Debug.WriteLine($"Creating MapSection for {mapSectionResponse.MapSectionId}, bp: {mapSectionResponse.BlockPosition}.");
+				Debug.WriteLine($"WARNING: MapSectionPersistProcessor: The bulk insert of {inserts.Count} MapSections failed, inserting them one at a time. Got exception: {e}.");
 
-				mapSectionId = await _mapSectionAdapter.SaveMapSectionAsync(mapSectionResponse);
-
-				// Experimental
-				if (mapSectionResponse.MapSectionId != null && mapSectionId != null)
+				foreach (var mapSectionPersistRequest in inserts)
 				{
-					var msrMapSectionId = new ObjectId(mapSectionResponse.MapSectionId);
+					var mapSectionResponse = mapSectionPersistRequest.Response;
 
-					if (msrMapSectionId != mapSectionId)
+					try
 					{
-						// Record already on file.
-						Debug.WriteLine($"Not Inserting MapSectionRecord with BlockPos: {mapSectionResponse.BlockPosition} and ScreenPos: {mapSectionRequest.ScreenPosition}. A record already exists for this block position with Id: {mapSectionId}.");
+						// If a MapSection for the same block is already on file, its Id is returned and its counts are updated.
+						var mapSectionId = await _mapSectionAdapter.SaveMapSectionAsync(mapSectionResponse);
+						mapSectionResponse.MapSectionId = mapSectionId?.ToString();
+					}
+					catch (Exception e2)
+					{
+						Debug.WriteLine($"WARNING: MapSectionPersistProcessor: Could not insert the MapSection for bp: {mapSectionResponse.BlockPosition}. Got exception: {e2}.");
+						mapSectionResponse.MapSectionId = null;
 					}
 				}
+			}
+		}
+
+		private async Task UpdateMapSectionsAsync(IList<MapSectionPersistRequest> updates)
+		{
+			Debug.WriteLineIf(_useDetailedDebug, $"PersistProc: Updating Count Values for {updates.Count} MapSections.");
+
+			try
+			{
+				_ = await _mapSectionAdapter.UpdateCountValuesAsync(updates.Select(x => x.Response).ToList());
+			}
+			catch (Exception e)
+			{
+				Debug.WriteLine($"WARNING: MapSectionPersistProcessor: The bulk update of {updates.Count} MapSections failed, updating them one at a time. Got exception: {e}.");
 
-				if (mapSectionId.HasValue)
+				foreach (var mapSectionPersistRequest in updates)
 				{
-					mapSectionResponse.MapSectionId = mapSectionId.ToString();
-					_ = await SaveJobMapSection(mapSectionId.Value, mapSectionRequest, mapSectionResponse);
+					var mapSectionResponse = mapSectionPersistRequest.Response;
+
+					try
+					{
+						_ = await _mapSectionAdapter.UpdateCountValuesAync(mapSectionResponse);
+					}
+					catch (Exception e2)
+					{
+						Debug.WriteLine($"WARNING: MapSectionPersistProcessor: Could not update the Count Values for {mapSectionResponse.MapSectionId}, bp: {mapSectionResponse.BlockPosition}. Got exception: {e2}.");
+					}
 				}
 			}
-
-			return mapSectionId;
 		}
 
-		private async Task PersistTheZValuesAsync(ObjectId mapSectionId, MapSectionResponse mapSectionResponse, CancellationToken ct)
+		private async Task PersistTheZValuesAsync(ObjectId mapSectionId, MapSectionRequest mapSectionRequest, MapSectionResponse mapSectionResponse, bool wasUpdated, CancellationToken ct)
 		{
-			var zValuesRecordOnFile = await _mapSectionAdapter.DoesMapSectionZValuesExistAsync(mapSectionId, ct);
+			var saveTheZValues = mapSectionRequest.MapCalcSettings.SaveTheZValues;
 
-			if (zValuesRecordOnFile)
+			if (mapSectionResponse.AllRowsHaveEscaped)
 			{
-				Debug.WriteLineIf(_useDetailedDebug, $"PersistProc: UpdateZValuesAsync for {mapSectionId}, bp: {mapSectionResponse.BlockPosition}.");
-				_ = await _mapSectionAdapter.UpdateZValuesAync(mapSectionResponse, mapSectionId);
+				// A newly inserted MapSection can only have Z values if they are being saved.
+				if (wasUpdated || saveTheZValues)
+				{
+					var zValuesRecordOnFile = await _mapSectionAdapter.DoesMapSectionZValuesExistAsync(mapSectionId, ct);
+
+					if (zValuesRecordOnFile)
+					{
+						_ = await _mapSectionAdapter.DeleteZValuesAync(mapSectionId);
+					}
+				}
 			}
 			else
 			{
-				if (!mapSectionResponse.AllRowsHaveEscaped)
+				if (mapSectionResponse.MapSectionZVectors != null)
 				{
-					Debug.WriteLineIf(_useDetailedDebug, $"PersistProc: SaveMapSectionZValuesAsync for {mapSectionId}, bp: {mapSectionResponse.BlockPosition}.");
-					_ = await _mapSectionAdapter.SaveMapSectionZValuesAsync(mapSectionResponse, mapSectionId);
+					var zValuesRecordOnFile = await _mapSectionAdapter.DoesMapSectionZValuesExistAsync(mapSectionId, ct);
+
+					if (zValuesRecordOnFile)
+					{
+						Debug.WriteLineIf(_useDetailedDebug, $"PersistProc: UpdateZValuesAsync for {mapSectionId}, bp: {mapSectionResponse.BlockPosition}.");
+						_ = await _mapSectionAdapter.UpdateZValuesAync(mapSectionResponse, mapSectionId);
+					}
+					else
+					{
+						Debug.WriteLineIf(_useDetailedDebug, $"PersistProc: SaveMapSectionZValuesAsync for {mapSectionId}, bp: {mapSectionResponse.BlockPosition}.");
+						_ = await _mapSectionAdapter.SaveMapSectionZValuesAsync(mapSectionResponse, mapSectionId);
+					}
+				}
+				else
+				{
+					if (saveTheZValues)
+					{
+						Debug.WriteLine("WARNING: MapSectionPersistProcessor: The MapSectionZValues is null, but the SaveTheZValues setting is true.");
+					}
 				}
 			}
 		}
 
-		private Task<ObjectId?> SaveJobMapSection(ObjectId mapSectionId, MapSectionRequest mapSectionRequest, MapSectionResponse mapSectionResponse)
+		private JobMapSectionLink CreateJobMapSectionLink(ObjectId mapSectionId, MapSectionRequest mapSectionRequest, MapSectionResponse mapSectionResponse)
 		{
-			//var mapSectionIdStr = mapSectionResponse.MapSectionId;
-			//if (string.IsNullOrEmpty(mapSectionIdStr))
-			//{
-			//	throw new ArgumentNullException(nameof(MapSectionResponse.MapSectionId), "The MapSectionId cannot be null.");
-			//}
-
 			var mapSubdivisionIdStr = mapSectionResponse.SubdivisionId;
 			if (string.IsNullOrEmpty(mapSubdivisionIdStr))
 			{
@@ -265,11 +382,9 @@ namespace MapSectionProviderLib
 
 			var blockIndex = new SizeInt(mapSectionRequest.ScreenPositionReleativeToCenter);
 
-			//var result = _mapSectionAdapter.SaveJobMapSectionAsync(mapSectionRequest.JobType, new ObjectId(jobIdStr), new ObjectId(mapSectionIdStr), blockIndex, mapSectionRequest.IsInverted, new ObjectId(mapSubdivisionIdStr), new ObjectId(jobSubdivisionIdStr), mapSectionRequest.OwnerType);
-			var result = _mapSectionAdapter.SaveJobMapSectionAsync(mapSectionRequest.JobType, new ObjectId(jobIdStr), mapSectionId, blockIndex, mapSectionRequest.IsInverted, new ObjectId(mapSubdivisionIdStr), new ObjectId(jobSubdivisionIdStr), mapSectionRequest.OwnerType);
+			var result = new JobMapSectionLink(mapSectionRequest.JobType, new ObjectId(jobIdStr), mapSectionId, blockIndex, mapSectionRequest.IsInverted, new ObjectId(mapSubdivisionIdStr), new ObjectId(jobSubdivisionIdStr), mapSectionRequest.OwnerType);
 
 			return result;
-
 		}
 
 		private void CheckMapSectionId(MapSectionRequest mapSectionRequest, MapSectionResponse mapSectionResponse)
@@ -0,0 +1,272 @@
+﻿using MSS.Common;
+using MSS.Common.MSet;
+using MSS.Types;
+using MSS.Types.MSet;
+using System;
+using System.Collections.Generic;
+using System.Diagnostics.CodeAnalysis;
+using System.Linq;
+using System.Numerics;
+using System.Runtime.InteropServices;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace MapSectionProviderLib
+{
+	/// <summary>
+	/// Derives a MapSection from the MapSections already generated at 2 or 4 times the resolution, i.e., using a SamplePointDelta 2 or 4 times smaller.
+	/// The finer MapSections covering the same area, 2x2 or 4x4 of them, have a sample that coincides with every sample of the MapSection being derived,
+	/// every ScaleFactor-th sample of every ScaleFactor-th row is copied.
+	/// The result is exact if each of the finer MapSections was completed, using at least the requested TargetIterations (or has all samples escaped)
+	/// and calculated escape velocities if requested. Otherwise, the result is an approximation that can be shown while the MapSection is generated.
+	/// </summary>
+	public class MapSectionPyramidBuilder
+	{
+		// The ratios of the MapSection's SamplePointDelta to the SamplePointDelta of the finer MapSections, in the order tried.
+		private static readonly int[] CHILD_SCALE_FACTORS = new int[] { 2, 4 };
+
+		private readonly SubdivisonProvider _subdivisonProvider;
+		private readonly Func<string, MapBlockOffset, CancellationToken, Task<MapSectionBytes?>> _fetchAsync;
+
+		#region Constructor
+
+		/// <param name="fetchAsync">Fetches the MapSection for a SubdivisionId and BlockPosition, if one exists.</param>
+		public MapSectionPyramidBuilder(SubdivisonProvider subdivisonProvider, Func<string, MapBlockOffset, CancellationToken, Task<MapSectionBytes?>> fetchAsync)
+		{
+			_subdivisonProvider = subdivisonProvider;
+			_fetchAsync = fetchAsync;
+		}
+
+		#endregion
+
+		#region Public Methods
+
+		public async Task<DerivedMapSection?> TryDeriveAsync(MapSectionRequest mapSectionRequest, CancellationToken ct)
+		{
+			var baseMapPosition = mapSectionRequest.SubdivisionBaseMapPosition;
+
+			if (baseMapPosition == null)
+			{
+				return null;
+			}
+
+			var blockSize = mapSectionRequest.BlockSize;
+			var blockPosition = baseMapPosition.Tranlate(MapFrom(mapSectionRequest.RepoBlockPosition));
+
+			foreach (var scaleFactor in CHILD_SCALE_FACTORS)
+			{
+				if (blockSize.Width % scaleFactor != 0 || blockSize.Height % scaleFactor != 0)
+				{
+					continue;
+				}
+
+				var children = await FetchChildrenAsync(mapSectionRequest.SamplePointDelta, blockSize, blockPosition, scaleFactor, ct);
+
+				if (children != null)
+				{
+					var result = Derive(mapSectionRequest, children, scaleFactor);
+					return result;
+				}
+			}
+
+			return null;
+		}
+
+		#endregion
+
+		#region Private Methods
+
+		// Returns the finer MapSections row by row, starting with the one that shares the MapSection's first sample, or null if any are missing.
+		private async Task<MapSectionBytes[]?> FetchChildrenAsync(RSize samplePointDelta, SizeInt blockSize, BigVector blockPosition, int scaleFactor, CancellationToken ct)
+		{
+			var childSamplePointDelta = samplePointDelta;
+
+			for (var i = 1; i < scaleFactor; i *= 2)
+			{
+				childSamplePointDelta = childSamplePointDelta.ScaleByHalf();
+			}
+
+			var fetchTasks = new List<Task<MapSectionBytes?>>(scaleFactor * scaleFactor);
+			var subdivisions = new Dictionary<BigVector, Subdivision>();
+
+			for (var j = 0; j < scaleFactor; j++)
+			{
+				for (var i = 0; i < scaleFactor; i++)
+				{
+					var childBlockPosition = new BigVector(blockPosition.X * scaleFactor + i, blockPosition.Y * scaleFactor + j);
+					var childBaseMapPosition = _subdivisonProvider.GetBaseMapPosition(childBlockPosition, out var childLocalBlockPosition);
+
+					if (!subdivisions.TryGetValue(childBaseMapPosition, out var childSubdivision))
+					{
+						if (!TryGetChildSubdivision(childSamplePointDelta, childBaseMapPosition, out childSubdivision) || childSubdivision.BlockSize != blockSize)
+						{
+							return null;
+						}
+
+						subdivisions.Add(childBaseMapPosition, childSubdivision);
+					}
+
+					fetchTasks.Add(_fetchAsync(childSubdivision.Id.ToString(), MapTo(childLocalBlockPosition), ct));
+				}
+			}
+
+			var children = await Task.WhenAll(fetchTasks);
+
+			if (children.Any(x => x == null))
+			{
+				return null;
+			}
+
+			return children!;
+		}
+
+		private DerivedMapSection Derive(MapSectionRequest mapSectionRequest, MapSectionBytes[] children, int scaleFactor)
+		{
+			var blockSize = mapSectionRequest.BlockSize;
+			var mapCalcSettings = mapSectionRequest.MapCalcSettings;
+			var targetIterations = mapCalcSettings.TargetIterations;
+
+			var counts = new ushort[blockSize.NumberOfCells];
+			var escapeVelocities = new ushort[blockSize.NumberOfCells];
+
+			var cellWidth = blockSize.Width / scaleFactor;
+			var cellHeight = blockSize.Height / scaleFactor;
+
+			var isExact = true;
+			var allRowsHaveEscaped = true;
+
+			for (var childPtr = 0; childPtr < children.Length; childPtr++)
+			{
+				var child = children[childPtr];
+				isExact &= IsExact(child, mapCalcSettings);
+				allRowsHaveEscaped &= child.AllRowsHaveEscaped;
+
+				var childCounts = MemoryMarshal.Cast<byte, ushort>(child.Counts);
+				var childEscapeVelocities = MemoryMarshal.Cast<byte, ushort>(child.EscapeVelocities);
+
+				var startX = (childPtr % scaleFactor) * cellWidth;
+				var startY = (childPtr / scaleFactor) * cellHeight;
+
+				for (var v = 0; v < cellHeight; v++)
+				{
+					var childRowStart = v * scaleFactor * blockSize.Width;
+					var rowStart = (startY + v) * blockSize.Width + startX;
+
+					for (var u = 0; u < cellWidth; u++)
+					{
+						var count = childCounts[childRowStart + u * scaleFactor];
+
+						if (count > targetIterations)
+						{
+							// The finer MapSection was generated using a larger TargetIterations value, the sample has not escaped at this TargetIterations value.
+							counts[rowStart + u] = (ushort)(targetIterations + 1);
+							escapeVelocities[rowStart + u] = 0;
+							allRowsHaveEscaped = false;
+						}
+						else
+						{
+							counts[rowStart + u] = count;
+							escapeVelocities[rowStart + u] = childEscapeVelocities.Length == 0 ? (ushort)0 : childEscapeVelocities[childRowStart + u * scaleFactor];
+						}
+					}
+				}
+			}
+
+			var mapSectionVectors2 = new MapSectionVectors2(blockSize, MemoryMarshal.AsBytes(counts.AsSpan()).ToArray(), MemoryMarshal.AsBytes(escapeVelocities.AsSpan()).ToArray());
+			var result = new DerivedMapSection(mapSectionVectors2, scaleFactor, isExact, allRowsHaveEscaped);
+
+			return result;
+		}
+
+		private bool IsExact(MapSectionBytes child, MapCalcSettings mapCalcSettings)
+		{
+			if (!child.RequestWasCompleted)
+			{
+				return false;
+			}
+
+			var childMapCalcSettings = child.MapCalcSettings;
+
+			if (childMapCalcSettings.Threshold != mapCalcSettings.Threshold)
+			{
+				// The counts depend on the escape radius.
+				return false;
+			}
+
+			if (childMapCalcSettings.TargetIterations < mapCalcSettings.TargetIterations && !child.AllRowsHaveEscaped)
+			{
+				return false;
+			}
+
+			if (mapCalcSettings.CalculateEscapeVelocities && !childMapCalcSettings.CalculateEscapeVelocities)
+			{
+				return false;
+			}
+
+			return true;
+		}
+
+		private bool TryGetChildSubdivision(RSize childSamplePointDelta, BigVector childBaseMapPosition, [NotNullWhen(true)] out Subdivision? childSubdivision)
+		{
+			if (_subdivisonProvider.TryGetSubdivision(childSamplePointDelta, childBaseMapPosition, out childSubdivision))
+			{
+				return true;
+			}
+
+			var reducedChildSamplePointDelta = Reducer.Reduce(childSamplePointDelta);
+
+			if (reducedChildSamplePointDelta != childSamplePointDelta && _subdivisonProvider.TryGetSubdivision(reducedChildSamplePointDelta, childBaseMapPosition, out childSubdivision))
+			{
+				return true;
+			}
+
+			return false;
+		}
+
+		// Copied from MapSectionBuilder
+		private BigVector MapFrom(MapBlockOffset mapBlockOffset)
+		{
+			var x = BigIntegerHelper.FromLongs(new long[] { mapBlockOffset.XHi, mapBlockOffset.XLo });
+			var y = BigIntegerHelper.FromLongs(new long[] { mapBlockOffset.YHi, mapBlockOffset.YLo });
+			var result = new BigVector(x, y);
+
+			return result;
+		}
+
+		private MapBlockOffset MapTo(BigVector bigVector)
+		{
+			var x = BigIntegerHelper.ToLongPairs(bigVector.X);
+			var y = BigIntegerHelper.ToLongPairs(bigVector.Y);
+
+			var mapBlockOffset = new MapBlockOffset(x, y);
+			return mapBlockOffset;
+		}
+
+		#endregion
+	}
+
+	public class DerivedMapSection
+	{
+		public DerivedMapSection(MapSectionVectors2 mapSectionVectors2, int scaleFactor, bool isExact, bool allRowsHaveEscaped)
+		{
+			MapSectionVectors2 = mapSectionVectors2;
+			ScaleFactor = scaleFactor;
+			IsExact = isExact;
+			AllRowsHaveEscaped = allRowsHaveEscaped;
+		}
+
+		public MapSectionVectors2 MapSectionVectors2 { get; init; }
+
+		/// <summary>
+		/// The ratio of the MapSection's SamplePointDelta to the SamplePointDelta of the MapSections it was derived from.
+		/// </summary>
+		public int ScaleFactor { get; init; }
+
+		/// <summary>
+		/// True if the counts and escape velocities are the same as those the MapSection would have if it were generated.
+		/// </summary>
+		public bool IsExact { get; init; }
+
+		public bool AllRowsHaveEscaped { get; init; }
+	}
+}
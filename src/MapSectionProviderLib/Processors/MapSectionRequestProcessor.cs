@@ -1,5 +1,6 @@
 ﻿using MongoDB.Bson;
 using MSS.Common;
+using MSS.Common.MSet;
 using MSS.Types;
 using MSS.Types.MSet;
 using System;
@@ -8,6 +9,7 @@ using System.Collections.Generic;
 using System.Diagnostics;
 using System.Diagnostics.CodeAnalysis;
 using System.Linq;
+using System.Numerics;
 using System.Threading;
 using System.Threading.Tasks;
 
@@ -17,34 +19,61 @@ namespace MapSectionProviderLib
 	{
 		#region Private Properties
 
-		private const int NUMBER_OF_REQUEST_CONSUMERS = 1;
-		private const int REQUEST_QUEUE_CAPACITY = 50;
+		// The consumers spend most of their time waiting on the repository, there are enough to keep the generator busy.
+		private static readonly int NUMBER_OF_REQUEST_CONSUMERS = Math.Clamp(Environment.ProcessorCount, 2, 8);
+
+		// Per job, large enough to hold the requests for a screen, so that these can be taken in order of priority.
+		private const int REQUEST_QUEUE_CAPACITY = 1000;
 		private const int RETURN_QUEUE_CAPACITY = 200;
 
+		private const long DEFAULT_MAP_SECTION_CACHE_BYTES = 256L * 1024 * 1024;
+
+		// The number of MapSections generated speculatively for each screen, about one ring of blocks and the center of the next zoom level.
+		private const int DEFAULT_SPECULATIVE_BLOCK_BUDGET = 64;
+
+		// Speculative requests do not belong to a MapLoader job, the job numbers provided by GetNextRequestId are positive.
+		private const int SPECULATIVE_JOB_ID = -1;
+
+		// Blocks found to be missing by FetchInBulkAsync whose requests were cancelled before being processed are never removed, the set is cleared when it reaches this size.
+		private const int MAX_BLOCKS_NOT_IN_REPO = 20000;
+
+		// The ratios of a parent's SamplePointDelta to the SamplePointDelta of the MapSection being generated, in the order tried.
+		private static readonly int[] PARENT_SCALE_FACTORS = new int[] { 2, 4 };
+
 		private readonly MapSectionVectorProvider _mapSectionVectorProvider;
 		private readonly IMapSectionAdapter _mapSectionAdapter;
 		private readonly MapSectionBuilder _mapSectionBuilder;
+		private readonly SubdivisonProvider _subdivisonProvider;
+		private readonly MapSectionPyramidBuilder _mapSectionPyramidBuilder;
+		private readonly MapSectionSpeculativeGenerator _speculativeGenerator;
 
 		private readonly MapSectionGeneratorProcessor _mapSectionGeneratorProcessor;
 		private readonly MapSectionResponseProcessor _mapSectionResponseProcessor;
 		private readonly MapSectionPersistProcessor _mapSectionPersistProcessor;
 
 		private readonly CancellationTokenSource _requestQueueCts;
-		private readonly BlockingCollection<MapSectionWorkRequest> _requestQueue;
+		private readonly MapSectionRequestScheduler _requestScheduler;
 
 		private readonly Task[] _requestQueueProcessors;
 		private readonly int[] _requestCounters;
+		private int _requestsBeingProcessed;
 
 		private readonly object _cancelledJobsLock = new();
 
 		private readonly ReaderWriterLockSlim _requestsLock;
 
-		private readonly List<int> _cancelledJobIds;
-		private readonly List<MapSectionWorkRequest> _pendingRequests;
+		// The MapSections being generated, each with the requests waiting on it.
+		private readonly Dictionary<(string subdivisionId, MapBlockOffset blockPosition, int targetIterations), InFlightGeneration> _inFlightGenerations;
+
+		private readonly object _blocksNotInRepoLock = new();
+		private readonly HashSet<(string subdivisionId, MapBlockOffset blockPosition)> _blocksNotInRepo;
 
 		private int _nextJobId;
 		private bool disposedValue;
 
+		// The most recent FullScale job, the MapSections fetched for it are pinned in the MapSectionCache.
+		private int _pinnedJobNumber = -1;
+
 		private bool _isStopped;
 
 		private readonly CancellationTokenSource _returnQueueCts;
@@ -58,7 +87,8 @@ namespace MapSectionProviderLib
 		#region Constructor
 
 		public MapSectionRequestProcessor(IMapSectionAdapter mapSectionAdapter, MapSectionVectorProvider mapSectionVectorProvider,
-			MapSectionGeneratorProcessor mapSectionGeneratorProcessor, MapSectionResponseProcessor mapSectionResponseProcessor, MapSectionPersistProcessor mapSectionPersistProcessor)
+			MapSectionGeneratorProcessor mapSectionGeneratorProcessor, MapSectionResponseProcessor mapSectionResponseProcessor, MapSectionPersistProcessor mapSectionPersistProcessor,
+			long mapSectionCacheBytes = DEFAULT_MAP_SECTION_CACHE_BYTES)
 		{
 			_isStopped = false;
 
@@ -68,32 +98,30 @@ namespace MapSectionProviderLib
 			_mapSectionVectorProvider = mapSectionVectorProvider;
 			_mapSectionAdapter = mapSectionAdapter;
 			_mapSectionBuilder = new MapSectionBuilder();
+			_subdivisonProvider = new SubdivisonProvider(mapSectionAdapter);
+			MapSectionCache = new MapSectionCache(mapSectionCacheBytes);
+			_mapSectionPyramidBuilder = new MapSectionPyramidBuilder(_subdivisonProvider, (subdivisionId, blockPosition, ct) => FetchAsync(subdivisionId, blockPosition, pinOwner: null, ct));
+			_speculativeGenerator = new MapSectionSpeculativeGenerator(_subdivisonProvider, SpeculateAsync, IsIdle);
 
 			_mapSectionGeneratorProcessor = mapSectionGeneratorProcessor;
 			_mapSectionResponseProcessor = mapSectionResponseProcessor;
 			_mapSectionPersistProcessor = mapSectionPersistProcessor;
 
 			_requestQueueCts = new CancellationTokenSource();
-			_requestQueue = new BlockingCollection<MapSectionWorkRequest>(REQUEST_QUEUE_CAPACITY);
-			_pendingRequests = new List<MapSectionWorkRequest>();
+			_requestScheduler = new MapSectionRequestScheduler(REQUEST_QUEUE_CAPACITY);
+			_inFlightGenerations = new Dictionary<(string subdivisionId, MapBlockOffset blockPosition, int targetIterations), InFlightGeneration>();
+			_blocksNotInRepo = new HashSet<(string subdivisionId, MapBlockOffset blockPosition)>();
 			_requestsLock = new ReaderWriterLockSlim(LockRecursionPolicy.NoRecursion);
-			_cancelledJobIds = new List<int>();
 
 			_requestQueueProcessors = new Task[NUMBER_OF_REQUEST_CONSUMERS];
 			_requestCounters = new int[NUMBER_OF_REQUEST_CONSUMERS];
 
-			//for (var processorIndex = 0; processorIndex < _requestQueueProcessors.Length; processorIndex++)
-			//{
-			//	_requestCounters[processorIndex] = 0;
-			//	_requestQueueProcessors[processorIndex] = Task.Run(async () => await ProcessTheRequestQueueAsync(_mapSectionGeneratorProcessor, processorIndex, _requestQueueCts.Token));
-			//}
-
-			_requestCounters[0] = 0;
-			_requestQueueProcessors[0] = Task.Run(async () => await ProcessTheRequestQueueAsync(_mapSectionGeneratorProcessor, 0, _requestQueueCts.Token));
-
-			//_requestCounters[1] = 0;
-			//_requestQueueProcessors[1] = Task.Run(async () => await ProcessTheRequestQueueAsync(_mapSectionGeneratorProcessor, 1, _requestQueueCts.Token));
-
+			for (var processorIndex = 0; processorIndex < _requestQueueProcessors.Length; processorIndex++)
+			{
+				var queueProcessorIndex = processorIndex;
+				_requestCounters[queueProcessorIndex] = 0;
+				_requestQueueProcessors[queueProcessorIndex] = Task.Run(async () => await ProcessTheRequestQueueAsync(_mapSectionGeneratorProcessor, queueProcessorIndex, _requestQueueCts.Token));
+			}
 
 			_returnQueueCts = new CancellationTokenSource();
 			_returnQueue = new BlockingCollection<MapSectionGenerateRequest>(RETURN_QUEUE_CAPACITY);
@@ -107,7 +135,38 @@ namespace MapSectionProviderLib
 
 		public bool UseRepo { get; set; }
 
-		public int NumberOfRequestsPending => _requestQueue.Count;
+		/// <summary>
+		/// If true, samples from MapSections generated at the previous zoom level (2x or 4x) are used to seed new MapSections.
+		/// </summary>
+		public bool UseParentSamples { get; set; } = true;
+
+		/// <summary>
+		/// If true, a MapSection not found in the repository is derived from the MapSections generated at the next zoom level (2x or 4x), if they exist.
+		/// If these have the requested accuracy, the result is used instead of generating the MapSection, otherwise it is sent as a preview while the MapSection is generated.
+		/// </summary>
+		public bool UseDerivedSections { get; set; } = true;
+
+		/// <summary>
+		/// Holds the MapSections most recently fetched from the repository, shared by all jobs.
+		/// </summary>
+		public MapSectionCache MapSectionCache { get; }
+
+		/// <summary>
+		/// If true, the MapSections fetched for the most recent FullScale job are pinned in the MapSectionCache until a newer FullScale job is started.
+		/// </summary>
+		public bool PinOnScreenSections { get; set; } = true;
+
+		/// <summary>
+		/// If true, while there is no other work, the MapSections surrounding the screen and those at the next zoom level are generated, see SetSpeculationTarget.
+		/// </summary>
+		public bool UseSpeculativeGeneration { get; set; } = true;
+
+		/// <summary>
+		/// The maximum number of MapSections generated speculatively for each screen.
+		/// </summary>
+		public int SpeculativeBlockBudget { get; set; } = DEFAULT_SPECULATIVE_BLOCK_BUDGET;
+
+		public int NumberOfRequestsPending => _requestScheduler.Count;
 		public int NumberOfReturnsPending => _returnQueue.Count;
 
 		#endregion
@@ -149,23 +208,107 @@ namespace MapSectionProviderLib
 			return result;
 		}
 
-		public void AddWork(int jobNumber, MapSectionRequest mapSectionRequest, Action<MapSectionRequest, MapSection> responseHandler)
+		public void AddWork(int jobNumber, MapSectionRequest mapSectionRequest, Action<MapSectionRequest, MapSection> responseHandler, Action<MapSectionRequest, MapSection>? previewHandler = null)
 		{
-			var mapSectionWorkItem = new MapSectionWorkRequest(jobNumber, mapSectionRequest, responseHandler);
+			var mapSectionWorkItem = new MapSectionWorkRequest(jobNumber, mapSectionRequest, responseHandler, previewHandler);
+			_speculativeGenerator.Preempt();
+
+			if (_requestScheduler.IsAddingCompleted)
+			{
+				Debug.WriteLineIf(_useDetailedDebug, $"MapSectionRequestProcessor. Not adding: {mapSectionWorkItem.Request}, The MapSectionRequestProcessor's RequestQueue IsAddingComplete has been set.");
+			}
+			else if (!_requestScheduler.TryAdd(mapSectionWorkItem))
+			{
+				// The job has been cancelled.
+				SendCancelledResponse(mapSectionWorkItem, _requestQueueCts.Token);
+			}
+		}
 
-			if (!_requestQueue.IsAddingCompleted)
+		/// <summary>
+		/// Fetches the MapSections for the requests using a single query for each Subdivision and adds them to the MapSectionCache.
+		/// The blocks that were not found are remembered, so that when their request is processed, the block is queued for generation without querying the repository again.
+		/// </summary>
+		public async Task FetchInBulkAsync(IList<MapSectionRequest> mapSectionRequests, CancellationToken ct)
+		{
+			if (!UseRepo)
 			{
-				_requestQueue.Add(mapSectionWorkItem);
+				return;
 			}
-			else
+
+			var requestsBySubdivision = mapSectionRequests
+				.Where(x => !x.CancellationTokenSource.IsCancellationRequested && !x.MapCalcSettings.SaveTheZValues)
+				.GroupBy(x => x.SubdivisionId);
+
+			foreach (var requestGroup in requestsBySubdivision)
 			{
-				Debug.WriteLineIf(_useDetailedDebug, $"MapSectionRequestProcessor. Not adding: {mapSectionWorkItem.Request}, The MapSectionRequestProcessor's RequestQueue IsAddingComplete has been set.");
+				var subdivisionId = requestGroup.Key;
+				var requests = requestGroup.ToList();
+
+				if (requests.Count < 2)
+				{
+					// Fetched when the request is processed.
+					continue;
+				}
+
+				var pinOwner = GetPinOwner(requests[0]);
+				var blockPositions = new HashSet<MapBlockOffset>(requests.Select(x => x.RepoBlockPosition));
+				GetBoundingRectangle(blockPositions, out var lowerLeft, out var upperRight);
+
+				try
+				{
+					await foreach (var mapSectionBytes in _mapSectionAdapter.GetMapSectionBytesInRectangleAsync(new ObjectId(subdivisionId), lowerLeft, upperRight, ct))
+					{
+						// The rectangle may include blocks that were not requested.
+						if (blockPositions.Remove(mapSectionBytes.BlockPosition))
+						{
+							MapSectionCache.Add(subdivisionId, mapSectionBytes, pinOwner);
+						}
+					}
+				}
+				catch (OperationCanceledException)
+				{
+					return;
+				}
+				catch (Exception e)
+				{
+					Debug.WriteLine($"WARNING: MapSectionRequestProcessor. FetchInBulk got exception: {e}. The MapSections will be fetched one at a time.");
+					continue;
+				}
+
+				lock (_blocksNotInRepoLock)
+				{
+					if (_blocksNotInRepo.Count + blockPositions.Count > MAX_BLOCKS_NOT_IN_REPO)
+					{
+						_blocksNotInRepo.Clear();
+					}
+
+					foreach (var blockPosition in blockPositions)
+					{
+						_ = _blocksNotInRepo.Add((subdivisionId, blockPosition));
+					}
+				}
+			}
+		}
+
+		/// <summary>
+		/// Sets the screen whose surrounding MapSections are generated while the processor is idle, replacing the previous screen.
+		/// </summary>
+		public void SetSpeculationTarget(JobType jobType, string jobId, OwnerType jobOwnerType, MapAreaInfo mapAreaInfo, MapCalcSettings mapCalcSettings)
+		{
+			// The generated MapSections are of use only once on file. Those that save the ZValues are too expensive to generate speculatively.
+			if (!UseSpeculativeGeneration || !UseRepo || mapCalcSettings.SaveTheZValues)
+			{
+				_speculativeGenerator.ClearTarget();
+				return;
 			}
+
+			_speculativeGenerator.SetTarget(jobType, jobId, jobOwnerType, mapAreaInfo, mapCalcSettings, SpeculativeBlockBudget);
+			SignalIfIdle();
 		}
 
 		public int GetNumberOfPendingRequests(int jobNumber)
 		{
-			var result = DoWithReadLock(() => { return _pendingRequests.Count(x => x.JobId == jobNumber); });
+			var result = DoWithReadLock(() => { return _inFlightGenerations.Values.Sum(x => x.Requests.Count(y => y.JobId == jobNumber)); });
 			return result;
 		}
 
@@ -177,32 +320,36 @@ namespace MapSectionProviderLib
 
 		public void CancelJob(int jobId)
 		{
+			IEnumerable<MapSectionWorkRequest> removedRequests;
+
 			lock (_cancelledJobsLock)
 			{
-				if (!_cancelledJobIds.Contains(jobId))
-				{
-					_cancelledJobIds.Add(jobId);
-				}
-
+				removedRequests = _requestScheduler.CancelJob(jobId);
 				_mapSectionGeneratorProcessor.CancelJob(jobId);
 			}
+
+			// Stop generating the MapSections that only this job, or other cancelled jobs, are waiting on.
+			CancelUnwantedGenerations();
+
+			// Each request receives a response, so that the job's MapLoader can account for all of its requests.
+			foreach (var mapSectionWorkRequest in removedRequests)
+			{
+				SendCancelledResponse(mapSectionWorkRequest, _requestQueueCts.Token);
+			}
 		}
 
 		public void MarkJobAsComplete(int jobId)
 		{
 			lock (_cancelledJobsLock)
 			{
-				if (_cancelledJobIds.Contains(jobId))
-				{
-					_cancelledJobIds.Remove(jobId);
-				}
-
+				_requestScheduler.MarkJobAsComplete(jobId);
 				_mapSectionGeneratorProcessor.MarkJobAsComplete(jobId);
 			}
 		}
 
 		public void Stop(bool immediately)
 		{
+			_speculativeGenerator.Stop();
 			_mapSectionGeneratorProcessor?.Stop(immediately);
 			_mapSectionResponseProcessor?.Stop(immediately);
 
@@ -220,9 +367,9 @@ namespace MapSectionProviderLib
 				}
 				else
 				{
-					if (!_requestQueue.IsCompleted && !_requestQueue.IsAddingCompleted)
+					if (!_requestScheduler.IsAddingCompleted)
 					{
-						_requestQueue.CompleteAdding();
+						_requestScheduler.CompleteAdding();
 					}
 
 					if (!_returnQueue.IsCompleted && !_returnQueue.IsAddingCompleted)
@@ -278,21 +425,68 @@ namespace MapSectionProviderLib
 
 		private async Task ProcessTheRequestQueueAsync(MapSectionGeneratorProcessor mapSectionGeneratorProcessor, int queueProcessorIndex, CancellationToken ct)
 		{
-			while (!ct.IsCancellationRequested && !_requestQueue.IsCompleted)
+			while (!ct.IsCancellationRequested && !_requestScheduler.IsCompleted)
 			{
 				try
 				{
-					var mapSectionWorkRequest = _requestQueue.Take(ct);
-					var mapSectionRequest = mapSectionWorkRequest.Request;
+					if (!_requestScheduler.TryTake(out var mapSectionWorkRequest, ct) || mapSectionWorkRequest == null)
+					{
+						continue;
+					}
+
+					// While any requests are being processed, the processor is not idle.
+					Interlocked.Increment(ref _requestsBeingProcessed);
 
-					var jobIsCancelled = IsJobCancelled(mapSectionWorkRequest.JobId);
-					if (jobIsCancelled || mapSectionRequest.CancellationTokenSource.IsCancellationRequested)
+					try
+					{
+						await ProcessTheRequestAsync(mapSectionWorkRequest, mapSectionGeneratorProcessor, queueProcessorIndex, ct);
+					}
+					finally
 					{
-						var msg = $"MapSectionRequestProcessor: QueueProcessor:{queueProcessorIndex} is skipping request with JobId/Request#: {mapSectionRequest.JobId}/{mapSectionRequest.RequestNumber}.";
+						Interlocked.Decrement(ref _requestsBeingProcessed);
+						SignalIfIdle();
+					}
+				}
+				catch (OperationCanceledException)
+				{
+					//Debug.WriteLineIf(_useDetailedDebug, "The work queue got a OCE.");
+				}
+				catch (Exception e)
+				{
+					Debug.WriteLineIf(_useDetailedDebug, $"MapSectionRequestProcessor: QueueProcessor:{queueProcessorIndex} got an exception: {e}.");
+					throw;
+				}
+			}
+		}
+
+		private async Task ProcessTheRequestAsync(MapSectionWorkRequest mapSectionWorkRequest, MapSectionGeneratorProcessor mapSectionGeneratorProcessor, int queueProcessorIndex, CancellationToken ct)
+		{
+			var mapSectionRequest = mapSectionWorkRequest.Request;
+
+			var jobIsCancelled = IsJobCancelled(mapSectionWorkRequest.JobId);
+			if (jobIsCancelled || mapSectionRequest.CancellationTokenSource.IsCancellationRequested)
+			{
+				var msg = $"MapSectionRequestProcessor: QueueProcessor:{queueProcessorIndex} is skipping request with JobId/Request#: {mapSectionRequest.JobId}/{mapSectionRequest.RequestNumber}.";
 
-						msg += jobIsCancelled ? " JobIsCancelled" : "MapSectionRequest's Cancellation Token is cancelled.";
+				msg += jobIsCancelled ? " JobIsCancelled" : "MapSectionRequest's Cancellation Token is cancelled.";
+
+				SendCancelledResponse(mapSectionWorkRequest, ct);
+			}
+			else
+			{
+				if (!UseRepo)
+				{
+					QueueForGeneration(mapSectionWorkRequest, mapSectionGeneratorProcessor, queueProcessorIndex);
+				}
+				else
+				{
+					var mapSectionResponse = await FetchOrQueueForGenerationAsync(mapSectionWorkRequest, mapSectionGeneratorProcessor, queueProcessorIndex, ct);
+					var mapSectionVectors = mapSectionResponse?.MapSectionVectors;
 
-						mapSectionWorkRequest.Response = _mapSectionBuilder.CreateEmptyMapSection(mapSectionRequest, mapSectionWorkRequest.JobId, isCancelled: true);
+					if (mapSectionVectors != null)
+					{
+						var mapSection = CreateMapSection(mapSectionRequest, mapSectionVectors, mapSectionWorkRequest.JobId);
+						mapSectionWorkRequest.Response = mapSection;
 
 						_requestsLock.EnterReadLock();
 
@@ -307,48 +501,26 @@ namespace MapSectionProviderLib
 					}
 					else
 					{
-						if (!UseRepo)
-						{
-							QueueForGeneration(mapSectionWorkRequest, mapSectionGeneratorProcessor, queueProcessorIndex);
-						}
-						else
-						{
-							var mapSectionResponse = await FetchOrQueueForGenerationAsync(mapSectionWorkRequest, mapSectionGeneratorProcessor, queueProcessorIndex, ct);
-							var mapSectionVectors = mapSectionResponse?.MapSectionVectors;
-
-							if (mapSectionVectors != null)
-							{
-								var mapSection = CreateMapSection(mapSectionRequest, mapSectionVectors, mapSectionWorkRequest.JobId);
-								mapSectionWorkRequest.Response = mapSection;
-
-								_requestsLock.EnterReadLock();
-
-								try
-								{
-									_mapSectionResponseProcessor.AddWork(mapSectionWorkRequest, ct);
-								}
-								finally
-								{
-									_requestsLock.ExitReadLock();
-								}
-							}
-							else
-							{
-								// A request has been sent which will result in the HandleGeneratedResponse callback being called.
-							}
-							
-						}
+						// A request has been sent which will result in the HandleGeneratedResponse callback being called.
 					}
+
 				}
-				catch (OperationCanceledException)
-				{
-					//Debug.WriteLineIf(_useDetailedDebug, "The work queue got a OCE.");
-				}
-				catch (Exception e)
-				{
-					Debug.WriteLineIf(_useDetailedDebug, $"MapSectionRequestProcessor: QueueProcessor:{queueProcessorIndex} got an exception: {e}.");
-					throw;
-				}
+			}
+		}
+
+		private void SendCancelledResponse(MapSectionWorkRequest mapSectionWorkRequest, CancellationToken ct)
+		{
+			mapSectionWorkRequest.Response = _mapSectionBuilder.CreateEmptyMapSection(mapSectionWorkRequest.Request, mapSectionWorkRequest.JobId, isCancelled: true);
+
+			_requestsLock.EnterReadLock();
+
+			try
+			{
+				_mapSectionResponseProcessor.AddWork(mapSectionWorkRequest, ct);
+			}
+			finally
+			{
+				_requestsLock.ExitReadLock();
 			}
 		}
 
@@ -393,7 +565,10 @@ namespace MapSectionProviderLib
 					var mapSectionVectors = _mapSectionVectorProvider.ObtainMapSectionVectors();
 					var mapSectionResponse = MapFrom(mapSectionBytes, mapSectionVectors);
 
-					PersistJobMapSectionRecord(request, mapSectionResponse, ct);
+					if (mapSectionWorkRequest.JobId != SPECULATIVE_JOB_ID)
+					{
+						PersistJobMapSectionRecord(request, mapSectionResponse, ct);
+					}
 
 					return mapSectionResponse;
 				}
@@ -414,7 +589,8 @@ namespace MapSectionProviderLib
 							mapSectionZVectors.Load(zValues.Zrs, zValues.Zis, zValues.HasEscapedFlags, zValues.RowsHasEscaped);
 							request.MapSectionZVectors = mapSectionZVectors;
 
-							var mapSectionVectors2 = new MapSectionVectors2(request.BlockSize, mapSectionBytes.Counts, mapSectionBytes.EscapeVelocities);
+							// The MapSectionBytes may be held by the MapSectionCache, the generator updates the counts in place.
+							var mapSectionVectors2 = new MapSectionVectors2(request.BlockSize, (byte[])mapSectionBytes.Counts.Clone(), (byte[])mapSectionBytes.EscapeVelocities.Clone());
 							request.MapSectionVectors2 = mapSectionVectors2;
 						}
 						else
@@ -430,8 +606,31 @@ namespace MapSectionProviderLib
 			}
 			else
 			{
+				if (UseDerivedSections && !persistZValues)
+				{
+					var derivedMapSection = await _mapSectionPyramidBuilder.TryDeriveAsync(request, ct);
+
+					if (derivedMapSection != null)
+					{
+						if (derivedMapSection.IsExact)
+						{
+							Debug.WriteLineIf(_useDetailedDebug, $"Request for {request.ScreenPosition} not found in the repo: Derived from MapSections {derivedMapSection.ScaleFactor}x smaller.");
+
+							QueueDerivedResponse(mapSectionWorkRequest, derivedMapSection);
+							return null;
+						}
+
+						SendPreview(mapSectionWorkRequest, derivedMapSection, ct);
+					}
+				}
+
 				Debug.WriteLineIf(_useDetailedDebug, $"Request for {request.ScreenPosition} not found in the repo: Queuing for generation.");
 
+				if (UseParentSamples && !persistZValues)
+				{
+					request.ParentSamples = await FetchParentSamplesAsync(request, ct);
+				}
+
 				QueueForGeneration(mapSectionWorkRequest, mapSectionGeneratorProcessor, queueProcessorIndex);
 				return null;
 			}
@@ -477,54 +676,301 @@ namespace MapSectionProviderLib
 				throw new ArgumentNullException(nameof(mapSectionWorkRequest), "The mapSectionWorkRequest must be non-null.");
 			}
 
+			if (mapSectionWorkRequest.JobId != SPECULATIVE_JOB_ID)
+			{
+				// Real work is waiting to be generated.
+				_speculativeGenerator.Preempt();
+			}
+
+			MapSectionGenerateRequest? mapSectionGenerateRequest = null;
+
 			_requestsLock.EnterWriteLock();
 
 			try
 			{
-				if (ThereIsAMatchingRequest(mapSectionWorkRequest.Request))
+				// If this same block is being generated, our request is answered along with the request that was made first.
+				if (AddInFlightRequest(mapSectionWorkRequest, out var inFlightGeneration))
 				{
-					// There is already a request made for this same block, add our request to the queue
-					mapSectionWorkRequest.Request.Pending = true;
-					_pendingRequests.Add(mapSectionWorkRequest);
+					mapSectionGenerateRequest = CreateGenerateRequest(mapSectionWorkRequest, inFlightGeneration.Cts.Token);
 				}
-				else
-				{
-					// Let other's know about our request.
-					_pendingRequests.Add(mapSectionWorkRequest);
+			}
+			finally
+			{
+				_requestsLock.ExitWriteLock();
+			}
 
-					var mapSectionGenerateRequest = new MapSectionGenerateRequest(mapSectionWorkRequest.JobId, mapSectionWorkRequest, QueueGeneratedResponse);
-					mapSectionGeneratorProcessor.AddWork(mapSectionGenerateRequest, ct);
+			if (mapSectionGenerateRequest == null)
+			{
+				return;
+			}
 
-					if (Interlocked.Increment(ref _requestCounters[queueProcessorIndex]) % 10 == 0)
-					{
-						var msg = $"MapSectionRequestProcessor: QueueProcessor:{queueProcessorIndex} has processed {_requestCounters[queueProcessorIndex]} requests.";
-						Debug.WriteLineIf(_useDetailedDebug, msg);
-						Console.WriteLine(msg);
-					}
+			// AddWork blocks while the generator's queue is full. The generator threads call IsWanted, which takes the read lock,
+			// so the work must be added after the write lock has been released.
+			mapSectionGeneratorProcessor.AddWork(mapSectionGenerateRequest, ct);
+
+			if (Interlocked.Increment(ref _requestCounters[queueProcessorIndex]) % 10 == 0)
+			{
+				var msg = $"MapSectionRequestProcessor: QueueProcessor:{queueProcessorIndex} has processed {_requestCounters[queueProcessorIndex]} requests.";
+				Debug.WriteLineIf(_useDetailedDebug, msg);
+				Console.WriteLine(msg);
+			}
+		}
+
+		// The derived MapSection is handled as if it was generated, it is persisted and sent to this and any pending requests for the same block.
+		private void QueueDerivedResponse(MapSectionWorkRequest mapSectionWorkRequest, DerivedMapSection derivedMapSection)
+		{
+			var mapSectionResponse = new MapSectionResponse(mapSectionWorkRequest.Request, requestCompleted: true, derivedMapSection.AllRowsHaveEscaped, derivedMapSection.MapSectionVectors2);
+
+			_requestsLock.EnterWriteLock();
+
+			try
+			{
+				if (!AddInFlightRequest(mapSectionWorkRequest, out _))
+				{
+					// The block is being generated, our request will be answered along with the request that was made first.
+					return;
 				}
 			}
 			finally
 			{
 				_requestsLock.ExitWriteLock();
 			}
+
+			mapSectionWorkRequest.Request.ProcessingEndTime = DateTime.UtcNow;
+			QueueGeneratedResponse(mapSectionWorkRequest, mapSectionResponse);
+		}
+
+		private void SendPreview(MapSectionWorkRequest mapSectionWorkRequest, DerivedMapSection derivedMapSection, CancellationToken ct)
+		{
+			var previewAction = mapSectionWorkRequest.PreviewAction;
+
+			if (previewAction == null)
+			{
+				return;
+			}
+
+			var mapSection = CreateMapSectionFromBytes(mapSectionWorkRequest.Request, derivedMapSection.MapSectionVectors2, mapSectionWorkRequest.JobId);
+			mapSection.IsPreview = true;
+
+			var previewWorkRequest = new MapSectionWorkRequest(mapSectionWorkRequest.JobId, mapSectionWorkRequest.Request, previewAction)
+			{
+				Response = mapSection
+			};
+
+			_mapSectionResponseProcessor.AddWork(previewWorkRequest, ct);
 		}
 
 		private async Task<MapSectionBytes?> FetchAsync(MapSectionRequest mapSectionRequest, CancellationToken ct)
 		{
-			var subdivisionId = new ObjectId(mapSectionRequest.SubdivisionId);
-			var mapSectionBytes = await _mapSectionAdapter.GetMapSectionBytesAsync(subdivisionId, mapSectionRequest.RepoBlockPosition, ct);
+			var pinOwner = GetPinOwner(mapSectionRequest);
+			var mapSectionBytes = await FetchAsync(mapSectionRequest.SubdivisionId, mapSectionRequest.RepoBlockPosition, pinOwner, ct, checkBlocksNotInRepo: true);
+
+			return mapSectionBytes;
+		}
+
+		private async Task<MapSectionBytes?> FetchAsync(string subdivisionId, MapBlockOffset blockPosition, int? pinOwner, CancellationToken ct, bool checkBlocksNotInRepo = false)
+		{
+			if (MapSectionCache.TryGet(subdivisionId, blockPosition, out var mapSectionBytes, pinOwner))
+			{
+				return mapSectionBytes;
+			}
+
+			if (checkBlocksNotInRepo && TryRemoveBlockNotInRepo(subdivisionId, blockPosition))
+			{
+				// FetchInBulkAsync has already looked for this block.
+				return null;
+			}
+
+			mapSectionBytes = await _mapSectionAdapter.GetMapSectionBytesAsync(new ObjectId(subdivisionId), blockPosition, ct);
+
+			if (mapSectionBytes != null)
+			{
+				MapSectionCache.Add(subdivisionId, mapSectionBytes, pinOwner);
+			}
 
 			return mapSectionBytes;
 		}
 
 		private MapSectionBytes? Fetch(MapSectionRequest mapSectionRequest)
 		{
+			var pinOwner = GetPinOwner(mapSectionRequest);
+
+			if (MapSectionCache.TryGet(mapSectionRequest.SubdivisionId, mapSectionRequest.RepoBlockPosition, out var mapSectionBytes, pinOwner))
+			{
+				return mapSectionBytes;
+			}
+
 			var subdivisionId = new ObjectId(mapSectionRequest.SubdivisionId);
-			var mapSectionBytes = _mapSectionAdapter.GetMapSectionBytes(subdivisionId, mapSectionRequest.RepoBlockPosition);
+			mapSectionBytes = _mapSectionAdapter.GetMapSectionBytes(subdivisionId, mapSectionRequest.RepoBlockPosition);
+
+			if (mapSectionBytes != null)
+			{
+				MapSectionCache.Add(mapSectionRequest.SubdivisionId, mapSectionBytes, pinOwner);
+			}
 
 			return mapSectionBytes;
 		}
 
+		private bool TryRemoveBlockNotInRepo(string subdivisionId, MapBlockOffset blockPosition)
+		{
+			lock (_blocksNotInRepoLock)
+			{
+				return _blocksNotInRepo.Remove((subdivisionId, blockPosition));
+			}
+		}
+
+		// The Hi, Lo pairs compare in the same order as the values they represent.
+		private void GetBoundingRectangle(IEnumerable<MapBlockOffset> blockPositions, out MapBlockOffset lowerLeft, out MapBlockOffset upperRight)
+		{
+			var minX = (hi: long.MaxValue, lo: long.MaxValue);
+			var minY = (hi: long.MaxValue, lo: long.MaxValue);
+			var maxX = (hi: long.MinValue, lo: long.MinValue);
+			var maxY = (hi: long.MinValue, lo: long.MinValue);
+
+			foreach (var blockPosition in blockPositions)
+			{
+				var x = (hi: blockPosition.XHi, lo: blockPosition.XLo);
+				var y = (hi: blockPosition.YHi, lo: blockPosition.YLo);
+
+				minX = x.CompareTo(minX) < 0 ? x : minX;
+				maxX = x.CompareTo(maxX) > 0 ? x : maxX;
+				minY = y.CompareTo(minY) < 0 ? y : minY;
+				maxY = y.CompareTo(maxY) > 0 ? y : maxY;
+			}
+
+			lowerLeft = new MapBlockOffset(minX.hi, minX.lo, minY.hi, minY.lo);
+			upperRight = new MapBlockOffset(maxX.hi, maxX.lo, maxY.hi, maxY.lo);
+		}
+
+		// The MapSections fetched for the most recent FullScale job are on screen. Once a newer FullScale job starts, those of the previous job are released.
+		private int? GetPinOwner(MapSectionRequest mapSectionRequest)
+		{
+			if (!PinOnScreenSections || mapSectionRequest.JobType != JobType.FullScale)
+			{
+				return null;
+			}
+
+			var jobNumber = mapSectionRequest.MapLoaderJobNumber;
+
+			lock (_cancelledJobsLock)
+			{
+				if (jobNumber < _pinnedJobNumber)
+				{
+					return null;
+				}
+
+				if (jobNumber > _pinnedJobNumber)
+				{
+					MapSectionCache.UnpinAll(_pinnedJobNumber);
+					_pinnedJobNumber = jobNumber;
+				}
+			}
+
+			return jobNumber;
+		}
+
+		// Find a MapSection generated using a SamplePointDelta 2 or 4 times larger than the request's SamplePointDelta whose samples coincide with the request's samples.
+		private async Task<MapSectionParentSamples?> FetchParentSamplesAsync(MapSectionRequest mapSectionRequest, CancellationToken ct)
+		{
+			var baseMapPosition = mapSectionRequest.SubdivisionBaseMapPosition;
+
+			if (baseMapPosition == null)
+			{
+				return null;
+			}
+
+			var blockSize = mapSectionRequest.BlockSize;
+			var targetIterations = mapSectionRequest.MapCalcSettings.TargetIterations;
+			var blockPosition = baseMapPosition.Tranlate(MapFrom(mapSectionRequest.RepoBlockPosition));
+
+			foreach (var scaleFactor in PARENT_SCALE_FACTORS)
+			{
+				if (blockSize.Width % scaleFactor != 0 || blockSize.Height % scaleFactor != 0)
+				{
+					continue;
+				}
+
+				var parentBlockPosition = DivideAndRoundDown(blockPosition, scaleFactor, out var quadrant);
+				var parentBaseMapPosition = _subdivisonProvider.GetBaseMapPosition(parentBlockPosition, out var parentLocalBlockPosition);
+
+				if (!TryGetParentSubdivision(mapSectionRequest.SamplePointDelta, scaleFactor, parentBaseMapPosition, out var parentSubdivision))
+				{
+					continue;
+				}
+
+				if (parentSubdivision.BlockSize != blockSize)
+				{
+					continue;
+				}
+
+				var mapSectionBytes = await FetchAsync(parentSubdivision.Id.ToString(), MapTo(parentLocalBlockPosition), pinOwner: null, ct);
+
+				if (mapSectionBytes == null || !mapSectionBytes.RequestWasCompleted)
+				{
+					continue;
+				}
+
+				var parentMapCalcSettings = mapSectionBytes.MapCalcSettings;
+
+				if (parentMapCalcSettings == null || parentMapCalcSettings.TargetIterations < targetIterations
+					|| parentMapCalcSettings.Threshold != mapSectionRequest.MapCalcSettings.Threshold
+					|| parentMapCalcSettings.CalculateEscapeVelocities != mapSectionRequest.MapCalcSettings.CalculateEscapeVelocities)
+				{
+					continue;
+				}
+
+				var parentOffset = new PointInt(quadrant.Width * blockSize.Width / scaleFactor, quadrant.Height * blockSize.Height / scaleFactor);
+				var parentVectors = new MapSectionVectors2(blockSize, mapSectionBytes.Counts, mapSectionBytes.EscapeVelocities);
+
+				Debug.WriteLineIf(_useDetailedDebug, $"Seeding {mapSectionRequest.ScreenPosition} using the MapSection at {parentLocalBlockPosition} generated at 1/{scaleFactor} the resolution.");
+
+				return new MapSectionParentSamples(parentVectors, scaleFactor, parentOffset, targetIterations);
+			}
+
+			return null;
+		}
+
+		private bool TryGetParentSubdivision(RSize samplePointDelta, int scaleFactor, BigVector parentBaseMapPosition, [NotNullWhen(true)] out Subdivision? parentSubdivision)
+		{
+			var parentSamplePointDelta = samplePointDelta.Scale(new SizeInt(scaleFactor));
+
+			if (_subdivisonProvider.TryGetSubdivision(parentSamplePointDelta, parentBaseMapPosition, out parentSubdivision))
+			{
+				return true;
+			}
+
+			var reducedParentSamplePointDelta = Reducer.Reduce(parentSamplePointDelta);
+
+			if (reducedParentSamplePointDelta != parentSamplePointDelta && _subdivisonProvider.TryGetSubdivision(reducedParentSamplePointDelta, parentBaseMapPosition, out parentSubdivision))
+			{
+				return true;
+			}
+
+			return false;
+		}
+
+		private BigVector DivideAndRoundDown(BigVector blockPosition, int divisor, out SizeInt remainder)
+		{
+			var x = BigInteger.DivRem(blockPosition.X, divisor, out var remX);
+			var y = BigInteger.DivRem(blockPosition.Y, divisor, out var remY);
+
+			if (remX < 0)
+			{
+				x -= 1;
+				remX += divisor;
+			}
+
+			if (remY < 0)
+			{
+				y -= 1;
+				remY += divisor;
+			}
+
+			remainder = new SizeInt((int)remX, (int)remY);
+
+			return new BigVector(x, y);
+		}
+
 		private async Task<ZValues?> FetchTheZValuesAsync(ObjectId mapSectionId, CancellationToken ct)
 		{
 			var result = await _mapSectionAdapter.GetMapSectionZValuesAsync(mapSectionId, ct);
@@ -540,6 +986,8 @@ namespace MapSectionProviderLib
 			var ct = _requestQueueCts.Token;
 
 			var workRequestsToSend = new List<MapSectionWorkRequest>();
+			MapSectionWorkRequest? promotedRequest = null;
+			InFlightGeneration? promotedGeneration = null;
 
 			try
 			{
@@ -547,25 +995,42 @@ namespace MapSectionProviderLib
 
 				try
 				{
+					_ = TryRemoveBlockNotInRepo(mapSectionWorkRequest.Request.SubdivisionId, mapSectionWorkRequest.Request.RepoBlockPosition);
+
+					var pendingRequests = RemoveInFlightRequests(mapSectionWorkRequest.Request);
+
 					if (UseRepo)
 					{
-						PersistResponse(mapSectionWorkRequest.Request, mapSectionResponse, ct);
+						// Speculative requests are not made on behalf of a Job, the MapSection is linked only to the Jobs whose requests were waiting on it.
+						var jobRequests = pendingRequests.Where(x => x.JobId != SPECULATIVE_JOB_ID).Select(x => x.Request).ToList();
+						PersistResponse(mapSectionWorkRequest.Request, mapSectionResponse, jobRequests, ct);
 					}
 
 					mapSectionWorkRequest.Response = BuildMapSection(mapSectionWorkRequest.Request, mapSectionResponse, mapSectionWorkRequest.JobId);
 					workRequestsToSend.Add(mapSectionWorkRequest);
 
-					var pendingRequests = GetPendingRequests(mapSectionWorkRequest.Request);
+					Debug.WriteLineIf(_useDetailedDebug && pendingRequests.Count > 1, $"MapSectionRequestProcessor. Handling generated response, the count is {pendingRequests.Count} for request: {mapSectionWorkRequest.Request}");
 
-					//Debug.WriteLineIf(_useDetailedDebug, $"Handling generated response, the count is {pendingRequests.Count} for request: {mapSectionWorkRequest.Request}");
+					AssertPrimaryRequestFound(mapSectionWorkRequest, pendingRequests);
 
-					if (pendingRequests.Count > 0)
+					if (mapSectionResponse.RequestCancelled)
 					{
-						Debug.WriteLineIf(_useDetailedDebug, $"MapSectionRequestProcessor. Handling generated response, the count is {pendingRequests.Count} for request: {mapSectionWorkRequest.Request}");
-						RemoveFoundRequests(pendingRequests);
-					}
+						// The generation was interrupted, if requests made by other jobs are still waiting, one of these is generated in its place.
+						var waitingRequests = pendingRequests.Where(x => x != mapSectionWorkRequest && !IsRequestCancelled(x)).ToList();
 
-					AssertPrimaryRequestFound(mapSectionWorkRequest, pendingRequests);
+						if (waitingRequests.Count > 0)
+						{
+							promotedRequest = waitingRequests[0];
+							promotedRequest.Request.Pending = false;
+
+							var key = GetInFlightKey(promotedRequest.Request);
+							promotedGeneration = CreateInFlightGeneration(key);
+							waitingRequests.ForEach(promotedGeneration.Add);
+							_inFlightGenerations.Add(key, promotedGeneration);
+
+							pendingRequests = pendingRequests.Except(waitingRequests).ToList();
+						}
+					}
 
 					foreach (var workItem in pendingRequests)
 					{
@@ -595,6 +1060,33 @@ namespace MapSectionProviderLib
 
 				_requestsLock.ExitUpgradeableReadLock();
 			}
+
+			if (promotedRequest != null && promotedGeneration != null)
+			{
+				RequeueForGeneration(promotedRequest, promotedGeneration.Cts.Token, ct);
+			}
+
+			SignalIfIdle();
+		}
+
+		// Waiting for room on the generator's queue could deadlock with the generator waiting for room on the return queue,
+		// the request is added to the generator's requeued work, which is not bounded. The requests are cancelled only if the generator has been stopped.
+		private void RequeueForGeneration(MapSectionWorkRequest mapSectionWorkRequest, CancellationToken generationCt, CancellationToken ct)
+		{
+			Debug.WriteLineIf(_useDetailedDebug, $"MapSectionRequestProcessor. Requeuing the request: {mapSectionWorkRequest.Request} for generation, it replaces a request that was cancelled.");
+
+			if (_mapSectionGeneratorProcessor.AddRequeuedWork(CreateGenerateRequest(mapSectionWorkRequest, generationCt)))
+			{
+				return;
+			}
+
+			var pendingRequests = new List<MapSectionWorkRequest>();
+			DoWithWriteLock(() => { pendingRequests = RemoveInFlightRequests(mapSectionWorkRequest.Request); });
+
+			foreach (var workItem in pendingRequests)
+			{
+				SendCancelledResponse(workItem, ct);
+			}
 		}
 
 		private MapSection BuildMapSection(MapSectionRequest mapSectionRequest, MapSectionResponse mapSectionResponse, int jobNumber)
@@ -640,7 +1132,7 @@ namespace MapSectionProviderLib
 			_mapSectionPersistProcessor.AddWork(new MapSectionPersistRequest(mapSectionRequest, copyWithNoVectors, onlyInsertJobMapSectionRecord: true), ct);
 		}
 
-		private void PersistResponse(MapSectionRequest mapSectionRequest, MapSectionResponse mapSectionResponse, CancellationToken ct)
+		private void PersistResponse(MapSectionRequest mapSectionRequest, MapSectionResponse mapSectionResponse, IList<MapSectionRequest> jobRequests, CancellationToken ct)
 		{
 			// Send work to the Persist processor
 			// If the request is not cancelled -- OR -- if SaveTheZValues is 'On'.
@@ -677,54 +1169,155 @@ namespace MapSectionProviderLib
 				//mapSectionResponse.MapSectionVectors2?.IncreaseRefCount();
 				//mapSectionResponse.MapSectionZVectors?.IncreaseRefCount();
 
-				_mapSectionPersistProcessor.AddWork(new MapSectionPersistRequest(mapSectionRequest, cpy), ct);
+				// Any MapSection held by the MapSectionCache for this block was fetched before it was generated again, it is replaced by the new one.
+				// A new MapSection is added once it has been inserted and its Id is known.
+				Action<MapSectionResponse>? mapSectionSaved = null;
+
+				if (mapSectionRequest.MapSectionId != null)
+				{
+					AddToCache(mapSectionRequest, cpy, new ObjectId(mapSectionRequest.MapSectionId));
+				}
+				else
+				{
+					mapSectionSaved = x => AddToCache(mapSectionRequest, x, new ObjectId(x.MapSectionId));
+				}
+
+				_mapSectionPersistProcessor.AddWork(new MapSectionPersistRequest(mapSectionRequest, cpy, onlyInsertJobMapSectionRecord: false, jobRequests) { MapSectionSaved = mapSectionSaved }, ct);
 			}
 		}
 
-		// Returns true, if there is a "Primary" Request already in the queue
-		private bool ThereIsAMatchingRequest(MapSectionRequest mapSectionRequest)
+		// The MapSectionVectors2 are not pooled, the Counts and EscapeVelocities are shared with the MapSectionCache.
+		private void AddToCache(MapSectionRequest mapSectionRequest, MapSectionResponse mapSectionResponse, ObjectId mapSectionId)
 		{
-			var subdivisionId = mapSectionRequest.SubdivisionId;
-			var result = _pendingRequests.Any(x => (!x.Request.Pending) && x.Request.SubdivisionId == subdivisionId && x.Request.RepoBlockPosition == mapSectionRequest.RepoBlockPosition);
+			var mapSectionVectors2 = mapSectionResponse.MapSectionVectors2;
 
-			return result;
+			if (mapSectionVectors2 == null)
+			{
+				return;
+			}
+
+			var now = DateTime.UtcNow;
+
+			var mapSectionBytes = new MapSectionBytes(mapSectionId, dateCreatedUtc: now, lastSavedUtc: now, lastAccessed: now, new ObjectId(mapSectionRequest.SubdivisionId), mapSectionRequest.RepoBlockPosition,
+				mapSectionResponse.MapCalcSettings, mapSectionResponse.RequestCompleted, mapSectionResponse.AllRowsHaveEscaped, mapSectionVectors2.Counts, mapSectionVectors2.EscapeVelocities);
+
+			MapSectionCache.Add(mapSectionRequest.SubdivisionId, mapSectionBytes, GetPinOwner(mapSectionRequest));
 		}
 
-		// Find all matching requests.
-		private List<MapSectionWorkRequest> GetPendingRequests(MapSectionRequest mapSectionRequest)
+		private (string subdivisionId, MapBlockOffset blockPosition, int targetIterations) GetInFlightKey(MapSectionRequest mapSectionRequest)
 		{
-			var subdivisionId = mapSectionRequest.SubdivisionId;
-			var result = _pendingRequests.Where(x => x.Request.SubdivisionId == subdivisionId && x.Request.RepoBlockPosition == mapSectionRequest.RepoBlockPosition).ToList();
+			return (mapSectionRequest.SubdivisionId, mapSectionRequest.RepoBlockPosition, mapSectionRequest.MapCalcSettings.TargetIterations);
+		}
+
+		// Returns true, if the request is the "Primary" request for its block, otherwise the request is marked as Pending.
+		// Must be called while holding the write lock.
+		private bool AddInFlightRequest(MapSectionWorkRequest mapSectionWorkRequest, out InFlightGeneration inFlightGeneration)
+		{
+			var key = GetInFlightKey(mapSectionWorkRequest.Request);
+
+			if (_inFlightGenerations.TryGetValue(key, out var existingGeneration))
+			{
+				mapSectionWorkRequest.Request.Pending = true;
+				existingGeneration.Add(mapSectionWorkRequest);
+				inFlightGeneration = existingGeneration;
+				return false;
+			}
+			else
+			{
+				inFlightGeneration = CreateInFlightGeneration(key);
+				inFlightGeneration.Add(mapSectionWorkRequest);
+				_inFlightGenerations.Add(key, inFlightGeneration);
+				return true;
+			}
+		}
 
+		// Removes and returns the primary request and all requests waiting on it. Must be called while holding the write lock.
+		private List<MapSectionWorkRequest> RemoveInFlightRequests(MapSectionRequest mapSectionRequest)
+		{
+			if (_inFlightGenerations.Remove(GetInFlightKey(mapSectionRequest), out var inFlightGeneration))
+			{
+				inFlightGeneration.UnregisterRequests();
+				return inFlightGeneration.Requests;
+			}
+			else
+			{
+				return new List<MapSectionWorkRequest>();
+			}
+		}
+
+		// When a request is cancelled, the callback runs on the thread that cancelled it, which may hold the requests lock, the check is made on another thread.
+		private InFlightGeneration CreateInFlightGeneration((string subdivisionId, MapBlockOffset blockPosition, int targetIterations) key)
+		{
+			var result = new InFlightGeneration(() => { _ = Task.Run(() => CancelGenerationIfUnwanted(key)); });
 			return result;
 		}
 
-		private bool RemoveFoundRequests(IList<MapSectionWorkRequest> requests)
+		private MapSectionGenerateRequest CreateGenerateRequest(MapSectionWorkRequest mapSectionWorkRequest, CancellationToken generationCt)
 		{
-			var result = true;
+			var key = GetInFlightKey(mapSectionWorkRequest.Request);
 
-			foreach (var workItem in requests)
+			var result = new MapSectionGenerateRequest(mapSectionWorkRequest.JobId, mapSectionWorkRequest, QueueGeneratedResponse)
 			{
-				if (!_pendingRequests.Remove(workItem))
-				{
-					result = false;
-				}
-			}
+				IsWanted = () => IsGenerationWanted(key),
+				CancellationToken = generationCt
+			};
 
 			return result;
 		}
 
-		private bool IsJobCancelled(int jobId)
+		// The generation is cancelled only if every request waiting on it has been cancelled.
+		private bool IsGenerationWanted((string subdivisionId, MapBlockOffset blockPosition, int targetIterations) key)
 		{
-			bool result;
-			lock(_cancelledJobsLock)
+			var result = DoWithReadLock(() =>
 			{
-				result = _cancelledJobIds.Contains(jobId);
-			}
+				return _inFlightGenerations.TryGetValue(key, out var inFlightGeneration) && IsGenerationWanted(inFlightGeneration);
+			});
 
 			return result;
 		}
 
+		private bool IsGenerationWanted(InFlightGeneration inFlightGeneration)
+		{
+			var result = inFlightGeneration.Requests.Any(x => !IsRequestCancelled(x));
+			return result;
+		}
+
+		private void CancelGenerationIfUnwanted((string subdivisionId, MapBlockOffset blockPosition, int targetIterations) key)
+		{
+			var cts = DoWithReadLock(() =>
+			{
+				return _inFlightGenerations.TryGetValue(key, out var inFlightGeneration) && !IsGenerationWanted(inFlightGeneration)
+					? inFlightGeneration.Cts
+					: null;
+			});
+
+			// Cancelling runs the generator's callbacks, this is done after the lock has been released.
+			cts?.Cancel();
+		}
+
+		private void CancelUnwantedGenerations()
+		{
+			var ctsList = DoWithReadLock(() =>
+			{
+				return _inFlightGenerations.Values.Where(x => !IsGenerationWanted(x)).Select(x => x.Cts).ToList();
+			});
+
+			ctsList.ForEach(x => x.Cancel());
+		}
+
+		private bool IsRequestCancelled(MapSectionWorkRequest mapSectionWorkRequest)
+		{
+			var result = IsJobCancelled(mapSectionWorkRequest.JobId) || mapSectionWorkRequest.Request.CancellationTokenSource.IsCancellationRequested;
+			return result;
+		}
+
+		private bool IsJobCancelled(int jobId)
+		{
+			var result = _requestScheduler.IsJobCancelled(jobId);
+			return result;
+		}
+
+
 		// Copied from MSetRecordMapper
 		private MapSectionResponse MapFrom(MapSectionBytes target, MapSectionVectors mapSectionVectors)
 		{
@@ -744,6 +1337,25 @@ namespace MapSectionProviderLib
 			return result;
 		}
 
+		// Copied from MapSectionBuilder
+		private BigVector MapFrom(MapBlockOffset mapBlockOffset)
+		{
+			var x = BigIntegerHelper.FromLongs(new long[] { mapBlockOffset.XHi, mapBlockOffset.XLo });
+			var y = BigIntegerHelper.FromLongs(new long[] { mapBlockOffset.YHi, mapBlockOffset.YLo });
+			var result = new BigVector(x, y);
+
+			return result;
+		}
+
+		private MapBlockOffset MapTo(BigVector bigVector)
+		{
+			var x = BigIntegerHelper.ToLongPairs(bigVector.X);
+			var y = BigIntegerHelper.ToLongPairs(bigVector.Y);
+
+			var mapBlockOffset = new MapBlockOffset(x, y);
+			return mapBlockOffset;
+		}
+
 		[Conditional("DEBUG")]
 		private void AssertPrimaryRequestFound(MapSectionWorkRequest mapSectionWorkRequest, IList<MapSectionWorkRequest> pendingRequests)
 		{
@@ -771,6 +1383,57 @@ namespace MapSectionProviderLib
 
 		#endregion
 
+		#region Private Methods - Speculative Generation
+
+		// Fetches the MapSection for a speculative request, queuing it for generation if not found. Returns true if the MapSection was generated.
+		private async Task<bool> SpeculateAsync(MapSectionRequest mapSectionRequest, CancellationToken ct)
+		{
+			var generatedTcs = new TaskCompletionSource<bool>(TaskCreationOptions.RunContinuationsAsynchronously);
+
+			var mapSectionWorkRequest = new MapSectionWorkRequest(SPECULATIVE_JOB_ID, mapSectionRequest, (request, mapSection) =>
+			{
+				_mapSectionVectorProvider.ReturnMapSection(mapSection);
+				generatedTcs.TrySetResult(!mapSection.RequestCancelled);
+			});
+
+			var mapSectionResponse = await FetchOrQueueForGenerationAsync(mapSectionWorkRequest, _mapSectionGeneratorProcessor, queueProcessorIndex: 0, ct);
+
+			if (mapSectionResponse != null)
+			{
+				// Found in the repository, the MapSection is now held by the MapSectionCache.
+				_mapSectionVectorProvider.ReturnMapSectionResponse(mapSectionResponse);
+				return false;
+			}
+
+			using (ct.Register(() => generatedTcs.TrySetCanceled()))
+			{
+				var result = await generatedTcs.Task;
+				return result;
+			}
+		}
+
+		private void SignalIfIdle()
+		{
+			if (UseSpeculativeGeneration && IsIdle())
+			{
+				_speculativeGenerator.SignalIdle();
+			}
+		}
+
+		// The processor is idle if the only MapSection being generated, if any, is a speculative one.
+		private bool IsIdle()
+		{
+			if (_requestScheduler.Count > 0 || Volatile.Read(ref _requestsBeingProcessed) > 0)
+			{
+				return false;
+			}
+
+			var result = DoWithReadLock(() => { return _inFlightGenerations.Values.All(x => x.Requests.All(y => y.JobId == SPECULATIVE_JOB_ID)); });
+			return result;
+		}
+
+		#endregion
+
 		#region Private Methods - Return Queue
 
 		private void ProcessTheReturnQueue(CancellationToken ct)
@@ -851,6 +1514,42 @@ namespace MapSectionProviderLib
 
 		#endregion
 
+		#region Private Types
+
+		// A MapSection being generated, the first request is the one that was sent to the generator.
+		// The generation is stopped using the Cts, once none of the requests are wanted.
+		private class InFlightGeneration
+		{
+			private readonly Action _requestCancelled;
+			private readonly List<CancellationTokenRegistration> _registrations;
+
+			public InFlightGeneration(Action requestCancelled)
+			{
+				_requestCancelled = requestCancelled;
+				_registrations = new List<CancellationTokenRegistration>();
+
+				Requests = new List<MapSectionWorkRequest>();
+				Cts = new CancellationTokenSource();
+			}
+
+			public List<MapSectionWorkRequest> Requests { get; }
+			public CancellationTokenSource Cts { get; }
+
+			public void Add(MapSectionWorkRequest mapSectionWorkRequest)
+			{
+				Requests.Add(mapSectionWorkRequest);
+				_registrations.Add(mapSectionWorkRequest.Request.CancellationTokenSource.Token.Register(_requestCancelled));
+			}
+
+			public void UnregisterRequests()
+			{
+				_registrations.ForEach(x => x.Dispose());
+				_registrations.Clear();
+			}
+		}
+
+		#endregion
+
 		#region IDisposable Support
 
 		protected virtual void Dispose(bool disposing)
@@ -862,16 +1561,13 @@ namespace MapSectionProviderLib
 					Stop(true);
 
 					// Dispose managed state (managed objects)
+					_speculativeGenerator.Dispose();
+
 					if (_requestQueueCts != null)
 					{
 						_requestQueueCts.Dispose();
 					}
 
-					if (_requestQueue != null)
-					{
-						_requestQueue.Dispose();
-					}
-
 					if (_returnQueueCts != null)
 					{
 						_returnQueueCts.Dispose();
@@ -0,0 +1,282 @@
+﻿using MSS.Types.MSet;
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Threading;
+
+namespace MapSectionProviderLib
+{
+	/// <summary>
+	/// Holds the MapSectionWorkRequests waiting to be processed, in a separate priority queue for each job.
+	/// The jobs take turns, a job whose MapSections are shown on screen gets VISIBLE_JOB_SHARE turns for every turn given to other jobs.
+	/// Within a job, the request for the block closest to the center of the screen is taken first.
+	/// Cancelling a job removes all of its requests at once.
+	/// </summary>
+	internal class MapSectionRequestScheduler
+	{
+		private const int VISIBLE_JOB_SHARE = 4;
+
+		private readonly object _stateLock = new();
+
+		private readonly Dictionary<int, JobQueue> _jobQueues;
+		private readonly LinkedList<JobQueue> _jobsWithWork;
+		private readonly HashSet<int> _cancelledJobIds;
+
+		private int _count;
+		private long _sequenceNumber;
+		private bool _isAddingCompleted;
+
+		#region Constructor
+
+		/// <param name="jobCapacity">The number of requests a job may have waiting, TryAdd blocks until the job has room.</param>
+		public MapSectionRequestScheduler(int jobCapacity)
+		{
+			JobCapacity = jobCapacity;
+
+			_jobQueues = new Dictionary<int, JobQueue>();
+			_jobsWithWork = new LinkedList<JobQueue>();
+			_cancelledJobIds = new HashSet<int>();
+		}
+
+		#endregion
+
+		#region Public Properties
+
+		public int JobCapacity { get; init; }
+
+		public int Count
+		{
+			get
+			{
+				lock (_stateLock)
+				{
+					return _count;
+				}
+			}
+		}
+
+		public bool IsAddingCompleted
+		{
+			get
+			{
+				lock (_stateLock)
+				{
+					return _isAddingCompleted;
+				}
+			}
+		}
+
+		public bool IsCompleted
+		{
+			get
+			{
+				lock (_stateLock)
+				{
+					return _isAddingCompleted && _count == 0;
+				}
+			}
+		}
+
+		#endregion
+
+		#region Public Methods
+
+		/// <summary>
+		/// Returns false if the request was not added because its job has been cancelled or adding has been completed.
+		/// </summary>
+		public bool TryAdd(MapSectionWorkRequest mapSectionWorkRequest)
+		{
+			var jobId = mapSectionWorkRequest.JobId;
+
+			lock (_stateLock)
+			{
+				JobQueue? jobQueue;
+
+				while (true)
+				{
+					if (_isAddingCompleted || _cancelledJobIds.Contains(jobId))
+					{
+						return false;
+					}
+
+					if (!_jobQueues.TryGetValue(jobId, out jobQueue))
+					{
+						jobQueue = new JobQueue(jobId, IsVisible(mapSectionWorkRequest.Request) ? VISIBLE_JOB_SHARE : 1);
+						_jobQueues.Add(jobId, jobQueue);
+					}
+
+					if (jobQueue.Queue.Count < JobCapacity)
+					{
+						break;
+					}
+
+					_ = Monitor.Wait(_stateLock);
+				}
+
+				jobQueue.Queue.Enqueue(mapSectionWorkRequest, (GetDistanceFromCenter(mapSectionWorkRequest.Request), _sequenceNumber++));
+
+				if (jobQueue.Node.List == null)
+				{
+					_jobsWithWork.AddLast(jobQueue.Node);
+				}
+
+				_count++;
+				Monitor.PulseAll(_stateLock);
+			}
+
+			return true;
+		}
+
+		/// <summary>
+		/// Waits for a request. Returns false if there are no more requests and adding has been completed.
+		/// </summary>
+		public bool TryTake(out MapSectionWorkRequest? mapSectionWorkRequest, CancellationToken ct)
+		{
+			using var registration = ct.Register(PulseAll);
+
+			lock (_stateLock)
+			{
+				while (_count == 0)
+				{
+					if (_isAddingCompleted)
+					{
+						mapSectionWorkRequest = null;
+						return false;
+					}
+
+					ct.ThrowIfCancellationRequested();
+					_ = Monitor.Wait(_stateLock);
+				}
+
+				var jobQueue = _jobsWithWork.First!.Value;
+				mapSectionWorkRequest = jobQueue.Queue.Dequeue();
+				_count--;
+
+				if (jobQueue.Queue.Count == 0)
+				{
+					_jobsWithWork.Remove(jobQueue.Node);
+					_ = _jobQueues.Remove(jobQueue.JobId);
+				}
+				else if (--jobQueue.TurnsRemaining == 0)
+				{
+					// Give the next job a turn.
+					jobQueue.TurnsRemaining = jobQueue.Share;
+					_jobsWithWork.Remove(jobQueue.Node);
+					_jobsWithWork.AddLast(jobQueue.Node);
+				}
+
+				// Wake any producer waiting for room.
+				Monitor.PulseAll(_stateLock);
+			}
+
+			return true;
+		}
+
+		/// <summary>
+		/// Removes the job's requests, any requests added for the job are refused until MarkJobAsComplete is called.
+		/// Returns the requests that were removed.
+		/// </summary>
+		public IEnumerable<MapSectionWorkRequest> CancelJob(int jobId)
+		{
+			JobQueue? jobQueue;
+
+			lock (_stateLock)
+			{
+				_ = _cancelledJobIds.Add(jobId);
+
+				if (!_jobQueues.Remove(jobId, out jobQueue))
+				{
+					return Enumerable.Empty<MapSectionWorkRequest>();
+				}
+
+				if (jobQueue.Node.List != null)
+				{
+					_jobsWithWork.Remove(jobQueue.Node);
+				}
+
+				_count -= jobQueue.Queue.Count;
+				Monitor.PulseAll(_stateLock);
+			}
+
+			// The queue is no longer shared.
+			return jobQueue.Queue.UnorderedItems.Select(x => x.Element);
+		}
+
+		public void MarkJobAsComplete(int jobId)
+		{
+			lock (_stateLock)
+			{
+				_ = _cancelledJobIds.Remove(jobId);
+			}
+		}
+
+		public bool IsJobCancelled(int jobId)
+		{
+			lock (_stateLock)
+			{
+				return _cancelledJobIds.Contains(jobId);
+			}
+		}
+
+		public void CompleteAdding()
+		{
+			lock (_stateLock)
+			{
+				_isAddingCompleted = true;
+				Monitor.PulseAll(_stateLock);
+			}
+		}
+
+		#endregion
+
+		#region Private Methods
+
+		private void PulseAll()
+		{
+			lock (_stateLock)
+			{
+				Monitor.PulseAll(_stateLock);
+			}
+		}
+
+		// Poster jobs are not shown on screen.
+		private bool IsVisible(MapSectionRequest mapSectionRequest)
+		{
+			return mapSectionRequest.JobType != JobType.Image;
+		}
+
+		private long GetDistanceFromCenter(MapSectionRequest mapSectionRequest)
+		{
+			var offset = mapSectionRequest.ScreenPositionReleativeToCenter;
+			var result = (long)offset.X * offset.X + (long)offset.Y * offset.Y;
+
+			return result;
+		}
+
+		#endregion
+
+		#region Private Types
+
+		private class JobQueue
+		{
+			public JobQueue(int jobId, int share)
+			{
+				JobId = jobId;
+				Share = share;
+				TurnsRemaining = share;
+
+				Queue = new PriorityQueue<MapSectionWorkRequest, (long distance, long sequenceNumber)>();
+				Node = new LinkedListNode<JobQueue>(this);
+			}
+
+			public int JobId { get; }
+			public int Share { get; }
+			public int TurnsRemaining { get; set; }
+
+			public PriorityQueue<MapSectionWorkRequest, (long distance, long sequenceNumber)> Queue { get; }
+			public LinkedListNode<JobQueue> Node { get; }
+		}
+
+		#endregion
+	}
+}
@@ -0,0 +1,414 @@
+﻿using MSS.Common;
+using MSS.Common.MSet;
+using MSS.Types;
+using MSS.Types.MSet;
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Linq;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace MapSectionProviderLib
+{
+	/// <summary>
+	/// Uses the time the MapSectionRequestProcessor is idle to generate the MapSections most likely to be requested next: the ring of blocks
+	/// surrounding the blocks on screen, then the blocks at the next zoom level (a SamplePointDelta 2 times smaller) covering the center of the screen.
+	/// One block is processed at a time. Its request is cancelled as soon as real work arrives and is tried again once the processor is idle.
+	/// At most BlockBudget MapSections are generated for each screen.
+	/// </summary>
+	internal class MapSectionSpeculativeGenerator : IDisposable
+	{
+		#region Private Properties
+
+		private readonly MapSectionBuilder _mapSectionBuilder;
+		private readonly SubdivisonProvider _subdivisonProvider;
+		private readonly Func<MapSectionRequest, CancellationToken, Task<bool>> _speculateAsync;
+		private readonly Func<bool> _isIdle;
+
+		private readonly object _stateLock = new();
+		private readonly SemaphoreSlim _idleSignal;
+
+		private readonly CancellationTokenSource _cts;
+		private readonly Task _speculationTask;
+
+		private SpeculationTarget? _target;
+		private int _targetVersion;
+
+		private List<SpeculativeBlock> _blocks;
+		private int _blocksVersion;
+		private int _nextBlockPtr;
+		private int _blocksGenerated;
+
+		private MapSectionRequest? _currentRequest;
+
+		private bool disposedValue;
+
+		#endregion
+
+		#region Constructor
+
+		/// <param name="speculateAsync">Fetches or generates the MapSection for a request, returns true if the MapSection was generated.</param>
+		/// <param name="isIdle">Returns true if the MapSectionRequestProcessor has no work, other than the speculative request.</param>
+		public MapSectionSpeculativeGenerator(SubdivisonProvider subdivisonProvider, Func<MapSectionRequest, CancellationToken, Task<bool>> speculateAsync, Func<bool> isIdle)
+		{
+			_mapSectionBuilder = new MapSectionBuilder();
+			_subdivisonProvider = subdivisonProvider;
+			_speculateAsync = speculateAsync;
+			_isIdle = isIdle;
+
+			_idleSignal = new SemaphoreSlim(0, 1);
+
+			_target = null;
+			_targetVersion = 0;
+
+			_blocks = new List<SpeculativeBlock>();
+			_blocksVersion = 0;
+
+			_cts = new CancellationTokenSource();
+			_speculationTask = Task.Run(async () => await ProcessAsync(_cts.Token));
+		}
+
+		#endregion
+
+		#region Public Properties
+
+		public int NumberOfBlocksGenerated
+		{
+			get
+			{
+				lock (_stateLock)
+				{
+					return _blocksGenerated;
+				}
+			}
+		}
+
+		#endregion
+
+		#region Public Methods
+
+		/// <summary>
+		/// Replaces the screen for which MapSections are generated, the request in progress for the previous screen is cancelled.
+		/// </summary>
+		public void SetTarget(JobType jobType, string jobId, OwnerType ownerType, MapAreaInfo mapAreaInfo, MapCalcSettings mapCalcSettings, int blockBudget)
+		{
+			lock (_stateLock)
+			{
+				_target = new SpeculationTarget(jobType, jobId, ownerType, mapAreaInfo, mapCalcSettings, blockBudget);
+				_targetVersion++;
+
+				CancelCurrentRequest();
+			}
+		}
+
+		public void ClearTarget()
+		{
+			lock (_stateLock)
+			{
+				_target = null;
+				_targetVersion++;
+
+				CancelCurrentRequest();
+			}
+		}
+
+		/// <summary>
+		/// Called when the MapSectionRequestProcessor has finished its work.
+		/// </summary>
+		public void SignalIdle()
+		{
+			if (_idleSignal.CurrentCount == 0)
+			{
+				try
+				{
+					_idleSignal.Release();
+				}
+				catch (SemaphoreFullException)
+				{ }
+			}
+		}
+
+		/// <summary>
+		/// Called when real work arrives, the speculative request in progress, if any, is cancelled.
+		/// </summary>
+		public void Preempt()
+		{
+			lock (_stateLock)
+			{
+				if (_currentRequest != null && !_currentRequest.CancellationTokenSource.IsCancellationRequested)
+				{
+					_currentRequest.CancellationTokenSource.Cancel();
+				}
+			}
+		}
+
+		public void Stop()
+		{
+			ClearTarget();
+
+			if (!_cts.IsCancellationRequested)
+			{
+				_cts.Cancel();
+			}
+
+			try
+			{
+				if (!_speculationTask.Wait(RMapConstants.MAP_SECTION_PROCESSOR_STOP_TIMEOUT_SECONDS * 1000))
+				{
+					Debug.WriteLine($"WARNING: The MapSectionSpeculativeGenerator's Task did not complete after waiting for {RMapConstants.MAP_SECTION_PROCESSOR_STOP_TIMEOUT_SECONDS} seconds.");
+				}
+			}
+			catch { }
+		}
+
+		#endregion
+
+		#region Private Methods
+
+		private async Task ProcessAsync(CancellationToken ct)
+		{
+			while (!ct.IsCancellationRequested)
+			{
+				try
+				{
+					await _idleSignal.WaitAsync(ct);
+
+					while (!ct.IsCancellationRequested && _isIdle() && TryGetNextRequest(out var mapSectionRequest))
+					{
+						var generated = await _speculateAsync(mapSectionRequest, ct);
+						CompleteRequest(mapSectionRequest, generated);
+					}
+				}
+				catch (OperationCanceledException)
+				{ }
+				catch (Exception e)
+				{
+					Debug.WriteLine($"WARNING: The MapSectionSpeculativeGenerator got an exception: {e}.");
+				}
+			}
+		}
+
+		private bool TryGetNextRequest(out MapSectionRequest mapSectionRequest)
+		{
+			mapSectionRequest = null!;
+
+			SpeculationTarget? target;
+			int version;
+			bool blocksAreCurrent;
+
+			lock (_stateLock)
+			{
+				target = _target;
+				version = _targetVersion;
+				blocksAreCurrent = version == _blocksVersion;
+			}
+
+			if (target == null)
+			{
+				return false;
+			}
+
+			// Finding the Subdivisions for the next zoom level requires reading from the repository, this is done without holding the lock.
+			var blocks = blocksAreCurrent ? null : GetSpeculativeBlocks(target);
+
+			lock (_stateLock)
+			{
+				if (version != _targetVersion)
+				{
+					// The target has been replaced, the caller will be signaled again.
+					return false;
+				}
+
+				if (blocks != null)
+				{
+					_blocks = blocks;
+					_blocksVersion = version;
+					_nextBlockPtr = 0;
+					_blocksGenerated = 0;
+				}
+
+				if (_nextBlockPtr >= _blocks.Count || _blocksGenerated >= target.BlockBudget)
+				{
+					return false;
+				}
+
+				var block = _blocks[_nextBlockPtr++];
+
+				mapSectionRequest = _mapSectionBuilder.CreateRequest(target.JobType, block.ScreenPosition, new VectorInt(), block.MapBlockOffset, block.Precision, target.JobId, target.OwnerType,
+					block.Subdivision, target.MapAreaInfo.OriginalSourceSubdivisionId, target.MapCalcSettings, mapLoaderJobNumber: -1, requestNumber: _nextBlockPtr);
+
+				_currentRequest = mapSectionRequest;
+			}
+
+			return true;
+		}
+
+		private void CompleteRequest(MapSectionRequest mapSectionRequest, bool generated)
+		{
+			lock (_stateLock)
+			{
+				if (_currentRequest != mapSectionRequest)
+				{
+					// The target was replaced while the request was in progress.
+					return;
+				}
+
+				_currentRequest = null;
+
+				if (mapSectionRequest.CancellationTokenSource.IsCancellationRequested)
+				{
+					// Preempted by real work, try the same block again.
+					_nextBlockPtr--;
+				}
+				else if (generated)
+				{
+					_blocksGenerated++;
+				}
+			}
+		}
+
+		// Must be called while holding the state lock.
+		private void CancelCurrentRequest()
+		{
+			if (_currentRequest != null)
+			{
+				_currentRequest.CancellationTokenSource.Cancel();
+				_currentRequest = null;
+			}
+		}
+
+		private List<SpeculativeBlock> GetSpeculativeBlocks(SpeculationTarget target)
+		{
+			var result = new List<SpeculativeBlock>();
+
+			var mapAreaInfo = target.MapAreaInfo;
+			var subdivision = mapAreaInfo.Subdivision;
+			var mapExtentInBlocks = RMapHelper.GetMapExtentInBlocks(mapAreaInfo.CanvasSize.Round(), mapAreaInfo.CanvasControlOffset, subdivision.BlockSize);
+
+			// The ring of blocks surrounding the blocks on screen.
+			for (var y = -1; y <= mapExtentInBlocks.Height; y++)
+			{
+				for (var x = -1; x <= mapExtentInBlocks.Width; x++)
+				{
+					if (x == -1 || y == -1 || x == mapExtentInBlocks.Width || y == mapExtentInBlocks.Height)
+					{
+						result.Add(new SpeculativeBlock(subdivision, mapAreaInfo.MapBlockOffset, new PointInt(x, y), mapAreaInfo.Precision));
+					}
+				}
+			}
+
+			result.AddRange(GetNextZoomLevelBlocks(mapAreaInfo, mapExtentInBlocks));
+
+			return result;
+		}
+
+		// Zooming in 2x on the center of the screen shows the blocks, at the next zoom level, that cover the center half of the screen, nearest the center first.
+		private List<SpeculativeBlock> GetNextZoomLevelBlocks(MapAreaInfo mapAreaInfo, SizeInt mapExtentInBlocks)
+		{
+			var result = new List<SpeculativeBlock>();
+
+			var subdivision = mapAreaInfo.Subdivision;
+			var childSamplePointDelta = subdivision.SamplePointDelta.ScaleByHalf();
+			var childSubdivisions = new Dictionary<BigVector, Subdivision?>();
+
+			var startX = mapExtentInBlocks.Width / 4;
+			var startY = mapExtentInBlocks.Height / 4;
+			var endX = mapExtentInBlocks.Width - startX;
+			var endY = mapExtentInBlocks.Height - startY;
+
+			var centerX = mapExtentInBlocks.Width / 2.0;
+			var centerY = mapExtentInBlocks.Height / 2.0;
+
+			var screenPositions = new List<PointInt>();
+
+			for (var y = startY; y < endY; y++)
+			{
+				for (var x = startX; x < endX; x++)
+				{
+					screenPositions.Add(new PointInt(x, y));
+				}
+			}
+
+			foreach (var screenPosition in screenPositions.OrderBy(p => Math.Abs(p.X + 0.5 - centerX) + Math.Abs(p.Y + 0.5 - centerY)))
+			{
+				var blockPosition = subdivision.BaseMapPosition.Tranlate(mapAreaInfo.MapBlockOffset.Tranlate(screenPosition));
+
+				for (var j = 0; j < 2; j++)
+				{
+					for (var i = 0; i < 2; i++)
+					{
+						var childBlockPosition = new BigVector(blockPosition.X * 2 + i, blockPosition.Y * 2 + j);
+						var childBaseMapPosition = _subdivisonProvider.GetBaseMapPosition(childBlockPosition, out var childLocalBlockPosition);
+
+						if (!childSubdivisions.TryGetValue(childBaseMapPosition, out var childSubdivision))
+						{
+							childSubdivision = GetChildSubdivision(childSamplePointDelta, childBaseMapPosition, subdivision.BlockSize);
+							childSubdivisions.Add(childBaseMapPosition, childSubdivision);
+						}
+
+						if (childSubdivision != null)
+						{
+							result.Add(new SpeculativeBlock(childSubdivision, childLocalBlockPosition, new PointInt(), mapAreaInfo.Precision + 1));
+						}
+					}
+				}
+			}
+
+			return result;
+		}
+
+		// Subdivisions are not created speculatively, the next zoom level is only generated if its Subdivision is already on file.
+		private Subdivision? GetChildSubdivision(RSize childSamplePointDelta, BigVector childBaseMapPosition, SizeInt blockSize)
+		{
+			if (!_subdivisonProvider.TryGetSubdivision(childSamplePointDelta, childBaseMapPosition, out var childSubdivision))
+			{
+				var reducedChildSamplePointDelta = Reducer.Reduce(childSamplePointDelta);
+
+				if (reducedChildSamplePointDelta == childSamplePointDelta || !_subdivisonProvider.TryGetSubdivision(reducedChildSamplePointDelta, childBaseMapPosition, out childSubdivision))
+				{
+					return null;
+				}
+			}
+
+			return childSubdivision.BlockSize == blockSize ? childSubdivision : null;
+		}
+
+		#endregion
+
+		#region Private Types
+
+		private record SpeculationTarget(JobType JobType, string JobId, OwnerType OwnerType, MapAreaInfo MapAreaInfo, MapCalcSettings MapCalcSettings, int BlockBudget);
+
+		// The block's position is given by the ScreenPosition relative to the MapBlockOffset, as for a job's MapSectionRequests.
+		private record SpeculativeBlock(Subdivision Subdivision, BigVector MapBlockOffset, PointInt ScreenPosition, int Precision);
+
+		#endregion
+
+		#region IDisposable Support
+
+		protected virtual void Dispose(bool disposing)
+		{
+			if (!disposedValue)
+			{
+				if (disposing)
+				{
+					Stop();
+
+					_cts.Dispose();
+					_idleSignal.Dispose();
+				}
+
+				disposedValue = true;
+			}
+		}
+
+		public void Dispose()
+		{
+			Dispose(disposing: true);
+			GC.SuppressFinalize(this);
+		}
+
+		#endregion
+	}
+}
@@ -2,6 +2,8 @@
 using MSS.Types;
 using MSS.Types.MSet;
 using System;
+using System.Collections.Generic;
+using System.Threading;
 
 namespace MapSectionProviderLib
 {
@@ -34,10 +36,16 @@ namespace MapSectionProviderLib
 
 	internal class MapSectionWorkRequest : WorkItem<MapSectionRequest, MapSection>
 	{
-		public MapSectionWorkRequest(int jobId, MapSectionRequest request, Action<MapSectionRequest, MapSection> workAction)
+		public MapSectionWorkRequest(int jobId, MapSectionRequest request, Action<MapSectionRequest, MapSection> workAction, Action<MapSectionRequest, MapSection>? previewAction = null)
 			: base(jobId, request, workAction)
 		{
+			PreviewAction = previewAction;
 		}
+
+		/// <summary>
+		/// If not null, receives a MapSection marked as a preview, if one can be produced, before the MapSection is generated.
+		/// </summary>
+		public Action<MapSectionRequest, MapSection>? PreviewAction { get; init; }
 	}
 
 	internal class MapSectionGenerateRequest : WorkItem<MapSectionWorkRequest, MapSectionResponse>
@@ -51,6 +59,17 @@ namespace MapSectionProviderLib
 		public MapSectionGenerateRequest(int jobId, MapSectionWorkRequest request, Action<MapSectionWorkRequest, MapSectionResponse> workAction)
 			: base(jobId, request, workAction)
 		{ }
+
+		/// <summary>
+		/// If not null, decides if the MapSection is to be generated, in place of checking the request's job and CancellationToken.
+		/// Requests made by other jobs for the same block may be waiting on this one.
+		/// </summary>
+		public Func<bool>? IsWanted { get; init; }
+
+		/// <summary>
+		/// If not null, stops the generation in place of the request's CancellationToken. It is cancelled once none of the requests waiting on the MapSection are wanted.
+		/// </summary>
+		public CancellationToken? CancellationToken { get; init; }
 	}
 
 	internal class MapSectionPersistRequest 
@@ -59,15 +78,30 @@ namespace MapSectionProviderLib
 		public MapSectionResponse Response { get; init; }
 		public bool OnlyInsertJobMapSectionRecord { get; init; }
 
+		/// <summary>
+		/// The requests for which a JobMapSectionRecord is saved. Empty if the MapSection is not (yet) used by any Job, e.g., one generated speculatively.
+		/// </summary>
+		public IList<MapSectionRequest> JobRequests { get; init; }
+
+		/// <summary>
+		/// If not null, called once the MapSection has been written, the Response's MapSectionId holds the Id of the MapSection on file.
+		/// </summary>
+		public Action<MapSectionResponse>? MapSectionSaved { get; init; }
+
 		public MapSectionPersistRequest(MapSectionRequest request, MapSectionResponse response)
 			: this(request, response, onlyInsertJobMapSectionRecord: false)
 		{ }
 
 		public MapSectionPersistRequest(MapSectionRequest request, MapSectionResponse response, bool onlyInsertJobMapSectionRecord)
+			: this(request, response, onlyInsertJobMapSectionRecord, new List<MapSectionRequest> { request })
+		{ }
+
+		public MapSectionPersistRequest(MapSectionRequest request, MapSectionResponse response, bool onlyInsertJobMapSectionRecord, IList<MapSectionRequest> jobRequests)
 		{
 			Request = request ?? throw new ArgumentNullException(nameof(request));
 			Response = response ?? throw new ArgumentNullException(nameof(response));
 			OnlyInsertJobMapSectionRecord = onlyInsertJobMapSectionRecord;
+			JobRequests = jobRequests ?? throw new ArgumentNullException(nameof(jobRequests));
 		}
 
 	}
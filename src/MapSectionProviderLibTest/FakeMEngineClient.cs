@@ -0,0 +1,58 @@
+﻿using MSS.Common;
+using MSS.Types;
+using MSS.Types.MSet;
+
+namespace MapSectionProviderLibTest
+{
+	/// <summary>
+	/// An IMEngineClient that records each MapSection it is asked to generate and holds the call until it is released.
+	/// The MapSection returned is marked as cancelled if the generation's CancellationToken was cancelled by then.
+	/// </summary>
+	internal class FakeMEngineClient : IMEngineClient
+	{
+		private readonly object _stateLock = new();
+		private readonly List<(MapSectionRequest mapSectionRequest, CancellationToken ct)> _generations = new();
+		private readonly SemaphoreSlim _released = new(0);
+
+		public int ClientNumber => 0;
+		public string EndPointAddress => "Fake";
+		public bool IsLocal => true;
+
+		public List<(MapSectionRequest mapSectionRequest, CancellationToken ct)> Generations
+		{
+			get
+			{
+				lock (_stateLock)
+				{
+					return _generations.ToList();
+				}
+			}
+		}
+
+		public void Release(int count = 1)
+		{
+			_released.Release(count);
+		}
+
+		public MapSectionResponse GenerateMapSection(MapSectionRequest mapSectionRequest, CancellationToken ct)
+		{
+			lock (_stateLock)
+			{
+				_generations.Add((mapSectionRequest, ct));
+			}
+
+			_released.Wait();
+
+			var result = ct.IsCancellationRequested
+				? new MapSectionResponse(mapSectionRequest, isCancelled: true)
+				: new MapSectionResponse(mapSectionRequest, requestCompleted: true, allRowsHaveEscaped: false, new MapSectionVectors2(mapSectionRequest.BlockSize));
+
+			return result;
+		}
+
+		public bool CancelGeneration(MapSectionRequest mapSectionRequest, CancellationToken ct)
+		{
+			throw new NotImplementedException();
+		}
+	}
+}
@@ -0,0 +1,151 @@
+﻿using MongoDB.Bson;
+using MSS.Common;
+using MSS.Types;
+using MSS.Types.MSet;
+using System.Diagnostics.CodeAnalysis;
+
+namespace MapSectionProviderLibTest
+{
+	/// <summary>
+	/// An in-memory IMapSectionAdapter holding Subdivisions and recording the MapSections written. The members not used by the tests throw NotImplementedException.
+	/// </summary>
+	internal class FakeMapSectionAdapter : IMapSectionAdapter
+	{
+		private readonly List<Subdivision> _subdivisions = new();
+
+		#region Written MapSections
+
+		public List<(DateTime timeWritten, IList<MapSectionResponse> mapSectionResponses)> InsertBatches { get; } = new();
+		public List<MapSectionResponse> SingleInserts { get; } = new();
+		public List<MapSectionResponse> Updates { get; } = new();
+		public List<JobMapSectionLink> JobMapSectionLinks { get; } = new();
+
+		/// <summary>
+		/// If true, the bulk writes throw an exception.
+		/// </summary>
+		public bool FailBulkWrites { get; set; }
+
+		public Task<ObjectId?[]> SaveMapSectionsAsync(IList<MapSectionResponse> mapSectionResponses)
+		{
+			if (FailBulkWrites)
+			{
+				throw new InvalidOperationException("The bulk write failed.");
+			}
+
+			InsertBatches.Add((DateTime.UtcNow, mapSectionResponses.ToList()));
+
+			var result = mapSectionResponses.Select(x => (ObjectId?)ObjectId.GenerateNewId()).ToArray();
+			return Task.FromResult(result);
+		}
+
+		public Task<ObjectId?> SaveMapSectionAsync(MapSectionResponse mapSectionResponse)
+		{
+			SingleInserts.Add(mapSectionResponse);
+			return Task.FromResult((ObjectId?)ObjectId.GenerateNewId());
+		}
+
+		public Task<long?> UpdateCountValuesAsync(IList<MapSectionResponse> mapSectionResponses)
+		{
+			if (FailBulkWrites)
+			{
+				throw new InvalidOperationException("The bulk write failed.");
+			}
+
+			Updates.AddRange(mapSectionResponses);
+			return Task.FromResult((long?)mapSectionResponses.Count);
+		}
+
+		public Task<long?> UpdateCountValuesAync(MapSectionResponse mapSectionResponse)
+		{
+			Updates.Add(mapSectionResponse);
+			return Task.FromResult((long?)1);
+		}
+
+		public Task<int> SaveJobMapSectionsAsync(IList<JobMapSectionLink> jobMapSectionLinks)
+		{
+			JobMapSectionLinks.AddRange(jobMapSectionLinks);
+			return Task.FromResult(jobMapSectionLinks.Count);
+		}
+
+		public Task<bool> DoesMapSectionZValuesExistAsync(ObjectId mapSectionId, CancellationToken ct) => Task.FromResult(false);
+
+		#endregion
+
+		#region Subdivisions
+
+		public Subdivision AddSubdivision(RSize samplePointDelta, BigVector baseMapPosition, SizeInt blockSize)
+		{
+			var result = new Subdivision(ObjectId.GenerateNewId(), samplePointDelta, baseMapPosition, blockSize, DateTime.UtcNow);
+			_subdivisions.Add(result);
+
+			return result;
+		}
+
+		// RSize equality does not consider the Exponent.
+		public bool TryGetSubdivision(RSize samplePointDelta, BigVector baseMapPosition, [NotNullWhen(true)] out Subdivision? subdivision)
+		{
+			subdivision = _subdivisions.FirstOrDefault(x => x.SamplePointDelta.Exponent == samplePointDelta.Exponent && x.SamplePointDelta == samplePointDelta && x.BaseMapPosition == baseMapPosition);
+			return subdivision != null;
+		}
+
+		public Subdivision InsertSubdivision(Subdivision subdivision)
+		{
+			_subdivisions.Add(subdivision);
+			return subdivision;
+		}
+
+		public IEnumerable<Subdivision> GetAllSubdivisions() => _subdivisions.ToList();
+
+		#endregion
+
+		#region Not Implemented
+
+		public void CreateCollections() => throw new NotImplementedException();
+		public void CreateIndexes() => throw new NotImplementedException();
+		public void DropMapSections() => throw new NotImplementedException();
+		public void DropMapSectionsAndSubdivisions() => throw new NotImplementedException();
+
+		public Task<MapSectionBytes?> GetMapSectionBytesAsync(ObjectId subdivisionId, MapBlockOffset blockPosition, CancellationToken ct) => throw new NotImplementedException();
+		public MapSectionBytes? GetMapSectionBytes(ObjectId subdivisionId, MapBlockOffset blockPosition) => throw new NotImplementedException();
+		public IAsyncEnumerable<MapSectionBytes> GetMapSectionBytesInRectangleAsync(ObjectId subdivisionId, MapBlockOffset lowerLeft, MapBlockOffset upperRight, CancellationToken ct) => throw new NotImplementedException();
+		public ObjectId? GetMapSectionId(ObjectId subdivisionId, MapBlockOffset blockPosition) => throw new NotImplementedException();
+
+		public Task<ObjectId?> SaveJobMapSectionAsync(JobType jobType, ObjectId jobId, ObjectId mapSectionId, SizeInt blockIndex, bool isInverted, ObjectId mapSectionSubdivisionId, ObjectId jobSubdivisionId, OwnerType ownerType) => throw new NotImplementedException();
+
+		public Task<ZValues?> GetMapSectionZValuesAsync(ObjectId mapSectionId, CancellationToken ct) => throw new NotImplementedException();
+		public Task<ObjectId?> SaveMapSectionZValuesAsync(MapSectionResponse mapSectionResponse, ObjectId mapSectionId) => throw new NotImplementedException();
+		public Task<long?> UpdateZValuesAync(MapSectionResponse mapSectionResponse, ObjectId mapSectionId) => throw new NotImplementedException();
+		public Task<long?> DeleteZValuesAync(ObjectId mapSectionId) => throw new NotImplementedException();
+
+		public IList<ObjectId> GetMapSectionIds(ObjectId jobId) => throw new NotImplementedException();
+		public bool InsertIfNotFoundJobMapSection(JobType jobType, ObjectId jobId, ObjectId mapSectionId, SizeInt blockIndex, bool isInverted, ObjectId mapSectionSubdivisionId, ObjectId jobSubdivisionId, OwnerType ownerType, out ObjectId jobMapSectionId) => throw new NotImplementedException();
+
+		public IEnumerable<ValueTuple<ObjectId, ObjectId, ObjectId, ObjectId>> GetMapSectionAndSubdivisionIdsForAllJobMapSections() => throw new NotImplementedException();
+		public IEnumerable<ValueTuple<ObjectId, ObjectId, ObjectId, ObjectId>> GetJobAndSubdivisionIdsForAllJobMapSections() => throw new NotImplementedException();
+		public ObjectId? GetSubdivisionId(ObjectId mapSectionId) => throw new NotImplementedException();
+		public long DeleteJobMapSectionsInList(IEnumerable<ObjectId> jobMapSectionIds) => throw new NotImplementedException();
+		public IEnumerable<ObjectId> GetAllMapSectionIds() => throw new NotImplementedException();
+		public IEnumerable<ObjectId> GetJobMapSectionIds(IEnumerable<ObjectId> mapSectionIds) => throw new NotImplementedException();
+		public long DeleteMapSectionsInList(IList<ObjectId> mapSectionIds) => throw new NotImplementedException();
+
+		public IEnumerable<ValueTuple<ObjectId, ObjectId>> GetJobAndSubdivisionIdsForAllJobs() => throw new NotImplementedException();
+		public IEnumerable<ObjectId> GetSubdivisionIdsForAllJobs() => throw new NotImplementedException();
+		public IEnumerable<ObjectId> GetSubdivisionIdsForAllMapSections() => throw new NotImplementedException();
+		public long DeleteSubdivisionsInList(IList<ObjectId> subdivisionIds) => throw new NotImplementedException();
+		public long GetSizeOfCollectionInMB() => throw new NotImplementedException();
+
+		public void UpdateJobMapSectionSubdivisionIds(ObjectId jobMapSectionId, ObjectId mapSectionSubdivisionId, ObjectId jobSubdivisionId) => throw new NotImplementedException();
+		public IEnumerable<ValueTuple<ObjectId, DateTime, ObjectId>> GetMapSectionCreationDatesAndSubIds(IEnumerable<ObjectId> mapSectionIds) => throw new NotImplementedException();
+		public long? DeleteMapSectionsForJobHavingJobTypes(ObjectId jobId, JobType[] jobTypes) => throw new NotImplementedException();
+
+		public long? DuplicateJobMapSections(ObjectId ownerId, OwnerType jobOwnerType, ObjectId newOwnerId) => throw new NotImplementedException();
+
+		public long? DeleteMapSectionsForJob(ObjectId jobId) => throw new NotImplementedException();
+		public long? DeleteMapSectionsForManyJobs(IEnumerable<ObjectId> jobIds) => throw new NotImplementedException();
+		public long? DeleteMapSectionsWithJobType(IList<ObjectId> mapSectionIds, OwnerType jobOwnerType) => throw new NotImplementedException();
+		public long? DeleteMapSectionsCreatedSince(DateTime dateCreatedUtc, bool overrideRecentGuard = false) => throw new NotImplementedException();
+		public long? DeleteJobMapSectionsCreatedSince(DateTime dateCreatedUtc, bool overrideRecentGuard = false) => throw new NotImplementedException();
+
+		#endregion
+	}
+}
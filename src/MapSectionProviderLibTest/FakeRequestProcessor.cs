@@ -0,0 +1,75 @@
+﻿using MSS.Types.MSet;
+
+namespace MapSectionProviderLibTest
+{
+	/// <summary>
+	/// Stands in for the MapSectionRequestProcessor, providing the speculateAsync and isIdle delegates used by the MapSectionSpeculativeGenerator.
+	/// Each request is recorded and, if HoldRequests is true, held until it is released or cancelled. A request that is cancelled is reported as not generated.
+	/// </summary>
+	internal class FakeRequestProcessor
+	{
+		private readonly object _stateLock = new();
+		private readonly List<MapSectionRequest> _requests = new();
+		private readonly SemaphoreSlim _released = new(0);
+
+		private bool _isIdle;
+
+		public bool HoldRequests { get; init; }
+
+		public List<MapSectionRequest> Requests
+		{
+			get
+			{
+				lock (_stateLock)
+				{
+					return _requests.ToList();
+				}
+			}
+		}
+
+		public void SetIsIdle(bool isIdle)
+		{
+			lock (_stateLock)
+			{
+				_isIdle = isIdle;
+			}
+		}
+
+		public bool IsIdle()
+		{
+			lock (_stateLock)
+			{
+				return _isIdle;
+			}
+		}
+
+		public void Release(int count = 1)
+		{
+			_released.Release(count);
+		}
+
+		public async Task<bool> SpeculateAsync(MapSectionRequest mapSectionRequest, CancellationToken ct)
+		{
+			lock (_stateLock)
+			{
+				_requests.Add(mapSectionRequest);
+			}
+
+			if (HoldRequests)
+			{
+				using var linkedCts = CancellationTokenSource.CreateLinkedTokenSource(ct, mapSectionRequest.CancellationTokenSource.Token);
+
+				try
+				{
+					await _released.WaitAsync(linkedCts.Token);
+				}
+				catch (OperationCanceledException)
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+	}
+}
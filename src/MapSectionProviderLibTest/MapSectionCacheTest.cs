@@ -0,0 +1,166 @@
+﻿using MapSectionProviderLib;
+using MongoDB.Bson;
+using MSS.Types.MSet;
+
+namespace MapSectionProviderLibTest
+{
+	public class MapSectionCacheTest
+	{
+		// Each MapSection added takes 1 KB, counting the cache's allowance for its own bookkeeping.
+		private const int ENTRY_SIZE = 1024;
+		private const int COUNTS_LENGTH = ENTRY_SIZE - 256;
+
+		private const string SUBDIVISION_ID = "64a0c3e2f1d2b3a4c5d6e7f8";
+
+		[Fact]
+		public void Add_BeyondByteBudget_EvictsTheLeastRecentlyUsed()
+		{
+			var cache = new MapSectionCache(byteBudget: 4 * ENTRY_SIZE);
+			var mapSections = Enumerable.Range(0, 5).Select(CreateMapSectionBytes).ToList();
+
+			mapSections.Take(4).ToList().ForEach(x => cache.Add(SUBDIVISION_ID, x));
+			Assert.Equal(4 * ENTRY_SIZE, cache.BytesInUse);
+
+			// Using the first MapSection leaves the second as the least recently used.
+			Assert.True(cache.TryGet(SUBDIVISION_ID, mapSections[0].BlockPosition, out _));
+
+			cache.Add(SUBDIVISION_ID, mapSections[4]);
+
+			Assert.Equal(4, cache.Count);
+			Assert.Equal(4 * ENTRY_SIZE, cache.BytesInUse);
+			Assert.Equal(1, cache.Evictions);
+
+			Assert.False(cache.TryGet(SUBDIVISION_ID, mapSections[1].BlockPosition, out _));
+
+			foreach (var mapSection in mapSections.Where((x, i) => i != 1))
+			{
+				Assert.True(cache.TryGet(SUBDIVISION_ID, mapSection.BlockPosition, out var cached));
+				Assert.Same(mapSection, cached);
+			}
+		}
+
+		[Fact]
+		public void Add_Replacing_KeepsTheSizeAndTheLruPosition()
+		{
+			var cache = new MapSectionCache(byteBudget: 2 * ENTRY_SIZE);
+			var mapSections = Enumerable.Range(0, 3).Select(CreateMapSectionBytes).ToList();
+
+			cache.Add(SUBDIVISION_ID, mapSections[0]);
+			cache.Add(SUBDIVISION_ID, mapSections[1]);
+
+			var replacement = CreateMapSectionBytes(0);
+			cache.Add(SUBDIVISION_ID, replacement);
+
+			Assert.Equal(2, cache.Count);
+			Assert.Equal(2 * ENTRY_SIZE, cache.BytesInUse);
+			Assert.Equal(0, cache.Evictions);
+
+			// The replacement is the most recently used, the second MapSection is evicted.
+			cache.Add(SUBDIVISION_ID, mapSections[2]);
+
+			Assert.False(cache.TryGet(SUBDIVISION_ID, mapSections[1].BlockPosition, out _));
+			Assert.True(cache.TryGet(SUBDIVISION_ID, mapSections[0].BlockPosition, out var cached));
+			Assert.Same(replacement, cached);
+		}
+
+		[Fact]
+		public void UnpinAll_AfterPinningBeyondByteBudget_EvictsToTheBudget()
+		{
+			var cache = new MapSectionCache(byteBudget: 4 * ENTRY_SIZE);
+			var mapSections = Enumerable.Range(0, 5).Select(CreateMapSectionBytes).ToList();
+
+			// Pinned MapSections are kept even though they take the total over the budget.
+			mapSections.ForEach(x => cache.Add(SUBDIVISION_ID, x, pinOwner: 1));
+
+			Assert.Equal(5, cache.Count);
+			Assert.Equal(5 * ENTRY_SIZE, cache.PinnedBytes);
+			Assert.Equal(0, cache.Evictions);
+
+			// A second owner pins the third MapSection, which also makes it the most recently used.
+			Assert.True(cache.TryGet(SUBDIVISION_ID, mapSections[2].BlockPosition, out _, pinOwner: 2));
+			Assert.Equal(5 * ENTRY_SIZE, cache.PinnedBytes);
+
+			cache.UnpinAll(1);
+
+			Assert.Equal(4, cache.Count);
+			Assert.Equal(4 * ENTRY_SIZE, cache.BytesInUse);
+			Assert.Equal(ENTRY_SIZE, cache.PinnedBytes);
+			Assert.Equal(1, cache.Evictions);
+			Assert.False(cache.TryGet(SUBDIVISION_ID, mapSections[0].BlockPosition, out _));
+
+			// Only the MapSection pinned by the second owner survives when the other MapSections are pushed out.
+			Enumerable.Range(5, 4).Select(CreateMapSectionBytes).ToList().ForEach(x => cache.Add(SUBDIVISION_ID, x));
+
+			Assert.True(cache.TryGet(SUBDIVISION_ID, mapSections[2].BlockPosition, out _));
+			Assert.Equal(4, cache.Count);
+
+			cache.UnpinAll(2);
+			Assert.Equal(0, cache.PinnedBytes);
+		}
+
+		[Fact]
+		public void Add_AfterRemovingAPinnedMapSection_KeepsThePin()
+		{
+			var cache = new MapSectionCache(byteBudget: ENTRY_SIZE);
+
+			cache.Add(SUBDIVISION_ID, CreateMapSectionBytes(0), pinOwner: 1);
+			Assert.True(cache.Remove(SUBDIVISION_ID, CreateMapSectionBytes(0).BlockPosition));
+			Assert.Equal(0, cache.PinnedBytes);
+
+			var replacement = CreateMapSectionBytes(0);
+			cache.Add(SUBDIVISION_ID, replacement);
+			Assert.Equal(ENTRY_SIZE, cache.PinnedBytes);
+
+			// The unpinned MapSection is evicted, the pinned one is kept.
+			cache.Add(SUBDIVISION_ID, CreateMapSectionBytes(1));
+
+			Assert.Equal(1, cache.Count);
+			Assert.True(cache.TryGet(SUBDIVISION_ID, replacement.BlockPosition, out var cached));
+			Assert.Same(replacement, cached);
+		}
+
+		[Fact]
+		public void TryGet_CountsHitsAndMisses()
+		{
+			var cache = new MapSectionCache(byteBudget: 4 * ENTRY_SIZE);
+			var mapSections = Enumerable.Range(0, 2).Select(CreateMapSectionBytes).ToList();
+
+			cache.Add(SUBDIVISION_ID, mapSections[0]);
+
+			Assert.True(cache.TryGet(SUBDIVISION_ID, mapSections[0].BlockPosition, out _));
+			Assert.True(cache.TryGet(SUBDIVISION_ID, mapSections[0].BlockPosition, out _));
+			Assert.True(cache.TryGet(SUBDIVISION_ID, mapSections[0].BlockPosition, out _));
+			Assert.False(cache.TryGet(SUBDIVISION_ID, mapSections[1].BlockPosition, out var missing));
+			Assert.Null(missing);
+
+			// The same BlockPosition under another Subdivision is a different MapSection.
+			Assert.False(cache.TryGet("64a0c3e2f1d2b3a4c5d6e7f9", mapSections[0].BlockPosition, out _));
+
+			Assert.Equal(3, cache.Hits);
+			Assert.Equal(2, cache.Misses);
+			Assert.Equal(0.6, cache.HitRatio, precision: 6);
+
+			cache.ResetCounts();
+
+			Assert.Equal(0, cache.Hits);
+			Assert.Equal(0, cache.Misses);
+			Assert.Equal(0, cache.HitRatio);
+			Assert.Equal(1, cache.Count);
+		}
+
+		#region Support Methods
+
+		private MapSectionBytes CreateMapSectionBytes(int x)
+		{
+			var mapCalcSettings = new MapCalcSettings(targetIterations: 100, threshold: 4, calculateEscapeVelocities: false, saveTheZValues: false);
+			var dateCreated = new DateTime(2023, 1, 1, 0, 0, 0, DateTimeKind.Utc);
+
+			var result = new MapSectionBytes(ObjectId.GenerateNewId(), dateCreated, dateCreated, dateCreated, ObjectId.Parse(SUBDIVISION_ID), new MapBlockOffset(0, x, 0, 0),
+				mapCalcSettings, requestWasCompleted: true, allRowsHaveEscaped: false, new byte[COUNTS_LENGTH], new byte[0]);
+
+			return result;
+		}
+
+		#endregion
+	}
+}
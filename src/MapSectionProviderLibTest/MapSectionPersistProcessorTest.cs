@@ -0,0 +1,132 @@
+﻿using MapSectionProviderLib;
+using MongoDB.Bson;
+using MSS.Common;
+using MSS.Types;
+using MSS.Types.MSet;
+using System.Diagnostics;
+
+namespace MapSectionProviderLibTest
+{
+	public class MapSectionPersistProcessorTest
+	{
+		private static readonly SizeInt BLOCK_SIZE = new SizeInt(128);
+
+		private readonly FakeMapSectionAdapter _mapSectionAdapter;
+		private readonly MapSectionVectorProvider _mapSectionVectorProvider;
+		private readonly string _subdivisionId;
+
+		public MapSectionPersistProcessorTest()
+		{
+			_mapSectionAdapter = new FakeMapSectionAdapter();
+			_mapSectionVectorProvider = new MapSectionVectorProvider(new MapSectionVectorsPool(BLOCK_SIZE, initialSize: 1), new MapSectionZVectorsPool(BLOCK_SIZE, limbCount: 2, initialSize: 1));
+			_subdivisionId = ObjectId.GenerateNewId().ToString();
+		}
+
+		[Fact]
+		public void AddWork_MoreThanMaxBatchSize_WritesFullBatches()
+		{
+			using var persistProcessor = new MapSectionPersistProcessor(_mapSectionAdapter, _mapSectionVectorProvider);
+
+			for (var i = 0; i < 100; i++)
+			{
+				persistProcessor.AddWork(CreatePersistRequest(x: i, targetIterations: 100), CancellationToken.None);
+			}
+
+			persistProcessor.Stop(immediately: false);
+
+			Assert.Equal(new[] { 64, 36 }, _mapSectionAdapter.InsertBatches.Select(x => x.mapSectionResponses.Count));
+			Assert.Equal(100, _mapSectionAdapter.JobMapSectionLinks.Count);
+		}
+
+		[Fact]
+		public void AddWork_FewerThanMaxBatchSize_WritesOnceTheLatencyLimitHasPassed()
+		{
+			using var persistProcessor = new MapSectionPersistProcessor(_mapSectionAdapter, _mapSectionVectorProvider);
+			var stopwatch = Stopwatch.StartNew();
+
+			for (var i = 0; i < 3; i++)
+			{
+				persistProcessor.AddWork(CreatePersistRequest(x: i, targetIterations: 100), CancellationToken.None);
+			}
+
+			// The batch is written without the queue being completed.
+			Assert.True(SpinWait.SpinUntil(() => _mapSectionAdapter.InsertBatches.Count > 0, TimeSpan.FromSeconds(5)));
+			stopwatch.Stop();
+
+			persistProcessor.Stop(immediately: false);
+
+			Assert.Single(_mapSectionAdapter.InsertBatches);
+			Assert.Equal(3, _mapSectionAdapter.InsertBatches[0].mapSectionResponses.Count);
+			Assert.InRange(stopwatch.ElapsedMilliseconds, 200, 5000);
+		}
+
+		[Fact]
+		public void AddWork_SameBlock_WritesTheResponseWithTheLargestTargetIterations()
+		{
+			using var persistProcessor = new MapSectionPersistProcessor(_mapSectionAdapter, _mapSectionVectorProvider);
+			var savedResponses = new List<MapSectionResponse>();
+
+			// The response generated using 200 arrives after the one generated using 300, e.g., from a job that was still using the lower value.
+			foreach (var targetIterations in new[] { 100, 300, 200 })
+			{
+				persistProcessor.AddWork(CreatePersistRequest(x: 0, targetIterations, savedResponses.Add), CancellationToken.None);
+			}
+
+			persistProcessor.Stop(immediately: false);
+
+			var mapSectionResponse = Assert.Single(Assert.Single(_mapSectionAdapter.InsertBatches).mapSectionResponses);
+			Assert.Equal(300, mapSectionResponse.MapCalcSettings.TargetIterations);
+
+			var savedResponse = Assert.Single(savedResponses);
+			Assert.Same(mapSectionResponse, savedResponse);
+
+			// Each job that requested the block is linked to the one MapSection written.
+			Assert.Equal(3, _mapSectionAdapter.JobMapSectionLinks.Count);
+			Assert.All(_mapSectionAdapter.JobMapSectionLinks, x => Assert.Equal(new ObjectId(savedResponse.MapSectionId!), x.MapSectionId));
+		}
+
+		[Fact]
+		public void AddWork_BulkWriteFails_WritesTheMapSectionsOneAtATime()
+		{
+			_mapSectionAdapter.FailBulkWrites = true;
+
+			using var persistProcessor = new MapSectionPersistProcessor(_mapSectionAdapter, _mapSectionVectorProvider);
+			var savedResponses = new List<MapSectionResponse>();
+
+			for (var i = 0; i < 3; i++)
+			{
+				persistProcessor.AddWork(CreatePersistRequest(x: i, targetIterations: 100, savedResponses.Add), CancellationToken.None);
+			}
+
+			persistProcessor.Stop(immediately: false);
+
+			Assert.Empty(_mapSectionAdapter.InsertBatches);
+			Assert.Equal(3, _mapSectionAdapter.SingleInserts.Count);
+
+			Assert.Equal(3, savedResponses.Count);
+			Assert.All(savedResponses, x => Assert.NotNull(x.MapSectionId));
+			Assert.Equal(3, savedResponses.Select(x => x.MapSectionId).Distinct().Count());
+			Assert.Equal(3, _mapSectionAdapter.JobMapSectionLinks.Count);
+		}
+
+		#region Support Methods
+
+		private MapSectionPersistRequest CreatePersistRequest(int x, int targetIterations, Action<MapSectionResponse>? mapSectionSaved = null)
+		{
+			var mapCalcSettings = new MapCalcSettings(targetIterations, threshold: 4, calculateEscapeVelocities: false, saveTheZValues: false);
+			var jobId = ObjectId.GenerateNewId().ToString();
+
+			var mapSectionRequest = new MapSectionRequest(JobType.FullScale, jobId, OwnerType.Project, _subdivisionId, _subdivisionId,
+				new PointInt(x, 0), new VectorInt(x, 0), new BigVector(), new MapBlockOffset(0, x, 0, 0), new RPoint(), isInverted: false,
+				precision: 0, limbCount: 2, BLOCK_SIZE, new RSize(1, 1, -8), mapCalcSettings, mapLoaderJobNumber: 0, requestNumber: x);
+
+			var mapSectionResponse = new MapSectionResponse(mapSectionRequest, requestCompleted: true, allRowsHaveEscaped: false, new MapSectionVectors2(BLOCK_SIZE));
+
+			var result = new MapSectionPersistRequest(mapSectionRequest, mapSectionResponse) { MapSectionSaved = mapSectionSaved };
+
+			return result;
+		}
+
+		#endregion
+	}
+}
@@ -0,0 +1,230 @@
+﻿using MapSectionProviderLib;
+using MongoDB.Bson;
+using MSetGeneratorPrototype;
+using MSS.Common.MSet;
+using MSS.Types;
+using MSS.Types.MSet;
+using System.Runtime.InteropServices;
+
+namespace MapSectionProviderLibTest
+{
+	public class MapSectionPyramidBuilderTest
+	{
+		private const int LIMB_COUNT = 2;
+
+		private static readonly SizeInt BLOCK_SIZE = new SizeInt(128);
+
+		// The MapSection being derived covers 0.25 to 0.5 along the real axis and 0.5 to 0.75 along the imaginary axis.
+		private static readonly RSize SAMPLE_POINT_DELTA = new RSize(1, 1, -9);
+		private static readonly BigVector BLOCK_POSITION = new BigVector(1, 2);
+
+		private readonly FakeMapSectionAdapter _mapSectionAdapter;
+		private readonly Dictionary<(string subdivisionId, MapBlockOffset blockPosition), MapSectionBytes> _mapSections;
+		private readonly MapSectionPyramidBuilder _pyramidBuilder;
+
+		public MapSectionPyramidBuilderTest()
+		{
+			_mapSectionAdapter = new FakeMapSectionAdapter();
+			_mapSections = new Dictionary<(string subdivisionId, MapBlockOffset blockPosition), MapSectionBytes>();
+
+			_pyramidBuilder = new MapSectionPyramidBuilder(new SubdivisonProvider(_mapSectionAdapter),
+				(subdivisionId, blockPosition, ct) => Task.FromResult(_mapSections.TryGetValue((subdivisionId, blockPosition), out var mapSectionBytes) ? mapSectionBytes : null));
+		}
+
+		// The escape velocities calculated by the generator depend on the other samples in the same vector, only the counts are compared.
+		[Theory]
+		[InlineData(2, 200)]
+		[InlineData(4, 200)]
+		[InlineData(2, 400)]	// The finer MapSections were generated using a larger TargetIterations value.
+		[InlineData(4, 400)]
+		public async Task TryDeriveAsync_FromGeneratedMapSections_MatchesDirectGeneration(int scaleFactor, int childTargetIterations)
+		{
+			var mapCalcSettings = new MapCalcSettings(targetIterations: 200, threshold: 4, calculateEscapeVelocities: false, saveTheZValues: false);
+			var childMapCalcSettings = new MapCalcSettings(childTargetIterations, threshold: 4, calculateEscapeVelocities: false, saveTheZValues: false);
+
+			AddChildren(scaleFactor, childMapCalcSettings, (mapPosition, samplePointDelta) =>
+			{
+				var response = Generate(mapPosition, samplePointDelta, childMapCalcSettings);
+				return (response.MapSectionVectors2!.Counts, response.MapSectionVectors2.EscapeVelocities, response.RequestCompleted, response.AllRowsHaveEscaped);
+			});
+
+			var derived = await _pyramidBuilder.TryDeriveAsync(CreateRequest(mapCalcSettings), CancellationToken.None);
+
+			Assert.NotNull(derived);
+			Assert.Equal(scaleFactor, derived!.ScaleFactor);
+			Assert.True(derived.IsExact);
+
+			var mapPosition = new RPoint(BLOCK_POSITION.X * BLOCK_SIZE.Width, BLOCK_POSITION.Y * BLOCK_SIZE.Height, SAMPLE_POINT_DELTA.Exponent);
+			var expected = Generate(mapPosition, SAMPLE_POINT_DELTA, mapCalcSettings);
+
+			Assert.Equal(expected.AllRowsHaveEscaped, derived.AllRowsHaveEscaped);
+			Assert.Equal(GetValues(expected.MapSectionVectors2!.Counts), GetValues(derived.MapSectionVectors2.Counts));
+		}
+
+		[Theory]
+		[InlineData(true, true, false, 2)]
+		[InlineData(false, true, false, 4)]
+		[InlineData(true, true, true, 4)]		// One of the MapSections at 2x is missing, those at 4x are used.
+		[InlineData(true, false, true, 0)]		// No MapSection can be derived.
+		public async Task TryDeriveAsync_PrefersTheSmallestScaleFactorAvailable(bool addTwoTimes, bool addFourTimes, bool removeOneAtTwoTimes, int expectedScaleFactor)
+		{
+			var mapCalcSettings = new MapCalcSettings(targetIterations: 200, threshold: 4, calculateEscapeVelocities: false, saveTheZValues: false);
+
+			if (addTwoTimes)
+			{
+				AddChildren(2, mapCalcSettings, (mapPosition, samplePointDelta) => CreateValues(count: 2, escapeVelocity: 0, allRowsHaveEscaped: true));
+			}
+
+			if (addFourTimes)
+			{
+				AddChildren(4, mapCalcSettings, (mapPosition, samplePointDelta) => CreateValues(count: 4, escapeVelocity: 0, allRowsHaveEscaped: true));
+			}
+
+			if (removeOneAtTwoTimes)
+			{
+				_mapSections.Remove(_mapSections.Keys.First(x => GetValues(_mapSections[x].Counts)[0] == 2));
+			}
+
+			var derived = await _pyramidBuilder.TryDeriveAsync(CreateRequest(mapCalcSettings), CancellationToken.None);
+
+			if (expectedScaleFactor == 0)
+			{
+				Assert.Null(derived);
+			}
+			else
+			{
+				Assert.NotNull(derived);
+				Assert.Equal(expectedScaleFactor, derived!.ScaleFactor);
+				Assert.All(GetValues(derived.MapSectionVectors2.Counts), x => Assert.Equal(expectedScaleFactor, x));
+			}
+		}
+
+		[Theory]
+		[InlineData(true, 4, 200, false, false, false, true)]
+		[InlineData(false, 4, 200, false, false, false, false)]		// A finer MapSection was not completed.
+		[InlineData(true, 8, 200, false, false, false, false)]		// The finer MapSections used a different escape radius.
+		[InlineData(true, 4, 100, false, false, false, false)]		// The finer MapSections used a smaller TargetIterations value.
+		[InlineData(true, 4, 100, true, false, false, true)]		// ... but every sample escaped.
+		[InlineData(true, 4, 200, false, false, true, false)]		// The finer MapSections have no escape velocities.
+		[InlineData(true, 4, 200, false, true, true, true)]
+		public async Task TryDeriveAsync_IsExact_OnlyWhenTheFinerMapSectionsMatch(bool requestWasCompleted, int threshold, int targetIterations, bool allRowsHaveEscaped,
+			bool childCalculateEscapeVelocities, bool calculateEscapeVelocities, bool expectedIsExact)
+		{
+			var mapCalcSettings = new MapCalcSettings(targetIterations: 200, threshold: 4, calculateEscapeVelocities, saveTheZValues: false);
+			var childMapCalcSettings = new MapCalcSettings(targetIterations, threshold, childCalculateEscapeVelocities, saveTheZValues: false);
+
+			AddChildren(2, childMapCalcSettings, (mapPosition, samplePointDelta) =>
+			{
+				var values = CreateValues(count: 50, escapeVelocity: 0, allRowsHaveEscaped);
+				return values with { requestWasCompleted = requestWasCompleted };
+			});
+
+			var derived = await _pyramidBuilder.TryDeriveAsync(CreateRequest(mapCalcSettings), CancellationToken.None);
+
+			Assert.NotNull(derived);
+			Assert.Equal(expectedIsExact, derived!.IsExact);
+		}
+
+		[Theory]
+		[InlineData(150, 150, 1234, true)]
+		[InlineData(300, 201, 0, false)]		// The sample has not escaped at the requested TargetIterations value.
+		public async Task TryDeriveAsync_FromLargerTargetIterations_ClampsTheCounts(int childCount, int expectedCount, int expectedEscapeVelocity, bool expectedAllRowsHaveEscaped)
+		{
+			var mapCalcSettings = new MapCalcSettings(targetIterations: 200, threshold: 4, calculateEscapeVelocities: true, saveTheZValues: false);
+			var childMapCalcSettings = new MapCalcSettings(targetIterations: 400, threshold: 4, calculateEscapeVelocities: true, saveTheZValues: false);
+
+			AddChildren(2, childMapCalcSettings, (mapPosition, samplePointDelta) => CreateValues((ushort)childCount, escapeVelocity: 1234, allRowsHaveEscaped: true));
+
+			var derived = await _pyramidBuilder.TryDeriveAsync(CreateRequest(mapCalcSettings), CancellationToken.None);
+
+			Assert.NotNull(derived);
+			Assert.True(derived!.IsExact);
+			Assert.Equal(expectedAllRowsHaveEscaped, derived.AllRowsHaveEscaped);
+			Assert.All(GetValues(derived.MapSectionVectors2.Counts), x => Assert.Equal(expectedCount, x));
+			Assert.All(GetValues(derived.MapSectionVectors2.EscapeVelocities), x => Assert.Equal(expectedEscapeVelocity, x));
+		}
+
+		#region Support Methods
+
+		// Adds the scaleFactor x scaleFactor MapSections, generated using a SamplePointDelta scaleFactor times smaller, that cover the MapSection being derived.
+		private void AddChildren(int scaleFactor, MapCalcSettings mapCalcSettings,
+			Func<RPoint, RSize, (byte[] counts, byte[] escapeVelocities, bool requestWasCompleted, bool allRowsHaveEscaped)> createValues)
+		{
+			var exponent = SAMPLE_POINT_DELTA.Exponent - (scaleFactor == 2 ? 1 : 2);
+			var samplePointDelta = new RSize(SAMPLE_POINT_DELTA.WidthNumerator, SAMPLE_POINT_DELTA.HeightNumerator, exponent);
+			var subdivision = _mapSectionAdapter.AddSubdivision(samplePointDelta, new BigVector(), BLOCK_SIZE);
+
+			for (var j = 0; j < scaleFactor; j++)
+			{
+				for (var i = 0; i < scaleFactor; i++)
+				{
+					var x = (long)BLOCK_POSITION.X * scaleFactor + i;
+					var y = (long)BLOCK_POSITION.Y * scaleFactor + j;
+
+					var mapPosition = new RPoint(x * BLOCK_SIZE.Width, y * BLOCK_SIZE.Height, exponent);
+					var (counts, escapeVelocities, requestWasCompleted, allRowsHaveEscaped) = createValues(mapPosition, samplePointDelta);
+
+					var blockPosition = new MapBlockOffset(0, x, 0, y);
+					var dateCreated = DateTime.UtcNow;
+
+					var mapSectionBytes = new MapSectionBytes(ObjectId.GenerateNewId(), dateCreated, dateCreated, dateCreated, subdivision.Id, blockPosition,
+						mapCalcSettings, requestWasCompleted, allRowsHaveEscaped, counts, escapeVelocities);
+
+					_mapSections.Add((subdivision.Id.ToString(), blockPosition), mapSectionBytes);
+				}
+			}
+		}
+
+		private (byte[] counts, byte[] escapeVelocities, bool requestWasCompleted, bool allRowsHaveEscaped) CreateValues(ushort count, ushort escapeVelocity, bool allRowsHaveEscaped)
+		{
+			var counts = Enumerable.Repeat(count, BLOCK_SIZE.NumberOfCells).ToArray();
+			var escapeVelocities = Enumerable.Repeat(escapeVelocity, BLOCK_SIZE.NumberOfCells).ToArray();
+
+			return (MemoryMarshal.AsBytes(counts.AsSpan()).ToArray(), MemoryMarshal.AsBytes(escapeVelocities.AsSpan()).ToArray(), true, allRowsHaveEscaped);
+		}
+
+		private MapSectionResponse Generate(RPoint mapPosition, RSize samplePointDelta, MapCalcSettings mapCalcSettings)
+		{
+			var byteCount = BLOCK_SIZE.NumberOfCells * 2;
+			var subdivisionId = ObjectId.GenerateNewId().ToString();
+
+			var request = new MapSectionRequest(JobType.FullScale, jobId: string.Empty, OwnerType.Project, subdivisionId, subdivisionId,
+				new PointInt(), new VectorInt(), new BigVector(), new MapBlockOffset(), mapPosition, isInverted: false,
+				precision: 0, LIMB_COUNT, BLOCK_SIZE, samplePointDelta, mapCalcSettings, mapLoaderJobNumber: 0, requestNumber: 0)
+			{
+				MapSectionVectors2 = new MapSectionVectors2(BLOCK_SIZE, new byte[byteCount], new byte[byteCount])
+			};
+
+			var generator = new MapSectionGeneratorDepthFirst(LIMB_COUNT, BLOCK_SIZE);
+			var result = generator.GenerateMapSection(request, CancellationToken.None);
+
+			Assert.True(result.RequestCompleted);
+
+			return result;
+		}
+
+		private MapSectionRequest CreateRequest(MapCalcSettings mapCalcSettings)
+		{
+			var subdivisionId = ObjectId.GenerateNewId().ToString();
+			var blockPosition = new MapBlockOffset(0, (long)BLOCK_POSITION.X, 0, (long)BLOCK_POSITION.Y);
+			var mapPosition = new RPoint(BLOCK_POSITION.X * BLOCK_SIZE.Width, BLOCK_POSITION.Y * BLOCK_SIZE.Height, SAMPLE_POINT_DELTA.Exponent);
+
+			var result = new MapSectionRequest(JobType.FullScale, jobId: string.Empty, OwnerType.Project, subdivisionId, subdivisionId,
+				new PointInt(), new VectorInt(), new BigVector(), blockPosition, mapPosition, isInverted: false,
+				precision: 0, LIMB_COUNT, BLOCK_SIZE, SAMPLE_POINT_DELTA, mapCalcSettings, mapLoaderJobNumber: 0, requestNumber: 0)
+			{
+				SubdivisionBaseMapPosition = new BigVector()
+			};
+
+			return result;
+		}
+
+		private ushort[] GetValues(byte[] bytes)
+		{
+			var result = MemoryMarshal.Cast<byte, ushort>(bytes).ToArray();
+			return result;
+		}
+
+		#endregion
+	}
+}
@@ -0,0 +1,159 @@
+﻿using MapSectionProviderLib;
+using MongoDB.Bson;
+using MSS.Common;
+using MSS.Types;
+using MSS.Types.MSet;
+
+namespace MapSectionProviderLibTest
+{
+	public class MapSectionRequestProcessorTest : IDisposable
+	{
+		private static readonly SizeInt BLOCK_SIZE = new SizeInt(128);
+		private static readonly TimeSpan TIMEOUT = TimeSpan.FromSeconds(10);
+
+		private readonly FakeMEngineClient _mEngineClient;
+		private readonly MapSectionRequestProcessor _mapSectionRequestProcessor;
+		private readonly string _subdivisionId;
+
+		public MapSectionRequestProcessorTest()
+		{
+			var mapSectionAdapter = new FakeMapSectionAdapter();
+			var mapSectionVectorProvider = new MapSectionVectorProvider(new MapSectionVectorsPool(BLOCK_SIZE, initialSize: 1), new MapSectionZVectorsPool(BLOCK_SIZE, limbCount: 2, initialSize: 1));
+
+			_mEngineClient = new FakeMEngineClient();
+
+			// Without the repository, each request not answered by a MapSection being generated is sent to the generator.
+			_mapSectionRequestProcessor = new MapSectionRequestProcessor(mapSectionAdapter, mapSectionVectorProvider, new MapSectionGeneratorProcessor(new IMEngineClient[] { _mEngineClient }),
+				new MapSectionResponseProcessor(), new MapSectionPersistProcessor(mapSectionAdapter, mapSectionVectorProvider))
+			{
+				UseRepo = false,
+				UseSpeculativeGeneration = false
+			};
+
+			_subdivisionId = ObjectId.GenerateNewId().ToString();
+		}
+
+		public void Dispose()
+		{
+			_mapSectionRequestProcessor.Dispose();
+		}
+
+		[Fact]
+		public void AddWork_TwoJobsSameBlock_GeneratesTheMapSectionOnce()
+		{
+			var (_, firstMapSection) = AddFirstRequest(jobId: 1);
+			var (_, secondMapSection) = AddWaitingRequest(jobId: 2);
+
+			_mEngineClient.Release();
+
+			Assert.False(Await(firstMapSection).RequestCancelled);
+			Assert.False(Await(secondMapSection).RequestCancelled);
+			Assert.Single(_mEngineClient.Generations);
+		}
+
+		[Fact]
+		public void CancelRequest_FirstOfTwo_KeepsGeneratingForTheOther()
+		{
+			var (firstRequest, firstMapSection) = AddFirstRequest(jobId: 1);
+			var (_, secondMapSection) = AddWaitingRequest(jobId: 2);
+
+			firstRequest.CancellationTokenSource.Cancel();
+
+			var generationCt = Assert.Single(_mEngineClient.Generations).ct;
+			Assert.False(SpinWait.SpinUntil(() => generationCt.IsCancellationRequested, 200));
+
+			_mEngineClient.Release();
+
+			Assert.False(Await(secondMapSection).RequestCancelled);
+			Assert.NotNull(Await(firstMapSection));
+			Assert.Single(_mEngineClient.Generations);
+		}
+
+		[Fact]
+		public void CancelJob_AllRequestsCancelled_CancelsTheGeneration()
+		{
+			var (firstRequest, firstMapSection) = AddFirstRequest(jobId: 1);
+			var (_, secondMapSection) = AddWaitingRequest(jobId: 2);
+
+			firstRequest.CancellationTokenSource.Cancel();
+			_mapSectionRequestProcessor.CancelJob(2);
+
+			var generationCt = Assert.Single(_mEngineClient.Generations).ct;
+			Assert.True(SpinWait.SpinUntil(() => generationCt.IsCancellationRequested, TIMEOUT));
+
+			_mEngineClient.Release();
+
+			Assert.True(Await(firstMapSection).RequestCancelled);
+			Assert.True(Await(secondMapSection).RequestCancelled);
+			Assert.Single(_mEngineClient.Generations);
+		}
+
+		[Fact]
+		public void CancelRequest_RequestAddedAfterTheGenerationWasCancelled_IsGeneratedInItsPlace()
+		{
+			var (firstRequest, firstMapSection) = AddFirstRequest(jobId: 1);
+
+			firstRequest.CancellationTokenSource.Cancel();
+
+			var firstGenerationCt = Assert.Single(_mEngineClient.Generations).ct;
+			Assert.True(SpinWait.SpinUntil(() => firstGenerationCt.IsCancellationRequested, TIMEOUT));
+
+			// The second request waits on the generation, which has been cancelled, but has not yet returned.
+			var (secondRequest, secondMapSection) = AddWaitingRequest(jobId: 2);
+
+			_mEngineClient.Release();
+			Assert.True(Await(firstMapSection).RequestCancelled);
+
+			// The waiting request is sent to the generator, with a CancellationToken of its own.
+			Assert.True(SpinWait.SpinUntil(() => _mEngineClient.Generations.Count == 2, TIMEOUT));
+
+			var (promotedRequest, promotedGenerationCt) = _mEngineClient.Generations[1];
+			Assert.Same(secondRequest, promotedRequest);
+			Assert.False(promotedGenerationCt.IsCancellationRequested);
+
+			_mEngineClient.Release();
+
+			Assert.False(Await(secondMapSection).RequestCancelled);
+		}
+
+		#region Support Methods
+
+		private (MapSectionRequest mapSectionRequest, Task<MapSection> mapSection) AddFirstRequest(int jobId)
+		{
+			var result = AddRequest(jobId);
+			Assert.True(SpinWait.SpinUntil(() => _mEngineClient.Generations.Count == 1, TIMEOUT));
+
+			return result;
+		}
+
+		private (MapSectionRequest mapSectionRequest, Task<MapSection> mapSection) AddWaitingRequest(int jobId)
+		{
+			var result = AddRequest(jobId);
+			Assert.True(SpinWait.SpinUntil(() => _mapSectionRequestProcessor.GetNumberOfPendingRequests(jobId) == 1, TIMEOUT));
+
+			return result;
+		}
+
+		private (MapSectionRequest mapSectionRequest, Task<MapSection> mapSection) AddRequest(int jobId)
+		{
+			var mapCalcSettings = new MapCalcSettings(targetIterations: 100, threshold: 4, calculateEscapeVelocities: false, saveTheZValues: false);
+
+			var mapSectionRequest = new MapSectionRequest(JobType.FullScale, ObjectId.GenerateNewId().ToString(), OwnerType.Project, _subdivisionId, _subdivisionId,
+				new PointInt(), new VectorInt(), new BigVector(), new MapBlockOffset(), new RPoint(), isInverted: false,
+				precision: 0, limbCount: 2, BLOCK_SIZE, new RSize(1, 1, -8), mapCalcSettings, mapLoaderJobNumber: jobId, requestNumber: 0);
+
+			var mapSectionTcs = new TaskCompletionSource<MapSection>(TaskCreationOptions.RunContinuationsAsynchronously);
+			_mapSectionRequestProcessor.AddWork(jobId, mapSectionRequest, (request, mapSection) => mapSectionTcs.TrySetResult(mapSection));
+
+			return (mapSectionRequest, mapSectionTcs.Task);
+		}
+
+		private MapSection Await(Task<MapSection> mapSection)
+		{
+			Assert.True(mapSection.Wait(TIMEOUT));
+			return mapSection.Result;
+		}
+
+		#endregion
+	}
+}
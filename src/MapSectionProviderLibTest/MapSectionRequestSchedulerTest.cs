@@ -0,0 +1,150 @@
+﻿using MapSectionProviderLib;
+using MongoDB.Bson;
+using MSS.Types;
+using MSS.Types.MSet;
+
+namespace MapSectionProviderLibTest
+{
+	public class MapSectionRequestSchedulerTest
+	{
+		private static readonly SizeInt BLOCK_SIZE = new SizeInt(128);
+
+		[Fact]
+		public void TryTake_OneJob_TakesTheRequestClosestToTheCenterFirst()
+		{
+			var scheduler = new MapSectionRequestScheduler(jobCapacity: 10);
+			var offsets = new[] { new VectorInt(3, 0), new VectorInt(1, 0), new VectorInt(0, -1), new VectorInt(-2, 0), new VectorInt(-1, 0) };
+
+			for (var i = 0; i < offsets.Length; i++)
+			{
+				Assert.True(scheduler.TryAdd(CreateWorkRequest(jobId: 1, JobType.FullScale, offsets[i], requestNumber: i)));
+			}
+
+			// Requests the same distance from the center are taken in the order they were added.
+			Assert.Equal(new[] { 1, 2, 4, 3, 0 }, TakeAll(scheduler).Select(x => x.Request.RequestNumber));
+		}
+
+		[Fact]
+		public void TryTake_VisibleAndImageJobs_GivesTheVisibleJobItsShareOfTurns()
+		{
+			var scheduler = new MapSectionRequestScheduler(jobCapacity: 10);
+
+			for (var i = 0; i < 10; i++)
+			{
+				Assert.True(scheduler.TryAdd(CreateWorkRequest(jobId: 1, JobType.FullScale, new VectorInt(i, 0), requestNumber: i)));
+			}
+
+			for (var i = 0; i < 4; i++)
+			{
+				Assert.True(scheduler.TryAdd(CreateWorkRequest(jobId: 2, JobType.Image, new VectorInt(i, 0), requestNumber: i)));
+			}
+
+			var jobIds = TakeAll(scheduler).Select(x => x.JobId);
+
+			// The visible job gets 4 turns for each turn given to the Image job, the Image job has the remaining turns once the visible job has no more requests.
+			Assert.Equal(new[] { 1, 1, 1, 1, 2, 1, 1, 1, 1, 2, 1, 1, 2, 2 }, jobIds);
+		}
+
+		[Fact]
+		public void TryAdd_JobQueueIsFull_WaitsUntilARequestIsTaken()
+		{
+			var scheduler = new MapSectionRequestScheduler(jobCapacity: 2);
+
+			Assert.True(scheduler.TryAdd(CreateWorkRequest(jobId: 1, JobType.FullScale, new VectorInt(0, 0), requestNumber: 0)));
+			Assert.True(scheduler.TryAdd(CreateWorkRequest(jobId: 1, JobType.FullScale, new VectorInt(1, 0), requestNumber: 1)));
+
+			var addTask = Task.Run(() => scheduler.TryAdd(CreateWorkRequest(jobId: 1, JobType.FullScale, new VectorInt(2, 0), requestNumber: 2)));
+			Assert.False(addTask.Wait(200));
+
+			// Only the job whose queue is full has to wait.
+			Assert.True(scheduler.TryAdd(CreateWorkRequest(jobId: 2, JobType.FullScale, new VectorInt(0, 0), requestNumber: 0)));
+			Assert.False(addTask.IsCompleted);
+
+			Assert.True(scheduler.TryTake(out var mapSectionWorkRequest, CancellationToken.None));
+			Assert.Equal(1, mapSectionWorkRequest!.JobId);
+
+			Assert.True(addTask.Wait(TimeSpan.FromSeconds(5)));
+			Assert.True(addTask.Result);
+			Assert.Equal(3, scheduler.Count);
+		}
+
+		[Fact]
+		public void CancelJob_ReturnsTheRemovedRequestsAndRefusesNewOnes()
+		{
+			var scheduler = new MapSectionRequestScheduler(jobCapacity: 10);
+
+			for (var i = 0; i < 3; i++)
+			{
+				Assert.True(scheduler.TryAdd(CreateWorkRequest(jobId: 1, JobType.FullScale, new VectorInt(i, 0), requestNumber: i)));
+				Assert.True(scheduler.TryAdd(CreateWorkRequest(jobId: 2, JobType.FullScale, new VectorInt(i, 0), requestNumber: i)));
+			}
+
+			var removed = scheduler.CancelJob(1).ToList();
+
+			Assert.All(removed, x => Assert.Equal(1, x.JobId));
+			Assert.Equal(new[] { 0, 1, 2 }, removed.Select(x => x.Request.RequestNumber).OrderBy(x => x));
+			Assert.Equal(3, scheduler.Count);
+			Assert.True(scheduler.IsJobCancelled(1));
+
+			Assert.False(scheduler.TryAdd(CreateWorkRequest(jobId: 1, JobType.FullScale, new VectorInt(0, 0), requestNumber: 3)));
+			Assert.Empty(scheduler.CancelJob(1));
+
+			scheduler.MarkJobAsComplete(1);
+			Assert.True(scheduler.TryAdd(CreateWorkRequest(jobId: 1, JobType.FullScale, new VectorInt(0, 0), requestNumber: 4)));
+
+			var remaining = TakeAll(scheduler);
+
+			Assert.Equal(3, remaining.Count(x => x.JobId == 2));
+			Assert.Equal(4, Assert.Single(remaining, x => x.JobId == 1).Request.RequestNumber);
+		}
+
+		[Fact]
+		public void TryTake_AddingCompleted_ReturnsTheRemainingRequestsThenFalse()
+		{
+			var scheduler = new MapSectionRequestScheduler(jobCapacity: 10);
+
+			Assert.True(scheduler.TryAdd(CreateWorkRequest(jobId: 1, JobType.FullScale, new VectorInt(0, 0), requestNumber: 0)));
+			scheduler.CompleteAdding();
+
+			Assert.False(scheduler.TryAdd(CreateWorkRequest(jobId: 1, JobType.FullScale, new VectorInt(0, 0), requestNumber: 1)));
+			Assert.False(scheduler.IsCompleted);
+
+			Assert.True(scheduler.TryTake(out _, CancellationToken.None));
+			Assert.False(scheduler.TryTake(out var mapSectionWorkRequest, CancellationToken.None));
+			Assert.Null(mapSectionWorkRequest);
+			Assert.True(scheduler.IsCompleted);
+		}
+
+		#region Support Methods
+
+		private List<MapSectionWorkRequest> TakeAll(MapSectionRequestScheduler scheduler)
+		{
+			scheduler.CompleteAdding();
+
+			var result = new List<MapSectionWorkRequest>();
+
+			while (scheduler.TryTake(out var mapSectionWorkRequest, CancellationToken.None))
+			{
+				result.Add(mapSectionWorkRequest!);
+			}
+
+			return result;
+		}
+
+		private MapSectionWorkRequest CreateWorkRequest(int jobId, JobType jobType, VectorInt screenPositionRelativeToCenter, int requestNumber)
+		{
+			var subdivisionId = ObjectId.Empty.ToString();
+			var mapCalcSettings = new MapCalcSettings(targetIterations: 100, threshold: 4, calculateEscapeVelocities: false, saveTheZValues: false);
+
+			var mapSectionRequest = new MapSectionRequest(jobType, jobId.ToString(), OwnerType.Project, subdivisionId, subdivisionId,
+				new PointInt(), screenPositionRelativeToCenter, new BigVector(), new MapBlockOffset(), new RPoint(), isInverted: false,
+				precision: 0, limbCount: 2, BLOCK_SIZE, new RSize(1, 1, -8), mapCalcSettings, mapLoaderJobNumber: jobId, requestNumber);
+
+			var result = new MapSectionWorkRequest(jobId, mapSectionRequest, (request, mapSection) => { });
+
+			return result;
+		}
+
+		#endregion
+	}
+}
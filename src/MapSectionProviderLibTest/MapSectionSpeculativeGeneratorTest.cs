@@ -0,0 +1,110 @@
+﻿using MapSectionProviderLib;
+using MongoDB.Bson;
+using MSS.Common;
+using MSS.Common.MSet;
+using MSS.Types;
+using MSS.Types.MSet;
+
+namespace MapSectionProviderLibTest
+{
+	public class MapSectionSpeculativeGeneratorTest
+	{
+		private static readonly SizeInt BLOCK_SIZE = new SizeInt(128);
+		private static readonly TimeSpan TIMEOUT = TimeSpan.FromSeconds(10);
+
+		// The screen is 4 x 4 blocks, the ring of blocks surrounding it has more blocks than the budget.
+		private const int BLOCK_BUDGET = 5;
+
+		private readonly FakeMapSectionAdapter _mapSectionAdapter;
+		private readonly MapAreaInfo _mapAreaInfo;
+		private readonly MapCalcSettings _mapCalcSettings;
+
+		public MapSectionSpeculativeGeneratorTest()
+		{
+			_mapSectionAdapter = new FakeMapSectionAdapter();
+
+			var subdivision = _mapSectionAdapter.AddSubdivision(new RSize(1, 1, -8), new BigVector(), BLOCK_SIZE);
+			_mapAreaInfo = new MapAreaInfo(new RRectangle(), new SizeDbl(4 * BLOCK_SIZE.Width), subdivision, precision: 0, new BigVector(), new VectorInt(), subdivision.Id);
+			_mapCalcSettings = new MapCalcSettings(targetIterations: 100, threshold: 4, calculateEscapeVelocities: false, saveTheZValues: false);
+		}
+
+		[Fact]
+		public void SignalIdle_RequestProcessorIsBusy_GeneratesNothingUntilItIsIdle()
+		{
+			var requestProcessor = new FakeRequestProcessor();
+			using var speculativeGenerator = CreateSpeculativeGenerator(requestProcessor);
+
+			speculativeGenerator.SignalIdle();
+			Assert.False(SpinWait.SpinUntil(() => requestProcessor.Requests.Count > 0, 300));
+
+			requestProcessor.SetIsIdle(true);
+			speculativeGenerator.SignalIdle();
+
+			Assert.True(SpinWait.SpinUntil(() => speculativeGenerator.NumberOfBlocksGenerated == BLOCK_BUDGET, TIMEOUT));
+		}
+
+		[Fact]
+		public void SignalIdle_RequestProcessorIsIdle_GeneratesNoMoreThanTheBudget()
+		{
+			var requestProcessor = new FakeRequestProcessor();
+			requestProcessor.SetIsIdle(true);
+
+			using var speculativeGenerator = CreateSpeculativeGenerator(requestProcessor);
+			speculativeGenerator.SignalIdle();
+
+			Assert.True(SpinWait.SpinUntil(() => speculativeGenerator.NumberOfBlocksGenerated == BLOCK_BUDGET, TIMEOUT));
+
+			speculativeGenerator.SignalIdle();
+			Assert.False(SpinWait.SpinUntil(() => requestProcessor.Requests.Count > BLOCK_BUDGET, 300));
+
+			var requests = requestProcessor.Requests;
+			Assert.Equal(BLOCK_BUDGET, requests.Count);
+			Assert.Equal(BLOCK_BUDGET, requests.Select(x => x.ScreenPosition).Distinct().Count());
+			Assert.All(requests, x => Assert.Equal(_mapAreaInfo.Subdivision.Id.ToString(), x.SubdivisionId));
+		}
+
+		[Fact]
+		public void Preempt_RequestInProgress_CancelsItAndTriesTheSameBlockOnceIdle()
+		{
+			var requestProcessor = new FakeRequestProcessor { HoldRequests = true };
+			requestProcessor.SetIsIdle(true);
+
+			using var speculativeGenerator = CreateSpeculativeGenerator(requestProcessor);
+			speculativeGenerator.SignalIdle();
+
+			Assert.True(SpinWait.SpinUntil(() => requestProcessor.Requests.Count == 1, TIMEOUT));
+			var preemptedRequest = requestProcessor.Requests[0];
+
+			// Real work arrives.
+			requestProcessor.SetIsIdle(false);
+			speculativeGenerator.Preempt();
+
+			Assert.True(preemptedRequest.CancellationTokenSource.IsCancellationRequested);
+			Assert.False(SpinWait.SpinUntil(() => requestProcessor.Requests.Count > 1, 300));
+			Assert.Equal(0, speculativeGenerator.NumberOfBlocksGenerated);
+
+			requestProcessor.SetIsIdle(true);
+			requestProcessor.Release(BLOCK_BUDGET);
+			speculativeGenerator.SignalIdle();
+
+			Assert.True(SpinWait.SpinUntil(() => speculativeGenerator.NumberOfBlocksGenerated == BLOCK_BUDGET, TIMEOUT));
+
+			var retriedRequest = requestProcessor.Requests[1];
+			Assert.NotSame(preemptedRequest, retriedRequest);
+			Assert.Equal(preemptedRequest.ScreenPosition, retriedRequest.ScreenPosition);
+			Assert.False(retriedRequest.CancellationTokenSource.IsCancellationRequested);
+		}
+
+		#region Support Methods
+
+		private MapSectionSpeculativeGenerator CreateSpeculativeGenerator(FakeRequestProcessor requestProcessor)
+		{
+			var result = new MapSectionSpeculativeGenerator(new SubdivisonProvider(_mapSectionAdapter), requestProcessor.SpeculateAsync, requestProcessor.IsIdle);
+			result.SetTarget(JobType.FullScale, ObjectId.GenerateNewId().ToString(), OwnerType.Project, _mapAreaInfo, _mapCalcSettings, BLOCK_BUDGET);
+
+			return result;
+		}
+
+		#endregion
+	}
+}
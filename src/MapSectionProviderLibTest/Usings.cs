@@ -0,0 +1 @@
+global using Xunit;
\ No newline at end of file
@@ -42,6 +42,13 @@ namespace ProjectRepo.Entities
 		[BsonDefaultValue(true)]
 		public bool Complete { get; init; } = true;
 
+		/// <summary>
+		/// Identifies how the Counts and EscapeVelocities are encoded, records saved before the values were compressed have a value of 0.
+		/// </summary>
+		[BsonIgnoreIfDefault]
+		[BsonDefaultValue(0)]
+		public int CodecVersion { get; init; } = 0;
+
 		public DateTime LastSavedUtc { get; set; }
 		public DateTime LastAccessed { get; set; }
 
@@ -145,6 +145,18 @@ namespace ProjectRepo
 			return jobMapSectionRecords.FirstOrDefault();
 		}
 
+		// Returns the records for any of the MapSections belonging to any of the Jobs, the caller selects the combinations it needs.
+		public async Task<IList<JobMapSectionRecord>> GetByMapSectionIdsAndJobIdsAsync(IEnumerable<ObjectId> mapSectionIds, IEnumerable<ObjectId> jobIds)
+		{
+			var filter1 = Builders<JobMapSectionRecord>.Filter.In(f => f.MapSectionId, mapSectionIds);
+			var filter2 = Builders<JobMapSectionRecord>.Filter.In(f => f.JobId, jobIds);
+
+			var resultCursor = await Collection.FindAsync(filter1 & filter2).ConfigureAwait(false);
+			var jobMapSectionRecords = await resultCursor.ToListAsync().ConfigureAwait(false);
+
+			return jobMapSectionRecords;
+		}
+
 		public JobMapSectionRecord? GetByMapSectionIdJobIdAndJobType(ObjectId mapSectionId, ObjectId jobId, JobType jobType)
 		{
 			var filter1 = Builders<JobMapSectionRecord>.Filter.Eq(f => f.MapSectionId, mapSectionId);
@@ -174,6 +186,21 @@ namespace ProjectRepo
 			return jobMapSectionRecord.Id;
 		}
 
+		public async Task InsertManyAsync(IList<JobMapSectionRecord> jobMapSectionRecords)
+		{
+			if (jobMapSectionRecords.Any(x => x.Onfile))
+			{
+				throw new InvalidOperationException("Cannot insert a JobMapSectionRecord that is already OnFile.");
+			}
+
+			foreach (var jobMapSectionRecord in jobMapSectionRecords)
+			{
+				jobMapSectionRecord.Id = ObjectId.GenerateNewId();
+			}
+
+			await Collection.InsertManyAsync(jobMapSectionRecords, new InsertManyOptions { IsOrdered = false }).ConfigureAwait(false);
+		}
+
 		public ObjectId Insert(JobMapSectionRecord jobMapSectionRecord)
 		{
 			if (jobMapSectionRecord.Onfile)
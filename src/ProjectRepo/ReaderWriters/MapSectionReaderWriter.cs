@@ -5,6 +5,8 @@ using ProjectRepo.Entities;
 using System;
 using System.Collections.Generic;
 using System.Diagnostics;
+using System.Linq;
+using System.Runtime.CompilerServices;
 using System.Threading;
 using System.Threading.Tasks;
 
@@ -44,6 +46,19 @@ namespace ProjectRepo
 			var idx = Collection.Indexes.CreateOne(new CreateIndexModel<MapSectionRecord>(indexKeysDef, new CreateIndexOptions() { Unique = true, Name = "SubAndPos" }));
 		}
 
+		// Supports GetInRectangleAsync: the Hi values are usually the same for all blocks in the rectangle and are matched first.
+		public void CreateSubAndBlockRangeIndex()
+		{
+			var indexKeysDef = Builders<MapSectionRecord>.IndexKeys
+				.Ascending(x => x.SubdivisionId)
+				.Ascending(x => x.BlockPosXHi)
+				.Ascending(x => x.BlockPosYHi)
+				.Ascending(x => x.BlockPosXLo)
+				.Ascending(x => x.BlockPosYLo);
+
+			var idx = Collection.Indexes.CreateOne(new CreateIndexModel<MapSectionRecord>(indexKeysDef, new CreateIndexOptions() { Name = "SubAndBlockRange" }));
+		}
+
 		#endregion
 
 		public MapSectionRecord? Get(ObjectId mapSectionId)
@@ -121,6 +136,28 @@ namespace ProjectRepo
 			}
 		}
 
+		/// <summary>
+		/// Returns the MapSectionRecords for the given Subdivision whose block position lies within the rectangle, the corners are inclusive.
+		/// The records are returned as each batch is received.
+		/// </summary>
+		public async IAsyncEnumerable<MapSectionRecord> GetInRectangleAsync(ObjectId subdivisionId, MapBlockOffset lowerLeft, MapBlockOffset upperRight, [EnumeratorCancellation] CancellationToken ct)
+		{
+			var filter = Builders<MapSectionRecord>.Filter.Eq("SubdivisionId", subdivisionId)
+				& GetRangeFilter("BlockPosXHi", "BlockPosXLo", lowerLeft.XHi, lowerLeft.XLo, upperRight.XHi, upperRight.XLo)
+				& GetRangeFilter("BlockPosYHi", "BlockPosYLo", lowerLeft.YHi, lowerLeft.YLo, upperRight.YHi, upperRight.YLo);
+
+			using var cursor = await Collection.FindAsync(filter, options: null, ct);
+
+			while (await cursor.MoveNextAsync(ct))
+			{
+				foreach (var mapSectionRecord in cursor.Current)
+				{
+					mapSectionRecord.LastAccessed = DateTime.UtcNow;
+					yield return mapSectionRecord;
+				}
+			}
+		}
+
 		public async Task<ObjectId> InsertAsync(MapSectionRecord mapSectionRecord)
 		{
 			try
@@ -152,6 +189,39 @@ namespace ProjectRepo
 			}
 		}
 
+		/// <summary>
+		/// Inserts the records using a single, unordered, bulk write. A record for a block position already on file is not inserted,
+		/// the SubAndPos index rejects it, the Id of the record on file is returned in its place.
+		/// </summary>
+		public async Task<ObjectId?[]> InsertManyAsync(IList<MapSectionRecord> mapSectionRecords)
+		{
+			var result = new ObjectId?[mapSectionRecords.Count];
+
+			for (var i = 0; i < mapSectionRecords.Count; i++)
+			{
+				mapSectionRecords[i].LastSavedUtc = DateTime.UtcNow;
+				result[i] = mapSectionRecords[i].Id;
+			}
+
+			try
+			{
+				await Collection.InsertManyAsync(mapSectionRecords, new InsertManyOptions { IsOrdered = false });
+			}
+			catch (MongoBulkWriteException<MapSectionRecord> e) when (e.WriteErrors.All(x => x.Category == ServerErrorCategory.DuplicateKey))
+			{
+				foreach (var writeError in e.WriteErrors)
+				{
+					var mapSectionRecord = mapSectionRecords[writeError.Index];
+					var blockPos = GetBlockPosition(mapSectionRecord);
+
+					result[writeError.Index] = await GetIdAsync(mapSectionRecord.SubdivisionId, blockPos);
+					Debug.WriteLine($"Not Inserting MapSectionRecord with BlockPos: {blockPos}. A record already exists for this block position with Id: {result[writeError.Index]}.");
+				}
+			}
+
+			return result;
+		}
+
 		public async Task<long?> UpdateCountValuesAync(MapSectionRecord mapSectionRecord, bool requestCompleted)
 		{
 			var filter = Builders<MapSectionRecord>.Filter.Eq("_id", mapSectionRecord.Id);
@@ -159,6 +229,7 @@ namespace ProjectRepo
 			var updateDefinition = Builders<MapSectionRecord>.Update
 				.Set(u => u.Counts, mapSectionRecord.Counts)
 				.Set(u => u.EscapeVelocities, mapSectionRecord.EscapeVelocities)
+				.Set(u => u.CodecVersion, mapSectionRecord.CodecVersion)
 				.Set(u => u.AllRowsHaveEscaped, mapSectionRecord.AllRowsHaveEscaped)
 				.Set(u => u.Complete, mapSectionRecord.Complete)
 				.Set(u => u.LastSavedUtc, DateTime.UtcNow);
@@ -174,6 +245,38 @@ namespace ProjectRepo
 		}
 
 
+		/// <summary>
+		/// Updates the records using a single, unordered, bulk write.
+		/// </summary>
+		public async Task<long?> UpdateManyCountValuesAsync(IList<(MapSectionRecord mapSectionRecord, bool requestCompleted)> updates)
+		{
+			var models = new List<WriteModel<MapSectionRecord>>(updates.Count);
+
+			foreach (var (mapSectionRecord, requestCompleted) in updates)
+			{
+				var filter = Builders<MapSectionRecord>.Filter.Eq("_id", mapSectionRecord.Id);
+
+				var updateDefinition = Builders<MapSectionRecord>.Update
+					.Set(u => u.Counts, mapSectionRecord.Counts)
+					.Set(u => u.EscapeVelocities, mapSectionRecord.EscapeVelocities)
+					.Set(u => u.CodecVersion, mapSectionRecord.CodecVersion)
+					.Set(u => u.AllRowsHaveEscaped, mapSectionRecord.AllRowsHaveEscaped)
+					.Set(u => u.Complete, mapSectionRecord.Complete)
+					.Set(u => u.LastSavedUtc, DateTime.UtcNow);
+
+				if (requestCompleted)
+				{
+					updateDefinition = updateDefinition.Set(u => u.MapCalcSettings.TargetIterations, mapSectionRecord.MapCalcSettings.TargetIterations);
+				}
+
+				models.Add(new UpdateOneModel<MapSectionRecord>(filter, updateDefinition));
+			}
+
+			var result = await Collection.BulkWriteAsync(models, new BulkWriteOptions { IsOrdered = false });
+
+			return result?.ModifiedCount;
+		}
+
 		public long? UpdateCountValues(MapSectionRecord mapSectionRecord, bool requestCompleted)
 		{
 			var filter = Builders<MapSectionRecord>.Filter.Eq("_id", mapSectionRecord.Id);
@@ -181,6 +284,7 @@ namespace ProjectRepo
 			var updateDefinition = Builders<MapSectionRecord>.Update
 				.Set(u => u.Counts, mapSectionRecord.Counts)
 				.Set(u => u.EscapeVelocities, mapSectionRecord.EscapeVelocities)
+				.Set(u => u.CodecVersion, mapSectionRecord.CodecVersion)
 				.Set(u => u.AllRowsHaveEscaped, mapSectionRecord.AllRowsHaveEscaped)
 				.Set(u => u.Complete, mapSectionRecord.Complete)
 				.Set(u => u.LastSavedUtc, DateTime.UtcNow);
@@ -369,6 +473,22 @@ namespace ProjectRepo
 			return result;
 		}
 
+		// A value is stored as a Hi, Lo pair, with Lo having the same sign as the value, comparing the pairs in order compares the values.
+		internal static FilterDefinition<MapSectionRecord> GetRangeFilter(string hiField, string loField, long fromHi, long fromLo, long toHi, long toLo)
+		{
+			var builder = Builders<MapSectionRecord>.Filter;
+
+			if (fromHi == toHi)
+			{
+				return builder.Eq(hiField, fromHi) & builder.Gte(loField, fromLo) & builder.Lte(loField, toLo);
+			}
+
+			var fromFilter = builder.Gt(hiField, fromHi) | (builder.Eq(hiField, fromHi) & builder.Gte(loField, fromLo));
+			var toFilter = builder.Lt(hiField, toHi) | (builder.Eq(hiField, toHi) & builder.Lte(loField, toLo));
+
+			return fromFilter & toFilter;
+		}
+
 		//public void RemoveEscapeVelsFromMapSectionRecords()
 		//{
 		//	var filter = Builders<MapSectionRecord>.Filter.Empty;
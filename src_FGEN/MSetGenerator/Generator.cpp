@@ -272,13 +272,8 @@ void Generator::PointDdToDoubleArray(PointDd z, double* zValues) {
 
 double Generator::GetEscapeVelocity(qp sumSqs)
 {
-	// TODO: Consider providing this method a qpMath object.
-	qpMath* qpCalc = new qpMath();
-
-	qp sumSqsHi = qp(sumSqs._hi());
-	qp sumSqsTotal = qpCalc->addD(sumSqsHi, sumSqs._lo());
-
-	double evd = sumSqsTotal.toDouble();
+	// Only a double's precision is needed here, the sum of the two parts does not require a qpMath object.
+	double evd = sumSqs._hi() + sumSqs._lo();
 
 	double modulus = std::log10(evd) / 2;
 	double nu = std::log10(modulus / m_Log2) / m_Log2;
@@ -292,16 +287,15 @@ double Generator::GetEscapeVelocity(qp sumSqs)
 	double result = 1 - nu;
 	//double result = 0.0;
 
-	delete qpCalc;
-
 	return result;
 }
 
 void Generator::GetPoints(qp startC, qp delta, int extent, qp* result)
 {
-	qpMath* qpCalc = new qpMath();
+	// All of the working arrays are taken from a single allocation.
+	double* workValues = new double[(size_t)extent * 7];
 
-	double* factors = new double[extent];
+	double* factors = workValues;
 
 	for (int i = 0; i < extent; i++)
 	{
@@ -310,28 +304,24 @@ void Generator::GetPoints(qp startC, qp delta, int extent, qp* result)
 
 	qpMathVec* qpVecCalc = new qpMathVec(extent);
 
-	double* diff_his = new double[extent];
-	double* diff_los = new double[extent];
+	double* diff_his = factors + extent;
+	double* diff_los = diff_his + extent;
 	qpVecCalc->extendSingleQp(delta, diff_his, diff_los);
 
-	double* temp_his = new double[extent];
-	double* temp_los = new double[extent];
+	double* temp_his = diff_los + extent;
+	double* temp_los = temp_his + extent;
 	qpVecCalc->mulQpByD(diff_his, diff_los, factors, temp_his, temp_los);
 
-	double* startC_his = new double[extent];
-	double* startC_los = new double[extent];
+	double* startC_his = temp_los + extent;
+	double* startC_los = startC_his + extent;
 	qpVecCalc->extendSingleQp(startC, startC_his, startC_los);
 
 	qpVecCalc->addQps(temp_his, temp_los, startC_his, startC_los, diff_his, diff_los);
 
 	qpVecCalc->fillQpVector(diff_his, diff_los, result);
 
-	delete qpCalc;
-	delete[] factors;
 	delete qpVecCalc;
-	delete[] diff_his, diff_los;
-	delete[] temp_his, temp_los;
-	delete[] startC_his, startC_los;
+	delete[] workValues;
 }
 
 